@@ -147,8 +147,14 @@ typedef struct lber_memory_fns {
 /* Only meaningful ifdef LDAP_PF_LOCAL_SENDMSG */
 #define LBER_SB_OPT_UNGET_BUF	15
 
+/* Output coalescing, see LBER_FLUSH_MORE */
+#define LBER_SB_OPT_SET_COALESCE	16
+#define LBER_SB_OPT_FLUSH		17
+/* Is what is written passed to the socket unchanged? */
+#define LBER_SB_OPT_IS_PLAIN		18
+
 /* Largest option used by the library */
-#define LBER_SB_OPT_OPT_MAX		15
+#define LBER_SB_OPT_OPT_MAX		18
 
 /* LBER IO operations stacking levels */
 #define LBER_SBIOD_LEVEL_PROVIDER	10
@@ -477,6 +483,7 @@ ber_flush2 LDAP_P((
 #define LBER_FLUSH_FREE_ON_SUCCESS	(0x1)	/* traditional behavior */
 #define LBER_FLUSH_FREE_ON_ERROR	(0x2)
 #define LBER_FLUSH_FREE_ALWAYS		(LBER_FLUSH_FREE_ON_SUCCESS|LBER_FLUSH_FREE_ON_ERROR)
+#define LBER_FLUSH_MORE			(0x4)	/* more PDUs follow, may be held back */
 
 LBER_F( int )
 ber_flush LDAP_P((
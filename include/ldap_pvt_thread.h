@@ -218,6 +218,20 @@ ldap_pvt_thread_pool_submit2 LDAP_P((
 	void *arg,
 	void **cookie ));
 
+/* Priority classes for ldap_pvt_thread_pool_submit_prio() */
+#define LDAP_PVT_THREAD_POOL_PRIO_HIGH		0
+#define LDAP_PVT_THREAD_POOL_PRIO_NORMAL	1
+#define LDAP_PVT_THREAD_POOL_PRIO_LOW		2
+#define LDAP_PVT_THREAD_POOL_NPRIO			3
+
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_prio LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start,
+	void *arg,
+	int prio,
+	void **cookie ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_retract LDAP_P((
 	void *cookie ));
@@ -239,6 +253,16 @@ ldap_pvt_thread_pool_queues LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	int numqs ));
 
+LDAP_F( int )
+ldap_pvt_thread_pool_worksteal LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int on ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_weights LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	const int *weights ));
+
 #ifndef LDAP_PVT_THREAD_H_DONE
 typedef enum {
 	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN = -1,
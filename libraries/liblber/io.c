@@ -241,6 +241,36 @@ ber_flush2( Sockbuf *sb, BerElement *ber, int freeit )
 			ber->ber_rwptr, towrite );
 	}
 
+	/* Coalesce PDUs that fit into the Sockbuf's output buffer, so
+	 * a stream of them costs one write per buffer instead of one
+	 * per PDU. A PDU too big for the buffer is written directly.
+	 */
+	if ( sb->sb_wmax && (( freeit & LBER_FLUSH_MORE ) ||
+		sb->sb_wbuf.buf_end ))
+	{
+		Sockbuf_Buf *wbuf = &sb->sb_wbuf;
+
+		if ( towrite > sb->sb_wmax - wbuf->buf_end &&
+			ber_int_sb_flush( sb ) < 0 )
+		{
+			if ( freeit & LBER_FLUSH_FREE_ON_ERROR ) ber_free( ber, 1 );
+			return -1;
+		}
+		if ( towrite <= sb->sb_wmax - wbuf->buf_end &&
+			ber_pvt_sb_grow_buffer( wbuf, sb->sb_wmax ) == 0 )
+		{
+			AC_MEMCPY( wbuf->buf_base + wbuf->buf_end, ber->ber_rwptr,
+				towrite );
+			wbuf->buf_end += towrite;
+			ber->ber_rwptr += towrite;
+			towrite = 0;
+		}
+		if ( !( freeit & LBER_FLUSH_MORE ) && ber_int_sb_flush( sb ) < 0 ) {
+			if ( freeit & LBER_FLUSH_FREE_ON_ERROR ) ber_free( ber, 1 );
+			return -1;
+		}
+	}
+
 	while ( towrite > 0 ) {
 #ifdef LBER_TRICKLE
 		sleep(1);
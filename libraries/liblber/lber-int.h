@@ -137,6 +137,8 @@ struct sockbuf {
 	ber_len_t			sb_max_incoming;
    	unsigned int		sb_trans_needs_read:1;
    	unsigned int		sb_trans_needs_write:1;
+	ber_len_t			sb_wmax;		/* coalesce up to this much output */
+	Sockbuf_Buf			sb_wbuf;		/* coalesced output */
 #ifdef LDAP_PF_LOCAL_SENDMSG
 	char				sb_ungetlen;
 	char				sb_ungetbuf[8];
@@ -220,6 +222,9 @@ ber_int_sb_read LDAP_P(( Sockbuf *sb, void *buf, ber_len_t len ));
 LBER_F( ber_slen_t )
 ber_int_sb_write LDAP_P(( Sockbuf *sb, void *buf, ber_len_t len ));
 
+LBER_F( int )
+ber_int_sb_flush LDAP_P(( Sockbuf *sb ));
+
 LDAP_END_DECL
 
 #endif /* _LBER_INT_H */
@@ -164,6 +164,42 @@ ber_sockbuf_ctrl( Sockbuf *sb, int opt, void *arg )
 #endif
 			break;
 
+		case LBER_SB_OPT_SET_COALESCE:
+			/* hold back up to *arg bytes of output written with
+			 * LBER_FLUSH_MORE, 0 turns coalescing off again. The
+			 * buffer itself is only allocated once it is used.
+			 */
+			if ( ber_int_sb_flush( sb ) < 0 ) {
+				ret = -1;
+				break;
+			}
+			sb->sb_wmax = *((ber_len_t *)arg);
+			if ( sb->sb_wmax == 0 ) {
+				ber_pvt_sb_buf_destroy( &sb->sb_wbuf );
+			}
+			ret = 1;
+			break;
+
+		case LBER_SB_OPT_FLUSH:
+			ret = ber_int_sb_flush( sb ) < 0 ? -1 : 1;
+			break;
+
+		case LBER_SB_OPT_IS_PLAIN:
+			/* only the TCP or fd provider, and the debug layer
+			 * while it has nothing to log */
+			ret = sb->sb_iod != NULL;
+			for ( p = sb->sb_iod; p; p = p->sbiod_next ) {
+				if ( p->sbiod_io == &ber_sockbuf_io_tcp ||
+					p->sbiod_io == &ber_sockbuf_io_fd )
+					continue;
+				if ( p->sbiod_io == &ber_sockbuf_io_debug &&
+					!( sb->sb_debug & LDAP_DEBUG_PACKETS ))
+					continue;
+				ret = 0;
+				break;
+			}
+			break;
+
 		default:
 			ret = sb->sb_iod->sbiod_io->sbi_ctrl( sb->sb_iod, opt, arg );
 			break;
@@ -366,6 +402,8 @@ ber_int_sb_init( Sockbuf *sb )
 	sb->sb_iod = NULL;
 	sb->sb_trans_needs_read = 0;
 	sb->sb_trans_needs_write = 0;
+	sb->sb_wmax = 0;
+	ber_pvt_sb_buf_init( &sb->sb_wbuf );
    
 	assert( SOCKBUF_VALID( sb ) );
 	return 0;
@@ -405,6 +443,7 @@ ber_int_sb_destroy( Sockbuf *sb )
 			sb->sb_iod->sbiod_level );
 		sb->sb_iod = p;
 	}
+	ber_pvt_sb_buf_destroy( &sb->sb_wbuf );
 
 	return ber_int_sb_init( sb );
 }
@@ -453,6 +492,28 @@ ber_int_sb_write( Sockbuf *sb, void *buf, ber_len_t len )
 	return ret;
 }
 
+/*
+ * Write out the output held back by LBER_FLUSH_MORE. Returns 0 once
+ * nothing is pending, -1 with errno set if the data could not all be
+ * written; the rest stays pending for the next call.
+ */
+int
+ber_int_sb_flush( Sockbuf *sb )
+{
+	Sockbuf_Buf		*wbuf = &sb->sb_wbuf;
+	ber_slen_t		ret;
+
+	while ( wbuf->buf_ptr < wbuf->buf_end ) {
+		ret = ber_int_sb_write( sb, wbuf->buf_base + wbuf->buf_ptr,
+			wbuf->buf_end - wbuf->buf_ptr );
+		if ( ret <= 0 ) return -1;
+		wbuf->buf_ptr += ret;
+	}
+	wbuf->buf_ptr = wbuf->buf_end = 0;
+
+	return 0;
+}
+
 /*
  * Support for TCP
  */
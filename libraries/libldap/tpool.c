@@ -94,6 +94,7 @@ typedef struct ldap_int_thread_task_s {
 	ldap_pvt_thread_start_t *ltt_start_routine;
 	void *ltt_arg;
 	struct ldap_int_thread_poolq_s *ltt_queue;
+	int ltt_prio;
 } ldap_int_thread_task_t;
 
 typedef LDAP_STAILQ_HEAD(tcq, ldap_int_thread_task_s) ldap_int_tpool_plist_t;
@@ -113,15 +114,18 @@ struct ldap_int_thread_poolq_s {
 	 */
 	ldap_pvt_thread_cond_t ltp_cond;
 
-	/* ltp_pause == 0 ? &ltp_pending_list : &empty_pending_list,
+	/* ltp_pause == 0 ? ltp_pending_list : empty_pending_list,
 	 * maintained to reduce work for pool_wrapper()
 	 */
 	ldap_int_tpool_plist_t *ltp_work_list;
 
-	/* pending tasks, and unused task objects */
-	ldap_int_tpool_plist_t ltp_pending_list;
+	/* pending tasks per priority class, and unused task objects */
+	ldap_int_tpool_plist_t ltp_pending_list[LDAP_PVT_THREAD_POOL_NPRIO];
 	LDAP_SLIST_HEAD(tcl, ldap_int_thread_task_s) ltp_free_list;
 
+	/* running credit of each priority class, see pool_next() */
+	int ltp_credit[LDAP_PVT_THREAD_POOL_NPRIO];
+
 	/* Max number of threads in this queue */
 	int ltp_max_count;
 
@@ -176,10 +180,25 @@ struct ldap_int_thread_pool_s {
 
 	/* Max pending + paused + idle tasks, negated when ltp_finishing */
 	int ltp_max_pending;
+
+	/* Idle workers take pending tasks from sibling queues before
+	 * going to sleep. Only meaningful with more than one queue.
+	 */
+	int ltp_steal;
+
+	/* Share of the threads given to each priority class when
+	 * several classes have tasks pending.
+	 */
+	int ltp_weight[LDAP_PVT_THREAD_POOL_NPRIO];
+};
+
+static ldap_int_tpool_plist_t empty_pending_list[LDAP_PVT_THREAD_POOL_NPRIO] = {
+	LDAP_STAILQ_HEAD_INITIALIZER(empty_pending_list[0]),
+	LDAP_STAILQ_HEAD_INITIALIZER(empty_pending_list[1]),
+	LDAP_STAILQ_HEAD_INITIALIZER(empty_pending_list[2])
 };
 
-static ldap_int_tpool_plist_t empty_pending_list =
-	LDAP_STAILQ_HEAD_INITIALIZER(empty_pending_list);
+static const int default_weight[LDAP_PVT_THREAD_POOL_NPRIO] = { 4, 2, 1 };
 
 static int ldap_int_has_thread_pool = 0;
 static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
@@ -189,6 +208,9 @@ static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
 static ldap_pvt_thread_mutex_t ldap_pvt_thread_pool_mutex;
 
 static void *ldap_int_thread_pool_wrapper( void *pool );
+static void ldap_int_thread_pool_wake_thief(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq );
 
 static ldap_pvt_thread_key_t	ldap_tpool_key;
 
@@ -227,7 +249,7 @@ ldap_pvt_thread_pool_init_q (
 {
 	ldap_pvt_thread_pool_t pool;
 	struct ldap_int_thread_poolq_s *pq;
-	int i, rc, rem_thr, rem_pend;
+	int i, j, rc, rem_thr, rem_pend;
 
 	/* multiple pools are currently not supported (ITS#4943) */
 	assert(!ldap_int_has_thread_pool);
@@ -264,6 +286,8 @@ ldap_pvt_thread_pool_init_q (
 
 	pool->ltp_numqs = numqs;
 	pool->ltp_conf_max_count = max_threads;
+	for (i=0; i<LDAP_PVT_THREAD_POOL_NPRIO; i++)
+		pool->ltp_weight[i] = default_weight[i];
 	if ( !max_threads )
 		max_threads = LDAP_MAXTHR;
 
@@ -296,8 +320,9 @@ fail:
 		rc = ldap_pvt_thread_cond_init(&pq->ltp_cond);
 		if (rc != 0)
 			return(rc);
-		LDAP_STAILQ_INIT(&pq->ltp_pending_list);
-		pq->ltp_work_list = &pq->ltp_pending_list;
+		for (j=0; j<LDAP_PVT_THREAD_POOL_NPRIO; j++)
+			LDAP_STAILQ_INIT(&pq->ltp_pending_list[j]);
+		pq->ltp_work_list = pq->ltp_pending_list;
 		LDAP_SLIST_INIT(&pq->ltp_free_list);
 
 		pq->ltp_max_count = max_threads / numqs;
@@ -356,12 +381,23 @@ ldap_pvt_thread_pool_submit2 (
 	ldap_pvt_thread_pool_t *tpool,
 	ldap_pvt_thread_start_t *start_routine, void *arg,
 	void **cookie )
+{
+	return ldap_pvt_thread_pool_submit_prio( tpool, start_routine, arg,
+		LDAP_PVT_THREAD_POOL_PRIO_NORMAL, cookie );
+}
+
+/* Submit a task in the given priority class */
+int
+ldap_pvt_thread_pool_submit_prio (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void *arg,
+	int prio, void **cookie )
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
 	ldap_pvt_thread_t thr;
-	int i, j;
+	int i, j, wake = 0;
 
 	if (tpool == NULL)
 		return(-1);
@@ -371,6 +407,9 @@ ldap_pvt_thread_pool_submit2 (
 	if (pool == NULL)
 		return(-1);
 
+	if (prio < 0 || prio >= LDAP_PVT_THREAD_POOL_NPRIO)
+		prio = LDAP_PVT_THREAD_POOL_PRIO_NORMAL;
+
 	if ( pool->ltp_numqs > 1 ) {
 		int min = pool->ltp_wqs[0]->ltp_max_pending + pool->ltp_wqs[0]->ltp_max_count;
 		int min_x = 0, cnt;
@@ -416,11 +455,12 @@ ldap_pvt_thread_pool_submit2 (
 	task->ltt_start_routine = start_routine;
 	task->ltt_arg = arg;
 	task->ltt_queue = pq;
+	task->ltt_prio = prio;
 	if ( cookie )
 		*cookie = task;
 
 	pq->ltp_pending_count++;
-	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list, task, ltt_next.q);
+	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list[prio], task, ltt_next.q);
 
 	if (pool->ltp_pause)
 		goto done;
@@ -449,7 +489,7 @@ ldap_pvt_thread_pool_submit2 (
 				/* let pool_close know there are no more threads */
 				ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
-				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list, ltt_next.q)
+				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list[prio], ltt_next.q)
 					if (ptr == task) break;
 				if (ptr == task) {
 					/* no open threads, task not handled, so
@@ -457,7 +497,7 @@ ldap_pvt_thread_pool_submit2 (
 					 * report the error.
 					 */
 					pq->ltp_pending_count--;
-					LDAP_STAILQ_REMOVE(&pq->ltp_pending_list, task,
+					LDAP_STAILQ_REMOVE(&pq->ltp_pending_list[prio], task,
 						ldap_int_thread_task_s, ltt_next.q);
 					LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task,
 						ltt_next.l);
@@ -471,8 +511,15 @@ ldap_pvt_thread_pool_submit2 (
 	}
 	ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
+	/* More tasks than threads here, let an idle sibling help out */
+	if (pool->ltp_steal &&
+		pq->ltp_open_count < pq->ltp_active_count+pq->ltp_pending_count)
+		wake = 1;
+
  done:
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+	if (wake)
+		ldap_int_thread_pool_wake_thief(pool, pq);
 	return(0);
 
  failed:
@@ -486,6 +533,116 @@ no_task( void *ctx, void *arg )
 	return NULL;
 }
 
+/* First pending task of any class, NULL if there are none */
+static ldap_int_thread_task_t *
+ldap_int_thread_pool_first( ldap_int_tpool_plist_t *work_list )
+{
+	ldap_int_thread_task_t *task = NULL;
+	int i;
+
+	for (i=0; i<LDAP_PVT_THREAD_POOL_NPRIO && task == NULL; i++)
+		task = LDAP_STAILQ_FIRST(&work_list[i]);
+	return task;
+}
+
+/* Dequeue the next task from work_list, which must not be empty.
+ * When several classes have tasks pending they are served in
+ * proportion to their weights, interleaved rather than in bursts:
+ * each busy class earns its weight in credit, the one with the
+ * most credit runs and pays back the weights of all busy classes.
+ * Idle classes do not accumulate credit.
+ */
+static ldap_int_thread_task_t *
+ldap_int_thread_pool_next(
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_int_tpool_plist_t *work_list )
+{
+	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
+	ldap_int_thread_task_t *task;
+	int i, best = -1, total = 0;
+
+	for (i=0; i<LDAP_PVT_THREAD_POOL_NPRIO; i++) {
+		if (LDAP_STAILQ_EMPTY(&work_list[i])) {
+			pq->ltp_credit[i] = 0;
+			continue;
+		}
+		pq->ltp_credit[i] += pool->ltp_weight[i];
+		total += pool->ltp_weight[i];
+		if (best < 0 || pq->ltp_credit[i] > pq->ltp_credit[best])
+			best = i;
+	}
+	assert(best >= 0);
+	pq->ltp_credit[best] -= total;
+
+	task = LDAP_STAILQ_FIRST(&work_list[best]);
+	LDAP_STAILQ_REMOVE_HEAD(&work_list[best], ltt_next.q);
+	return task;
+}
+
+/* Wake one idle thread of another queue, so that it can steal
+ * the task just queued on pq. The counters are peeked without
+ * the queue lock; a wasted or missed wakeup is harmless.
+ */
+static void
+ldap_int_thread_pool_wake_thief(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *tq;
+	int i;
+
+	for (i=0; i<pool->ltp_numqs; i++) {
+		tq = pool->ltp_wqs[i];
+		if (tq == pq ||
+			tq->ltp_open_count <= tq->ltp_active_count+tq->ltp_pending_count)
+			continue;
+		ldap_pvt_thread_mutex_lock(&tq->ltp_mutex);
+		if (tq->ltp_open_count > tq->ltp_active_count+tq->ltp_pending_count) {
+			ldap_pvt_thread_cond_signal(&tq->ltp_cond);
+			i = pool->ltp_numqs;
+		}
+		ldap_pvt_thread_mutex_unlock(&tq->ltp_mutex);
+	}
+}
+
+/* Take the oldest pending task of the most backed up sibling queue.
+ * Called by an idle thread with pq->ltp_mutex held. The sibling's
+ * mutex is only tried, so no lock order between queues is needed.
+ * Nothing is stolen while pausing: pool_pause() hides every queue's
+ * pending list while holding that queue's mutex.
+ */
+static ldap_int_thread_task_t *
+ldap_int_thread_pool_steal( struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
+	struct ldap_int_thread_poolq_s *tq, *vq = NULL;
+	ldap_int_thread_task_t *task = NULL;
+	int i, max = 0;
+
+	if (!pool->ltp_steal || pq->ltp_work_list != pq->ltp_pending_list)
+		return NULL;
+
+	for (i=0; i<pool->ltp_numqs; i++) {
+		tq = pool->ltp_wqs[i];
+		/* unlocked peek, checked again below */
+		if (tq != pq && tq->ltp_pending_count > max &&
+			ldap_int_thread_pool_first(tq->ltp_pending_list)) {
+			max = tq->ltp_pending_count;
+			vq = tq;
+		}
+	}
+
+	if (vq && ldap_pvt_thread_mutex_trylock(&vq->ltp_mutex) == 0) {
+		if (vq->ltp_work_list == vq->ltp_pending_list &&
+			ldap_int_thread_pool_first(vq->ltp_pending_list)) {
+			task = ldap_int_thread_pool_next(vq, vq->ltp_pending_list);
+			vq->ltp_pending_count--;
+		}
+		ldap_pvt_thread_mutex_unlock(&vq->ltp_mutex);
+	}
+	return task;
+}
+
 /* Cancel a pending task that was previously submitted.
  * Return 1 if the task was successfully cancelled, 0 if
  * not found, -1 for invalid parameters
@@ -506,7 +663,7 @@ ldap_pvt_thread_pool_retract (
 		return(-1);
 
 	ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
-	LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list, ltt_next.q)
+	LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list[ttmp->ltt_prio], ltt_next.q)
 		if (task == ttmp) {
 			/* Could LDAP_STAILQ_REMOVE the task, but that
 			 * walks ltp_pending_list again to find it.
@@ -530,7 +687,7 @@ ldap_pvt_thread_pool_walk(
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
-	int i;
+	int i, j;
 
 	if (tpool == NULL)
 		return(-1);
@@ -546,12 +703,14 @@ ldap_pvt_thread_pool_walk(
 
 	for (i=0; i<pool->ltp_numqs; i++) {
 		pq = pool->ltp_wqs[i];
-		LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list, ltt_next.q) {
-			if ( task->ltt_start_routine == start ) {
-				if ( cb( task->ltt_start_routine, task->ltt_arg, arg ) ) {
-					/* retract */
-					task->ltt_start_routine = no_task;
-					task->ltt_arg = NULL;
+		for (j=0; j<LDAP_PVT_THREAD_POOL_NPRIO; j++) {
+			LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list[j], ltt_next.q) {
+				if ( task->ltt_start_routine == start ) {
+					if ( cb( task->ltt_start_routine, task->ltt_arg, arg ) ) {
+						/* retract */
+						task->ltt_start_routine = no_task;
+						task->ltt_arg = NULL;
+					}
 				}
 			}
 		}
@@ -568,7 +727,7 @@ ldap_pvt_thread_pool_queues(
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
-	int i, rc, rem_thr, rem_pend;
+	int i, j, rc, rem_thr, rem_pend;
 
 	if (numqs < 1 || tpool == NULL)
 		return(-1);
@@ -604,8 +763,9 @@ ldap_pvt_thread_pool_queues(
 			rc = ldap_pvt_thread_cond_init(&pq->ltp_cond);
 			if (rc != 0)
 				return(rc);
-			LDAP_STAILQ_INIT(&pq->ltp_pending_list);
-			pq->ltp_work_list = &pq->ltp_pending_list;
+			for (j=0; j<LDAP_PVT_THREAD_POOL_NPRIO; j++)
+				LDAP_STAILQ_INIT(&pq->ltp_pending_list[j]);
+			pq->ltp_work_list = pq->ltp_pending_list;
 			LDAP_SLIST_INIT(&pq->ltp_free_list);
 		}
 	}
@@ -628,6 +788,56 @@ ldap_pvt_thread_pool_queues(
 	return 0;
 }
 
+/* Let idle threads take pending tasks from other work queues */
+int
+ldap_pvt_thread_pool_worksteal(
+	ldap_pvt_thread_pool_t *tpool,
+	int on )
+{
+	struct ldap_int_thread_pool_s *pool;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	pool->ltp_steal = (on != 0);
+	return(0);
+}
+
+/* Set the relative weight of each priority class, NULL for the defaults */
+int
+ldap_pvt_thread_pool_weights(
+	ldap_pvt_thread_pool_t *tpool,
+	const int *weights )
+{
+	struct ldap_int_thread_pool_s *pool;
+	int i;
+
+	if (tpool == NULL)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	if (weights == NULL)
+		weights = default_weight;
+	for (i=0; i<LDAP_PVT_THREAD_POOL_NPRIO; i++)
+		if (weights[i] < 1)
+			return(-1);
+
+	ldap_pvt_thread_mutex_lock(&pool->ltp_mutex);
+	for (i=0; i<LDAP_PVT_THREAD_POOL_NPRIO; i++)
+		pool->ltp_weight[i] = weights[i];
+	ldap_pvt_thread_mutex_unlock(&pool->ltp_mutex);
+	return(0);
+}
+
 /* Set max #threads.  value <= 0 means max supported #threads (LDAP_MAXTHR) */
 int
 ldap_pvt_thread_pool_maxthreads(
@@ -838,7 +1048,7 @@ ldap_pvt_thread_pool_close ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 	struct ldap_int_thread_pool_s *pool, *pptr;
 	struct ldap_int_thread_poolq_s *pq;
 	ldap_int_thread_task_t *task;
-	int i;
+	int i, j;
 
 	if (tpool == NULL)
 		return(-1);
@@ -869,9 +1079,11 @@ ldap_pvt_thread_pool_close ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 		if (pq->ltp_max_pending > 0)
 			pq->ltp_max_pending = -pq->ltp_max_pending;
 		if (!run_pending) {
-			while ((task = LDAP_STAILQ_FIRST(&pq->ltp_pending_list)) != NULL) {
-				LDAP_STAILQ_REMOVE_HEAD(&pq->ltp_pending_list, ltt_next.q);
-				LDAP_FREE(task);
+			for (j=0; j<LDAP_PVT_THREAD_POOL_NPRIO; j++) {
+				while ((task = LDAP_STAILQ_FIRST(&pq->ltp_pending_list[j])) != NULL) {
+					LDAP_STAILQ_REMOVE_HEAD(&pq->ltp_pending_list[j], ltt_next.q);
+					LDAP_FREE(task);
+				}
 			}
 			pq->ltp_pending_count = 0;
 		}
@@ -949,7 +1161,7 @@ ldap_int_thread_pool_wrapper (
 	ldap_int_tpool_plist_t *work_list;
 	ldap_int_thread_userctx_t ctx, *kctx;
 	unsigned i, keyslot, hash;
-	int pool_lock = 0, freeme = 0;
+	int pool_lock = 0, freeme = 0, stolen;
 
 	assert(pool != NULL);
 
@@ -988,7 +1200,10 @@ ldap_int_thread_pool_wrapper (
 
 	for (;;) {
 		work_list = pq->ltp_work_list; /* help the compiler a bit */
-		task = LDAP_STAILQ_FIRST(work_list);
+		task = ldap_int_thread_pool_first(work_list);
+		stolen = 0;
+		if (task == NULL && (task = ldap_int_thread_pool_steal(pq)) != NULL)
+			stolen = 1;
 		if (task == NULL) {	/* paused or no pending tasks */
 			if (--(pq->ltp_active_count) < 1) {
 				if (pool->ltp_pause) {
@@ -1033,7 +1248,10 @@ ldap_int_thread_pool_wrapper (
 					ldap_pvt_thread_cond_wait(&pq->ltp_cond, &pq->ltp_mutex);
 
 				work_list = pq->ltp_work_list;
-				task = LDAP_STAILQ_FIRST(work_list);
+				task = ldap_int_thread_pool_first(work_list);
+				if (task == NULL && !pool_lock &&
+					(task = ldap_int_thread_pool_steal(pq)) != NULL)
+					stolen = 1;
 			} while (task == NULL);
 
 			if (pool_lock) {
@@ -1044,8 +1262,10 @@ ldap_int_thread_pool_wrapper (
 			pq->ltp_active_count++;
 		}
 
-		LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
-		pq->ltp_pending_count--;
+		if (!stolen) {
+			task = ldap_int_thread_pool_next(pq, work_list);
+			pq->ltp_pending_count--;
+		}
 		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
 		task->ltt_start_routine(&ctx, task->ltt_arg);
@@ -1186,7 +1406,7 @@ handle_pause( ldap_pvt_thread_pool_t *tpool, int pause_type )
 				ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
 
 			/* Hide pending tasks from ldap_pvt_thread_pool_wrapper() */
-			pq->ltp_work_list = &empty_pending_list;
+			pq->ltp_work_list = empty_pending_list;
 
 			if (pq->ltp_active_count > 0)
 				pool->ltp_active_queues++;
@@ -1297,7 +1517,7 @@ ldap_pvt_thread_pool_resume (
 	pool->ltp_pause = 0;
 	for (i=0; i<pool->ltp_numqs; i++) {
 		pq = pool->ltp_wqs[i];
-		pq->ltp_work_list = &pq->ltp_pending_list;
+		pq->ltp_work_list = pq->ltp_pending_list;
 		ldap_pvt_thread_cond_broadcast(&pq->ltp_cond);
 	}
 	ldap_pvt_thread_cond_broadcast(&pool->ltp_cond);
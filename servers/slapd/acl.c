@@ -47,6 +47,8 @@ static const struct berval	acl_bv_ipv6_eq = BER_BVC( "IP=[" );
 static const struct berval	acl_bv_path_eq = BER_BVC("PATH=");
 #endif /* LDAP_PF_LOCAL */
 
+struct acl_cache;
+
 static AccessControl * slap_acl_get(
 	AccessControl *ac, int *count,
 	Operation *op, Entry *e,
@@ -54,7 +56,12 @@ static AccessControl * slap_acl_get(
 	struct berval *val,
 	AclRegexMatches *matches,
 	slap_mask_t *mask,
-	AccessControlState *state );
+	AccessControlState *state,
+	struct acl_cache *cache );
+
+static int acl_to_dn(
+	AccessControl *a, Entry *e,
+	AclRegexMatches *matches, int count );
 
 static slap_control_t slap_acl_mask(
 	AccessControl *ac,
@@ -131,6 +138,312 @@ slap_access_always_allowed(
 	(m)->val_count = MATCHES_VALMAXCOUNT( (m) );		\
 } while ( 0 /* CONSTCOND */ )
 
+/*
+ * Per-thread cache of ACL evaluation results. It only lives as long
+ * as the operation it was filled for, so the requester, its connection
+ * and the ACL lists are constant. For the entry being checked it records
+ * which "to" clauses (DN and filter) match, so the ACL walk done for
+ * each further attribute skips the patterns already known not to apply.
+ * Entries selected by the same set of ACLs, all of them ACL_F_SHARED,
+ * get the same answer for the same attribute; the decisions are shared
+ * by that whole class of entries.
+ *
+ * ACL clauses may check access to other entries while an entry is
+ * being checked (sets, groups, dnattr); those nested checks bypass the
+ * cache so they don't overwrite what is recorded for the outer entry.
+ */
+#define	ACL_TO_DN_OK	0x01
+#define	ACL_TO_DN_NO	0x02
+#define	ACL_TO_F_OK	0x04
+#define	ACL_TO_F_NO	0x08
+
+#define	ACL_CACHE_CLASSES	8
+#define	ACL_CACHE_DECISIONS	64
+
+#define	ACL_CLASS_UNKNOWN	(-1)
+#define	ACL_CLASS_NONE		(-2)
+
+typedef struct acl_decision {
+	AttributeDescription	*ad_desc;
+	slap_access_t		ad_access;
+	slap_mask_t		ad_inmask;
+	slap_mask_t		ad_mask;
+	int			ad_ret;
+} acl_decision;
+
+typedef struct acl_class {
+	unsigned char		*acc_match;	/* which ACLs select the entries */
+	int			acc_ndecisions;
+	int			acc_next;
+	acl_decision		acc_decisions[ACL_CACHE_DECISIONS];
+} acl_class;
+
+typedef struct acl_cache {
+	/* the operation the cache was filled for */
+	Operation		*ac_op;
+	unsigned long		ac_connid;
+	unsigned long		ac_opid;
+	time_t			ac_time;
+	int			ac_tincr;
+	BackendDB		*ac_bd;
+	AccessControl		*ac_acl;
+	unsigned long		ac_generation;
+	int			ac_depth;	/* checks in progress */
+	struct berval		ac_ndn;
+	ber_len_t		ac_ndnsize;
+
+	int			ac_nacl;	/* ACLs in the walk */
+	int			ac_size;
+	unsigned char		*ac_mem;
+
+	/* the entry whose "to" results are recorded */
+	Entry			*ac_e;
+	struct berval		ac_endn;
+	ber_len_t		ac_endnsize;
+	unsigned char		*ac_to;
+	unsigned char		*ac_match;
+	int			ac_checks;
+	int			ac_class;
+
+	int			ac_nclasses;
+	int			ac_nextclass;
+	acl_class		ac_classes[ACL_CACHE_CLASSES];
+} acl_cache;
+
+static void
+acl_cache_free( void *key, void *data )
+{
+	acl_cache *ac = data;
+
+	ch_free( ac->ac_ndn.bv_val );
+	ch_free( ac->ac_endn.bv_val );
+	ch_free( ac->ac_mem );
+	ch_free( ac );
+}
+
+static void
+acl_cache_bv( struct berval *dst, ber_len_t *size, struct berval *src )
+{
+	if ( *size <= src->bv_len ) {
+		*size = src->bv_len + 1;
+		dst->bv_val = ch_realloc( dst->bv_val, *size );
+	}
+	AC_MEMCPY( dst->bv_val, src->bv_val, src->bv_len );
+	dst->bv_val[src->bv_len] = '\0';
+	dst->bv_len = src->bv_len;
+}
+
+/* ACLs in the order slap_acl_get() walks them */
+static AccessControl *
+acl_walk_first( Operation *op )
+{
+	if ( op->o_bd == NULL || op->o_bd->be_acl == NULL )
+		return frontendDB->be_acl;
+	return op->o_bd->be_acl;
+}
+
+static AccessControl *
+acl_walk_next( AccessControl *a, int *fe_done )
+{
+	a = a->acl_next;
+	if ( a == NULL && !*fe_done ) {
+		*fe_done = 1;
+		a = frontendDB->be_acl;
+	}
+	return a;
+}
+
+/*
+ * Only searches are worth it: they check many attributes of many
+ * entries on behalf of one requester.
+ */
+static acl_cache *
+acl_cache_get( Operation *op )
+{
+	acl_cache	*ac;
+	AccessControl	*a, *first;
+	void		*data = NULL;
+	int		n, i, fe_done;
+
+	if ( op->o_threadctx == NULL || op->o_tag != LDAP_REQ_SEARCH )
+		return NULL;
+
+	if ( ldap_pvt_thread_pool_getkey( op->o_threadctx,
+		(void *)acl_cache_get, &data, NULL ) || data == NULL )
+	{
+		data = ch_calloc( 1, sizeof( acl_cache ) );
+		if ( ldap_pvt_thread_pool_setkey( op->o_threadctx,
+			(void *)acl_cache_get, data, acl_cache_free, NULL, NULL ) )
+		{
+			ch_free( data );
+			return NULL;
+		}
+	}
+	ac = data;
+
+	/* nested in another check */
+	if ( ac->ac_depth )
+		return NULL;
+
+	first = acl_walk_first( op );
+	if ( ac->ac_op == op && ac->ac_connid == op->o_connid &&
+		ac->ac_opid == op->o_opid && ac->ac_time == op->o_time &&
+		ac->ac_tincr == op->o_tincr && ac->ac_bd == op->o_bd &&
+		ac->ac_acl == first && ac->ac_generation == acl_generation &&
+		ac->ac_ndn.bv_len == op->o_ndn.bv_len &&
+		( op->o_ndn.bv_len == 0 || !memcmp( ac->ac_ndn.bv_val,
+			op->o_ndn.bv_val, op->o_ndn.bv_len ) ) )
+	{
+		return ac;
+	}
+
+	ac->ac_op = op;
+	ac->ac_connid = op->o_connid;
+	ac->ac_opid = op->o_opid;
+	ac->ac_time = op->o_time;
+	ac->ac_tincr = op->o_tincr;
+	ac->ac_bd = op->o_bd;
+	ac->ac_acl = first;
+	ac->ac_generation = acl_generation;
+	acl_cache_bv( &ac->ac_ndn, &ac->ac_ndnsize, &op->o_ndn );
+
+	fe_done = ( first == frontendDB->be_acl );
+	for ( n = 0, a = first; a != NULL; a = acl_walk_next( a, &fe_done ) )
+		n++;
+	if ( n > ac->ac_size ) {
+		ac->ac_size = n;
+		ac->ac_mem = ch_realloc( ac->ac_mem,
+			( ACL_CACHE_CLASSES + 2 ) * n );
+	}
+	ac->ac_nacl = n;
+	ac->ac_to = ac->ac_mem;
+	ac->ac_match = ac->ac_mem + n;
+	for ( i = 0; i < ACL_CACHE_CLASSES; i++ ) {
+		ac->ac_classes[i].acc_match = ac->ac_mem + ( i + 2 ) * n;
+	}
+	ac->ac_nclasses = 0;
+	ac->ac_nextclass = 0;
+	ac->ac_e = NULL;
+
+	return ac;
+}
+
+static void
+acl_cache_entry( acl_cache *ac, Entry *e )
+{
+	if ( ac->ac_e == e && dn_match( &ac->ac_endn, &e->e_nname ) )
+		return;
+
+	ac->ac_e = e;
+	acl_cache_bv( &ac->ac_endn, &ac->ac_endnsize, &e->e_nname );
+	memset( ac->ac_to, 0, ac->ac_nacl );
+	ac->ac_checks = 0;
+	ac->ac_class = ACL_CLASS_UNKNOWN;
+}
+
+/*
+ * Evaluate all the "to" clauses against the entry, and return the
+ * class of entries selected by the same ACLs if its decisions can be
+ * shared.
+ */
+static int
+acl_cache_class( acl_cache *ac, Entry *e )
+{
+	AccessControl	*a, *first = ac->ac_acl;
+	AclRegexMatches	matches;
+	acl_class	*cls;
+	int		i, fe_done;
+
+	fe_done = ( first == frontendDB->be_acl );
+	for ( i = 0, a = first; a != NULL && i < ac->ac_nacl;
+		a = acl_walk_next( a, &fe_done ), i++ )
+	{
+		unsigned char *to = &ac->ac_to[i];
+
+		ac->ac_match[i] = 0;
+		if ( !( *to & ( ACL_TO_DN_OK | ACL_TO_DN_NO ) ) ) {
+			MATCHES_MEMSET( &matches );
+			*to |= acl_to_dn( a, e, &matches, i + 1 ) ?
+				ACL_TO_DN_OK : ACL_TO_DN_NO;
+		}
+		if ( *to & ACL_TO_DN_NO )
+			continue;
+
+		if ( a->acl_filter != NULL ) {
+			if ( !( *to & ( ACL_TO_F_OK | ACL_TO_F_NO ) ) ) {
+				*to |= test_filter( NULL, e, a->acl_filter ) ==
+					LDAP_COMPARE_TRUE ? ACL_TO_F_OK : ACL_TO_F_NO;
+			}
+			if ( *to & ACL_TO_F_NO )
+				continue;
+		}
+
+		if ( !( a->acl_flags & ACL_F_SHARED ) )
+			return ACL_CLASS_NONE;
+		ac->ac_match[i] = 1;
+	}
+
+	for ( i = 0; i < ac->ac_nclasses; i++ ) {
+		if ( !memcmp( ac->ac_classes[i].acc_match, ac->ac_match,
+			ac->ac_nacl ) )
+			return i;
+	}
+
+	i = ac->ac_nextclass;
+	ac->ac_nextclass = ( i + 1 ) % ACL_CACHE_CLASSES;
+	if ( ac->ac_nclasses < ACL_CACHE_CLASSES )
+		ac->ac_nclasses++;
+
+	cls = &ac->ac_classes[i];
+	AC_MEMCPY( cls->acc_match, ac->ac_match, ac->ac_nacl );
+	cls->acc_ndecisions = 0;
+	cls->acc_next = 0;
+
+	return i;
+}
+
+static acl_decision *
+acl_cache_decision(
+	acl_class		*cls,
+	AttributeDescription	*desc,
+	slap_access_t		access,
+	slap_mask_t		inmask )
+{
+	int i;
+
+	for ( i = 0; i < cls->acc_ndecisions; i++ ) {
+		acl_decision *d = &cls->acc_decisions[i];
+
+		if ( d->ad_desc == desc && d->ad_access == access &&
+			d->ad_inmask == inmask )
+			return d;
+	}
+
+	return NULL;
+}
+
+static void
+acl_cache_decide(
+	acl_class		*cls,
+	AttributeDescription	*desc,
+	slap_access_t		access,
+	slap_mask_t		inmask,
+	slap_mask_t		mask,
+	int			ret )
+{
+	acl_decision *d = &cls->acc_decisions[cls->acc_next];
+
+	d->ad_desc = desc;
+	d->ad_access = access;
+	d->ad_inmask = inmask;
+	d->ad_mask = mask;
+	d->ad_ret = ret;
+
+	cls->acc_next = ( cls->acc_next + 1 ) % ACL_CACHE_DECISIONS;
+	if ( cls->acc_ndecisions < ACL_CACHE_DECISIONS )
+		cls->acc_ndecisions++;
+}
+
 int
 slap_access_allowed(
 	Operation		*op,
@@ -155,6 +468,9 @@ slap_access_allowed(
 	AclRegexMatches			matches;
 	AccessControlState		acl_state = ACL_STATE_INIT;
 	static AccessControlState	state_init = ACL_STATE_INIT;
+	acl_cache			*ac = NULL;
+	acl_class			*cls = NULL;
+	slap_mask_t			inmask;
 
 	assert( op != NULL );
 	assert( e != NULL );
@@ -167,6 +483,7 @@ slap_access_allowed(
 	assert( attr != NULL );
 
 	ACL_INIT( mask );
+	ACL_INIT( inmask );
 
 	/* grant database root access */
 	if ( be_isroot( op ) ) {
@@ -218,6 +535,12 @@ slap_access_allowed(
 	ret = 0;
 	control = ACL_BREAK;
 
+	ac = acl_cache_get( op );
+	if ( ac != NULL ) {
+		acl_cache_entry( ac, e );
+		ac->ac_depth++;
+	}
+
 	if ( state == NULL )
 		state = &acl_state;
 	if ( state->as_desc == desc &&
@@ -235,13 +558,37 @@ slap_access_allowed(
 		a = NULL;
 		count = 0;
 		ACL_PRIV_ASSIGN( mask, *maskp );
+
+		/* the first check of an entry only records its "to"
+		 * results, classifying it would cost a full walk */
+		if ( ac != NULL && val == NULL && ac->ac_checks++ ) {
+			if ( ac->ac_class == ACL_CLASS_UNKNOWN )
+				ac->ac_class = acl_cache_class( ac, e );
+			if ( ac->ac_class >= 0 ) {
+				acl_decision *d;
+
+				cls = &ac->ac_classes[ac->ac_class];
+				d = acl_cache_decision( cls, desc, access, mask );
+				if ( d != NULL ) {
+					ret = d->ad_ret;
+					ACL_PRIV_ASSIGN( mask, d->ad_mask );
+					Debug( LDAP_DEBUG_ACL,
+						"=> slap_access_allowed: %s access %s by %s (cached)\n",
+						access2str( access ), ret ? "granted" : "denied",
+						accessmask2str( mask, accessmaskbuf, 1 ) );
+					cls = NULL;
+					goto done;
+				}
+				ACL_PRIV_ASSIGN( inmask, mask );
+			}
+		}
 	}
 
 	MATCHES_MEMSET( &matches );
 	prev = a;
 
 	while ( ( a = slap_acl_get( a, &count, op, e, desc, val,
-		&matches, &mask, state ) ) != NULL )
+		&matches, &mask, state, ac ) ) != NULL )
 	{
 		int i; 
 		int dnmaxcount = MATCHES_DNMAXCOUNT( &matches );
@@ -317,6 +664,10 @@ slap_access_allowed(
 		accessmask2str( mask, accessmaskbuf, 1 ) );
 
 done:
+	if ( cls != NULL && !state->as_vd_acl_present )
+		acl_cache_decide( cls, desc, access, inmask, mask, ret );
+	if ( ac != NULL )
+		ac->ac_depth--;
 	ACL_PRIV_ASSIGN( *maskp, mask );
 	return ret;
 }
@@ -488,6 +839,82 @@ done:
 	return ret;
 }
 
+/*
+ * acl_to_dn - check the DN part of the "to" clause of ACL a against
+ * entry e, filling in the submatches of a regex pattern.
+ * Returns 1 if the ACL applies to the entry.
+ */
+static int
+acl_to_dn(
+	AccessControl	*a,
+	Entry		*e,
+	AclRegexMatches	*matches,
+	int		count )
+{
+	ber_len_t dnlen = e->e_nname.bv_len;
+
+	if ( a->acl_dn_pat.bv_len || ( a->acl_dn_style != ACL_STYLE_REGEX )) {
+		if ( a->acl_dn_style == ACL_STYLE_REGEX ) {
+			Debug( LDAP_DEBUG_ACL, "=> dnpat: [%d] %s nsub: %d\n", 
+				count, a->acl_dn_pat.bv_val, (int) a->acl_dn_re.re_nsub );
+			if ( regexec ( &a->acl_dn_re, 
+				       e->e_ndn, 
+			 	       matches->dn_count, 
+				       matches->dn_data, 0 ) )
+				return 0;
+
+		} else {
+			ber_len_t patlen;
+
+			Debug( LDAP_DEBUG_ACL, "=> dn: [%d] %s\n", 
+				count, a->acl_dn_pat.bv_val );
+			patlen = a->acl_dn_pat.bv_len;
+			if ( dnlen < patlen )
+				return 0;
+
+			if ( a->acl_dn_style == ACL_STYLE_BASE ) {
+				/* base dn -- entire object DN must match */
+				if ( dnlen != patlen )
+					return 0;
+
+			} else if ( a->acl_dn_style == ACL_STYLE_ONE ) {
+				ber_len_t	rdnlen = 0;
+				ber_len_t	sep = 0;
+
+				if ( dnlen <= patlen )
+					return 0;
+
+				if ( patlen > 0 ) {
+					if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+						return 0;
+					sep = 1;
+				}
+
+				rdnlen = dn_rdnlen( NULL, &e->e_nname );
+				if ( rdnlen + patlen + sep != dnlen )
+					return 0;
+
+			} else if ( a->acl_dn_style == ACL_STYLE_SUBTREE ) {
+				if ( dnlen > patlen && !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+					return 0;
+
+			} else if ( a->acl_dn_style == ACL_STYLE_CHILDREN ) {
+				if ( dnlen <= patlen )
+					return 0;
+				if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
+					return 0;
+			}
+
+			if ( strcmp( a->acl_dn_pat.bv_val, e->e_ndn + dnlen - patlen ) != 0 )
+				return 0;
+		}
+
+		Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] matched\n",
+			count );
+	}
+
+	return 1;
+}
 
 /*
  * slap_acl_get - return the acl applicable to entry e, attribute
@@ -505,11 +932,12 @@ slap_acl_get(
 	struct berval	*val,
 	AclRegexMatches	*matches,
 	slap_mask_t *mask,
-	AccessControlState *state )
+	AccessControlState *state,
+	acl_cache *cache )
 {
 	const char *attr;
-	ber_len_t dnlen;
 	AccessControl *prev;
+	unsigned char *to, dummy;
 
 	assert( e != NULL );
 	assert( count != NULL );
@@ -536,8 +964,6 @@ slap_acl_get(
 		a = a->acl_next;
 	}
 
-	dnlen = e->e_nname.bv_len;
-
  retry:
 	for ( ; a != NULL; prev = a, a = a->acl_next ) {
 		(*count) ++;
@@ -545,64 +971,25 @@ slap_acl_get(
 		if ( a != frontendDB->be_acl && state->as_fe_done )
 			state->as_fe_done++;
 
-		if ( a->acl_dn_pat.bv_len || ( a->acl_dn_style != ACL_STYLE_REGEX )) {
-			if ( a->acl_dn_style == ACL_STYLE_REGEX ) {
-				Debug( LDAP_DEBUG_ACL, "=> dnpat: [%d] %s nsub: %d\n", 
-					*count, a->acl_dn_pat.bv_val, (int) a->acl_dn_re.re_nsub );
-				if ( regexec ( &a->acl_dn_re, 
-					       e->e_ndn, 
-				 	       matches->dn_count, 
-					       matches->dn_data, 0 ) )
-					continue;
-
-			} else {
-				ber_len_t patlen;
-
-				Debug( LDAP_DEBUG_ACL, "=> dn: [%d] %s\n", 
-					*count, a->acl_dn_pat.bv_val );
-				patlen = a->acl_dn_pat.bv_len;
-				if ( dnlen < patlen )
-					continue;
-
-				if ( a->acl_dn_style == ACL_STYLE_BASE ) {
-					/* base dn -- entire object DN must match */
-					if ( dnlen != patlen )
-						continue;
-
-				} else if ( a->acl_dn_style == ACL_STYLE_ONE ) {
-					ber_len_t	rdnlen = 0;
-					ber_len_t	sep = 0;
-
-					if ( dnlen <= patlen )
-						continue;
-
-					if ( patlen > 0 ) {
-						if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-							continue;
-						sep = 1;
-					}
-
-					rdnlen = dn_rdnlen( NULL, &e->e_nname );
-					if ( rdnlen + patlen + sep != dnlen )
-						continue;
-
-				} else if ( a->acl_dn_style == ACL_STYLE_SUBTREE ) {
-					if ( dnlen > patlen && !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-						continue;
+		if ( cache != NULL && *count <= cache->ac_nacl ) {
+			to = &cache->ac_to[*count - 1];
+		} else {
+			to = &dummy;
+			dummy = 0;
+		}
 
-				} else if ( a->acl_dn_style == ACL_STYLE_CHILDREN ) {
-					if ( dnlen <= patlen )
-						continue;
-					if ( !DN_SEPARATOR( e->e_ndn[dnlen - patlen - 1] ) )
-						continue;
-				}
+		if ( *to & ACL_TO_DN_NO )
+			continue;
 
-				if ( strcmp( a->acl_dn_pat.bv_val, e->e_ndn + dnlen - patlen ) != 0 )
-					continue;
+		/* regex submatches are needed by the "by" clauses */
+		if ( !( *to & ACL_TO_DN_OK ) ||
+			( a->acl_dn_style == ACL_STYLE_REGEX && a->acl_dn_pat.bv_len ))
+		{
+			if ( !acl_to_dn( a, e, matches, *count ) ) {
+				*to |= ACL_TO_DN_NO;
+				continue;
 			}
-
-			Debug( LDAP_DEBUG_ACL, "=> acl_get: [%d] matched\n",
-				*count );
+			*to |= ACL_TO_DN_OK;
 		}
 
 		if ( a->acl_attrs && !ad_inlist( desc, a->acl_attrs ) ) {
@@ -694,9 +1081,15 @@ slap_acl_get(
 		}
 
 		if ( a->acl_filter != NULL ) {
-			ber_int_t rc = test_filter( NULL, e, a->acl_filter );
-			if ( rc != LDAP_COMPARE_TRUE ) {
+			if ( *to & ACL_TO_F_NO )
 				continue;
+			if ( !( *to & ACL_TO_F_OK ) ) {
+				ber_int_t rc = test_filter( NULL, e, a->acl_filter );
+				if ( rc != LDAP_COMPARE_TRUE ) {
+					*to |= ACL_TO_F_NO;
+					continue;
+				}
+				*to |= ACL_TO_F_OK;
 			}
 		}
 
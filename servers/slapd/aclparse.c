@@ -60,6 +60,10 @@ const char *style_strings[] = {
 #define ACLBUF_CHUNKSIZE	8192
 static struct berval aclbuf;
 
+/* bumped whenever an ACL is added or freed, so that cached
+ * ACL evaluation results can be discarded */
+unsigned long acl_generation;
+
 static void		split(char *line, int splitchar, char **left, char **right);
 static void		access_append(Access **l, Access *a);
 static void		access_free( Access *a );
@@ -72,6 +76,7 @@ static void		print_acl(Backend *be, AccessControl *a);
 #endif
 
 static int		check_scope( BackendDB *be, AccessControl *a );
+static int		acl_shared( AccessControl *a );
 
 #ifdef SLAP_DYNACL
 static int
@@ -1936,9 +1941,11 @@ parse_acl(
 					break;
 				}
 			}
+			a->acl_flags |= acl_shared( a );
 			acl_append( &be->be_acl, a, pos );
 
 		} else {
+			a->acl_flags |= acl_shared( a );
 			acl_append( &frontendDB->be_acl, a, pos );
 		}
 	}
@@ -2306,6 +2313,60 @@ acl_append( AccessControl **l, AccessControl *a, int pos )
 	if ( *l && a )
 		a->acl_next = *l;
 	*l = a;
+	acl_generation++;
+}
+
+/* Does a "by" pattern get expanded with the entry's DN submatches? */
+static int
+acl_pat_expands( slap_style_t style, struct berval *pat )
+{
+	if ( BER_BVISEMPTY( pat ) )
+		return 0;
+	if ( style == ACL_STYLE_EXPAND )
+		return 1;
+	return style == ACL_STYLE_REGEX && strchr( pat->bv_val, '$' ) != NULL;
+}
+
+static int
+acl_dn_shared( slap_dn_access *bdn )
+{
+	if ( bdn->a_style == ACL_STYLE_SELF || bdn->a_at != NULL ||
+		bdn->a_self || bdn->a_expand )
+		return 0;
+	return !acl_pat_expands( bdn->a_style, &bdn->a_pat );
+}
+
+/*
+ * An ACL whose "by" clauses only look at the requester and its
+ * connection grants the same access to every entry its "to" clause
+ * selects; slap_access_allowed() shares its decisions among them.
+ * Groups and sets are evaluated against the target entry, dynamic
+ * ACLs may do anything.
+ */
+static int
+acl_shared( AccessControl *a )
+{
+	Access *b;
+
+	for ( b = a->acl_access; b != NULL; b = b->a_next ) {
+		if ( !acl_dn_shared( &b->a_dn ) || !acl_dn_shared( &b->a_realdn ) )
+			return 0;
+		if ( acl_pat_expands( b->a_peername_style, &b->a_peername_pat ) ||
+			acl_pat_expands( b->a_sockname_style, &b->a_sockname_pat ) ||
+			acl_pat_expands( b->a_sockurl_style, &b->a_sockurl_pat ) ||
+			acl_pat_expands( b->a_domain_style, &b->a_domain_pat ) ||
+			b->a_domain_expand )
+			return 0;
+		if ( !BER_BVISEMPTY( &b->a_group_pat ) ||
+			!BER_BVISEMPTY( &b->a_set_pat ) )
+			return 0;
+#ifdef SLAP_DYNACL
+		if ( b->a_dynacl != NULL )
+			return 0;
+#endif /* SLAP_DYNACL */
+	}
+
+	return ACL_F_SHARED;
 }
 
 static void
@@ -2388,6 +2449,7 @@ acl_free( AccessControl *a )
 		access_free( a->acl_access );
 	}
 	free( a );
+	acl_generation++;
 }
 
 void
@@ -258,6 +258,8 @@ at_delete( AttributeType *at )
 	LDAP_STAILQ_REMOVE(&attr_list, at, AttributeType, sat_next);
 
 	at_delete_names( at );
+
+	dn_cache_flush();
 }
 
 static void
@@ -582,6 +584,9 @@ at_insert(
 		LDAP_STAILQ_INSERT_TAIL( &attr_list, sat, sat_next );
 	}
 
+	/* DNs may normalize differently now */
+	dn_cache_flush();
+
 	return 0;
 }
 
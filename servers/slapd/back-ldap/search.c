@@ -327,6 +327,8 @@ retry:
 		}
 
 		if ( rc == 0 || rc == -2 ) {
+			/* don't keep entries from the client while waiting */
+			slap_stream_flush( op );
 			ldap_pvt_thread_yield();
 
 			/* check timeout */
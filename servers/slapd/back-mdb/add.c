@@ -356,6 +356,11 @@ mdb_add(Operation *op, SlapReply *rs )
 	}
 
 	if ( moi == &opinfo ) {
+		if ( !op->o_noop && slap_precommit_play( op ) != LDAP_SUCCESS ) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "txn precommit failed";
+			goto return_results;
+		}
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if ( op->o_noop ) {
@@ -366,7 +371,7 @@ mdb_add(Operation *op, SlapReply *rs )
 			goto return_results;
 		}
 
-		rs->sr_err = mdb_txn_commit( txn );
+		rs->sr_err = mdb_attr_stat_commit( mdb, txn );
 		txn = NULL;
 		if ( rs->sr_err != 0 ) {
 			mdb->mi_numads = numads;
@@ -25,6 +25,7 @@
 #include "back-mdb.h"
 #include "config.h"
 #include "lutil.h"
+#include "ldap_rq.h"
 
 /* Find the ad, return -1 if not found,
  * set point for insertion if ins is non-NULL
@@ -384,17 +385,21 @@ fail:
 #endif
 		a->ai_cursor = NULL;
 		a->ai_root = NULL;
+		a->ai_bulk = NULL;
 		a->ai_desc = ad;
 		a->ai_dbi = 0;
 		a->ai_multi_hi = UINT_MAX;
 		a->ai_multi_lo = UINT_MAX;
+		memset( &a->ai_stat, 0, sizeof( a->ai_stat ));
 
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			a->ai_indexmask = 0;
 			a->ai_newmask = mask;
+			a->ai_indexed = 1;
 		} else {
 			a->ai_indexmask = mask;
 			a->ai_newmask = 0;
+			a->ai_indexed = 0;
 		}
 
 #ifdef LDAP_COMP_MATCH
@@ -432,6 +437,7 @@ fail:
 			if ( !( b->ai_indexmask || b->ai_newmask ) && b->ai_multi_lo < UINT_MAX ) {
 				b->ai_indexmask = a->ai_indexmask;
 				b->ai_newmask = a->ai_newmask;
+				b->ai_indexed = a->ai_indexed;
 				ch_free( a );
 				rc = 0;
 				continue;
@@ -447,6 +453,9 @@ fail:
 					if ( b->ai_newmask )
 						b->ai_indexmask = b->ai_newmask;
 					b->ai_newmask = a->ai_newmask;
+					b->ai_indexed = 1;
+					/* the key set changes, count it again */
+					mdb_attr_stat_reset( mdb, b );
 					ch_free( a );
 					rc = 0;
 					continue;
@@ -680,6 +689,338 @@ mdb_attr_info_free( AttrInfo *ai )
 	free( ai );
 }
 
+/* The presence slot is stored under a key of all zeroes */
+static int
+stat_is_presence( MDB_val *key )
+{
+	unsigned char *c = key->mv_data;
+
+	return key->mv_size == 4 && !( c[0] | c[1] | c[2] | c[3] );
+}
+
+/* Record the new size of a key's slot in the list of the largest ones */
+static void
+stat_heavy( mdb_idxstat *st, MDB_val *key, ID count )
+{
+	mdb_heavykey *hk, *min = NULL;
+	int i;
+
+	if ( key->mv_size > MDB_STAT_KEYLEN )
+		return;
+
+	for ( i = 0; i < MDB_STAT_HEAVY; i++ ) {
+		hk = &st->is_heavy[i];
+		if ( hk->hk_len == key->mv_size &&
+			!memcmp( hk->hk_key, key->mv_data, key->mv_size ) ) {
+			hk->hk_count = count;
+			if ( !count )
+				hk->hk_len = 0;
+			return;
+		}
+		if ( !min || hk->hk_count < min->hk_count )
+			min = hk;
+	}
+	if ( count > min->hk_count ) {
+		min->hk_count = count;
+		min->hk_len = key->mv_size;
+		memcpy( min->hk_key, key->mv_data, key->mv_size );
+	}
+}
+
+/* Apply the change made to one key of an index, mi_stat_mutex held */
+static void
+stat_update( mdb_idxstat *st, MDB_val *key, ID count, int dkeys, int dids )
+{
+	if ( st->is_seeding ) {
+		if ( stat_is_presence( key )) {
+			st->is_dpresent += dids;
+		} else {
+			st->is_dkeys += dkeys;
+			st->is_dids += dids;
+			stat_heavy( st, key, count );
+		}
+	} else if ( st->is_seeded ) {
+		if ( stat_is_presence( key )) {
+			st->is_present = count;
+		} else {
+			if ( dkeys < 0 && st->is_keys < (ID)-dkeys )
+				st->is_keys = 0;
+			else
+				st->is_keys += dkeys;
+			if ( dids < 0 && st->is_ids < (ID)-dids )
+				st->is_ids = 0;
+			else
+				st->is_ids += dids;
+			stat_heavy( st, key, count );
+		}
+	}
+}
+
+/* Note the change made to one key of an index in the current write
+ * txn. count is the number of IDs now in the slot, dkeys and dids
+ * the change in the number of keys and IDs of the index. Nothing is
+ * counted until mdb_attr_stat_commit() sees the txn commit.
+ */
+void
+mdb_attr_stat_update(
+	struct mdb_info *mdb,
+	mdb_idxstat *st,
+	MDB_val *key,
+	ID count,
+	int dkeys,
+	int dids )
+{
+	mdb_statrec *sr;
+
+	if ( mdb->mi_stat_npending == mdb->mi_stat_maxpending ) {
+		mdb->mi_stat_maxpending = mdb->mi_stat_maxpending ?
+			mdb->mi_stat_maxpending * 2 : 64;
+		mdb->mi_stat_pending = ch_realloc( mdb->mi_stat_pending,
+			mdb->mi_stat_maxpending * sizeof( mdb_statrec ));
+	}
+	sr = &mdb->mi_stat_pending[ mdb->mi_stat_npending++ ];
+	sr->sr_stat = st;
+	sr->sr_count = count;
+	sr->sr_dkeys = dkeys;
+	sr->sr_dids = dids;
+	if ( key->mv_size > MDB_STAT_KEYLEN ) {
+		sr->sr_len = MDB_STAT_KEYLEN + 1;
+	} else {
+		sr->sr_len = key->mv_size;
+		memcpy( sr->sr_key, key->mv_data, key->mv_size );
+	}
+}
+
+/* A write txn starts, whatever an earlier one left behind
+ * was never committed
+ */
+void
+mdb_attr_stat_begin( struct mdb_info *mdb )
+{
+	mdb->mi_stat_npending = 0;
+}
+
+/* Commit a write txn and apply its changes to the statistics. The
+ * mutex is held across the commit, so that a scan either sees the
+ * txn in its snapshot or gets the changes summed up.
+ */
+int
+mdb_attr_stat_commit( struct mdb_info *mdb, MDB_txn *txn )
+{
+	MDB_val key;
+	int i, rc;
+
+	if ( !mdb->mi_stat_npending )
+		return mdb_txn_commit( txn );
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_stat_mutex );
+	rc = mdb_txn_commit( txn );
+	for ( i = 0; rc == 0 && i < mdb->mi_stat_npending; i++ ) {
+		mdb_statrec *sr = &mdb->mi_stat_pending[i];
+
+		key.mv_size = sr->sr_len;
+		key.mv_data = sr->sr_key;
+		stat_update( sr->sr_stat, &key, sr->sr_count,
+			sr->sr_dkeys, sr->sr_dids );
+	}
+	mdb->mi_stat_npending = 0;
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_stat_mutex );
+	return rc;
+}
+
+/* The key set of the index changes, count it again. A scan that
+ * is running now would publish counts of the old key set.
+ */
+void
+mdb_attr_stat_reset( struct mdb_info *mdb, AttrInfo *ai )
+{
+	mdb_idxstat *st = &ai->ai_stat;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_stat_mutex );
+	if ( st->is_seeding )
+		st->is_stale = 1;
+	else
+		memset( st, 0, sizeof( *st ));
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_stat_mutex );
+}
+
+/* Whether the statistics of an index are counted, mi_stat_mutex held */
+int
+mdb_attr_stat_ready( struct mdb_info *mdb, AttrInfo *ai )
+{
+	return ai->ai_stat.is_seeded;
+}
+
+/* Add a change summed up during a scan to a count it made */
+static ID
+stat_apply( ID count, long delta )
+{
+	if ( delta < 0 && count < (ID)-delta )
+		return 0;
+	return count + delta;
+}
+
+/* Count the keys of an index from scratch. The scan runs in its own
+ * read txn without holding mi_stat_mutex; changes committed meanwhile,
+ * which the txn can't see, are summed up in the stats and added to its
+ * counts when they are published.
+ */
+static int
+mdb_attr_stat_seed( struct mdb_info *mdb, AttrInfo *ai )
+{
+	mdb_idxstat *st = &ai->ai_stat, scan;
+	MDB_txn *txn = NULL;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID first, lo, count;
+	size_t n;
+	int i, rc;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_stat_mutex );
+	if ( st->is_seeded || st->is_seeding ) {
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_stat_mutex );
+		return 0;
+	}
+	memset( st, 0, sizeof( *st ));
+	st->is_seeding = 1;
+	/* commits apply their changes under the mutex, so they are
+	 * either in the snapshot or summed up, never both
+	 */
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_stat_mutex );
+	if ( rc )
+		goto done;
+
+	memset( &scan, 0, sizeof( scan ));
+	rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
+	if ( rc )
+		goto done;
+
+	while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_NODUP )) == 0 ) {
+		memcpy( &first, data.mv_data, sizeof(ID) );
+		if ( first == 0 ) {
+			/* a range, count its width */
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_DUP );
+			if ( rc )
+				break;
+			memcpy( &lo, data.mv_data, sizeof(ID) );
+			rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT_DUP );
+			if ( rc )
+				break;
+			memcpy( &count, data.mv_data, sizeof(ID) );
+			count -= lo - 1;
+		} else {
+			rc = mdb_cursor_count( mc, &n );
+			if ( rc )
+				break;
+			count = n;
+		}
+		if ( stat_is_presence( &key )) {
+			scan.is_present = count;
+		} else {
+			scan.is_keys++;
+			scan.is_ids += count;
+			stat_heavy( &scan, &key, count );
+		}
+	}
+	mdb_cursor_close( mc );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+
+done:
+	if ( txn )
+		mdb_txn_abort( txn );
+	ldap_pvt_thread_mutex_lock( &mdb->mi_stat_mutex );
+	if ( rc == 0 && !st->is_stale ) {
+		scan.is_keys = stat_apply( scan.is_keys, st->is_dkeys );
+		scan.is_ids = stat_apply( scan.is_ids, st->is_dids );
+		scan.is_present = stat_apply( scan.is_present, st->is_dpresent );
+		/* the latest sizes of the keys changed meanwhile */
+		for ( i = 0; i < MDB_STAT_HEAVY; i++ ) {
+			mdb_heavykey *hk = &st->is_heavy[i];
+
+			if ( hk->hk_len ) {
+				key.mv_size = hk->hk_len;
+				key.mv_data = hk->hk_key;
+				stat_heavy( &scan, &key, hk->hk_count );
+			}
+		}
+		scan.is_seeded = 1;
+		*st = scan;
+	} else {
+		memset( st, 0, sizeof( *st ));
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_stat_mutex );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "mdb_attr_stat_seed: "
+			"scan of %s index failed: %s (%d)\n",
+			ai->ai_desc->ad_cname.bv_val, mdb_strerror(rc), rc );
+	}
+	return rc;
+}
+
+/* Count the indexes whose statistics were asked for, one at a time
+ * so that a config change can get in between
+ */
+static void *
+mdb_attr_stat_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	struct mdb_info *mdb = rtask->arg;
+	int i;
+
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai;
+
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
+		if ( slapd_shutdown || !( mdb->mi_flags & MDB_IS_OPEN ))
+			break;
+		if ( i >= mdb->mi_nattrs )
+			break;
+		ai = mdb->mi_attrs[i];
+		if ( ai->ai_indexmask && ai->ai_dbi )
+			mdb_attr_stat_seed( mdb, ai );
+	}
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	mdb->mi_stat_task = NULL;
+	ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	return NULL;
+}
+
+/* Schedule counting the indexes that are not counted yet, unless it's
+ * already pending. The long interval makes it run only once.
+ */
+void
+mdb_attr_stat_task_start( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( !mdb->mi_stat_task ) {
+		mdb->mi_stat_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+			mdb_attr_stat_task, mdb,
+			LDAP_XSTRING(mdb_attr_stat_task), mdb->mi_dbenv_home );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Drop the counting task if it didn't start yet */
+void
+mdb_attr_stat_task_stop( struct mdb_info *mdb )
+{
+	struct re_s *re;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	re = mdb->mi_stat_task;
+	if ( re && !ldap_pvt_runqueue_isrunning( &slapd_rq, re )) {
+		mdb->mi_stat_task = NULL;
+		ldap_pvt_runqueue_remove( &slapd_rq, re );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
 void
 mdb_attr_index_destroy( struct mdb_info *mdb )
 {
@@ -714,6 +1055,7 @@ void mdb_attr_flush( struct mdb_info *mdb )
 			if ( mdb->mi_attrs[i]->ai_multi_lo < UINT_MAX ) {
 				mdb->mi_attrs[i]->ai_indexmask = 0;
 				mdb->mi_attrs[i]->ai_newmask = 0;
+				mdb_attr_stat_reset( mdb, mdb->mi_attrs[i] );
 			} else {
 				int j;
 				mdb_attr_info_free( mdb->mi_attrs[i] );
@@ -33,7 +33,15 @@ LDAP_BEGIN_DECL
 #define MDB_DN2ID		1
 #define MDB_ID2ENTRY	2
 #define MDB_ID2VAL		3
-#define MDB_NDB			4
+#define MDB_IDXPROG		4
+#define MDB_DBINFO		5
+#define MDB_NDB			6
+
+/* Features of the on-disk format that older code cannot read,
+ * recorded in the info DB under MDB_DBINFO_FORMAT
+ */
+#define MDB_DBINFO_FORMAT	"format"
+#define MDB_FMT_IDLEXACT	0x01	/* index slots may exceed an IDL */
 
 /* The default search IDL stack cache depth */
 #define DEFAULT_SEARCH_STACK_DEPTH	16
@@ -43,6 +51,9 @@ LDAP_BEGIN_DECL
 
 #define MDB_INDICES		128
 
+/* Named sub-databases reserved for overlays, see extra.c */
+#define MDB_AUXDBS		4
+
 #define	MDB_MAXADS	65536
 
 /* Default to 10MB max */
@@ -63,6 +74,9 @@ typedef struct mdb_monitor_t {
 /* From ldap_rq.h */
 struct re_s;
 
+/* Decoded entry cache, see ecache.c */
+struct mdb_ecache;
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
 
@@ -83,6 +97,10 @@ struct mdb_info {
 	int			mi_readers;
 
 	unsigned	mi_rtxn_size;
+	int			mi_idl_exact;
+	unsigned	mi_dbformat;
+	unsigned	mi_ecache_max;
+	struct mdb_ecache	*mi_ecache;
 	int			mi_txn_cp;
 	unsigned	mi_txn_cp_min;
 	unsigned	mi_txn_cp_kbyte;
@@ -91,6 +109,14 @@ struct mdb_info {
 	struct re_s		*mi_index_task;
 
 	mdb_monitor_t	mi_monitor;
+	ldap_pvt_thread_mutex_t	mi_stat_mutex;
+	struct re_s		*mi_stat_task;
+	/* index statistics changes of the current write txn,
+	 * only touched by the thread that holds it
+	 */
+	struct mdb_statrec	*mi_stat_pending;
+	int			mi_stat_npending;
+	int			mi_stat_maxpending;
 
 #ifdef MDB_MONITOR_IDX
 	ldap_pvt_thread_mutex_t	mi_idx_mutex;
@@ -114,6 +140,8 @@ struct mdb_info {
 		 * back into main blob */
 
 	MDB_dbi	mi_dbis[MDB_NDB];
+	MDB_dbi	mi_auxdbis[MDB_AUXDBS];
+	char	*mi_auxnames[MDB_AUXDBS];
 	AttributeDescription *mi_ads[MDB_MAXADS];
 	int mi_adxs[MDB_MAXADS];
 };
@@ -122,6 +150,8 @@ struct mdb_info {
 #define mi_dn2id	mi_dbis[MDB_DN2ID]
 #define mi_ad2id	mi_dbis[MDB_AD2ID]
 #define mi_id2val	mi_dbis[MDB_ID2VAL]
+#define mi_idxprog	mi_dbis[MDB_IDXPROG]
+#define mi_dbinfo	mi_dbis[MDB_DBINFO]
 
 typedef struct mdb_op_info {
 	OpExtra		moi_oe;
@@ -135,6 +165,45 @@ typedef struct mdb_op_info {
 
 LDAP_END_DECL
 
+/* Approximate statistics of an attribute's index DB. Equality, approx
+ * and substring keys are hashed into the same DB and can't be told
+ * apart, so only the presence slot is counted separately.
+ */
+#define MDB_STAT_HEAVY	8	/* how many of the largest keys to track */
+#define MDB_STAT_KEYLEN	16	/* longer keys are not tracked */
+
+typedef struct mdb_heavykey {
+	ID hk_count;
+	unsigned char hk_len;
+	unsigned char hk_key[MDB_STAT_KEYLEN];
+} mdb_heavykey;
+
+typedef struct mdb_idxstat {
+	int is_seeded;		/* counts are only kept once a scan set them */
+	int is_seeding;		/* a scan is running, changes are only summed */
+	int is_stale;		/* the key set changed under the running scan */
+	long is_dkeys;		/* change in keys, IDs and presence since */
+	long is_dids;
+	long is_dpresent;
+	ID is_keys;		/* number of value keys */
+	ID is_ids;		/* IDs stored under all value keys */
+	ID is_present;		/* IDs in the presence slot */
+	mdb_heavykey is_heavy[MDB_STAT_HEAVY];
+} mdb_idxstat;
+
+/* A change to one key of an index, applied to its statistics once the
+ * write txn that made it commits. Keys longer than MDB_STAT_KEYLEN are
+ * not kept, sr_len is just past it then.
+ */
+typedef struct mdb_statrec {
+	mdb_idxstat *sr_stat;
+	ID sr_count;
+	int sr_dkeys;
+	int sr_dids;
+	unsigned char sr_len;
+	unsigned char sr_key[MDB_STAT_KEYLEN];
+} mdb_statrec;
+
 /* for the cache of attribute information (which are indexed, etc.) */
 typedef struct mdb_attrinfo {
 	AttributeDescription *ai_desc; /* attribute description cn;lang-en */
@@ -145,12 +214,29 @@ typedef struct mdb_attrinfo {
 #endif
 	TAvlnode *ai_root;		/* for tools */
 	MDB_cursor *ai_cursor;	/* for tools */
+	void *ai_bulk;		/* for tools */
 	int ai_idx;	/* position in AI array */
 	MDB_dbi ai_dbi;
 	unsigned ai_multi_hi;
 	unsigned ai_multi_lo;
+	mdb_idxstat ai_stat;	/* protected by mi_stat_mutex */
+	ID ai_indexed;	/* online indexing: next ID to do, 0 if none */
 } AttrInfo;
 
+/* Progress of an online index build, kept in the idxp DB under the
+ * attribute name and updated in the same txn as the entries it covers.
+ * Entries below ip_next are indexed for ip_newmask; the rest only for
+ * ip_oldmask.
+ */
+typedef struct mdb_idxprog {
+	ID ip_next;
+	slap_mask_t ip_newmask;
+	slap_mask_t ip_oldmask;
+} mdb_idxprog;
+
+/* Entries indexed per write txn by the online indexer */
+#define MDB_INDEX_CHUNK	256
+
 /* tool threaded indexer state */
 typedef struct mdb_attrixinfo {
 	OpExtra ai_oe;
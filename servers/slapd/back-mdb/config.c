@@ -45,6 +45,8 @@ enum {
 	MDB_SSTACK,
 	MDB_MULTIVAL,
 	MDB_IDLEXP,
+	MDB_ECACHE,
+	MDB_IDLEXACT,
 };
 
 static ConfigTable mdbcfg[] = {
@@ -68,11 +70,21 @@ static ConfigTable mdbcfg[] = {
 			"DESC 'Disable synchronous database writes' "
 			"EQUALITY booleanMatch "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "entrycache", "entries", 2, 2, 0, ARG_UINT|ARG_MAGIC|MDB_ECACHE,
+		mdb_cf_gen, "( OLcfgDbAt:12.8 NAME 'olcDbEntryCache' "
+		"DESC 'Number of decoded entries to cache' "
+		"EQUALITY integerMatch "
+		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
+	{ "idlexact", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_IDLEXACT,
+		mdb_cf_gen, "( OLcfgDbAt:12.7 NAME 'olcDbIdlExact' "
+		"DESC 'Keep large index slots exact instead of collapsing them to ranges' "
+		"EQUALITY booleanMatch "
+		"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
@@ -137,7 +149,7 @@ static ConfigOCs mdbocs[] = {
 		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
 		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ olcDbRtxnSize $ "
-		"olcDbMultival ) )",
+		"olcDbMultival $ olcDbIdlExact $ olcDbEntryCache ) )",
 			Cft_Database, mdbcfg+1 },
 	{ NULL, 0, NULL }
 };
@@ -191,7 +203,11 @@ mdb_checkpoint( void *ctx, void *arg )
 	return NULL;
 }
 
-/* reindex entries on the fly */
+/* reindex entries on the fly. Entries are indexed a chunk at a time,
+ * so that client writes can get in between, and the progress of each
+ * attribute is recorded in the same txn as the chunk. An interrupted
+ * build resumes from there when the database is opened again.
+ */
 static void *
 mdb_online_index( void *ctx, void *arg )
 {
@@ -206,83 +222,106 @@ mdb_online_index( void *ctx, void *arg )
 	MDB_cursor *curs;
 	MDB_val key, data;
 	MDB_txn *txn;
-	ID id;
+	ID id, next;
 	Entry *e;
-	int rc, getnext = 1;
-	int i;
+	int rc = 0, done = 0;
+	int i, n;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
 
 	op->o_bd = be;
 
-	id = 1;
 	key.mv_size = sizeof(ID);
 
-	while ( 1 ) {
+	while ( !done ) {
 		if ( slapd_shutdown )
 			break;
 
+		/* let a pending config change through between chunks */
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
+		if ( !( mdb->mi_flags & MDB_IS_OPEN ))
+			break;
+
+		/* indexes may have been added or deleted meanwhile, start
+		 * from the one that is furthest behind
+		 */
+		id = NOID;
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			AttrInfo *ai = mdb->mi_attrs[ i ];
+			if ( ai->ai_indexed && ai->ai_indexed < id
+				&& !( ai->ai_indexmask & MDB_INDEX_DELETING ))
+				id = ai->ai_indexed;
+		}
+		if ( id == NOID )
+			break;
+
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
 		if ( rc )
 			break;
+		mdb_attr_stat_begin( mdb );
 		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
 		if ( rc ) {
 			mdb_txn_abort( txn );
 			break;
 		}
-		if ( getnext ) {
-			getnext = 0;
+
+		for ( n = 0; n < MDB_INDEX_CHUNK; n++ ) {
 			key.mv_data = &id;
 			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
 			if ( rc ) {
-				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
+				if ( rc == MDB_NOTFOUND ) {
 					rc = 0;
+					done = 1;
+				}
 				break;
 			}
 			memcpy( &id, key.mv_data, sizeof( id ));
-		}
 
-		rc = mdb_id2entry( op, curs, id, &e );
+			rc = mdb_id2entry( op, curs, id, &e );
+			if ( rc )
+				break;
+			rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+			mdb_entry_return( op, e );
+			if ( rc )
+				break;
+			id++;
+		}
 		mdb_cursor_close( curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
-				id++;
-				getnext = 1;
+
+		for ( i = 0; rc == 0 && i < mdb->mi_nattrs; i++ ) {
+			AttrInfo *ai = mdb->mi_attrs[ i ];
+			if ( !ai->ai_indexed || ai->ai_indexmask & MDB_INDEX_DELETING )
 				continue;
-			}
-			break;
+			next = done ? 0 : ( ai->ai_indexed > id ? ai->ai_indexed : id );
+			rc = mdb_idxprog_put( mdb, txn, ai, next );
 		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
 		if ( rc == 0 ) {
-			rc = mdb_txn_commit( txn );
-			txn = NULL;
+			rc = mdb_attr_stat_commit( mdb, txn );
 		} else {
 			mdb_txn_abort( txn );
-			txn = NULL;
 		}
 		if ( rc ) {
 			Debug( LDAP_DEBUG_ANY,
 				LDAP_XSTRING(mdb_online_index) ": database %s: "
-				"txn_commit failed: %s (%d)\n",
-				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+				"indexing failed at ID %lu: %s (%d)\n",
+				be->be_suffix[0].bv_val, (unsigned long) id,
+				mdb_strerror(rc), rc );
 			break;
 		}
-		id++;
-		getnext = 1;
-	}
 
-	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
-		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
-			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
-		{
-			continue;
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			AttrInfo *ai = mdb->mi_attrs[ i ];
+			if ( !ai->ai_indexed || ai->ai_indexmask & MDB_INDEX_DELETING )
+				continue;
+			if ( done ) {
+				ai->ai_indexmask = ai->ai_newmask;
+				ai->ai_newmask = 0;
+				ai->ai_indexed = 0;
+			} else if ( ai->ai_indexed < id ) {
+				ai->ai_indexed = id;
+			}
 		}
-		mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
-		mdb->mi_attrs[ i ]->ai_newmask = 0;
 	}
 
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
@@ -294,6 +333,49 @@ mdb_online_index( void *ctx, void *arg )
 	return NULL;
 }
 
+/* Schedule the online indexer unless it's already pending. Set a long
+ * interval (10 hours) so that it only gets scheduled once.
+ */
+void
+mdb_index_task_start( BackendDB *be )
+{
+	struct mdb_info *mdb = be->be_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( !mdb->mi_index_task ) {
+		mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+			mdb_online_index, be,
+			LDAP_XSTRING(mdb_online_index), be->be_suffix[0].bv_val );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Record the new index builds right away, so that they are resumed
+ * even if slapd stops before the indexer gets to them
+ */
+static int
+mdb_index_progress_init( struct mdb_info *mdb )
+{
+	MDB_txn *txn;
+	int i, rc;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	if ( rc )
+		return rc;
+
+	for ( i = 0; rc == 0 && i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[ i ];
+		if ( ai->ai_indexed == 1 && !( ai->ai_indexmask & MDB_INDEX_DELETING ))
+			rc = mdb_idxprog_put( mdb, txn, ai, 1 );
+	}
+	if ( rc == 0 ) {
+		rc = mdb_txn_commit( txn );
+	} else {
+		mdb_txn_abort( txn );
+	}
+	return rc;
+}
+
 /* Cleanup loose ends after Modify completes */
 static int
 mdb_cf_cleanup( ConfigArgs *c )
@@ -325,12 +407,64 @@ mdb_cf_cleanup( ConfigArgs *c )
 	if ( mdb->mi_flags & MDB_OPEN_INDEX ) {
 		mdb->mi_flags ^= MDB_OPEN_INDEX;
 		rc = mdb_attr_dbs_open( c->be, NULL, &c->reply );
+		if ( rc == 0 )
+			rc = mdb_index_progress_init( mdb );
 		if ( rc )
 			rc = LDAP_OTHER;
 	}
 	return rc;
 }
 
+/* Slots that were kept exact stay so until the database is reloaded;
+ * turning idlexact on marks an open database as using them.
+ */
+static int
+mdb_cf_idlexact( ConfigArgs *c, int on )
+{
+	struct mdb_info *mdb = c->be->be_private;
+	MDB_txn *txn;
+	int rc;
+
+	if ( !on ) {
+		if ( mdb->mi_dbformat & MDB_FMT_IDLEXACT ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s: index slots "
+				"were kept exact, reload the database to turn this off",
+				c->argv[0] );
+			Debug( LDAP_DEBUG_CONFIG, "%s %s\n", c->log, c->cr_msg );
+			return 1;
+		}
+		mdb->mi_idl_exact = 0;
+		return 0;
+	}
+
+	if (( mdb->mi_flags & MDB_IS_OPEN ) &&
+		!( mdb->mi_dbformat & MDB_FMT_IDLEXACT ))
+	{
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+		if ( rc == 0 ) {
+			rc = mdb_dbformat_put( mdb, txn,
+				mdb->mi_dbformat | MDB_FMT_IDLEXACT );
+			if ( rc == 0 ) {
+				rc = mdb_txn_commit( txn );
+				/* not recorded after all */
+				if ( rc )
+					mdb->mi_dbformat &= ~MDB_FMT_IDLEXACT;
+			} else {
+				mdb_txn_abort( txn );
+			}
+		}
+		if ( rc ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s: cannot "
+				"record the database format: %s (%d)",
+				c->argv[0], mdb_strerror( rc ), rc );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg );
+			return 1;
+		}
+	}
+	mdb->mi_idl_exact = 1;
+	return 0;
+}
+
 static int
 mdb_cf_gen( ConfigArgs *c )
 {
@@ -382,6 +516,11 @@ mdb_cf_gen( ConfigArgs *c )
 				c->value_int = 1;
 			break;
 
+		case MDB_IDLEXACT:
+			if ( mdb->mi_idl_exact )
+				c->value_int = 1;
+			break;
+
 		case MDB_ENVFLAGS:
 			if ( mdb->mi_dbenv_flags ) {
 				mask_to_verbs( mdb_envflags, mdb->mi_dbenv_flags, &c->rvalue_vals );
@@ -398,6 +537,13 @@ mdb_cf_gen( ConfigArgs *c )
 			c->value_int = mdb->mi_search_stack_depth;
 			break;
 
+		case MDB_ECACHE:
+			if ( mdb->mi_ecache_max )
+				c->value_uint = mdb->mi_ecache_max;
+			else
+				rc = 1;
+			break;
+
 		case MDB_MAXREADERS:
 			c->value_int = mdb->mi_readers;
 			break;
@@ -453,6 +599,15 @@ mdb_cf_gen( ConfigArgs *c )
 			mdb->mi_dbenv_flags &= ~MDB_NOSYNC;
 			break;
 
+		case MDB_IDLEXACT:
+			rc = mdb_cf_idlexact( c, 0 );
+			break;
+
+		case MDB_ECACHE:
+			mdb_ecache_close( mdb );
+			mdb->mi_ecache_max = 0;
+			break;
+
 		case MDB_ENVFLAGS:
 			if ( c->valx == -1 ) {
 				int i;
@@ -715,6 +870,11 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_IDLEXACT:
+		if ( mdb_cf_idlexact( c, c->value_int ))
+			return 1;
+		break;
+
 	case MDB_DBNOSYNC:
 		if ( c->value_int )
 			mdb->mi_dbenv_flags |= MDB_NOSYNC;
@@ -760,22 +920,14 @@ mdb_cf_gen( ConfigArgs *c )
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			mdb->mi_flags |= MDB_OPEN_INDEX;
 			config_push_cleanup( c, mdb_cf_cleanup );
-			if ( !mdb->mi_index_task ) {
-				/* Start the task as soon as we finish here. Set a long
-				 * interval (10 hours) so that it only gets scheduled once.
-				 */
-				if ( c->be->be_suffix == NULL || BER_BVISNULL( &c->be->be_suffix[0] ) ) {
-					fprintf( stderr, "%s: "
-						"\"index\" must occur after \"suffix\".\n",
-						c->log );
-					return 1;
-				}
-				ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
-				mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
-					mdb_online_index, c->be,
-					LDAP_XSTRING(mdb_online_index), c->be->be_suffix[0].bv_val );
-				ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+			/* Start the task as soon as we finish here */
+			if ( c->be->be_suffix == NULL || BER_BVISNULL( &c->be->be_suffix[0] ) ) {
+				fprintf( stderr, "%s: "
+					"\"index\" must occur after \"suffix\".\n",
+					c->log );
+				return 1;
 			}
+			mdb_index_task_start( c->be );
 		}
 		break;
 
@@ -805,6 +957,15 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_ECACHE:
+		mdb->mi_ecache_max = c->value_uint;
+		/* the server is paused, nobody is using the old cache */
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			mdb_ecache_close( mdb );
+			mdb_ecache_open( mdb );
+		}
+		break;
+
 	case MDB_MULTIVAL:
 		rc = mdb_attr_multi_config( mdb, c->fname, c->lineno,
 			c->argc - 1, &c->argv[1], &c->reply);
@@ -363,6 +363,11 @@ mdb_delete( Operation *op, SlapReply *rs )
 	}
 
 	if( moi == &opinfo ) {
+		if( !op->o_noop && slap_precommit_play( op ) != LDAP_SUCCESS ) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "txn precommit failed";
+			goto return_results;
+		}
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
@@ -371,7 +376,7 @@ mdb_delete( Operation *op, SlapReply *rs )
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_attr_stat_commit( mdb, txn );
 		}
 		txn = NULL;
 	}
@@ -0,0 +1,428 @@
+/* ecache.c - ldap mdb back-end decoded entry cache */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "back-mdb.h"
+
+/* The cache keeps private copies of decoded entries, since the values
+ * of a decoded entry point into the map and are only valid for the
+ * lifetime of its txn. Cached entries are never modified; readers get
+ * their own copy in the op's memory context, laid out just like an
+ * entry from mdb_entry_decode().
+ *
+ * Each cached entry remembers the txn it was read in, and a reader may
+ * only use it if its own snapshot is at least that recent. Writers drop
+ * the entries they change and raise the stripe's write mark to their own
+ * txn ID, so readers on older snapshots can't put stale copies back in.
+ * Write txns never use the cache at all.
+ */
+
+#define ECACHE_STRIPES	32	/* must be a power of 2 */
+
+typedef struct ecache_node {
+	struct ecache_node *en_hnext;	/* hash chain */
+	struct ecache_node *en_prev, *en_next;	/* LRU, newest first */
+	ID en_id;
+	size_t en_txnid;	/* txn the entry was read in */
+	ber_len_t en_size;	/* size of the entry block */
+	int en_nattrs;
+	int en_nvals;
+	Entry *en_entry;
+} ecache_node;
+
+typedef struct ecache_stripe {
+	ldap_pvt_thread_mutex_t es_mutex;
+	ecache_node **es_hash;
+	unsigned es_hmask;
+	ecache_node *es_head, *es_tail;
+	unsigned es_count;
+	unsigned es_max;
+	size_t es_wtxnid;	/* newest writer that dropped an entry here */
+	unsigned long es_hits;
+	unsigned long es_misses;
+} ecache_stripe;
+
+struct mdb_ecache {
+	ecache_stripe ec_stripes[ECACHE_STRIPES];
+};
+
+#define ECACHE_STRIPE(ec, id)	(&(ec)->ec_stripes[(id) & (ECACHE_STRIPES-1)])
+#define ECACHE_SLOT(es, id)	((es)->es_hash[((id) / ECACHE_STRIPES) & (es)->es_hmask])
+
+/* Move a pointer from one copy of an entry block to another */
+#define ECACHE_RELOC(to, from, p)	\
+	((void *)((char *)(to) + ((char *)(p) - (char *)(from))))
+
+int
+mdb_ecache_open( struct mdb_info *mdb )
+{
+	struct mdb_ecache *ec;
+	MDB_envinfo mei;
+	unsigned i, max, hsize;
+
+	if ( !mdb->mi_ecache_max || ( slapMode & SLAP_TOOL_MODE ))
+		return 0;
+
+	/* Nothing can be running yet, so only entries read from now on
+	 * may be cached.
+	 */
+	mdb_env_info( mdb->mi_dbenv, &mei );
+
+	max = ( mdb->mi_ecache_max + ECACHE_STRIPES - 1 ) / ECACHE_STRIPES;
+	for ( hsize = 8; hsize < max; hsize <<= 1 );
+
+	ec = ch_calloc( 1, sizeof( struct mdb_ecache ));
+	for ( i = 0; i < ECACHE_STRIPES; i++ ) {
+		ecache_stripe *es = &ec->ec_stripes[i];
+
+		ldap_pvt_thread_mutex_init( &es->es_mutex );
+		es->es_hash = ch_calloc( hsize, sizeof( ecache_node * ));
+		es->es_hmask = hsize - 1;
+		es->es_max = max;
+		es->es_wtxnid = mei.me_last_txnid;
+	}
+	mdb->mi_ecache = ec;
+	return 0;
+}
+
+void
+mdb_ecache_close( struct mdb_info *mdb )
+{
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	ecache_node *en, *next;
+	unsigned i;
+
+	if ( !ec )
+		return;
+
+	mdb->mi_ecache = NULL;
+	for ( i = 0; i < ECACHE_STRIPES; i++ ) {
+		ecache_stripe *es = &ec->ec_stripes[i];
+
+		for ( en = es->es_head; en; en = next ) {
+			next = en->en_next;
+			ch_free( en );
+		}
+		ch_free( es->es_hash );
+		ldap_pvt_thread_mutex_destroy( &es->es_mutex );
+	}
+	ch_free( ec );
+}
+
+/* Returns the snapshot ID of a read txn, or 0 for a write txn */
+static size_t
+ecache_txnid( struct mdb_info *mdb, MDB_txn *txn )
+{
+	MDB_envinfo mei;
+	size_t txnid = mdb_txn_id( txn );
+
+	/* A write txn is always one past the last committed one */
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	if ( txnid > mei.me_last_txnid )
+		return 0;
+	return txnid;
+}
+
+static void
+ecache_lru_unlink( ecache_stripe *es, ecache_node *en )
+{
+	if ( en->en_prev )
+		en->en_prev->en_next = en->en_next;
+	else
+		es->es_head = en->en_next;
+	if ( en->en_next )
+		en->en_next->en_prev = en->en_prev;
+	else
+		es->es_tail = en->en_prev;
+}
+
+static void
+ecache_lru_push( ecache_stripe *es, ecache_node *en )
+{
+	en->en_prev = NULL;
+	en->en_next = es->es_head;
+	if ( es->es_head )
+		es->es_head->en_prev = en;
+	else
+		es->es_tail = en;
+	es->es_head = en;
+}
+
+/* Unlink a node from its hash chain and the LRU list */
+static void
+ecache_remove( ecache_stripe *es, ecache_node *en )
+{
+	ecache_node **prev;
+
+	for ( prev = &ECACHE_SLOT( es, en->en_id ); *prev != en;
+		prev = &(*prev)->en_hnext );
+	*prev = en->en_hnext;
+	ecache_lru_unlink( es, en );
+	es->es_count--;
+}
+
+static ecache_node *
+ecache_find( ecache_stripe *es, ID id )
+{
+	ecache_node *en;
+
+	for ( en = ECACHE_SLOT( es, id ); en; en = en->en_hnext ) {
+		if ( en->en_id == id )
+			break;
+	}
+	return en;
+}
+
+int
+mdb_ecache_get(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	Entry **e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	ecache_stripe *es;
+	ecache_node *en;
+	Attribute *a;
+	struct berval *bv, *bend;
+	Entry *x;
+	size_t txnid;
+	int i;
+
+	if ( !ec || !( txnid = ecache_txnid( mdb, txn )))
+		return MDB_NOTFOUND;
+
+	es = ECACHE_STRIPE( ec, id );
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	en = ecache_find( es, id );
+	/* newer than this reader's snapshot? */
+	if ( !en || en->en_txnid > txnid ) {
+		es->es_misses++;
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+		return MDB_NOTFOUND;
+	}
+	es->es_hits++;
+	if ( en != es->es_head ) {
+		ecache_lru_unlink( es, en );
+		ecache_lru_push( es, en );
+	}
+	x = op->o_tmpalloc( en->en_size, op->o_tmpmemctx );
+	AC_MEMCPY( x, en->en_entry, en->en_size );
+
+	x->e_private = x;
+	if ( en->en_nattrs ) {
+		x->e_attrs = (Attribute *)(x+1);
+		for ( i = 0, a = x->e_attrs; i < en->en_nattrs; i++, a++ ) {
+			a->a_vals = ECACHE_RELOC( x, en->en_entry, a->a_vals );
+			a->a_nvals = ECACHE_RELOC( x, en->en_entry, a->a_nvals );
+			a->a_next = a+1;
+		}
+		a[-1].a_next = NULL;
+		bv = (struct berval *)a;
+		for ( bend = bv + en->en_nvals; bv < bend; bv++ ) {
+			if ( bv->bv_val )
+				bv->bv_val = ECACHE_RELOC( x, en->en_entry, bv->bv_val );
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+
+	*e = x;
+	return 0;
+}
+
+void
+mdb_ecache_put(
+	Operation *op,
+	MDB_txn *txn,
+	Entry *e )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	ecache_stripe *es;
+	ecache_node *en, *old, *evict = NULL;
+	Attribute *a, *b;
+	struct berval *bptr;
+	char *ptr;
+	ber_len_t size, dlen = 0;
+	size_t txnid;
+	int i, nattrs = 0, nvals = 0;
+
+	if ( !ec || !( txnid = ecache_txnid( mdb, txn )))
+		return;
+
+	es = ECACHE_STRIPE( ec, e->e_id );
+	/* skip the copy if a writer already got here */
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	i = txnid < es->es_wtxnid;
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	if ( i )
+		return;
+
+	for ( a = e->e_attrs; a; a = a->a_next ) {
+		nattrs++;
+		nvals += a->a_numvals + 1;
+		for ( i = 0; i < a->a_numvals; i++ )
+			dlen += a->a_vals[i].bv_len + 1;
+		if ( a->a_nvals != a->a_vals ) {
+			nvals += a->a_numvals + 1;
+			for ( i = 0; i < a->a_numvals; i++ )
+				dlen += a->a_nvals[i].bv_len + 1;
+		}
+	}
+	size = sizeof( Entry ) + nattrs * sizeof( Attribute ) +
+		nvals * sizeof( struct berval ) + dlen;
+
+	en = ch_malloc( sizeof( ecache_node ) + size );
+	en->en_id = e->e_id;
+	en->en_txnid = txnid;
+	en->en_size = size;
+	en->en_nattrs = nattrs;
+	en->en_nvals = nvals;
+	en->en_entry = (Entry *)(en+1);
+	en->en_entry->e_id = e->e_id;
+	en->en_entry->e_ocflags = e->e_ocflags;
+	BER_BVZERO( &en->en_entry->e_name );
+	BER_BVZERO( &en->en_entry->e_nname );
+	BER_BVZERO( &en->en_entry->e_bv );
+	en->en_entry->e_private = NULL;
+	en->en_entry->e_attrs = nattrs ? (Attribute *)(en->en_entry+1) : NULL;
+
+	b = en->en_entry->e_attrs;
+	bptr = (struct berval *)(b + nattrs);
+	ptr = (char *)(bptr + nvals);
+	for ( a = e->e_attrs; a; a = a->a_next, b++ ) {
+		*b = *a;
+		b->a_flags |= SLAP_ATTR_DONT_FREE_DATA | SLAP_ATTR_DONT_FREE_VALS;
+		b->a_vals = bptr;
+		for ( i = 0; i < a->a_numvals; i++, bptr++ ) {
+			bptr->bv_len = a->a_vals[i].bv_len;
+			bptr->bv_val = ptr;
+			AC_MEMCPY( ptr, a->a_vals[i].bv_val, bptr->bv_len );
+			ptr += bptr->bv_len;
+			*ptr++ = '\0';
+		}
+		BER_BVZERO( bptr );
+		bptr++;
+		if ( a->a_nvals != a->a_vals ) {
+			b->a_nvals = bptr;
+			for ( i = 0; i < a->a_numvals; i++, bptr++ ) {
+				bptr->bv_len = a->a_nvals[i].bv_len;
+				bptr->bv_val = ptr;
+				AC_MEMCPY( ptr, a->a_nvals[i].bv_val, bptr->bv_len );
+				ptr += bptr->bv_len;
+				*ptr++ = '\0';
+			}
+			BER_BVZERO( bptr );
+			bptr++;
+		} else {
+			b->a_nvals = b->a_vals;
+		}
+		b->a_next = a->a_next ? b+1 : NULL;
+	}
+
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	if ( txnid < es->es_wtxnid ) {
+		evict = en;
+		goto done;
+	}
+	old = ecache_find( es, en->en_id );
+	if ( old ) {
+		/* another reader beat us to it */
+		if ( old->en_txnid >= txnid ) {
+			evict = en;
+			goto done;
+		}
+		ecache_remove( es, old );
+		old->en_next = evict;
+		evict = old;
+	}
+	en->en_hnext = ECACHE_SLOT( es, en->en_id );
+	ECACHE_SLOT( es, en->en_id ) = en;
+	ecache_lru_push( es, en );
+	es->es_count++;
+	while ( es->es_count > es->es_max ) {
+		old = es->es_tail;
+		ecache_remove( es, old );
+		old->en_next = evict;
+		evict = old;
+	}
+done:
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+
+	while ( evict ) {
+		en = evict;
+		evict = en->en_next;
+		ch_free( en );
+	}
+}
+
+/* Called by writers for each entry they change */
+void
+mdb_ecache_del(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	ID id )
+{
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	ecache_stripe *es;
+	ecache_node *en;
+	size_t txnid;
+
+	if ( !ec )
+		return;
+
+	txnid = mdb_txn_id( txn );
+	es = ECACHE_STRIPE( ec, id );
+	ldap_pvt_thread_mutex_lock( &es->es_mutex );
+	if ( es->es_wtxnid < txnid )
+		es->es_wtxnid = txnid;
+	en = ecache_find( es, id );
+	if ( en )
+		ecache_remove( es, en );
+	ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+
+	if ( en )
+		ch_free( en );
+}
+
+void
+mdb_ecache_counters(
+	struct mdb_info *mdb,
+	unsigned long *hits,
+	unsigned long *misses )
+{
+	struct mdb_ecache *ec = mdb->mi_ecache;
+	unsigned i;
+
+	*hits = 0;
+	*misses = 0;
+	if ( !ec )
+		return;
+
+	for ( i = 0; i < ECACHE_STRIPES; i++ ) {
+		ecache_stripe *es = &ec->ec_stripes[i];
+
+		ldap_pvt_thread_mutex_lock( &es->es_mutex );
+		*hits += es->es_hits;
+		*misses += es->es_misses;
+		ldap_pvt_thread_mutex_unlock( &es->es_mutex );
+	}
+}
@@ -0,0 +1,245 @@
+/* extra.c - auxiliary sub-databases for overlays */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+#include <ac/errno.h>
+
+#include "back-mdb.h"
+
+/* Overlays keep their private records in named sub-databases of the
+ * environment, see bi_aux_open in slap.h. An aux handle points into
+ * mi_auxdbis; the handles stay valid until the database is closed.
+ */
+
+/* Open (and create) a named sub-database */
+int
+mdb_aux_open( BackendDB *be, const char *name, void **aux )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_txn *txn;
+	MDB_dbi d;
+	int i, slot = -1, rc, flags = 0;
+
+	if ( !( mdb->mi_flags & MDB_IS_OPEN ))
+		return LDAP_UNAVAILABLE;
+
+	for ( i=0; i<MDB_AUXDBS; i++ ) {
+		if ( !mdb->mi_auxnames[i] ) {
+			if ( slot < 0 )
+				slot = i;
+		} else if ( !strcmp( mdb->mi_auxnames[i], name )) {
+			*aux = &mdb->mi_auxdbis[i];
+			return LDAP_SUCCESS;
+		}
+	}
+	if ( slot < 0 ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_aux_open) ": database \"%s\": "
+			"cannot open \"%s\": no more than %d allowed.\n",
+			be->be_suffix[0].bv_val, name, MDB_AUXDBS );
+		return LDAP_OTHER;
+	}
+
+	if ( slapMode & SLAP_TOOL_READONLY )
+		flags = MDB_RDONLY;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, flags, &txn );
+	if ( rc == 0 ) {
+		rc = mdb_dbi_open( txn, name, flags ? 0 : MDB_CREATE, &d );
+		if ( rc == 0 )
+			rc = mdb_txn_commit( txn );
+		else
+			mdb_txn_abort( txn );
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_aux_open) ": database \"%s\": "
+			"cannot open \"%s\": %s (%d).\n",
+			be->be_suffix[0].bv_val, name, mdb_strerror(rc), rc );
+		return LDAP_OTHER;
+	}
+	mdb->mi_auxdbis[slot] = d;
+	mdb->mi_auxnames[slot] = ch_strdup( name );
+	*aux = &mdb->mi_auxdbis[slot];
+	return LDAP_SUCCESS;
+}
+
+void
+mdb_aux_close( struct mdb_info *mdb )
+{
+	int i;
+
+	for ( i=0; i<MDB_AUXDBS; i++ ) {
+		if ( mdb->mi_auxnames[i] ) {
+			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_auxdbis[i] );
+			ch_free( mdb->mi_auxnames[i] );
+			mdb->mi_auxnames[i] = NULL;
+		}
+	}
+}
+
+/* The write txn op holds in this database, if any */
+static MDB_txn *
+mdb_aux_optxn( Operation *op, struct mdb_info *mdb )
+{
+	OpExtra *oex;
+
+	if ( op ) {
+		LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+			if ( oex->oe_key == mdb ) {
+				mdb_op_info *moi = (mdb_op_info *)oex;
+				if ( !( moi->moi_flag & MOI_READER ))
+					return moi->moi_txn;
+				break;
+			}
+		}
+	}
+	return NULL;
+}
+
+int
+mdb_aux_put( BackendDB *be, Operation *op, void *aux,
+	struct berval *bkey, struct berval *bdata )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_dbi dbi = *(MDB_dbi *)aux;
+	MDB_txn *txn, *own = NULL;
+	MDB_val key, data;
+	int rc;
+
+	txn = mdb_aux_optxn( op, mdb );
+	if ( !txn ) {
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &own );
+		if ( rc )
+			goto fail;
+		txn = own;
+	}
+
+	key.mv_data = bkey->bv_val;
+	key.mv_size = bkey->bv_len;
+	if ( bdata ) {
+		data.mv_data = bdata->bv_val;
+		data.mv_size = bdata->bv_len;
+		rc = mdb_put( txn, dbi, &key, &data, 0 );
+	} else {
+		rc = mdb_del( txn, dbi, &key, NULL );
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+	}
+
+	if ( own ) {
+		if ( rc )
+			mdb_txn_abort( own );
+		else
+			rc = mdb_txn_commit( own );
+	}
+	if ( rc == 0 )
+		return LDAP_SUCCESS;
+
+fail:
+	Debug( LDAP_DEBUG_ANY,
+		LDAP_XSTRING(mdb_aux_put) ": database \"%s\": "
+		"write failed: %s (%d).\n",
+		be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+	return LDAP_OTHER;
+}
+
+int
+mdb_aux_walk( BackendDB *be, Operation *op, void *aux,
+	struct berval *from, BI_aux_func *func, void *arg )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_dbi dbi = *(MDB_dbi *)aux;
+	mdb_op_info opinfo = {{{ 0 }}}, *moi = &opinfo;
+	MDB_txn *txn, *own = NULL;
+	MDB_cursor *mc;
+	MDB_cursor_op next = MDB_FIRST;
+	MDB_val key, data;
+	struct berval bkey, bdata;
+	int rc, act, writable = 1;
+
+	if ( !op ) {
+		/* the calling thread may already own a reader slot */
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &own );
+		if ( rc )
+			goto fail;
+		txn = own;
+	} else if ( !( txn = mdb_aux_optxn( op, mdb ))) {
+		rc = mdb_opinfo_get( op, mdb, 1, &moi );
+		if ( rc )
+			goto fail;
+		txn = moi->moi_txn;
+		writable = 0;
+	}
+
+	rc = mdb_cursor_open( txn, dbi, &mc );
+	if ( rc == 0 ) {
+		if ( from ) {
+			key.mv_data = from->bv_val;
+			key.mv_size = from->bv_len;
+			next = MDB_SET_RANGE;
+		}
+		while (( rc = mdb_cursor_get( mc, &key, &data, next )) == 0 ) {
+			next = MDB_NEXT;
+			bkey.bv_val = key.mv_data;
+			bkey.bv_len = key.mv_size;
+			bdata.bv_val = data.mv_data;
+			bdata.bv_len = data.mv_size;
+			act = func( arg, &bkey, &bdata );
+			if ( act & SLAP_AUX_DELETE ) {
+				if ( !writable ) {
+					rc = EINVAL;
+					break;
+				}
+				/* the cursor moves on to the next record */
+				rc = mdb_cursor_del( mc, 0 );
+				if ( rc )
+					break;
+			}
+			if ( act & SLAP_AUX_STOP )
+				break;
+		}
+		mdb_cursor_close( mc );
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+
+	if ( own ) {
+		if ( rc )
+			mdb_txn_abort( own );
+		else
+			rc = mdb_txn_commit( own );
+	} else if ( !writable ) {
+		if ( moi == &opinfo ) {
+			mdb_txn_reset( moi->moi_txn );
+			LDAP_SLIST_REMOVE( &op->o_extra, &moi->moi_oe, OpExtra, oe_next );
+		} else {
+			moi->moi_ref--;
+		}
+	}
+	if ( rc == 0 )
+		return LDAP_SUCCESS;
+
+fail:
+	Debug( LDAP_DEBUG_ANY,
+		LDAP_XSTRING(mdb_aux_walk) ": database \"%s\": "
+		"walk failed: %s (%d).\n",
+		be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+	return LDAP_OTHER;
+}
@@ -240,7 +240,7 @@ mdb_filter_candidates(
 out:
 	Debug( LDAP_DEBUG_FILTER,
 		"<= mdb_filter_candidates: id=%ld first=%ld last=%ld\n",
-		(long) ids[0],
+		(long) MDB_IDL_N( ids ),
 		(long) MDB_IDL_FIRST( ids ),
 		(long) MDB_IDL_LAST( ids ) );
 
@@ -300,7 +300,7 @@ comp_list_candidates(
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
 			"<= comp_list_candidates: id=%ld first=%ld last=%ld\n",
-			(long) ids[0],
+			(long) MDB_IDL_N( ids ),
 			(long) MDB_IDL_FIRST(ids),
 			(long) MDB_IDL_LAST(ids) );
 
@@ -328,6 +328,7 @@ comp_equality_candidates (
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
+	AttrInfo *partial;
 	struct berval *keys = NULL;
 	MatchingRule *mr = mra->ma_rule;
 	Syntax *sat_syntax;
@@ -358,9 +359,9 @@ comp_equality_candidates (
 		return 0;
 
 	rc = mdb_index_param( op->o_bd, mra->ma_desc, LDAP_FILTER_EQUALITY,
-			&dbi, &mask, &prefix );
+			&dbi, &mask, &prefix, &partial );
 
-	if( rc != LDAP_SUCCESS ) {
+	if( rc != LDAP_SUCCESS || partial ) {
 		return 0;
 	}
 
@@ -417,7 +418,7 @@ comp_equality_candidates (
 
 	Debug( LDAP_DEBUG_TRACE,
 			"<= comp_equality_candidates: id=%ld, first=%ld, last=%ld\n",
-			(long) ids[0],
+			(long) MDB_IDL_N( ids ),
 			(long) MDB_IDL_FIRST(ids),
 			(long) MDB_IDL_LAST(ids) );
 	return( rc );
@@ -558,6 +559,176 @@ base:
 	return 0;
 }
 
+/* The components of an AND filter are evaluated cheapest first, using
+ * the number of IDs stored under their index keys as the estimate.
+ * Once the candidate list is short, fetching and intersecting a large
+ * slot costs more than letting test_filter() check each candidate, so
+ * the remaining components are left to it.
+ */
+
+/* Candidate lists this short are never narrowed any further */
+#define	PLAN_TEST_MAX	32
+
+/* Testing one candidate entry costs about as much as fetching and
+ * intersecting this many IDs
+ */
+#define	PLAN_ENTRY_COST	64
+
+typedef struct filter_plan {
+	Filter	*fp_filter;
+	ID		fp_est;
+} filter_plan;
+
+static ID
+keys_estimate(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttributeDescription *desc,
+	int ftype,
+	MatchingRule *mr,
+	void *assertion )
+{
+	MDB_dbi	dbi;
+	int i;
+	int rc;
+	slap_mask_t mask;
+	struct berval prefix = {0, NULL};
+	AttrInfo *partial;
+	struct berval *keys = NULL;
+	ID est = NOID, n;
+
+	rc = mdb_index_param( op->o_bd, desc, ftype, &dbi, &mask, &prefix, &partial );
+	if ( rc != LDAP_SUCCESS || prefix.bv_val == NULL || partial ) {
+		return NOID;
+	}
+
+	if ( ftype == LDAP_FILTER_PRESENT ) {
+		rc = mdb_key_count( op->o_bd, rtxn, dbi, &prefix, &n );
+		if ( rc == MDB_NOTFOUND ) {
+			est = 0;
+		} else if ( rc == 0 ) {
+			est = n;
+		}
+		return est;
+	}
+
+	if( !mr || !mr->smr_filter ) {
+		return NOID;
+	}
+
+	rc = (mr->smr_filter)(
+		ftype,
+		mask,
+		desc->ad_type->sat_syntax,
+		mr,
+		&prefix,
+		assertion,
+		&keys, op->o_tmpmemctx );
+
+	if( rc != LDAP_SUCCESS || keys == NULL ) {
+		return NOID;
+	}
+
+	/* the keys are intersected, so the smallest one bounds the result */
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		rc = mdb_key_count( op->o_bd, rtxn, dbi, &keys[i], &n );
+		if ( rc == MDB_NOTFOUND ) {
+			est = 0;
+			break;
+		} else if ( rc != 0 ) {
+			break;
+		}
+		if ( n < est ) {
+			est = n;
+		}
+	}
+
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	return est;
+}
+
+/* Estimate how many candidates a filter yields, NOID if unknown */
+static ID
+filter_estimate(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter *f )
+{
+	Filter	*f2;
+	ID est, n;
+	MatchingRule *mr;
+
+	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
+		return 0;
+	}
+
+	switch ( f->f_choice ) {
+	case SLAPD_FILTER_COMPUTED:
+		if ( f->f_result == LDAP_COMPARE_FALSE ||
+			f->f_result == SLAPD_COMPARE_UNDEFINED )
+			return 0;
+		return NOID;
+
+	case LDAP_FILTER_PRESENT:
+		if ( f->f_desc == slap_schema.si_ad_objectClass ) {
+			return NOID;
+		}
+		return keys_estimate( op, rtxn, f->f_desc, LDAP_FILTER_PRESENT,
+			NULL, NULL );
+
+	case LDAP_FILTER_EQUALITY:
+		if ( f->f_av_desc == slap_schema.si_ad_entryDN ) {
+			return 1;
+		}
+#ifdef LDAP_COMP_MATCH
+		if ( is_aliased_attribute && is_aliased_attribute( f->f_av_desc ) ) {
+			return NOID;
+		}
+#endif
+		return keys_estimate( op, rtxn, f->f_av_desc, LDAP_FILTER_EQUALITY,
+			f->f_av_desc->ad_type->sat_equality, &f->f_av_value );
+
+	case LDAP_FILTER_APPROX:
+		mr = f->f_av_desc->ad_type->sat_approx;
+		if ( !mr ) {
+			mr = f->f_av_desc->ad_type->sat_equality;
+		}
+		return keys_estimate( op, rtxn, f->f_av_desc, LDAP_FILTER_APPROX,
+			mr, &f->f_av_value );
+
+	case LDAP_FILTER_SUBSTRINGS:
+		return keys_estimate( op, rtxn, f->f_sub_desc, LDAP_FILTER_SUBSTRINGS,
+			f->f_sub_desc->ad_type->sat_substr, f->f_sub );
+
+	case LDAP_FILTER_AND:
+		est = NOID;
+		for ( f2 = f->f_and; f2 != NULL; f2 = f2->f_next ) {
+			n = filter_estimate( op, rtxn, f2 );
+			if ( n < est ) {
+				est = n;
+			}
+		}
+		return est;
+
+	case LDAP_FILTER_OR:
+		est = 0;
+		for ( f2 = f->f_or; f2 != NULL; f2 = f2->f_next ) {
+			n = filter_estimate( op, rtxn, f2 );
+			if ( n >= NOID - est ) {
+				return NOID;
+			}
+			est += n;
+		}
+		return est;
+
+	default:
+		/* inequality ranges, NOT and extensible filters are
+		 * not worth guessing about
+		 */
+		return NOID;
+	}
+}
+
 static int
 list_candidates(
 	Operation *op,
@@ -569,15 +740,46 @@ list_candidates(
 	ID *save )
 {
 	int rc = 0;
+	int i, j, nplan = 0, first = 1;
 	Filter	*f;
+	filter_plan *plan, fp;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype );
+
 	for ( f = flist; f != NULL; f = f->f_next ) {
-		/* ignore precomputed scopes */
+		nplan++;
+	}
+	plan = op->o_tmpalloc( nplan * sizeof(filter_plan), op->o_tmpmemctx );
+
+	nplan = 0;
+	for ( f = flist; f != NULL; f = f->f_next ) {
+		/* precomputed scopes are already in ids */
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
 		     f->f_result == LDAP_SUCCESS ) {
+			first = 0;
 			continue;
 		}
+		fp.fp_filter = f;
+		fp.fp_est = NOID;
+		plan[nplan++] = fp;
+	}
+
+	/* order the AND components by estimate, keeping the
+	 * client's order among equals
+	 */
+	if ( ftype == LDAP_FILTER_AND && nplan > 1 ) {
+		for ( i = 0; i < nplan; i++ ) {
+			fp = plan[i];
+			fp.fp_est = filter_estimate( op, rtxn, fp.fp_filter );
+			for ( j = i; j > 0 && plan[j-1].fp_est > fp.fp_est; j-- ) {
+				plan[j] = plan[j-1];
+			}
+			plan[j] = fp;
+		}
+	}
+
+	for ( i = 0; i < nplan; i++ ) {
+		f = plan[i].fp_filter;
 		MDB_IDL_ZERO( save );
 		rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
 			save+MDB_idl_um_size );
@@ -592,26 +794,48 @@ list_candidates(
 
 		
 		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_intersection( ids, save );
 			}
+			first = 0;
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
+
+			/* Leave the rest to test_filter() if that is cheaper,
+			 * unless it would exceed the unchecked limit.
+			 */
+			if ( i + 1 < nplan && !MDB_IDL_IS_RANGE( ids ) &&
+				!MDB_IDL_IS_RUNS( ids ) &&
+				( ids[0] <= PLAN_TEST_MAX ||
+				plan[i+1].fp_est / PLAN_ENTRY_COST > ids[0] ) &&
+				!( op->ors_limit &&
+				op->ors_limit->lms_s_unchecked != -1 &&
+				ids[0] > (unsigned) op->ors_limit->lms_s_unchecked ))
+			{
+				Debug( LDAP_DEBUG_FILTER,
+					"mdb_list_candidates: %ld candidates, "
+					"skipping %d components\n",
+					(long) ids[0], nplan - i - 1 );
+				break;
+			}
 		} else {
-			if ( f == flist ) {
+			if ( first ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_union( ids, save );
 			}
+			first = 0;
 		}
 	}
 
+	op->o_tmpfree( plan, op->o_tmpmemctx );
+
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
 			"<= mdb_list_candidates: id=%ld first=%ld last=%ld\n",
-			(long) ids[0],
+			(long) MDB_IDL_N( ids ),
 			(long) MDB_IDL_FIRST(ids),
 			(long) MDB_IDL_LAST(ids) );
 
@@ -624,6 +848,52 @@ list_candidates(
 	return rc;
 }
 
+/* An index that is still being built online only covers the IDs
+ * below the indexer's progress as seen by this txn, so every ID from
+ * there up is a candidate as well.
+ */
+static void
+partial_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	AttrInfo *ai,
+	ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_idxprog ip;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	ID first = 1, run[3];
+	int rc;
+
+	rc = mdb_idxprog_get( mdb, rtxn, ai, &ip );
+	if ( rc == 0 && ip.ip_newmask == ai->ai_newmask )
+		first = ip.ip_next;
+
+	rc = mdb_cursor_open( rtxn, mdb->mi_id2entry, &mc );
+	if ( rc ) {
+		MDB_IDL_ALL( ids );
+		return;
+	}
+	rc = mdb_cursor_get( mc, &key, &data, MDB_LAST );
+	mdb_cursor_close( mc );
+	if ( rc ) {
+		/* no entries at all */
+		return;
+	}
+	memcpy( &run[2], key.mv_data, sizeof(ID) );
+	if ( first > run[2] )
+		return;
+
+	Debug( LDAP_DEBUG_TRACE,
+		"<= mdb_partial_candidates: (%s) IDs %ld to %ld not indexed yet\n",
+		ai->ai_desc->ad_cname.bv_val, (long) first, (long) run[2] );
+
+	run[0] = MDB_IDL_RUNFLAG | 1;
+	run[1] = first;
+	mdb_idl_union( ids, run );
+}
+
 static int
 presence_candidates(
 	Operation *op,
@@ -635,6 +905,7 @@ presence_candidates(
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
+	AttrInfo *partial;
 
 	Debug( LDAP_DEBUG_TRACE, "=> mdb_presence_candidates (%s)\n",
 			desc->ad_cname.bv_val );
@@ -646,7 +917,7 @@ presence_candidates(
 	}
 
 	rc = mdb_index_param( op->o_bd, desc, LDAP_FILTER_PRESENT,
-		&dbi, &mask, &prefix );
+		&dbi, &mask, &prefix, &partial );
 
 	if( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		/* not indexed */
@@ -684,9 +955,12 @@ presence_candidates(
 		goto done;
 	}
 
+	if ( partial )
+		partial_candidates( op, rtxn, partial, ids );
+
 	Debug(LDAP_DEBUG_TRACE,
 		"<= mdb_presence_candidates: id=%ld first=%ld last=%ld\n",
-		(long) ids[0],
+		(long) MDB_IDL_N( ids ),
 		(long) MDB_IDL_FIRST(ids),
 		(long) MDB_IDL_LAST(ids) );
 
@@ -707,6 +981,7 @@ equality_candidates(
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
+	AttrInfo *partial;
 	struct berval *keys = NULL;
 	MatchingRule *mr;
 
@@ -731,7 +1006,7 @@ equality_candidates(
 	MDB_IDL_ALL( ids );
 
 	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
-		&dbi, &mask, &prefix );
+		&dbi, &mask, &prefix, &partial );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_FILTER,
@@ -816,9 +1091,12 @@ equality_candidates(
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( partial && rc == 0 )
+		partial_candidates( op, rtxn, partial, ids );
+
 	Debug( LDAP_DEBUG_TRACE,
 		"<= mdb_equality_candidates: id=%ld, first=%ld, last=%ld\n",
-		(long) ids[0],
+		(long) MDB_IDL_N( ids ),
 		(long) MDB_IDL_FIRST(ids),
 		(long) MDB_IDL_LAST(ids) );
 	return( rc );
@@ -838,6 +1116,7 @@ approx_candidates(
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
+	AttrInfo *partial;
 	struct berval *keys = NULL;
 	MatchingRule *mr;
 
@@ -847,7 +1126,7 @@ approx_candidates(
 	MDB_IDL_ALL( ids );
 
 	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_APPROX,
-		&dbi, &mask, &prefix );
+		&dbi, &mask, &prefix, &partial );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_FILTER,
@@ -937,8 +1216,11 @@ approx_candidates(
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( partial && rc == 0 )
+		partial_candidates( op, rtxn, partial, ids );
+
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_approx_candidates %ld, first=%ld, last=%ld\n",
-		(long) ids[0],
+		(long) MDB_IDL_N( ids ),
 		(long) MDB_IDL_FIRST(ids),
 		(long) MDB_IDL_LAST(ids) );
 	return( rc );
@@ -957,6 +1239,7 @@ substring_candidates(
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
+	AttrInfo *partial;
 	struct berval *keys = NULL;
 	MatchingRule *mr;
 
@@ -966,7 +1249,7 @@ substring_candidates(
 	MDB_IDL_ALL( ids );
 
 	rc = mdb_index_param( op->o_bd, sub->sa_desc, LDAP_FILTER_SUBSTRINGS,
-		&dbi, &mask, &prefix );
+		&dbi, &mask, &prefix, &partial );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_FILTER,
@@ -1052,8 +1335,11 @@ substring_candidates(
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( partial && rc == 0 )
+		partial_candidates( op, rtxn, partial, ids );
+
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_substring_candidates: %ld, first=%ld, last=%ld\n",
-		(long) ids[0],
+		(long) MDB_IDL_N( ids ),
 		(long) MDB_IDL_FIRST(ids),
 		(long) MDB_IDL_LAST(ids) );
 	return( rc );
@@ -1072,6 +1358,7 @@ inequality_candidates(
 	int rc;
 	slap_mask_t mask;
 	struct berval prefix = {0, NULL};
+	AttrInfo *partial;
 	struct berval *keys = NULL;
 	MatchingRule *mr;
 	MDB_cursor *cursor = NULL;
@@ -1082,7 +1369,7 @@ inequality_candidates(
 	MDB_IDL_ALL( ids );
 
 	rc = mdb_index_param( op->o_bd, ava->aa_desc, LDAP_FILTER_EQUALITY,
-		&dbi, &mask, &prefix );
+		&dbi, &mask, &prefix, &partial );
 
 	if ( rc == LDAP_INAPPROPRIATE_MATCHING ) {
 		Debug( LDAP_DEBUG_FILTER,
@@ -1164,9 +1451,12 @@ inequality_candidates(
 	}
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( partial && rc == 0 )
+		partial_candidates( op, rtxn, partial, ids );
+
 	Debug( LDAP_DEBUG_TRACE,
 		"<= mdb_inequality_candidates: id=%ld, first=%ld, last=%ld\n",
-		(long) ids[0],
+		(long) MDB_IDL_N( ids ),
 		(long) MDB_IDL_FIRST(ids),
 		(long) MDB_IDL_LAST(ids) );
 	return( rc );
@@ -276,6 +276,8 @@ static int mdb_id2entry_put(
 
 	/* We only store rdns, and they go in the dn2id database. */
 
+	mdb_ecache_del( mdb, txn, e->e_id );
+
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
@@ -404,6 +406,9 @@ int mdb_id2entry(
 
 	*e = NULL;
 
+	if ( mdb_ecache_get( op, mdb_cursor_txn( mc ), id, e ) == 0 )
+		return MDB_SUCCESS;
+
 	key.mv_data = &id;
 	key.mv_size = sizeof(ID);
 
@@ -446,13 +451,15 @@ int mdb_id2entry(
 		rc = MDB_NOTFOUND;
 	if ( rc ) return rc;
 
-	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, e );
+	rc = mdb_entry_decode( op, mdb_cursor_txn( mc ), &data, id, NULL, e );
 	if ( rc ) return rc;
 
 	(*e)->e_id = id;
 	(*e)->e_name.bv_val = NULL;
 	(*e)->e_nname.bv_val = NULL;
 
+	mdb_ecache_put( op, mdb_cursor_txn( mc ), *e );
+
 	return rc;
 }
 
@@ -470,6 +477,8 @@ int mdb_id2entry_delete(
 	key.mv_data = &e->e_id;
 	key.mv_size = sizeof(ID);
 
+	mdb_ecache_del( mdb, tid, e->e_id );
+
 	/* delete from database */
 	rc = mdb_del( tid, dbi, &key, NULL );
 	if (rc)
@@ -752,6 +761,8 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 				if (rc) {
 					Debug( LDAP_DEBUG_ANY, "mdb_opinfo_get: err %s(%d)\n",
 						mdb_strerror(rc), rc );
+				} else {
+					mdb_attr_stat_begin( mdb );
 				}
 				return rc;
 			}
@@ -826,7 +837,7 @@ int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 		}
 		return rc;
 	case SLAP_TXN_COMMIT:
-		rc = mdb_txn_commit( moi->moi_txn );
+		rc = mdb_attr_stat_commit( mdb, moi->moi_txn );
 		if ( rc )
 			mdb->mi_numads = 0;
 		op->o_tmpfree( moi, op->o_tmpmemctx );
@@ -1007,9 +1018,23 @@ static int mdb_entry_encode(Operation *op, Entry *e, MDB_val *data, Ecount *eh)
  * Note: everything is stored in a single contiguous block, so
  * you can not free individual attributes or names from this
  * structure. Attempting to do so will likely corrupt memory.
+ *
+ * If ads is not NULL, only attributes that are subtypes of one of
+ * the listed descriptions are decoded, and the others are skipped.
  */
 
-int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e)
+static int
+mdb_ad_wanted( AttributeDescription *ad, AttributeDescription **ads )
+{
+	for ( ; *ads; ads++ ) {
+		if ( is_ad_subtype( ad, *ads ))
+			return 1;
+	}
+	return 0;
+}
+
+int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id,
+	AttributeDescription **ads, Entry **e)
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 	int i, j, nattrs, nvals;
@@ -1068,6 +1093,18 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 			a->a_numvals ^= MDB_AT_NVALS;
 			have_nval = 1;
 		}
+		if (ads && !mdb_ad_wanted(a->a_desc, ads)) {
+			/* values of a multi attr are not in the blob */
+			if (!multi) {
+				for (i=0; i<a->a_numvals; i++)
+					ptr += *lp++ + 1;
+				if (have_nval) {
+					for (i=0; i<a->a_numvals; i++)
+						ptr += *lp++ + 1;
+				}
+			}
+			continue;
+		}
 		a->a_vals = bptr;
 		if (multi) {
 			if (!mvc) {
@@ -1124,7 +1161,10 @@ int mdb_entry_decode(Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **
 		a->a_next = a+1;
 		a = a->a_next;
 	}
-	a[-1].a_next = NULL;
+	if (a == x->e_attrs)
+		x->e_attrs = NULL;
+	else
+		a[-1].a_next = NULL;
 done:
 	Debug(LDAP_DEBUG_TRACE, "<= mdb_entry_decode\n" );
 	*e = x;
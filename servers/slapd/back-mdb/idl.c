@@ -21,6 +21,7 @@
 
 #include "back-mdb.h"
 #include "idl.h"
+#include "idlsimd.h"
 
 unsigned int MDB_idl_logn = MDB_IDL_LOGN;
 unsigned int MDB_idl_db_size = 1 << MDB_IDL_LOGN;
@@ -37,6 +38,13 @@ static void idl_check( ID *ids )
 {
 	if( MDB_IDL_IS_RANGE( ids ) ) {
 		assert( MDB_IDL_RANGE_FIRST(ids) <= MDB_IDL_RANGE_LAST(ids) );
+	} else if( MDB_IDL_IS_RUNS( ids ) ) {
+		ID i;
+		for( i=1; i <= MDB_IDL_NRUNS( ids ); i++ ) {
+			assert( MDB_IDL_RUN_LO( ids, i ) <= MDB_IDL_RUN_HI( ids, i ) );
+			if ( i > 1 )
+				assert( MDB_IDL_RUN_LO( ids, i ) > MDB_IDL_RUN_HI( ids, i-1 ) + 1 );
+		}
 	} else {
 		ID i;
 		for( i=1; i < ids[0]; i++ ) {
@@ -54,6 +62,20 @@ static void idl_dump( ID *ids )
 			(long) MDB_IDL_RANGE_FIRST( ids ),
 			(long) MDB_IDL_RANGE_LAST( ids ) );
 
+	} else if( MDB_IDL_IS_RUNS( ids ) ) {
+		ID i;
+		Debug( LDAP_DEBUG_ANY, "IDL: runs %ld", (long) MDB_IDL_NRUNS( ids ) );
+
+		for( i=1; i<=MDB_IDL_NRUNS( ids ); i++ ) {
+			if( i % 8 == 1 ) {
+				Debug( LDAP_DEBUG_ANY, "\n" );
+			}
+			Debug( LDAP_DEBUG_ANY, "  %02lx-%02lx",
+				(long) MDB_IDL_RUN_LO( ids, i ), (long) MDB_IDL_RUN_HI( ids, i ) );
+		}
+
+		Debug( LDAP_DEBUG_ANY, "\n" );
+
 	} else {
 		ID i;
 		Debug( LDAP_DEBUG_ANY, "IDL: size %ld", (long) ids[0] );
@@ -84,62 +106,183 @@ void mdb_idl_reset()
 	MDB_idl_um_max = MDB_idl_um_size - 1;
 }
 
-unsigned mdb_idl_search( ID *ids, ID id )
+ID mdb_idl_runs_count( ID *ids )
+{
+	ID i, n = 0;
+
+	for ( i = 1; i <= MDB_IDL_NRUNS( ids ); i++ )
+		n += MDB_IDL_RUN_HI( ids, i ) - MDB_IDL_RUN_LO( ids, i ) + 1;
+	return n;
+}
+
+unsigned mdb_idl_runs_search( ID *ids, ID id )
 {
-#define IDL_BINARY_SEARCH 1
-#ifdef IDL_BINARY_SEARCH
 	/*
-	 * binary search of id in ids
-	 * if found, returns position of id
-	 * if not found, returns first postion greater than id
+	 * binary search of id in the run upper bounds
+	 * returns the first run whose upper bound is >= id
 	 */
 	unsigned base = 0;
-	unsigned cursor = 1;
-	int val = 0;
-	unsigned n = ids[0];
-
-#if IDL_DEBUG > 0
-	idl_check( ids );
-#endif
+	unsigned n = MDB_IDL_NRUNS( ids );
 
 	while( 0 < n ) {
 		unsigned pivot = n >> 1;
-		cursor = base + pivot + 1;
-		val = IDL_CMP( id, ids[cursor] );
-
-		if( val < 0 ) {
-			n = pivot;
+		unsigned cursor = base + pivot + 1;
 
-		} else if ( val > 0 ) {
+		if( MDB_IDL_RUN_HI( ids, cursor ) < id ) {
 			base = cursor;
 			n -= pivot + 1;
-
 		} else {
-			return cursor;
+			n = pivot;
 		}
 	}
-	
-	if( val > 0 ) {
-		++cursor;
+	return base + 1;
+}
+
+/* Accumulates sorted runs of IDs into a buffer laid out as a run-length
+ * IDL, keeping track of how many IDs they cover so that the result can
+ * be stored in the smallest exact form that fits.
+ */
+typedef struct idl_runs {
+	ID *ir_ids;
+	ID ir_max;		/* number of runs that fit in ir_ids */
+	ID ir_count;	/* number of IDs covered so far */
+	ID ir_last;		/* highest ID seen, once we overflowed */
+	int ir_over;
+} idl_runs;
+
+static void
+idl_runs_init( idl_runs *ir, ID *buf )
+{
+	ir->ir_ids = buf;
+	ir->ir_ids[0] = 0;
+	ir->ir_max = ( MDB_idl_um_size - 1 ) / 2;
+	ir->ir_count = 0;
+	ir->ir_last = 0;
+	ir->ir_over = 0;
+}
+
+/* Runs must be added in ascending order of their lower bound */
+static void
+idl_runs_add( idl_runs *ir, ID lo, ID hi )
+{
+	ID *ids = ir->ir_ids;
+	ID n = ids[0];
+
+	if ( ir->ir_over ) {
+		if ( hi > ir->ir_last )
+			ir->ir_last = hi;
+		return;
 	}
-	return cursor;
 
-#else
-	/* (reverse) linear search */
-	int i;
+	if ( n && lo <= MDB_IDL_RUN_HI( ids, n ) + 1 ) {
+		/* overlapping or adjacent, extend the last run */
+		if ( hi > MDB_IDL_RUN_HI( ids, n )) {
+			ir->ir_count += hi - MDB_IDL_RUN_HI( ids, n );
+			MDB_IDL_RUN_HI( ids, n ) = hi;
+		}
+		return;
+	}
 
-#if IDL_DEBUG > 0
-	idl_check( ids );
-#endif
+	if ( n == ir->ir_max ) {
+		/* out of room, the caller will have to settle for a range */
+		ir->ir_over = 1;
+		ir->ir_last = hi;
+		return;
+	}
 
-	for( i=ids[0]; i; i-- ) {
-		if( id > ids[i] ) {
-			break;
+	n = ++ids[0];
+	MDB_IDL_RUN_LO( ids, n ) = lo;
+	MDB_IDL_RUN_HI( ids, n ) = hi;
+	ir->ir_count += hi - lo + 1;
+}
+
+/* Store the accumulated runs into ids: as a plain list if it fits,
+ * else as a run-length IDL, else as a range.
+ */
+static void
+idl_runs_store( idl_runs *ir, ID *ids )
+{
+	ID *runs = ir->ir_ids;
+	ID i, id, n = runs[0];
+
+	assert( ids != runs );
+
+	if ( n == 0 ) {
+		ids[0] = 0;
+
+	} else if ( ir->ir_over ) {
+		MDB_IDL_RANGE( ids, MDB_IDL_RUN_LO( runs, 1 ), ir->ir_last );
+
+	} else if ( ir->ir_count <= MDB_idl_um_max ) {
+		ids[0] = 0;
+		for ( i = 1; i <= n; i++ ) {
+			for ( id = MDB_IDL_RUN_LO( runs, i );
+				id <= MDB_IDL_RUN_HI( runs, i ); id++ )
+				ids[++ids[0]] = id;
 		}
+
+	} else {
+		AC_MEMCPY( ids + 1, runs + 1, 2 * n * sizeof(ID) );
+		ids[0] = n | MDB_IDL_RUNFLAG;
 	}
+}
 
-	return i+1;
+/* Fetch the next run of consecutive IDs from any kind of IDL.
+ * *pos must be zero on the first call.
+ */
+static int
+idl_runs_next( ID *ids, ID *pos, ID *lo, ID *hi )
+{
+	if ( MDB_IDL_IS_RANGE( ids )) {
+		if ( *pos )
+			return 0;
+		*pos = 1;
+		*lo = MDB_IDL_RANGE_FIRST( ids );
+		*hi = MDB_IDL_RANGE_LAST( ids );
+		return 1;
+	}
+
+	if ( MDB_IDL_IS_RUNS( ids )) {
+		if ( *pos >= MDB_IDL_NRUNS( ids ))
+			return 0;
+		++*pos;
+		*lo = MDB_IDL_RUN_LO( ids, *pos );
+		*hi = MDB_IDL_RUN_HI( ids, *pos );
+		return 1;
+	}
+
+	if ( *pos >= ids[0] )
+		return 0;
+	*lo = *hi = ids[++*pos];
+	while ( *pos < ids[0] && ids[*pos+1] == *hi + 1 )
+		*hi = ids[++*pos];
+	return 1;
+}
+
+/* Degrade a run-length IDL to the range it spans */
+static void
+idl_runs2range( ID *ids )
+{
+	ID lo = MDB_IDL_RUN_LO( ids, 1 );
+	ID hi = MDB_IDL_RUN_HI( ids, MDB_IDL_NRUNS( ids ));
+
+	MDB_IDL_RANGE( ids, lo, hi );
+}
+
+unsigned mdb_idl_search( ID *ids, ID id )
+{
+	/*
+	 * search of id in ids, using the best kernel for this CPU
+	 * if found, returns position of id
+	 * if not found, returns first postion greater than id
+	 */
+#if IDL_DEBUG > 0
+	idl_check( ids );
 #endif
+	/* runs and ranges are searched by their callers */
+	assert( !MDB_IDL_IS_RUNS( ids ));
+
+	return mdb_idl_lb( ids + 1, ids[0], id ) + 1;
 }
 
 int mdb_idl_insert( ID *ids, ID id )
@@ -153,6 +296,9 @@ int mdb_idl_insert( ID *ids, ID id )
 	idl_check( ids );
 #endif
 
+	if (MDB_IDL_IS_RUNS( ids ))
+		idl_runs2range( ids );
+
 	if (MDB_IDL_IS_RANGE( ids )) {
 		/* if already in range, treat as a dup */
 		if (id >= MDB_IDL_RANGE_FIRST(ids) && id <= MDB_IDL_RANGE_LAST(ids))
@@ -214,6 +360,9 @@ static int mdb_idl_delete( ID *ids, ID id )
 	idl_check( ids );
 #endif
 
+	if (MDB_IDL_IS_RUNS( ids ))
+		idl_runs2range( ids );
+
 	if (MDB_IDL_IS_RANGE( ids )) {
 		/* If deleting a range boundary, adjust */
 		if ( ids[1] == id )
@@ -275,6 +424,42 @@ mdb_show_key(
 	}
 }
 
+/* Read a slot holding more IDs than a plain IDL can list,
+ * compressing them into runs as they are read.
+ */
+static int
+mdb_idl_fetch_runs(
+	MDB_cursor	*cursor,
+	MDB_val		*key,
+	ID			*ids )
+{
+	idl_runs ir;
+	MDB_val data;
+	ID *i, *end;
+	int rc;
+
+	idl_runs_init( &ir, ids );
+	rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
+	while ( rc == 0 ) {
+		i = data.mv_data;
+		end = i + data.mv_size / sizeof(ID);
+		for ( ; i < end; i++ )
+			idl_runs_add( &ir, *i, *i );
+		rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+
+	if ( ir.ir_over ) {
+		Debug( LDAP_DEBUG_TRACE, "=> mdb_idl_fetch_key: "
+			"too many runs, using a range\n" );
+		MDB_IDL_RANGE( ids, MDB_IDL_RUN_LO( ids, 1 ), ir.ir_last );
+	} else {
+		ids[0] |= MDB_IDL_RUNFLAG;
+	}
+	return rc;
+}
+
 int
 mdb_idl_fetch_key(
 	BackendDB	*be,
@@ -349,17 +534,33 @@ mdb_idl_fetch_key(
 		rc = MDB_NOTFOUND;
 	}
 	if (rc == 0) {
-		i = ids+1;
-		rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
-		while (rc == 0) {
-			memcpy( i, data.mv_data, data.mv_size );
-			i += data.mv_size / sizeof(ID);
-			rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
+		size_t count;
+		ID first;
+
+		memcpy( &first, data.mv_data, sizeof(ID) );
+		rc = mdb_cursor_count( cursor, &count );
+		if ( rc != 0 ) {
+			Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_key: "
+				"cursor count failed: %s (%d)\n", mdb_strerror(rc), rc );
+			mdb_cursor_close( cursor );
+			return rc;
+		}
+		/* Slots kept exact by idlexact may not fit a plain IDL */
+		if ( first != 0 && count > MDB_idl_um_max ) {
+			rc = mdb_idl_fetch_runs( cursor, key, ids );
+		} else {
+			i = ids+1;
+			rc = mdb_cursor_get( cursor, key, &data, MDB_GET_MULTIPLE );
+			while (rc == 0) {
+				memcpy( i, data.mv_data, data.mv_size );
+				i += data.mv_size / sizeof(ID);
+				rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_MULTIPLE );
+			}
+			if ( rc == MDB_NOTFOUND ) rc = 0;
+			ids[0] = i - &ids[1];
 		}
-		if ( rc == MDB_NOTFOUND ) rc = 0;
-		ids[0] = i - &ids[1];
 		/* On disk, a range is denoted by 0 in the first element */
-		if (ids[1] == 0) {
+		if (first == 0) {
 			if (ids[0] != MDB_IDL_RANGE_SIZE) {
 				Debug( LDAP_DEBUG_ANY, "=> mdb_idl_fetch_key: "
 					"range size mismatch: expected %d, got %ld\n",
@@ -406,16 +607,74 @@ mdb_idl_fetch_key(
 	return rc;
 }
 
+/* Return the number of IDs stored under a key, without fetching them.
+ * For a slot that was collapsed to a range this is the width of
+ * the range, which may overstate the number of matching entries.
+ */
+int
+mdb_idl_count_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count )
+{
+	MDB_cursor *cursor;
+	MDB_val data;
+	ID first, lo, hi;
+	size_t n;
+	int rc;
+
+	*count = 0;
+
+	rc = mdb_cursor_open( txn, dbi, &cursor );
+	if ( rc != 0 ) {
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_count_key: "
+			"cursor failed: %s (%d)\n", mdb_strerror(rc), rc );
+		return rc;
+	}
+
+	rc = mdb_cursor_get( cursor, key, &data, MDB_SET );
+	if ( rc == 0 ) {
+		memcpy( &first, data.mv_data, sizeof(ID) );
+		if ( first == 0 ) {
+			/* On disk, a range is denoted by 0 in the first element */
+			rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_DUP );
+			if ( rc == 0 ) {
+				memcpy( &lo, data.mv_data, sizeof(ID) );
+				rc = mdb_cursor_get( cursor, key, &data, MDB_NEXT_DUP );
+			}
+			if ( rc == 0 ) {
+				memcpy( &hi, data.mv_data, sizeof(ID) );
+				*count = hi - lo + 1;
+			}
+		} else {
+			rc = mdb_cursor_count( cursor, &n );
+			if ( rc == 0 )
+				*count = n;
+		}
+	}
+	mdb_cursor_close( cursor );
+
+	if ( rc != 0 && rc != MDB_NOTFOUND ) {
+		Debug( LDAP_DEBUG_ANY, "=> mdb_idl_count_key: "
+			"get failed: %s (%d)\n", mdb_strerror(rc), rc );
+	}
+	return rc;
+}
+
 int
 mdb_idl_insert_keys(
 	BackendDB	*be,
 	MDB_cursor	*cursor,
 	struct berval *keys,
-	ID			id )
+	ID			id,
+	mdb_idxstat	*st )
 {
 	struct mdb_info *mdb = be->be_private;
 	MDB_val key, data;
 	ID lo, hi, *i;
+	size_t count;
 	char *err;
 	int	rc = 0, k;
 	unsigned int flag = MDB_NODUPDATA;
@@ -451,6 +710,7 @@ mdb_idl_insert_keys(
 		key.mv_size = keys[k].bv_len;
 		key.mv_data = keys[k].bv_val;
 	}
+	count = 0;
 	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
 	err = "c_get";
 	if ( rc == 0 ) {
@@ -458,13 +718,12 @@ mdb_idl_insert_keys(
 		memcpy(&lo, data.mv_data, sizeof(ID));
 		if ( lo != 0 ) {
 			/* not a range, count the number of items */
-			size_t count;
 			rc = mdb_cursor_count( cursor, &count );
 			if ( rc != 0 ) {
 				err = "c_count";
 				goto fail;
 			}
-			if ( count >= MDB_idl_db_max ) {
+			if ( count >= MDB_idl_db_max && !mdb->mi_idl_exact ) {
 			/* No room, convert to a range */
 				lo = *i;
 				rc = mdb_cursor_get( cursor, &key, &data, MDB_LAST_DUP );
@@ -507,6 +766,8 @@ mdb_idl_insert_keys(
 					err = "c_put hi";
 					goto fail;
 				}
+				if ( st )
+					mdb_attr_stat_update( mdb, st, &key, hi - lo + 1, 0, 1 );
 			} else {
 			/* There's room, just store it */
 				if (id == mdb->mi_nextid)
@@ -542,6 +803,9 @@ mdb_idl_insert_keys(
 					err = "c_put lo/hi";
 					goto fail;
 				}
+				if ( st )
+					mdb_attr_stat_update( mdb, st, &key,
+						( id < lo ? hi - id : id - lo ) + 1, 0, 1 );
 			}
 		}
 	} else if ( rc == MDB_NOTFOUND ) {
@@ -549,6 +813,8 @@ mdb_idl_insert_keys(
 put1:	data.mv_data = &id;
 		data.mv_size = sizeof(ID);
 		rc = mdb_cursor_put( cursor, &key, &data, flag );
+		if ( rc == 0 && st )
+			mdb_attr_stat_update( mdb, st, &key, count + 1, count == 0, 1 );
 		/* Don't worry if it's already there */
 		if ( rc == MDB_KEYEXIST )
 			rc = 0;
@@ -572,11 +838,14 @@ mdb_idl_delete_keys(
 	BackendDB	*be,
 	MDB_cursor	*cursor,
 	struct berval *keys,
-	ID			id )
+	ID			id,
+	mdb_idxstat	*st )
 {
+	struct mdb_info *mdb = be->be_private;
 	int	rc = 0, k;
 	MDB_val key, data;
 	ID lo, hi, tmp, *i;
+	size_t count = 0;
 	char *err;
 #ifndef	MISALIGNED_OK
 	int kbuf[2];
@@ -622,11 +891,21 @@ mdb_idl_delete_keys(
 				err = "c_get id";
 				goto fail;
 			}
+			if ( st ) {
+				rc = mdb_cursor_count( cursor, &count );
+				if ( rc != 0 ) {
+					err = "c_count";
+					goto fail;
+				}
+			}
 			rc = mdb_cursor_del( cursor, 0 );
 			if ( rc != 0 ) {
 				err = "c_del id";
 				goto fail;
 			}
+			if ( st )
+				mdb_attr_stat_update( mdb, st, &key, count - 1,
+					count == 1 ? -1 : 0, -1 );
 		} else {
 			/* It's a range, see if we need to rewrite
 			 * the boundaries
@@ -668,6 +947,8 @@ mdb_idl_delete_keys(
 						err = "c_del dup2";
 						goto fail;
 					}
+					if ( st )
+						mdb_attr_stat_update( mdb, st, &key, 1, 0, -1 );
 				} else {
 					/* position on lo */
 					rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_DUP );
@@ -685,6 +966,9 @@ mdb_idl_delete_keys(
 						err = "c_put lo/hi";
 						goto fail;
 					}
+					if ( st )
+						mdb_attr_stat_update( mdb, st, &key,
+							hi2 - lo2 + 1, 0, -1 );
 				}
 			}
 		}
@@ -704,6 +988,56 @@ fail:
 }
 
 
+/* Intersect or merge two IDLs run by run, for when either one is a
+ * run-length IDL and the result may be too large to list.
+ */
+static int
+mdb_idl_runs_merge(
+	ID *a,
+	ID *b,
+	int isunion )
+{
+	idl_runs ir;
+	ID *buf;
+	ID posa = 0, posb = 0;
+	ID loa, hia, lob, hib;
+	int moa, mob;
+
+	buf = ch_malloc( MDB_idl_um_size * sizeof(ID) );
+	idl_runs_init( &ir, buf );
+
+	moa = idl_runs_next( a, &posa, &loa, &hia );
+	mob = idl_runs_next( b, &posb, &lob, &hib );
+
+	if ( isunion ) {
+		while ( moa || mob ) {
+			if ( !mob || ( moa && loa <= lob )) {
+				idl_runs_add( &ir, loa, hia );
+				moa = idl_runs_next( a, &posa, &loa, &hia );
+			} else {
+				idl_runs_add( &ir, lob, hib );
+				mob = idl_runs_next( b, &posb, &lob, &hib );
+			}
+		}
+	} else {
+		while ( moa && mob ) {
+			ID lo = IDL_MAX( loa, lob );
+			ID hi = IDL_MIN( hia, hib );
+
+			if ( lo <= hi )
+				idl_runs_add( &ir, lo, hi );
+			if ( hia < hib )
+				moa = idl_runs_next( a, &posa, &loa, &hia );
+			else
+				mob = idl_runs_next( b, &posb, &lob, &hib );
+		}
+	}
+
+	idl_runs_store( &ir, a );
+	ch_free( buf );
+	return 0;
+}
+
 /*
  * idl_intersection - return a = a intersection b
  */
@@ -712,9 +1046,9 @@ mdb_idl_intersection(
 	ID *a,
 	ID *b )
 {
-	ID ida, idb;
+	ID ida;
 	ID idmax, idmin;
-	ID cursora = 0, cursorb = 0, cursorc;
+	ID cursora, cursorc;
 	int swap = 0;
 
 	if ( MDB_IDL_IS_ZERO( a ) || MDB_IDL_IS_ZERO( b ) ) {
@@ -748,6 +1082,39 @@ mdb_idl_intersection(
 		}
 	}
 
+	if ( MDB_IDL_IS_RUNS( a ) ) {
+		if ( MDB_IDL_IS_RANGE( b ) || MDB_IDL_IS_RUNS( b ) ) {
+			mdb_idl_runs_merge( a, b, 0 );
+			goto done;
+		} else {
+		/* Swap so that b holds the runs, a is a list */
+			ID *tmp = a;
+			a = b;
+			b = tmp;
+			swap ^= 1;
+		}
+	}
+
+	/* Keep the IDs of the list that fall inside one of the runs.
+	 * The result is never longer than the list, so it is built in place.
+	 */
+	if ( MDB_IDL_IS_RUNS( b ) ) {
+		ID run = 1, nruns = MDB_IDL_NRUNS( b );
+
+		cursorc = 0;
+		for ( cursora = 1; cursora <= a[0]; cursora++ ) {
+			ida = a[cursora];
+			while ( run <= nruns && MDB_IDL_RUN_HI( b, run ) < ida )
+				run++;
+			if ( run > nruns )
+				break;
+			if ( MDB_IDL_RUN_LO( b, run ) <= ida )
+				a[++cursorc] = ida;
+		}
+		a[0] = cursorc;
+		goto done;
+	}
+
 	/* If a range completely covers the list, the result is
 	 * just the list.
 	 */
@@ -757,26 +1124,15 @@ mdb_idl_intersection(
 		goto done;
 	}
 
-	/* Fine, do the intersection one element at a time.
-	 * First advance to idmin in both IDLs.
-	 */
-	cursora = cursorb = idmin;
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
-	cursorc = 0;
-
-	while( ida <= idmax || idb <= idmax ) {
-		if( ida == idb ) {
-			a[++cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		} else if ( ida < idb ) {
-			ida = mdb_idl_next( a, &cursora );
-		} else {
-			idb = mdb_idl_next( b, &cursorb );
-		}
+	if ( MDB_IDL_IS_RANGE( b ) ) {
+		/* Keep the part of the list that lies inside the range */
+		cursora = mdb_idl_search( a, idmin );
+		cursorc = mdb_idl_search( a, idmax + 1 ) - cursora;
+		AC_MEMCPY( a + 1, a + cursora, cursorc * sizeof(ID) );
+		a[0] = cursorc;
+	} else {
+		a[0] = mdb_idl_isect( a + 1, a + 1, a[0], b + 1, b[0] );
 	}
-	a[0] = cursorc;
 done:
 	if (swap)
 		MDB_IDL_CPY( b, a );
@@ -794,7 +1150,6 @@ mdb_idl_union(
 	ID	*b )
 {
 	ID ida, idb;
-	ID cursora = 0, cursorb = 0, cursorc;
 
 	if ( MDB_IDL_IS_ZERO( b ) ) {
 		return 0;
@@ -806,7 +1161,7 @@ mdb_idl_union(
 	}
 
 	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) ) {
-over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
+		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		idb = IDL_MAX( MDB_IDL_LAST(a), MDB_IDL_LAST(b) );
 		a[0] = NOID;
 		a[1] = ida;
@@ -814,45 +1169,16 @@ over:		ida = IDL_MIN( MDB_IDL_FIRST(a), MDB_IDL_FIRST(b) );
 		return 0;
 	}
 
-	ida = mdb_idl_first( a, &cursora );
-	idb = mdb_idl_first( b, &cursorb );
-
-	cursorc = b[0];
-
-	/* The distinct elements of a are cat'd to b */
-	while( ida != NOID || idb != NOID ) {
-		if ( ida < idb ) {
-			if( ++cursorc > MDB_idl_um_max ) {
-				goto over;
-			}
-			b[cursorc] = ida;
-			ida = mdb_idl_next( a, &cursora );
-
-		} else {
-			if ( ida == idb )
-				ida = mdb_idl_next( a, &cursora );
-			idb = mdb_idl_next( b, &cursorb );
-		}
+	if ( MDB_IDL_IS_RUNS( a ) || MDB_IDL_IS_RUNS( b ) ) {
+		return mdb_idl_runs_merge( a, b, 1 );
 	}
 
-	/* b is copied back to a in sorted order */
-	a[0] = cursorc;
-	cursora = 1;
-	cursorb = 1;
-	cursorc = b[0]+1;
-	while (cursorb <= b[0] || cursorc <= a[0]) {
-		if (cursorc > a[0])
-			idb = NOID;
-		else
-			idb = b[cursorc];
-		if (cursorb <= b[0] && b[cursorb] < idb)
-			a[cursora++] = b[cursorb++];
-		else {
-			a[cursora++] = idb;
-			cursorc++;
-		}
+	if ( a[0] + b[0] > MDB_idl_um_max ) {
+		/* May not fit in a list, let the run merge decide */
+		return mdb_idl_runs_merge( a, b, 1 );
 	}
 
+	a[0] = mdb_idl_merge( a + 1, a[0], b + 1, b[0] );
 	return 0;
 }
 
@@ -872,13 +1198,13 @@ mdb_idl_notin(
 
 	if( MDB_IDL_IS_ZERO( a ) ||
 		MDB_IDL_IS_ZERO( b ) ||
-		MDB_IDL_IS_RANGE( b ) )
+		MDB_IDL_IS_RANGE( b ) || MDB_IDL_IS_RUNS( b ) )
 	{
 		MDB_IDL_CPY( ids, a );
 		return 0;
 	}
 
-	if( MDB_IDL_IS_RANGE( a ) ) {
+	if( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RUNS( a ) ) {
 		MDB_IDL_CPY( ids, a );
 		return 0;
 	}
@@ -927,6 +1253,18 @@ ID mdb_idl_first( ID *ids, ID *cursor )
 		return *cursor;
 	}
 
+	/* For run-length IDLs the cursor is the current ID itself */
+	if ( MDB_IDL_IS_RUNS( ids ) ) {
+		pos = mdb_idl_runs_search( ids, *cursor );
+		if( pos > MDB_IDL_NRUNS( ids ) ) {
+			return NOID;
+		}
+		if( *cursor < MDB_IDL_RUN_LO( ids, pos ) ) {
+			*cursor = MDB_IDL_RUN_LO( ids, pos );
+		}
+		return *cursor;
+	}
+
 	if ( *cursor == 0 )
 		pos = 1;
 	else
@@ -949,6 +1287,11 @@ ID mdb_idl_next( ID *ids, ID *cursor )
 		return *cursor;
 	}
 
+	if ( MDB_IDL_IS_RUNS( ids ) ) {
+		++(*cursor);
+		return mdb_idl_first( ids, cursor );
+	}
+
 	if ( ++(*cursor) <= ids[0] ) {
 		return ids[*cursor];
 	}
@@ -962,6 +1305,9 @@ ID mdb_idl_next( ID *ids, ID *cursor )
  */
 int mdb_idl_append_one( ID *ids, ID id )
 {
+	if (MDB_IDL_IS_RUNS( ids ))
+		idl_runs2range( ids );
+
 	if (MDB_IDL_IS_RANGE( ids )) {
 		/* if already in range, treat as a dup */
 		if (id >= MDB_IDL_RANGE_FIRST(ids) && id <= MDB_IDL_RANGE_LAST(ids))
@@ -1012,9 +1358,12 @@ int mdb_idl_append( ID *a, ID *b )
 		return 0;
 	}
 
+	if ( MDB_IDL_IS_RUNS( a ) )
+		idl_runs2range( a );
+
 	ida = MDB_IDL_LAST( a );
 	idb = MDB_IDL_LAST( b );
-	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) ||
+	if ( MDB_IDL_IS_RANGE( a ) || MDB_IDL_IS_RANGE(b) || MDB_IDL_IS_RUNS(b) ||
 		a[0] + b[0] >= MDB_idl_um_max ) {
 		a[2] = IDL_MAX( ida, idb );
 		a[1] = IDL_MIN( a[1], b[1] );
@@ -1062,7 +1411,7 @@ mdb_idl_sort( ID *ids, ID *tmp )
 	int i,j,k,l,ir,jstack;
 	ID a, itmp;
 
-	if ( MDB_IDL_IS_RANGE( ids ))
+	if ( MDB_IDL_IS_RANGE( ids ) || MDB_IDL_IS_RUNS( ids ))
 		return;
 
 	ir = ids[0];
@@ -1141,7 +1490,7 @@ mdb_idl_sort( ID *ids, ID *tmp )
 	ID *idls[2];
 	unsigned char *maxv = (unsigned char *)&ids[size];
 
- 	if ( MDB_IDL_IS_RANGE( ids ))
+ 	if ( MDB_IDL_IS_RANGE( ids ) || MDB_IDL_IS_RUNS( ids ))
  		return;
 
 	/* Use insertion sort for small lists */
@@ -1228,36 +1577,24 @@ mdb_idl_sort( ID *ids, ID *tmp )
 unsigned mdb_id2l_search( ID2L ids, ID id )
 {
 	/*
-	 * binary search of id in ids
+	 * branchless binary search of id in ids
 	 * if found, returns position of id
 	 * if not found, returns first position greater than id
+	 * The ID2s are too wide to compare several per vector,
+	 * but avoiding mispredicted branches still pays off.
 	 */
-	unsigned base = 0;
-	unsigned cursor = 1;
-	int val = 0;
+	ID2 *base = ids + 1;
 	unsigned n = ids[0].mid;
 
-	while( 0 < n ) {
-		unsigned pivot = n >> 1;
-		cursor = base + pivot + 1;
-		val = IDL_CMP( id, ids[cursor].mid );
-
-		if( val < 0 ) {
-			n = pivot;
-
-		} else if ( val > 0 ) {
-			base = cursor;
-			n -= pivot + 1;
-
-		} else {
-			return cursor;
-		}
-	}
+	if ( n == 0 )
+		return 1;
 
-	if( val > 0 ) {
-		++cursor;
+	while ( n > 1 ) {
+		unsigned half = n >> 1;
+		base = ( base[half].mid < id ) ? base + half : base;
+		n -= half;
 	}
-	return cursor;
+	return ( base - ids ) + ( base->mid < id );
 }
 
 int mdb_id2l_insert( ID2L ids, ID2 *id )
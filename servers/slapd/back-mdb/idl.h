@@ -30,8 +30,22 @@ extern unsigned int MDB_idl_um_max;
 #define MDB_IDL_IS_RANGE(ids)	((ids)[0] == NOID)
 #define MDB_IDL_RANGE_SIZE		(3)
 #define MDB_IDL_RANGE_SIZEOF	(MDB_IDL_RANGE_SIZE * sizeof(ID))
+
+/* A run-length IDL is used for sets too large to be listed in full.
+ * The count word has its top bit set, the remaining bits hold the
+ * number of runs, and each run follows as an inclusive (lo, hi) pair.
+ * Runs are sorted, disjoint and never adjacent.
+ */
+#define MDB_IDL_RUNFLAG		((ID)1 << (sizeof(ID) * CHAR_BIT - 1))
+#define MDB_IDL_IS_RUNS(ids)	(!MDB_IDL_IS_RANGE(ids) \
+	&& ((ids)[0] & MDB_IDL_RUNFLAG))
+#define MDB_IDL_NRUNS(ids)		((ids)[0] & ~MDB_IDL_RUNFLAG)
+#define MDB_IDL_RUN_LO(ids, i)	((ids)[2*(i)-1])
+#define MDB_IDL_RUN_HI(ids, i)	((ids)[2*(i)])
+
 #define MDB_IDL_SIZEOF(ids)		((MDB_IDL_IS_RANGE(ids) \
-	? MDB_IDL_RANGE_SIZE : ((ids)[0]+1)) * sizeof(ID))
+	? MDB_IDL_RANGE_SIZE : MDB_IDL_IS_RUNS(ids) \
+	? 2*MDB_IDL_NRUNS(ids)+1 : ((ids)[0]+1)) * sizeof(ID))
 
 #define MDB_IDL_RANGE_FIRST(ids)	((ids)[1])
 #define MDB_IDL_RANGE_LAST(ids)		((ids)[2])
@@ -62,10 +76,12 @@ extern unsigned int MDB_idl_um_max;
 #define MDB_IDL_FIRST( ids )	( (ids)[1] )
 #define MDB_IDL_LLAST( ids )	( (ids)[(ids)[0]] )
 #define MDB_IDL_LAST( ids )		( MDB_IDL_IS_RANGE(ids) \
-	? (ids)[2] : (ids)[(ids)[0]] )
+	? (ids)[2] : MDB_IDL_IS_RUNS(ids) \
+	? MDB_IDL_RUN_HI(ids, MDB_IDL_NRUNS(ids)) : (ids)[(ids)[0]] )
 
 #define MDB_IDL_N( ids )		( MDB_IDL_IS_RANGE(ids) \
-	? ((ids)[2]-(ids)[1])+1 : (ids)[0] )
+	? ((ids)[2]-(ids)[1])+1 : MDB_IDL_IS_RUNS(ids) \
+	? mdb_idl_runs_count(ids) : (ids)[0] )
 
 	/** An ID2 is an ID/value pair.
 	 */
@@ -98,6 +114,21 @@ LDAP_BEGIN_DECL
 	/** Reset IDL params after changing logn */
 void mdb_idl_reset();
 
+	/** Count the IDs in a run-length IDL.
+	 * @param[in] ids	The run-length IDL.
+	 * @return	The number of IDs covered by all of its runs.
+	 */
+ID mdb_idl_runs_count( ID *ids );
+
+	/** Search for an ID in a run-length IDL.
+	 * @param[in] ids	The run-length IDL to search.
+	 * @param[in] id	The ID to search for.
+	 * @return	The index of the first run whose upper bound is greater
+	 *	than or equal to \b id. The ID is present if that run exists
+	 *	and its lower bound is less than or equal to \b id.
+	 */
+unsigned mdb_idl_runs_search( ID *ids, ID id );
+
 
 	/** Search for an ID in an ID2L.
 	 * @param[in] ids	The ID2L to search.
@@ -0,0 +1,370 @@
+/* idlsimd.c - ldap mdb back-end vectorized ID list kernels */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+
+#include "idlsimd.h"
+
+/* The vector kernels compare IDs as 64 bit lanes, and are compiled with
+ * per-function target attributes so the rest of slapd needs no special
+ * compiler flags. The CPU is checked once at startup.
+ */
+#if defined(__x86_64__) && defined(__LP64__) && !defined(MDB_IDL_NO_SIMD) && \
+	( defined(__clang__) || __GNUC__ > 4 || \
+	( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ))
+#define IDL_X86_SIMD	1
+#include <immintrin.h>
+#endif
+
+/* Switch to galloping when one list is this many times longer */
+#define IDL_GALLOP_RATIO	32
+
+/* Binary search narrows down to a window this big before scanning it */
+#define IDL_LB_WINDOW	16
+
+#define IDL_MIN(x,y)	( (x) < (y) ? (x) : (y) )
+
+static unsigned
+idl_lb_scalar( const ID *ids, unsigned n, ID id )
+{
+	const ID *p = ids;
+
+	while ( n > 0 ) {
+		unsigned half = n >> 1;
+
+		if ( p[half] < id ) {
+			p += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+	return p - ids;
+}
+
+static unsigned
+idl_isect_scalar( ID *out, const ID *a, unsigned na, const ID *b, unsigned nb )
+{
+	unsigned i = 0, j = 0, k = 0;
+
+	while ( i < na && j < nb ) {
+		if ( a[i] < b[j] ) {
+			i++;
+		} else if ( b[j] < a[i] ) {
+			j++;
+		} else {
+			out[k++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	return k;
+}
+
+#ifdef IDL_X86_SIMD
+
+/* Flipping the sign bit turns the signed lane compares into unsigned ones */
+#define IDL_SIGN	((long long)1 << 63)
+
+static unsigned __attribute__((target("sse4.2")))
+idl_lb_sse42( const ID *ids, unsigned n, ID id )
+{
+	const ID *p = ids;
+	__m128i sign, key, v;
+	int m;
+
+	while ( n > IDL_LB_WINDOW ) {
+		unsigned half = n >> 1;
+
+		if ( p[half] < id ) {
+			p += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+
+	sign = _mm_set1_epi64x( IDL_SIGN );
+	key = _mm_xor_si128( _mm_set1_epi64x( (long long)id ), sign );
+	while ( n >= 2 ) {
+		v = _mm_xor_si128( _mm_loadu_si128( (const __m128i *)p ), sign );
+		m = _mm_movemask_pd( _mm_castsi128_pd( _mm_cmpgt_epi64( key, v )));
+		if ( m != 0x3 )
+			return ( p - ids ) + __builtin_popcount( m );
+		p += 2;
+		n -= 2;
+	}
+	if ( n && *p < id )
+		p++;
+	return p - ids;
+}
+
+static unsigned __attribute__((target("sse4.2")))
+idl_isect_sse42( ID *out, const ID *a, unsigned na, const ID *b, unsigned nb )
+{
+	unsigned i = 0, j = 0, k = 0;
+	ID tmp[2];
+
+	/* Compare 2x2 blocks, then drop the block with the smaller maximum.
+	 * Only elements of a are stored, in order, so out may alias a.
+	 */
+	while ( i + 2 <= na && j + 2 <= nb ) {
+		__m128i va = _mm_loadu_si128( (const __m128i *)( a + i ));
+		__m128i vb = _mm_loadu_si128( (const __m128i *)( b + j ));
+		ID amax = a[i+1], bmax = b[j+1];
+		int m;
+
+		m = _mm_movemask_pd( _mm_castsi128_pd( _mm_or_si128(
+			_mm_cmpeq_epi64( va, vb ),
+			_mm_cmpeq_epi64( va, _mm_shuffle_epi32( vb, 0x4e )))));
+		if ( m ) {
+			_mm_storeu_si128( (__m128i *)tmp, va );
+			if ( m & 1 )
+				out[k++] = tmp[0];
+			if ( m & 2 )
+				out[k++] = tmp[1];
+		}
+		if ( amax <= bmax )
+			i += 2;
+		if ( bmax <= amax )
+			j += 2;
+	}
+	return k + idl_isect_scalar( out + k, a + i, na - i, b + j, nb - j );
+}
+
+static unsigned __attribute__((target("avx2")))
+idl_lb_avx2( const ID *ids, unsigned n, ID id )
+{
+	const ID *p = ids;
+	__m256i sign, key, v;
+	int m;
+
+	while ( n > IDL_LB_WINDOW ) {
+		unsigned half = n >> 1;
+
+		if ( p[half] < id ) {
+			p += half + 1;
+			n -= half + 1;
+		} else {
+			n = half;
+		}
+	}
+
+	sign = _mm256_set1_epi64x( IDL_SIGN );
+	key = _mm256_xor_si256( _mm256_set1_epi64x( (long long)id ), sign );
+	while ( n >= 4 ) {
+		v = _mm256_xor_si256( _mm256_loadu_si256( (const __m256i *)p ), sign );
+		m = _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpgt_epi64( key, v )));
+		if ( m != 0xf )
+			return ( p - ids ) + __builtin_popcount( m );
+		p += 4;
+		n -= 4;
+	}
+	while ( n && *p < id ) {
+		p++;
+		n--;
+	}
+	return p - ids;
+}
+
+static unsigned __attribute__((target("avx2")))
+idl_isect_avx2( ID *out, const ID *a, unsigned na, const ID *b, unsigned nb )
+{
+	unsigned i = 0, j = 0, k = 0;
+	ID tmp[4];
+
+	/* Compare 4x4 blocks against all rotations of the b block,
+	 * then drop the block with the smaller maximum.
+	 * Only elements of a are stored, in order, so out may alias a.
+	 */
+	while ( i + 4 <= na && j + 4 <= nb ) {
+		__m256i va = _mm256_loadu_si256( (const __m256i *)( a + i ));
+		__m256i vb = _mm256_loadu_si256( (const __m256i *)( b + j ));
+		ID amax = a[i+3], bmax = b[j+3];
+		__m256i eq;
+		int m;
+
+		eq = _mm256_or_si256(
+			_mm256_or_si256( _mm256_cmpeq_epi64( va, vb ),
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x39 ))),
+			_mm256_or_si256(
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x4e )),
+				_mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x93 ))));
+		m = _mm256_movemask_pd( _mm256_castsi256_pd( eq ));
+		if ( m ) {
+			_mm256_storeu_si256( (__m256i *)tmp, va );
+			while ( m ) {
+				out[k++] = tmp[__builtin_ctz( m )];
+				m &= m - 1;
+			}
+		}
+		if ( amax <= bmax )
+			i += 4;
+		if ( bmax <= amax )
+			j += 4;
+	}
+	return k + idl_isect_scalar( out + k, a + i, na - i, b + j, nb - j );
+}
+
+#endif /* IDL_X86_SIMD */
+
+mdb_idl_lb_func *mdb_idl_lb = idl_lb_scalar;
+static mdb_idl_isect_func *idl_isect_block = idl_isect_scalar;
+
+static const char *idl_kern_names[] = { "scalar", "sse4.2", "avx2" };
+
+const char *
+mdb_idl_kern_name( int level )
+{
+	if ( level < MDB_IDL_KERN_SCALAR || level > MDB_IDL_KERN_AVX2 )
+		return "unknown";
+	return idl_kern_names[level];
+}
+
+int
+mdb_idl_kern_init( int level )
+{
+	int best = MDB_IDL_KERN_SCALAR;
+
+#ifdef IDL_X86_SIMD
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports( "avx2" ))
+		best = MDB_IDL_KERN_AVX2;
+	else if ( __builtin_cpu_supports( "sse4.2" ))
+		best = MDB_IDL_KERN_SSE42;
+#endif
+
+	if ( level < MDB_IDL_KERN_SCALAR || level > best )
+		level = best;
+
+	switch ( level ) {
+#ifdef IDL_X86_SIMD
+	case MDB_IDL_KERN_AVX2:
+		mdb_idl_lb = idl_lb_avx2;
+		idl_isect_block = idl_isect_avx2;
+		break;
+	case MDB_IDL_KERN_SSE42:
+		mdb_idl_lb = idl_lb_sse42;
+		idl_isect_block = idl_isect_sse42;
+		break;
+#endif
+	default:
+		mdb_idl_lb = idl_lb_scalar;
+		idl_isect_block = idl_isect_scalar;
+		break;
+	}
+	return level;
+}
+
+/* For each ID of the short list, gallop forward through the long list.
+ * Only IDs of the long list that are matched get stored, at a position
+ * no further than where they were read from, so out may alias big.
+ */
+static unsigned
+idl_isect_gallop( ID *out, const ID *small, unsigned ns,
+	const ID *big, unsigned nb )
+{
+	unsigned i, j = 0, k = 0, step;
+
+	for ( i = 0; i < ns && j < nb; i++ ) {
+		ID id = small[i];
+
+		step = 1;
+		while ( j + step < nb && big[j + step] < id ) {
+			j += step;
+			step <<= 1;
+		}
+		j += mdb_idl_lb( big + j, IDL_MIN( step, nb - 1 - j ) + 1, id );
+		if ( j < nb && big[j] == id ) {
+			out[k++] = big[j];
+			j++;
+		}
+	}
+	return k;
+}
+
+unsigned
+mdb_idl_isect( ID *out, const ID *a, unsigned na, const ID *b, unsigned nb )
+{
+	if ( na == 0 || nb == 0 )
+		return 0;
+	if ( na / IDL_GALLOP_RATIO > nb )
+		return idl_isect_gallop( out, b, nb, a, na );
+	if ( nb / IDL_GALLOP_RATIO > na )
+		return idl_isect_gallop( out, a, na, b, nb );
+	return idl_isect_block( out, a, na, b, nb );
+}
+
+/* Count the IDs less than id, probing backwards from the end since
+ * most of them are expected to be smaller.
+ */
+static unsigned
+idl_gallop_back( const ID *ids, unsigned n, ID id )
+{
+	unsigned lo, step = 1;
+
+	while ( step < n && ids[n - 1 - step] >= id )
+		step <<= 1;
+	lo = step < n ? n - 1 - step : 0;
+	return lo + mdb_idl_lb( ids + lo, n - lo, id );
+}
+
+unsigned
+mdb_idl_merge( ID *a, unsigned na, const ID *b, unsigned nb )
+{
+	unsigned i = na, j = nb, p = na + nb, k, n;
+
+	/* Fill a from the top. p never drops below i + j, so the IDs of a
+	 * that are still to be merged are never overwritten. Whole blocks
+	 * of either list that sort after the other's current tail are
+	 * moved at once.
+	 */
+	while ( i && j ) {
+		if ( a[i-1] > b[j-1] ) {
+			k = idl_gallop_back( a, i, b[j-1] + 1 );
+			n = i - k;
+			p -= n;
+			AC_MEMCPY( a + p, a + k, n * sizeof(ID) );
+			i = k;
+		} else if ( b[j-1] > a[i-1] ) {
+			k = idl_gallop_back( b, j, a[i-1] + 1 );
+			n = j - k;
+			p -= n;
+			AC_MEMCPY( a + p, b + k, n * sizeof(ID) );
+			j = k;
+		} else {
+			a[--p] = a[--i];
+			j--;
+		}
+	}
+	if ( j ) {
+		p -= j;
+		AC_MEMCPY( a + p, b, j * sizeof(ID) );
+	}
+	if ( i ) {
+		p -= i;
+		AC_MEMCPY( a + p, a, i * sizeof(ID) );
+	}
+
+	/* Duplicates leave a gap at the bottom */
+	n = na + nb - p;
+	if ( p )
+		AC_MEMCPY( a, a + p, n * sizeof(ID) );
+	return n;
+}
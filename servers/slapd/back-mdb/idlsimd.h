@@ -0,0 +1,84 @@
+/* idlsimd.h - ldap mdb back-end ID list kernels header file */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#ifndef _MDB_IDLSIMD_H_
+#define _MDB_IDLSIMD_H_
+
+#include <ldap_cdefs.h>
+
+/* The kernels only operate on plain sorted arrays of IDs, without the
+ * count word of an IDL, so that they can also be built outside slapd,
+ * e.g. by the IDL benchmark in tests/progs.
+ */
+#ifndef NOID
+typedef unsigned long	ID;
+#define NOID	((ID)~0)
+#endif
+
+#define MDB_IDL_KERN_BEST	-1
+#define MDB_IDL_KERN_SCALAR	0
+#define MDB_IDL_KERN_SSE42	1
+#define MDB_IDL_KERN_AVX2	2
+
+LDAP_BEGIN_DECL
+
+	/** Count the IDs less than \b id in a sorted array.
+	 * @param[in] ids	The sorted array.
+	 * @param[in] n	The number of IDs in the array.
+	 * @param[in] id	The ID to search for.
+	 * @return	The index of the first ID greater than or equal to \b id.
+	 */
+typedef unsigned (mdb_idl_lb_func)( const ID *ids, unsigned n, ID id );
+
+	/** Intersect two sorted arrays.
+	 * @param[out] out	Where to store the result, may be the same as \b a.
+	 * @param[in] a	The first sorted array.
+	 * @param[in] na	The number of IDs in \b a.
+	 * @param[in] b	The second sorted array.
+	 * @param[in] nb	The number of IDs in \b b.
+	 * @return	The number of IDs stored in \b out.
+	 */
+typedef unsigned (mdb_idl_isect_func)( ID *out, const ID *a, unsigned na,
+	const ID *b, unsigned nb );
+
+extern mdb_idl_lb_func *mdb_idl_lb;
+
+	/** Select the kernels to use.
+	 * @param[in] level	One of the MDB_IDL_KERN_* levels, or
+	 *	MDB_IDL_KERN_BEST for the best one this CPU supports.
+	 * @return	The level actually selected, which may be lower than
+	 *	requested if the CPU or compiler lacks support for it.
+	 */
+int mdb_idl_kern_init( int level );
+
+	/** Return the name of a kernel level, for diagnostics. */
+const char *mdb_idl_kern_name( int level );
+
+	/** Intersect two sorted arrays, galloping through the longer
+	 * one when their sizes are very different.
+	 */
+mdb_idl_isect_func mdb_idl_isect;
+
+	/** Merge sorted array \b b into sorted array \b a, dropping duplicates.
+	 * The merge runs backwards so that no scratch space is needed,
+	 * but \b a must have room for \b na + \b nb IDs.
+	 * @return	The number of IDs now in \b a.
+	 */
+unsigned mdb_idl_merge( ID *a, unsigned na, const ID *b, unsigned nb );
+
+LDAP_END_DECL
+
+#endif
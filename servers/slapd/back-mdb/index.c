@@ -78,11 +78,14 @@ int mdb_index_param(
 	int ftype,
 	MDB_dbi *dbip,
 	slap_mask_t *maskp,
-	struct berval *prefixp )
+	struct berval *prefixp,
+	AttrInfo **partialp )
 {
 	AttrInfo *ai;
 	slap_mask_t mask, type = 0;
+	int partial = 0;
 
+	*partialp = NULL;
 	ai = mdb_index_mask( be, desc, prefixp );
 
 	if ( !ai ) {
@@ -110,6 +113,7 @@ int mdb_index_param(
 	}
 	mask = ai->ai_indexmask;
 
+again:
 	switch( ftype ) {
 	case LDAP_FILTER_PRESENT:
 		type = SLAP_INDEX_PRESENT;
@@ -149,6 +153,15 @@ int mdb_index_param(
 		return LDAP_OTHER;
 	}
 
+	/* While an online index build is running, the new index is
+	 * usable for the IDs it already covers.
+	 */
+	if ( ai->ai_indexed && !partial && ai->ai_newmask ) {
+		mask = ai->ai_newmask;
+		partial = 1;
+		goto again;
+	}
+
 #ifdef MDB_MONITOR_IDX
 	mdb_monitor_idx_add( be->be_private, desc, type );
 #endif /* MDB_MONITOR_IDX */
@@ -158,9 +171,131 @@ int mdb_index_param(
 done:
 	*dbip = ai->ai_dbi;
 	*maskp = mask;
+	if ( partial )
+		*partialp = ai;
 	return LDAP_SUCCESS;
 }
 
+/* Read the progress marker of an online index build */
+int
+mdb_idxprog_get(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	mdb_idxprog *ip )
+{
+	MDB_val key, data;
+	int rc;
+
+	if ( !mdb->mi_idxprog )
+		return MDB_NOTFOUND;
+
+	key.mv_data = ai->ai_desc->ad_cname.bv_val;
+	key.mv_size = ai->ai_desc->ad_cname.bv_len;
+	rc = mdb_get( txn, mdb->mi_idxprog, &key, &data );
+	if ( rc == 0 ) {
+		if ( data.mv_size != sizeof( mdb_idxprog ))
+			return MDB_NOTFOUND;
+		memcpy( ip, data.mv_data, sizeof( mdb_idxprog ));
+	}
+	return rc;
+}
+
+/* Record that IDs below next are indexed, or forget the build
+ * if next is 0
+ */
+int
+mdb_idxprog_put(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	ID next )
+{
+	MDB_val key, data;
+	mdb_idxprog ip;
+	int rc;
+
+	if ( !mdb->mi_idxprog )
+		return 0;
+
+	key.mv_data = ai->ai_desc->ad_cname.bv_val;
+	key.mv_size = ai->ai_desc->ad_cname.bv_len;
+	if ( !next ) {
+		rc = mdb_del( txn, mdb->mi_idxprog, &key, NULL );
+		if ( rc == MDB_NOTFOUND )
+			rc = 0;
+		return rc;
+	}
+
+	ip.ip_next = next;
+	ip.ip_newmask = ai->ai_newmask;
+	ip.ip_oldmask = ai->ai_indexmask & ~MDB_INDEX_DELETING;
+	data.mv_data = &ip;
+	data.mv_size = sizeof( ip );
+	return mdb_put( txn, mdb->mi_idxprog, &key, &data, 0 );
+}
+
+/* Resume the online index builds that were running at shutdown.
+ * Markers of indexes that are no longer configured are dropped.
+ */
+int
+mdb_idxprog_load(
+	BackendDB *be,
+	MDB_txn *txn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	int rc;
+
+	if ( !mdb->mi_idxprog )
+		return 0;
+
+	rc = mdb_cursor_open( txn, mdb->mi_idxprog, &mc );
+	if ( rc )
+		return rc;
+
+	while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) == 0 ) {
+		AttributeDescription *ad = NULL;
+		AttrInfo *ai = NULL;
+		struct berval name;
+		const char *text;
+		mdb_idxprog ip;
+		slap_mask_t mask;
+
+		name.bv_val = key.mv_data;
+		name.bv_len = key.mv_size;
+		if ( slap_bv2ad( &name, &ad, &text ) == LDAP_SUCCESS )
+			ai = mdb_attr_mask( mdb, ad );
+		mask = ai ? ( ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask ) : 0;
+		if ( !mask || data.mv_size != sizeof( ip )) {
+			rc = mdb_cursor_del( mc, 0 );
+			if ( rc )
+				break;
+			continue;
+		}
+
+		memcpy( &ip, data.mv_data, sizeof( ip ));
+		/* the index definition changed while we were down */
+		if ( ip.ip_newmask != mask )
+			ip.ip_next = 1;
+
+		ai->ai_indexmask = ip.ip_oldmask & mask;
+		ai->ai_newmask = mask;
+		ai->ai_indexed = ip.ip_next ? ip.ip_next : 1;
+
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_idxprog_load) ": database \"%s\": "
+			"resuming index of %s at ID %lu.\n",
+			be->be_suffix[0].bv_val, ai->ai_desc->ad_cname.bv_val,
+			(unsigned long) ai->ai_indexed );
+	}
+	mdb_cursor_close( mc );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
 static int indexer(
 	Operation *op,
 	MDB_txn *txn,
@@ -176,10 +311,15 @@ static int indexer(
 	struct berval *keys;
 	MDB_cursor *mc = ai->ai_cursor;
 	mdb_idl_keyfunc *keyfunc;
+	mdb_idxstat *st = NULL;
 	char *err;
 
 	assert( mask != 0 );
 
+	/* tools build indexes from scratch, they get counted on demand */
+	if ( !( slapMode & SLAP_TOOL_MODE ))
+		st = &ai->ai_stat;
+
 	if ( !mc ) {
 		err = "c_open";
 		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
@@ -189,6 +329,10 @@ static int indexer(
 	}
 
 	if ( opid == SLAP_INDEX_ADD_OP ) {
+		if (( slapMode & SLAP_TOOL_QUICK ) && mdb_tool_bulk_open( txn, ai )) {
+			keyfunc = mdb_tool_bulk_add;
+			mc = (MDB_cursor *)ai;
+		} else
 #ifdef MDB_TOOL_IDL_CACHING
 		if (( slapMode & SLAP_TOOL_QUICK ) && slap_tool_thread_max > 2 ) {
 			AttrIxInfo *ax = (AttrIxInfo *)LDAP_SLIST_FIRST(&op->o_extra);
@@ -202,7 +346,7 @@ static int indexer(
 		keyfunc = mdb_idl_delete_keys;
 
 	if( IS_SLAP_INDEX( mask, SLAP_INDEX_PRESENT ) ) {
-		rc = keyfunc( op->o_bd, mc, presence_key, id );
+		rc = keyfunc( op->o_bd, mc, presence_key, id, st );
 		if( rc ) {
 			err = "presence";
 			goto done;
@@ -218,7 +362,7 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = keyfunc( op->o_bd, mc, keys, id, st );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "equality";
@@ -237,7 +381,7 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = keyfunc( op->o_bd, mc, keys, id, st );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if ( rc ) {
 				err = "approx";
@@ -257,7 +401,7 @@ static int indexer(
 			atname, vals, &keys, op->o_tmpmemctx );
 
 		if( rc == LDAP_SUCCESS && keys != NULL ) {
-			rc = keyfunc( op->o_bd, mc, keys, id );
+			rc = keyfunc( op->o_bd, mc, keys, id, st );
 			ber_bvarray_free_x( keys, op->o_tmpmemctx );
 			if( rc ) {
 				err = "substr";
@@ -282,6 +426,13 @@ done:
 	return rc;
 }
 
+/* The online indexer only adds the new bits for the attributes whose
+ * build hasn't gone past this ID yet
+ */
+#define mdb_index_update_mask( ai, id ) \
+	(( (ai)->ai_indexed && (id) >= (ai)->ai_indexed ) ? \
+		(ai)->ai_newmask & ~(ai)->ai_indexmask : 0 )
+
 static int index_at_values(
 	Operation *op,
 	MDB_txn *txn,
@@ -329,7 +480,7 @@ static int index_at_values(
 			 * already in the old mask.
 			 */
 			if ( opid == MDB_INDEX_UPDATE_OP )
-				mask = ai->ai_newmask & ~ai->ai_indexmask;
+				mask = mdb_index_update_mask( ai, id );
 			else
 			/* For regular updates, if there is a newmask use it. Otherwise
 			 * just use the old mask.
@@ -353,7 +504,7 @@ static int index_at_values(
 
 			if( ai && ( ai->ai_indexmask || ai->ai_newmask )) {
 				if ( opid == MDB_INDEX_UPDATE_OP )
-					mask = ai->ai_newmask & ~ai->ai_indexmask;
+					mask = mdb_index_update_mask( ai, id );
 				else
 					mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
 				if ( mask ) {
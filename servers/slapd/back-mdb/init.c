@@ -23,6 +23,7 @@
 #include <ac/errno.h>
 #include <sys/stat.h>
 #include "back-mdb.h"
+#include "idlsimd.h"
 #include <lutil.h>
 #include <ldap_rq.h>
 #include "config.h"
@@ -32,6 +33,8 @@ static const struct berval mdmi_databases[] = {
 	BER_BVC("dn2i"),
 	BER_BVC("id2e"),
 	BER_BVC("id2v"),
+	BER_BVC("idxp"),
+	BER_BVC("info"),
 	BER_BVNULL
 };
 
@@ -66,6 +69,8 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 	mdb->mi_multi_hi = UINT_MAX;
 	mdb->mi_multi_lo = UINT_MAX;
 
+	ldap_pvt_thread_mutex_init( &mdb->mi_stat_mutex );
+
 	be->be_private = mdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs+1;
 
@@ -81,6 +86,94 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 static int
 mdb_db_close( BackendDB *be, ConfigReply *cr );
 
+/* Record the format features the database now uses */
+int
+mdb_dbformat_put( struct mdb_info *mdb, MDB_txn *txn, unsigned format )
+{
+	MDB_val key, data;
+	ID fmt = format;
+	int rc;
+
+	if ( !mdb->mi_dbinfo )
+		return MDB_NOTFOUND;
+
+	key.mv_data = MDB_DBINFO_FORMAT;
+	key.mv_size = STRLENOF( MDB_DBINFO_FORMAT );
+	data.mv_data = &fmt;
+	data.mv_size = sizeof( fmt );
+	rc = mdb_put( txn, mdb->mi_dbinfo, &key, &data, 0 );
+	if ( rc == 0 )
+		mdb->mi_dbformat = format;
+	return rc;
+}
+
+/* Refuse a database whose format the configuration would
+ * misread, and mark the features the configuration will use
+ */
+static int
+mdb_dbformat_check( BackendDB *be, MDB_txn *txn, ConfigReply *cr )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_val key, data;
+	ID fmt = 0;
+	int rc;
+
+	if ( mdb->mi_dbinfo ) {
+		key.mv_data = MDB_DBINFO_FORMAT;
+		key.mv_size = STRLENOF( MDB_DBINFO_FORMAT );
+		rc = mdb_get( txn, mdb->mi_dbinfo, &key, &data );
+		if ( rc == 0 && data.mv_size != sizeof( fmt ))
+			rc = MDB_CORRUPTED;
+		if ( rc == 0 ) {
+			memcpy( &fmt, data.mv_data, sizeof( fmt ));
+		} else if ( rc != MDB_NOTFOUND ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"cannot read format: %s (%d).",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": %s\n", cr->msg );
+			return rc;
+		}
+	}
+	mdb->mi_dbformat = fmt;
+
+	if ( fmt & ~MDB_FMT_IDLEXACT ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"unknown format 0x%lx, written by a newer version.",
+			be->be_suffix[0].bv_val, (unsigned long) fmt );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": %s\n", cr->msg );
+		return LDAP_OTHER;
+	}
+
+	/* slapcat does not read the indices */
+	if ( slapMode & SLAP_TOOL_READONLY )
+		return 0;
+
+	if (( fmt & MDB_FMT_IDLEXACT ) && !mdb->mi_idl_exact ) {
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"index slots were kept exact, set \"idlexact on\" "
+			"or reload the database.",
+			be->be_suffix[0].bv_val );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": %s\n", cr->msg );
+		return LDAP_OTHER;
+	}
+
+	if ( mdb->mi_idl_exact && !( fmt & MDB_FMT_IDLEXACT )) {
+		rc = mdb_dbformat_put( mdb, txn, fmt | MDB_FMT_IDLEXACT );
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"cannot record format: %s (%d).",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": %s\n", cr->msg );
+			return rc;
+		}
+	}
+	return 0;
+}
+
 static int
 mdb_db_open( BackendDB *be, ConfigReply *cr )
 {
@@ -144,7 +237,7 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
-	rc = mdb_env_set_maxdbs( mdb->mi_dbenv, MDB_INDICES );
+	rc = mdb_env_set_maxdbs( mdb->mi_dbenv, MDB_INDICES + MDB_AUXDBS );
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
 			LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
@@ -205,6 +298,8 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 				flags |= MDB_DUPSORT;
 			if ( i == MDB_ID2VAL )
 				flags ^= MDB_INTEGERKEY|MDB_DUPSORT;
+			if ( i == MDB_IDXPROG || i == MDB_DBINFO )
+				flags ^= MDB_INTEGERKEY;
 			if ( !(slapMode & SLAP_TOOL_READONLY) )
 				flags |= MDB_CREATE;
 		}
@@ -214,6 +309,15 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			flags,
 			&mdb->mi_dbis[i] );
 
+		/* databases from before online index progress or
+		 * the format were kept, opened read-only
+		 */
+		if ( rc == MDB_NOTFOUND && ( i == MDB_IDXPROG || i == MDB_DBINFO )) {
+			mdb->mi_dbis[i] = 0;
+			rc = 0;
+			continue;
+		}
+
 		if ( rc != 0 ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
 				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
@@ -266,6 +370,12 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		}
 	}
 
+	rc = mdb_dbformat_check( be, txn, cr );
+	if ( rc ) {
+		mdb_txn_abort( txn );
+		goto fail;
+	}
+
 	rc = mdb_ad_read( mdb, txn );
 	if ( rc ) {
 		mdb_txn_abort( txn );
@@ -283,6 +393,15 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		}
 	}
 
+	/* pick up online index builds that were interrupted */
+	if ( !(slapMode & SLAP_TOOL_MODE) ) {
+		rc = mdb_idxprog_load( be, txn );
+		if ( rc ) {
+			mdb_txn_abort( txn );
+			goto fail;
+		}
+	}
+
 	rc = mdb_txn_commit(txn);
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -292,6 +411,11 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+	rc = mdb_ecache_open( mdb );
+	if ( rc != 0 ) {
+		goto fail;
+	}
+
 	/* monitor setup */
 	rc = mdb_monitor_db_open( be );
 	if ( rc != 0 ) {
@@ -300,6 +424,13 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_flags |= MDB_IS_OPEN;
 
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		if ( mdb->mi_attrs[i]->ai_indexed ) {
+			mdb_index_task_start( be );
+			break;
+		}
+	}
+
 	return 0;
 
 fail:
@@ -318,15 +449,21 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_flags &= ~MDB_IS_OPEN;
 
+	/* don't start counting index keys of a closed env */
+	mdb_attr_stat_task_stop( mdb );
+
 	if( mdb->mi_dbenv ) {
 		mdb_reader_flush( mdb->mi_dbenv );
 	}
 
+	mdb_ecache_close( mdb );
+
 	if ( mdb->mi_dbenv ) {
 		if ( mdb->mi_dbis[0] ) {
 			int i;
 
 			mdb_attr_dbs_close( mdb );
+			mdb_aux_close( mdb );
 			for ( i=0; i<MDB_NDB; i++ )
 				mdb_dbi_close( mdb->mi_dbenv, mdb->mi_dbis[i] );
 
@@ -373,6 +510,8 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
 
 	mdb_attr_index_destroy( mdb );
+	ch_free( mdb->mi_stat_pending );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_stat_mutex );
 
 	ch_free( mdb );
 	be->be_private = NULL;
@@ -441,6 +580,13 @@ mdb_back_initialize(
 			": %s\n", version );
 	}
 
+	{	/* pick the IDL kernels for this CPU */
+		int kern = mdb_idl_kern_init( MDB_IDL_KERN_BEST );
+
+		Debug( LDAP_DEBUG_TRACE, LDAP_XSTRING(mdb_back_initialize)
+			": using %s IDL kernels\n", mdb_idl_kern_name( kern ) );
+	}
+
 	bi->bi_open = 0;
 	bi->bi_close = 0;
 	bi->bi_config = 0;
@@ -462,6 +608,9 @@ mdb_back_initialize(
 
 	bi->bi_op_unbind = 0;
 	bi->bi_op_txn = mdb_txn;
+	bi->bi_aux_open = mdb_aux_open;
+	bi->bi_aux_put = mdb_aux_put;
+	bi->bi_aux_walk = mdb_aux_walk;
 
 	bi->bi_extended = mdb_extended;
 
@@ -756,6 +756,11 @@ mdb_modify( Operation *op, SlapReply *rs )
 	/* Only free attrs if they were dup'd.  */
 	if ( dummy.e_attrs == e->e_attrs ) dummy.e_attrs = NULL;
 	if( moi == &opinfo ) {
+		if( !op->o_noop && slap_precommit_play( op ) != LDAP_SUCCESS ) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "txn precommit failed";
+			goto return_results;
+		}
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
@@ -765,7 +770,7 @@ mdb_modify( Operation *op, SlapReply *rs )
 			txn = NULL;
 			goto return_results;
 		} else {
-			rs->sr_err = mdb_txn_commit( txn );
+			rs->sr_err = mdb_attr_stat_commit( mdb, txn );
 			if ( rs->sr_err )
 				mdb->mi_numads = numads;
 			txn = NULL;
@@ -530,6 +530,11 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 	}
 
 	if( moi == &opinfo ) {
+		if( !op->o_noop && slap_precommit_play( op ) != LDAP_SUCCESS ) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "txn precommit failed";
+			goto return_results;
+		}
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
@@ -539,7 +544,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 			goto return_results;
 
 		} else {
-			if(( rs->sr_err=mdb_txn_commit( txn )) != 0 ) {
+			if(( rs->sr_err=mdb_attr_stat_commit( mdb, txn )) != 0 ) {
 				rs->sr_text = "txn_commit failed";
 			} else {
 				rs->sr_err = LDAP_SUCCESS;
@@ -50,6 +50,25 @@ static AttributeDescription *ad_olmMDBReadersMax,
 
 static AttributeDescription *ad_olmMDBEntries;
 
+static AttributeDescription *ad_olmMDBIndexStats;
+
+static AttributeDescription *ad_olmMDBEntryCacheHits,
+	*ad_olmMDBEntryCacheMisses;
+
+static AttributeDescription *ad_olmMDBIndexProgress;
+
+static int
+mdb_monitor_stats_entry_add(
+	struct mdb_info	*mdb,
+	MDB_txn		*txn,
+	Entry		*e );
+
+static int
+mdb_monitor_progress_entry_add(
+	struct mdb_info	*mdb,
+	MDB_txn		*txn,
+	Entry		*e );
+
 /*
  * NOTE: there's some confusion in monitor OID arc;
  * by now, let's consider:
@@ -143,6 +162,38 @@ static struct {
 		"NO-USER-MODIFICATION "
 		"USAGE dSAOperation )",
 		&ad_olmMDBEntries },
+
+	{ "( olmMDBAttributes:7 "
+		"NAME ( 'olmMDBIndexStats' ) "
+		"DESC 'Approximate key statistics of an attribute index' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBIndexStats },
+
+	{ "( olmMDBAttributes:8 "
+		"NAME ( 'olmMDBEntryCacheHits' ) "
+		"DESC 'Number of entries found in the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBEntryCacheHits },
+
+	{ "( olmMDBAttributes:9 "
+		"NAME ( 'olmMDBEntryCacheMisses' ) "
+		"DESC 'Number of entries not found in the entry cache' "
+		"SUP monitorCounter "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBEntryCacheMisses },
+
+	{ "( olmMDBAttributes:10 "
+		"NAME ( 'olmMDBIndexProgress' ) "
+		"DESC 'Progress of an online index build' "
+		"SUP monitoredInfo "
+		"NO-USER-MODIFICATION "
+		"USAGE dSAOperation )",
+		&ad_olmMDBIndexProgress },
 	{ NULL }
 };
 
@@ -162,6 +213,9 @@ static struct {
 #endif /* MDB_MONITOR_IDX */
 			"$ olmMDBPagesMax $ olmMDBPagesUsed $ olmMDBPagesFree "
 			"$ olmMDBReadersMax $ olmMDBReadersUsed $ olmMDBEntries "
+			"$ olmMDBIndexStats "
+			"$ olmMDBEntryCacheHits $ olmMDBEntryCacheMisses "
+			"$ olmMDBIndexProgress "
 			") )",
 		&oc_olmMDBDatabase },
 
@@ -182,6 +236,7 @@ mdb_monitor_update(
 	MDB_stat mst;
 	MDB_envinfo mei;
 	MDB_txn *txn;
+	unsigned long hits, misses;
 	int rc;
 
 #ifdef MDB_MONITOR_IDX
@@ -216,6 +271,20 @@ mdb_monitor_update(
 	bv.bv_len = snprintf( buf, sizeof( buf ), "%u", mei.me_numreaders );
 	ber_bvreplace( &a->a_vals[ 0 ], &bv );
 
+	mdb_ecache_counters( mdb, &hits, &misses );
+
+	a = attr_find( e->e_attrs, ad_olmMDBEntryCacheHits );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", hits );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
+	a = attr_find( e->e_attrs, ad_olmMDBEntryCacheMisses );
+	assert( a != NULL );
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", misses );
+	ber_bvreplace( &a->a_vals[ 0 ], &bv );
+
 	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
 	if ( !rc ) {
 		MDB_cursor *cursor;
@@ -238,6 +307,9 @@ mdb_monitor_update(
 		bv.bv_len = snprintf( buf, sizeof( buf ), "%lu", mst.ms_entries );
 		ber_bvreplace( &a->a_vals[ 0 ], &bv );
 
+		mdb_monitor_stats_entry_add( mdb, txn, e );
+		mdb_monitor_progress_entry_add( mdb, txn, e );
+
 		mdb_txn_abort( txn );
 
 		a = attr_find( e->e_attrs, ad_olmMDBPagesFree );
@@ -436,7 +508,7 @@ mdb_monitor_db_open( BackendDB *be )
 	}
 
 	/* alloc as many as required (plus 1 for objectClass) */
-	a = attrs_alloc( 1 + 7 );
+	a = attrs_alloc( 1 + 9 );
 	if ( a == NULL ) {
 		rc = 1;
 		goto cleanup;
@@ -472,6 +544,14 @@ mdb_monitor_db_open( BackendDB *be )
 		next->a_desc = ad_olmMDBEntries;
 		attr_valadd( next, &bv, NULL, 1 );
 		next = next->a_next;
+
+		next->a_desc = ad_olmMDBEntryCacheHits;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
+
+		next->a_desc = ad_olmMDBEntryCacheMisses;
+		attr_valadd( next, &bv, NULL, 1 );
+		next = next->a_next;
 	}
 
 	{
@@ -607,6 +687,185 @@ mdb_monitor_db_destroy( BackendDB *be )
 	return 0;
 }
 
+static int
+heavy_cmp( const void *v1, const void *v2 )
+{
+	const mdb_heavykey *h1 = v1, *h2 = v2;
+
+	return ( h1->hk_count < h2->hk_count ) - ( h1->hk_count > h2->hk_count );
+}
+
+/* Format the statistics of one index as
+ * <attr>#keys=<n>#ids=<n>#avg=<n.nn>#present=<n>#heavy=<key>:<n>,...
+ * with the largest keys shown in hex, biggest first, or as
+ * <attr>#notready while its keys are still being counted.
+ */
+static void
+mdb_monitor_stats_unparse( AttrInfo *ai, BerVarray *valp )
+{
+	mdb_idxstat *st = &ai->ai_stat;
+	mdb_heavykey heavy[ MDB_STAT_HEAVY ];
+	struct berval bv;
+	char buf[ 256 + MDB_STAT_HEAVY * ( 2 * MDB_STAT_KEYLEN + 24 ) ], *ptr;
+	ID avg;
+	int i, j, n = 0;
+
+	if ( !st->is_seeded ) {
+		bv.bv_len = snprintf( buf, 256, "%s#notready",
+			ai->ai_desc->ad_cname.bv_val );
+		bv.bv_val = buf;
+		value_add_one( valp, &bv );
+		return;
+	}
+
+	avg = st->is_keys ? st->is_ids * 100 / st->is_keys : 0;
+	ptr = buf + snprintf( buf, 256, "%s#keys=%lu#ids=%lu#avg=%lu.%02lu#present=%lu",
+		ai->ai_desc->ad_cname.bv_val,
+		(unsigned long)st->is_keys, (unsigned long)st->is_ids,
+		(unsigned long)( avg / 100 ), (unsigned long)( avg % 100 ),
+		(unsigned long)st->is_present );
+	if ( ptr > buf + 255 )
+		ptr = buf + 255;
+
+	for ( i = 0; i < MDB_STAT_HEAVY; i++ ) {
+		if ( st->is_heavy[i].hk_len )
+			heavy[n++] = st->is_heavy[i];
+	}
+	qsort( heavy, n, sizeof( mdb_heavykey ), heavy_cmp );
+	for ( i = 0; i < n; i++ ) {
+		ptr = lutil_strcopy( ptr, i ? "," : "#heavy=" );
+		for ( j = 0; j < heavy[i].hk_len; j++ )
+			ptr += sprintf( ptr, "%02x", heavy[i].hk_key[j] );
+		ptr += sprintf( ptr, ":%lu", (unsigned long)heavy[i].hk_count );
+	}
+
+	bv.bv_val = buf;
+	bv.bv_len = ptr - buf;
+	value_add_one( valp, &bv );
+}
+
+static int
+mdb_monitor_stats_entry_add(
+	struct mdb_info	*mdb,
+	MDB_txn		*txn,
+	Entry		*e )
+{
+	BerVarray	vals = NULL;
+	Attribute	*a;
+	int		i, notready = 0;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_stat_mutex );
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[ i ];
+
+		if ( !ai->ai_indexmask || !ai->ai_dbi )
+			continue;
+		if ( !mdb_attr_stat_ready( mdb, ai ))
+			notready = 1;
+		mdb_monitor_stats_unparse( ai, &vals );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_stat_mutex );
+
+	/* the first look at an index has its keys counted */
+	if ( notready )
+		mdb_attr_stat_task_start( mdb );
+
+	a = attr_find( e->e_attrs, ad_olmMDBIndexStats );
+	if ( vals != NULL ) {
+		if ( a != NULL ) {
+			assert( a->a_nvals == a->a_vals );
+
+			ber_bvarray_free( a->a_vals );
+
+		} else {
+			Attribute	**ap;
+
+			for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
+				;
+			*ap = attr_alloc( ad_olmMDBIndexStats );
+			a = *ap;
+		}
+		a->a_vals = vals;
+		a->a_nvals = a->a_vals;
+		for ( i = 0; !BER_BVISNULL( &vals[ i ] ); i++ )
+			;
+		a->a_numvals = i;
+	}
+
+	return 0;
+}
+
+/* Show each online index build as <attr>#next=<id>#last=<id>, where
+ * the IDs from next to last are still to be indexed.
+ */
+static int
+mdb_monitor_progress_entry_add(
+	struct mdb_info	*mdb,
+	MDB_txn		*txn,
+	Entry		*e )
+{
+	BerVarray	vals = NULL;
+	Attribute	*a;
+	MDB_cursor	*mc;
+	MDB_val		key, data;
+	ID		last = 0;
+	int		i;
+
+	if ( mdb_cursor_open( txn, mdb->mi_id2entry, &mc ) == 0 ) {
+		if ( mdb_cursor_get( mc, &key, &data, MDB_LAST ) == 0 )
+			memcpy( &last, key.mv_data, sizeof( ID ));
+		mdb_cursor_close( mc );
+	}
+
+	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[ i ];
+		mdb_idxprog ip;
+		struct berval bv;
+		char buf[ 256 ];
+		ID next = 1;
+
+		if ( !ai->ai_indexed )
+			continue;
+		if ( mdb_idxprog_get( mdb, txn, ai, &ip ) == 0 )
+			next = ip.ip_next;
+		bv.bv_val = buf;
+		bv.bv_len = snprintf( buf, sizeof( buf ), "%s#next=%lu#last=%lu",
+			ai->ai_desc->ad_cname.bv_val,
+			(unsigned long)next, (unsigned long)last );
+		if ( bv.bv_len >= sizeof( buf ))
+			bv.bv_len = sizeof( buf ) - 1;
+		value_add_one( &vals, &bv );
+	}
+
+	a = attr_find( e->e_attrs, ad_olmMDBIndexProgress );
+	if ( vals == NULL ) {
+		if ( a != NULL )
+			attr_delete( &e->e_attrs, ad_olmMDBIndexProgress );
+		return 0;
+	}
+
+	if ( a != NULL ) {
+		assert( a->a_nvals == a->a_vals );
+
+		ber_bvarray_free( a->a_vals );
+
+	} else {
+		Attribute	**ap;
+
+		for ( ap = &e->e_attrs; *ap != NULL; ap = &(*ap)->a_next )
+			;
+		*ap = attr_alloc( ad_olmMDBIndexProgress );
+		a = *ap;
+	}
+	a->a_vals = vals;
+	a->a_nvals = a->a_vals;
+	for ( i = 0; !BER_BVISNULL( &vals[ i ] ); i++ )
+		;
+	a->a_numvals = i;
+
+	return 0;
+}
+
 #ifdef MDB_MONITOR_IDX
 
 #define MDB_MONITOR_IDX_TYPES	(4)
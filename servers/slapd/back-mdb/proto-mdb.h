@@ -55,6 +55,15 @@ void mdb_attr_multi_thresh LDAP_P(( struct mdb_info *mdb, AttributeDescription *
 
 void mdb_attr_info_free( AttrInfo *ai );
 
+void mdb_attr_stat_update( struct mdb_info *mdb, mdb_idxstat *st,
+	MDB_val *key, ID count, int dkeys, int dids );
+void mdb_attr_stat_begin( struct mdb_info *mdb );
+int mdb_attr_stat_commit( struct mdb_info *mdb, MDB_txn *txn );
+void mdb_attr_stat_reset( struct mdb_info *mdb, AttrInfo *ai );
+int mdb_attr_stat_ready( struct mdb_info *mdb, AttrInfo *ai );
+void mdb_attr_stat_task_start( struct mdb_info *mdb );
+void mdb_attr_stat_task_stop( struct mdb_info *mdb );
+
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads );
@@ -64,6 +73,13 @@ void mdb_ad_unwind( struct mdb_info *mdb, int prev_ads );
  */
 
 int mdb_back_init_cf( BackendInfo *bi );
+void mdb_index_task_start( BackendDB *be );
+
+/*
+ * init.c
+ */
+
+int mdb_dbformat_put( struct mdb_info *mdb, MDB_txn *txn, unsigned format );
 
 /*
  * dn2entry.c
@@ -162,6 +178,15 @@ void mdb_dn2id_wrestore(
 
 MDB_cmp_func mdb_dup_compare;
 
+/*
+ * extra.c
+ */
+
+extern BI_aux_open	mdb_aux_open;
+extern BI_aux_put	mdb_aux_put;
+extern BI_aux_walk	mdb_aux_walk;
+void mdb_aux_close( struct mdb_info *mdb );
+
 /*
  * filterentry.c
  */
@@ -174,6 +199,18 @@ int mdb_filter_candidates(
 	ID *tmp,
 	ID *stack );
 
+/*
+ * ecache.c
+ */
+
+int mdb_ecache_open( struct mdb_info *mdb );
+void mdb_ecache_close( struct mdb_info *mdb );
+int mdb_ecache_get( Operation *op, MDB_txn *txn, ID id, Entry **e );
+void mdb_ecache_put( Operation *op, MDB_txn *txn, Entry *e );
+void mdb_ecache_del( struct mdb_info *mdb, MDB_txn *txn, ID id );
+void mdb_ecache_counters( struct mdb_info *mdb,
+	unsigned long *hits, unsigned long *misses );
+
 /*
  * id2entry.c
  */
@@ -215,7 +252,8 @@ BI_entry_release_rw mdb_entry_release;
 BI_entry_get_rw mdb_entry_get;
 BI_op_txn mdb_txn;
 
-int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id, Entry **e );
+int mdb_entry_decode( Operation *op, MDB_txn *txn, MDB_val *data, ID id,
+	AttributeDescription **ads, Entry **e );
 
 void mdb_reader_flush( MDB_env *env );
 int mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **moi );
@@ -238,13 +276,21 @@ int mdb_idl_fetch_key(
 	MDB_cursor	**saved_cursor,
 	int                     get_flag );
 
+int mdb_idl_count_key(
+	BackendDB	*be,
+	MDB_txn		*txn,
+	MDB_dbi		dbi,
+	MDB_val		*key,
+	ID			*count );
+
 int mdb_idl_insert( ID *ids, ID id );
 
 typedef int (mdb_idl_keyfunc)(
 	BackendDB *be,
 	MDB_cursor *mc,
 	struct berval *key,
-	ID id );
+	ID id,
+	mdb_idxstat *st );
 
 mdb_idl_keyfunc mdb_idl_insert_keys;
 mdb_idl_keyfunc mdb_idl_delete_keys;
@@ -284,7 +330,27 @@ mdb_index_param LDAP_P((
 	int ftype,
 	MDB_dbi *dbi,
 	slap_mask_t *mask,
-	struct berval *prefix ));
+	struct berval *prefix,
+	AttrInfo **partial ));
+
+extern int
+mdb_idxprog_get LDAP_P((
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	mdb_idxprog *ip ));
+
+extern int
+mdb_idxprog_put LDAP_P((
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	AttrInfo *ai,
+	ID next ));
+
+extern int
+mdb_idxprog_load LDAP_P((
+	BackendDB *be,
+	MDB_txn *txn ));
 
 extern int
 mdb_index_values LDAP_P((
@@ -333,6 +399,14 @@ mdb_key_read(
     MDB_cursor **saved_cursor,
         int get_flags );
 
+extern int
+mdb_key_count(
+	Backend	*be,
+	MDB_txn *txn,
+	MDB_dbi dbi,
+	struct berval *k,
+	ID *count );
+
 /*
  * nextid.c
  */
@@ -405,6 +479,8 @@ extern BI_tool_entry_modify		mdb_tool_entry_modify;
 extern BI_tool_entry_delete		mdb_tool_entry_delete;
 
 extern mdb_idl_keyfunc mdb_tool_idl_add;
+extern mdb_idl_keyfunc mdb_tool_bulk_add;
+int mdb_tool_bulk_open( MDB_txn *txn, AttrInfo *ai );
 
 LDAP_END_DECL
 
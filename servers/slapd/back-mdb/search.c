@@ -416,6 +416,139 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, IdSc
 	return rc;
 }
 
+/* Candidates are first decoded with only the attributes the filter
+ * needs, and the rest of the entry is only decoded once it matches.
+ * This is only safe if nothing else looks at the entry before then,
+ * so the ACLs that test_filter() may evaluate are checked for the
+ * attributes they use as well.
+ */
+#define LAZY_MAXADS	16
+#define LAZY_PROBE	32	/* candidates to test before giving up */
+
+typedef struct lazy_ads {
+	int la_n;
+	AttributeDescription *la_ads[LAZY_MAXADS+1];
+} lazy_ads;
+
+static int
+lazy_ad_add( lazy_ads *la, AttributeDescription *ad )
+{
+	int i;
+
+	for ( i = 0; i < la->la_n; i++ ) {
+		if ( la->la_ads[i] == ad )
+			return 0;
+	}
+	if ( la->la_n == LAZY_MAXADS )
+		return -1;
+	la->la_ads[la->la_n++] = ad;
+	la->la_ads[la->la_n] = NULL;
+	return 0;
+}
+
+static int
+lazy_filter_ads( lazy_ads *la, Filter *f )
+{
+	for ( ; f; f = f->f_next ) {
+		switch ( f->f_choice & SLAPD_FILTER_MASK ) {
+		case LDAP_FILTER_AND:
+		case LDAP_FILTER_OR:
+		case LDAP_FILTER_NOT:
+			if ( lazy_filter_ads( la, f->f_list ))
+				return -1;
+			break;
+		case SLAPD_FILTER_COMPUTED:
+			break;
+		case LDAP_FILTER_PRESENT:
+			if ( lazy_ad_add( la, f->f_desc ))
+				return -1;
+			break;
+		case LDAP_FILTER_SUBSTRINGS:
+			if ( lazy_ad_add( la, f->f_sub_desc ))
+				return -1;
+			break;
+		case LDAP_FILTER_EXT:
+			/* no description means any attribute */
+			if ( !f->f_mr_desc || lazy_ad_add( la, f->f_mr_desc ))
+				return -1;
+			break;
+		default:
+			if ( lazy_ad_add( la, f->f_av_desc ))
+				return -1;
+			break;
+		}
+	}
+	return 0;
+}
+
+static int
+lazy_acl_ads( lazy_ads *la, AccessControl *a )
+{
+	Access *b;
+
+	for ( ; a; a = a->acl_next ) {
+		if ( a->acl_filter && lazy_filter_ads( la, a->acl_filter ))
+			return -1;
+		for ( b = a->acl_access; b; b = b->a_next ) {
+			/* sets and dynamic ACLs may look at anything */
+			if ( !BER_BVISEMPTY( &b->a_set_pat ))
+				return -1;
+#ifdef SLAP_DYNACL
+			if ( b->a_dynacl )
+				return -1;
+#endif /* SLAP_DYNACL */
+			if ( b->a_dn_at && lazy_ad_add( la, b->a_dn_at ))
+				return -1;
+			if ( b->a_realdn_at && lazy_ad_add( la, b->a_realdn_at ))
+				return -1;
+			/* the entry may be the group itself */
+			if ( !BER_BVISEMPTY( &b->a_group_pat ) &&
+				lazy_ad_add( la, b->a_group_at ))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/* Returns 0 if candidates may be decoded lazily */
+static int
+lazy_ads_init( Operation *op, lazy_ads *la )
+{
+	la->la_n = 0;
+	la->la_ads[0] = NULL;
+
+	if ( op->o_bd->bd_info->bi_access_allowed )
+		return -1;
+	if ( lazy_ad_add( la, slap_schema.si_ad_objectClass ) ||
+		lazy_filter_ads( la, op->oq_search.rs_filter ) ||
+		lazy_acl_ads( la, op->o_bd->be_acl ) ||
+		lazy_acl_ads( la, frontendDB->be_acl ))
+		return -1;
+	return 0;
+}
+
+/* Decode the rest of a lazily decoded entry */
+static int
+lazy_entry_finish( Operation *op, MDB_txn *txn, MDB_val *data, Entry **ep )
+{
+	Entry *e = *ep, *x;
+	int rc;
+
+	rc = mdb_entry_decode( op, txn, data, e->e_id, NULL, &x );
+	if ( rc ) {
+		mdb_entry_return( op, e );
+		*ep = NULL;
+		return rc;
+	}
+	x->e_id = e->e_id;
+	x->e_name = e->e_name;
+	x->e_nname = e->e_nname;
+	op->o_tmpfree( e, op->o_tmpmemctx );
+	mdb_ecache_put( op, txn, x );
+	*ep = x;
+	return 0;
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
@@ -436,6 +569,9 @@ mdb_search( Operation *op, SlapReply *rs )
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	lazy_ads	la;
+	int		lazy;
+	unsigned	lazy_tested = 0, lazy_matched = 0;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -722,6 +858,8 @@ adminlimit:
 		tentries = ncand;
 	}
 
+	lazy = !lazy_ads_init( op, &la );
+
 	wwctx.flag = 0;
 	wwctx.nentries = 0;
 	/* If we're running in our own read txn */
@@ -798,10 +936,11 @@ adminlimit:
 
 	while (id != NOID)
 	{
-		int scopeok;
+		int scopeok, partial;
 		MDB_val edata;
 
 loop_begin:
+		partial = 0;
 
 		/* check for abandon */
 		if ( op->o_abandon ) {
@@ -830,6 +969,8 @@ loop_begin:
 			goto done;
 		}
 
+		/* don't sit on entries already sent while looking for more */
+		slap_stream_check( op );
 
 		if ( nsubs < ncand ) {
 			unsigned i;
@@ -839,6 +980,11 @@ loop_begin:
 				if ( id >= MDB_IDL_RANGE_FIRST( candidates ) &&
 					id <= MDB_IDL_RANGE_LAST( candidates ))
 					scopeok = 1;
+			} else if (MDB_IDL_IS_RUNS( candidates )) {
+				i = mdb_idl_runs_search( candidates, id );
+				if (i <= MDB_IDL_NRUNS( candidates ) &&
+					MDB_IDL_RUN_LO( candidates, i ) <= id )
+					scopeok = 1;
 			} else {
 				i = mdb_idl_search( candidates, id );
 				if (i <= candidates[0] && candidates[i] == id )
@@ -898,7 +1044,7 @@ loop_begin:
 scopeok:
 		if ( id == base->e_id ) {
 			e = base;
-		} else {
+		} else if ( mdb_ecache_get( op, ltid, id, &e ) != 0 ) {
 
 			/* get the entry */
 			rs->sr_err = mdb_id2edata( op, mci, id, &edata );
@@ -936,8 +1082,10 @@ notfound:
 				goto done;
 			}
 
-			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id, &e );
+			rs->sr_err = mdb_entry_decode( op, ltid, &edata, id,
+				lazy ? la.la_ads : NULL, &e );
 			if ( rs->sr_err ) {
+decode_fail:
 				rs->sr_err = LDAP_OTHER;
 				rs->sr_text = "internal error in mdb_entry_decode";
 				send_ldap_result( op, rs );
@@ -946,6 +1094,10 @@ notfound:
 			e->e_id = id;
 			e->e_name.bv_val = NULL;
 			e->e_nname.bv_val = NULL;
+			if ( lazy )
+				partial = 1;
+			else
+				mdb_ecache_put( op, ltid, e );
 		}
 
 		if ( is_entry_subentry( e ) ) {
@@ -1050,7 +1202,11 @@ notfound:
 		if ( !manageDSAit && op->oq_search.rs_scope != LDAP_SCOPE_BASE
 			&& is_entry_referral( e ) )
 		{
-			BerVarray erefs = get_entry_referrals( op, e );
+			BerVarray erefs;
+
+			if ( partial && lazy_entry_finish( op, ltid, &edata, &e ))
+				goto decode_fail;
+			erefs = get_entry_referrals( op, e );
 			rs->sr_ref = referral_rewrite( erefs, &e->e_name, NULL,
 				op->oq_search.rs_scope == LDAP_SCOPE_ONELEVEL
 					? LDAP_SCOPE_BASE : LDAP_SCOPE_SUBTREE );
@@ -1075,6 +1231,18 @@ notfound:
 		/* if it matches the filter and scope, send it */
 		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
 
+		if ( partial ) {
+			lazy_tested++;
+			if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
+				lazy_matched++;
+				if ( lazy_entry_finish( op, ltid, &edata, &e ))
+					goto decode_fail;
+			}
+			/* not worth it if most candidates match */
+			if ( lazy_tested >= LAZY_PROBE && lazy_matched > lazy_tested / 2 )
+				lazy = 0;
+		}
+
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
 			/* check size limit */
 			if ( get_pagedresults(op) > SLAP_CONTROL_IGNORED ) {
@@ -1424,7 +1592,7 @@ static int search_candidates(
 	} else {
 		Debug(LDAP_DEBUG_TRACE,
 			"mdb_search_candidates: id=%ld first=%ld last=%ld\n",
-			(long) ids[0],
+			(long) MDB_IDL_N( ids ),
 			(long) MDB_IDL_FIRST(ids),
 			(long) MDB_IDL_LAST(ids) );
 	}
@@ -17,8 +17,10 @@
 #include "portable.h"
 
 #include <stdio.h>
+#include <ac/stdlib.h>
 #include <ac/string.h>
 #include <ac/errno.h>
+#include <ac/unistd.h>
 
 #define AVL_INTERNAL
 #include "back-mdb.h"
@@ -86,6 +88,7 @@ static ldap_pvt_thread_cond_t mdb_tool_index_cond_work;
 static void * mdb_tool_index_task( void *ctx, void *ptr );
 
 static int	mdb_writes, mdb_writes_per_commit;
+static int	mdb_tool_reindexed;
 
 /* Number of ops per commit in Quick mode.
  * Batching speeds writes overall, but too large a
@@ -98,6 +101,8 @@ static int	mdb_writes, mdb_writes_per_commit;
 static int
 mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep );
 
+static int mdb_tool_bulk_finish( BackendDB *be );
+
 int mdb_tool_entry_open(
 	BackendDB *be, int mode )
 {
@@ -229,6 +234,11 @@ int mdb_tool_entry_close(
 		txi = NULL;
 	}
 
+	mdb_tool_reindexed = 0;
+
+	if ( mdb_tool_bulk_finish( be ))
+		return -1;
+
 	if( nholes ) {
 		unsigned i;
 		fprintf( stderr, "Error, entries missing!\n");
@@ -413,7 +423,7 @@ mdb_tool_entry_get_int( BackendDB *be, ID id, Entry **ep )
 			}
 		}
 	}
-	rc = mdb_entry_decode( &op, mdb_tool_txn, &data, id, &e );
+	rc = mdb_entry_decode( &op, mdb_tool_txn, &data, id, NULL, &e );
 	e->e_id = id;
 	if ( !BER_BVISNULL( &dn )) {
 		e->e_name = dn;
@@ -890,6 +900,17 @@ int mdb_tool_entry_reindex(
 		}
 	}
 
+	/* these indexes are rebuilt here, forget any online build */
+	if ( !mdb_tool_reindexed ) {
+		int i;
+		for ( i=0; i < mi->mi_nattrs; i++ ) {
+			rc = mdb_idxprog_put( mi, txi, mi->mi_attrs[i], 0 );
+			if ( rc )
+				goto done;
+		}
+		mdb_tool_reindexed = 1;
+	}
+
 	if ( slapMode & SLAP_TRUNCATE_MODE ) {
 		int i;
 		for ( i=0; i < mi->mi_nattrs; i++ ) {
@@ -1091,6 +1112,19 @@ int mdb_tool_entry_delete(
 		mdb_cursor_close( cursor );
 		cursor = NULL;
 	}
+
+	/* deindexing needs any collected index keys in place */
+	rc = mdb_tool_bulk_finish( be );
+	if( rc != 0 ) {
+		snprintf( text->bv_val, text->bv_len,
+			"bulk index write failed: %s (%d)",
+			mdb_strerror(rc), rc );
+		Debug( LDAP_DEBUG_ANY,
+			"=> " LDAP_XSTRING(mdb_tool_entry_delete) ": %s\n",
+			 text->bv_val );
+		return LDAP_OTHER;
+	}
+
 	if( !mdb_tool_txn ) {
 		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &mdb_tool_txn );
 		if( rc != 0 ) {
@@ -1403,7 +1437,8 @@ int mdb_tool_idl_add(
 	BackendDB *be,
 	MDB_cursor *mc,
 	struct berval *keys,
-	ID id )
+	ID id,
+	mdb_idxstat *st )
 {
 	MDB_dbi dbi;
 	mdb_tool_idl_cache *ic, itmp;
@@ -1508,6 +1543,614 @@ int mdb_tool_idl_add(
 }
 #endif /* MDB_TOOL_IDL_CACHING */
 
+/* Sorted bulk index construction, for slapadd -q and slapindex -q.
+ *
+ * Inserting the keys of each entry as it is added makes random writes
+ * all over the index DBs. Instead, the (key, ID) pairs of every index
+ * that was empty to begin with are collected in memory; full buffers
+ * are sorted and spilled to temporary run files in the database
+ * directory. When the tool is done, or before anything else needs the
+ * indices, the runs are merged and each index DB is written in key
+ * order with MDB_APPEND/MDB_APPENDDUP, so every page is filled once.
+ *
+ * No more than MDB_TOOL_BULK_FANIN runs are merged at once. Whenever
+ * that many runs of the same generation pile up they are merged into
+ * one run of the next, which keeps the number of open run files and
+ * the passes over the data logarithmic in the size of the index.
+ */
+#ifndef MDB_TOOL_BULK_RUN
+#define MDB_TOOL_BULK_RUN	(16*1024*1024)	/* bytes per run and index */
+#endif
+#ifndef MDB_TOOL_BULK_TXN
+#define MDB_TOOL_BULK_TXN	(256*1024)	/* IDs written per commit */
+#endif
+#ifndef MDB_TOOL_BULK_FANIN
+#define MDB_TOOL_BULK_FANIN	16	/* runs merged at once */
+#endif
+
+typedef struct mdb_tool_bulk_rec {
+	ID br_id;
+	unsigned short br_len;
+	unsigned char br_key[1];
+} mdb_tool_bulk_rec;
+
+#define BULK_HDRSIZE	offsetof(mdb_tool_bulk_rec, br_key)
+#define BULK_RECSIZE(len)	((BULK_HDRSIZE + (len) + sizeof(ID) - 1) & ~(sizeof(ID) - 1))
+
+typedef struct mdb_tool_bulk {
+	int bk_active;		/* index was empty, keys are being collected */
+	char *bk_buf;		/* records of the current run */
+	size_t bk_used;
+	mdb_tool_bulk_rec **bk_recs;
+	size_t bk_nrecs, bk_maxrecs;
+	FILE **bk_runs;		/* sorted runs spilled so far */
+	int *bk_gens;		/* merges that went into each run */
+	int bk_nruns;
+} mdb_tool_bulk;
+
+/* One input of the merge, either a run file or the last in-memory run */
+typedef struct mdb_tool_bulk_src {
+	FILE *bs_fp;
+	mdb_tool_bulk_rec **bs_recs;
+	size_t bs_nrecs;
+	mdb_tool_bulk_rec *bs_cur;
+	mdb_tool_bulk_rec *bs_buf;
+} mdb_tool_bulk_src;
+
+/* Same order as LMDB's default key comparison, then by ID */
+static int
+mdb_tool_bulk_cmp( const mdb_tool_bulk_rec *r1, const mdb_tool_bulk_rec *r2 )
+{
+	int rc;
+
+	rc = memcmp( r1->br_key, r2->br_key,
+		r1->br_len < r2->br_len ? r1->br_len : r2->br_len );
+	if ( !rc )
+		rc = (int)r1->br_len - (int)r2->br_len;
+	if ( !rc )
+		rc = r1->br_id < r2->br_id ? -1 : r1->br_id > r2->br_id;
+	return rc;
+}
+
+static int
+mdb_tool_bulk_qcmp( const void *v1, const void *v2 )
+{
+	return mdb_tool_bulk_cmp( *(mdb_tool_bulk_rec * const *)v1,
+		*(mdb_tool_bulk_rec * const *)v2 );
+}
+
+static void
+mdb_tool_bulk_free( mdb_tool_bulk *bk )
+{
+	int i;
+
+	for ( i=0; i<bk->bk_nruns; i++ )
+		fclose( bk->bk_runs[i] );
+	ch_free( bk->bk_runs );
+	ch_free( bk->bk_gens );
+	ch_free( bk->bk_recs );
+	ch_free( bk->bk_buf );
+	ch_free( bk );
+}
+
+/* Decide whether keys for this index can be collected. Only indices
+ * that are empty when first used qualify, since appending requires
+ * that nothing sorts after the new keys.
+ */
+int
+mdb_tool_bulk_open( MDB_txn *txn, AttrInfo *ai )
+{
+	mdb_tool_bulk *bk = ai->ai_bulk;
+
+	if ( !bk ) {
+		MDB_stat st;
+
+		bk = ch_calloc( 1, sizeof( mdb_tool_bulk ));
+		if ( !( slapMode & SLAP_TOOL_READONLY ) &&
+			mdb_stat( txn, ai->ai_dbi, &st ) == 0 && !st.ms_entries )
+			bk->bk_active = 1;
+		ai->ai_bulk = bk;
+	}
+	return bk->bk_active;
+}
+
+/* Open an anonymous run file in the database directory */
+static FILE *
+mdb_tool_bulk_tmpfile( struct mdb_info *mdb )
+{
+	char *path, ebuf[128];
+	FILE *fp;
+	int fd;
+
+	path = ch_malloc( strlen( mdb->mi_dbenv_home ) + sizeof( LDAP_DIRSEP "bulkXXXXXX" ));
+	sprintf( path, "%s" LDAP_DIRSEP "bulkXXXXXX", mdb->mi_dbenv_home );
+	fd = mkstemp( path );
+	if ( fd < 0 ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_bulk_tmpfile)
+			": cannot create run file \"%s\": %s\n",
+			path, AC_STRERROR_R( errno, ebuf, sizeof(ebuf) ) );
+		ch_free( path );
+		return NULL;
+	}
+	/* nobody else needs to see it */
+	unlink( path );
+	ch_free( path );
+	fp = fdopen( fd, "w+b" );
+	if ( !fp )
+		close( fd );
+	return fp;
+}
+
+/* Write one record to a run file */
+static int
+mdb_tool_bulk_fwrite( mdb_tool_bulk_rec *br, FILE *fp )
+{
+	char ebuf[128];
+
+	if ( fwrite( br, BULK_HDRSIZE + br->br_len, 1, fp ) != 1 ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_bulk_fwrite)
+			": write failed: %s\n",
+			AC_STRERROR_R( errno, ebuf, sizeof(ebuf) ) );
+		return LDAP_OTHER;
+	}
+	return 0;
+}
+
+/* Add a run file to the list */
+static void
+mdb_tool_bulk_addrun( mdb_tool_bulk *bk, FILE *fp, int gen )
+{
+	bk->bk_runs = ch_realloc( bk->bk_runs, ( bk->bk_nruns + 1 ) * sizeof( FILE * ));
+	bk->bk_gens = ch_realloc( bk->bk_gens, ( bk->bk_nruns + 1 ) * sizeof( int ));
+	bk->bk_runs[bk->bk_nruns] = fp;
+	bk->bk_gens[bk->bk_nruns] = gen;
+	bk->bk_nruns++;
+}
+
+static int mdb_tool_bulk_collapse( struct mdb_info *mdb, mdb_tool_bulk *bk,
+	int from );
+
+/* Sort the current run and write it to a temporary file */
+static int
+mdb_tool_bulk_spill( struct mdb_info *mdb, mdb_tool_bulk *bk )
+{
+	mdb_tool_bulk_rec *br, *prev = NULL;
+	FILE *fp;
+	size_t i;
+	int rc, from;
+
+	qsort( bk->bk_recs, bk->bk_nrecs, sizeof( mdb_tool_bulk_rec * ),
+		mdb_tool_bulk_qcmp );
+
+	fp = mdb_tool_bulk_tmpfile( mdb );
+	if ( !fp )
+		return LDAP_OTHER;
+
+	for ( i=0; i<bk->bk_nrecs; i++ ) {
+		br = bk->bk_recs[i];
+		if ( prev && !mdb_tool_bulk_cmp( prev, br ))
+			continue;
+		if ( mdb_tool_bulk_fwrite( br, fp )) {
+			fclose( fp );
+			return LDAP_OTHER;
+		}
+		prev = br;
+	}
+	if ( fflush( fp )) {
+		fclose( fp );
+		return LDAP_OTHER;
+	}
+
+	mdb_tool_bulk_addrun( bk, fp, 0 );
+	bk->bk_used = 0;
+	bk->bk_nrecs = 0;
+
+	/* merge the last runs while they are of the same generation */
+	while (( from = bk->bk_nruns - MDB_TOOL_BULK_FANIN ) >= 0 &&
+		bk->bk_gens[from] == bk->bk_gens[bk->bk_nruns - 1] )
+	{
+		rc = mdb_tool_bulk_collapse( mdb, bk, from );
+		if ( rc )
+			return rc;
+	}
+	return 0;
+}
+
+int
+mdb_tool_bulk_add(
+	BackendDB *be,
+	MDB_cursor *mc,
+	struct berval *keys,
+	ID id,
+	mdb_idxstat *st )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	AttrInfo *ai = (AttrInfo *)mc;
+	mdb_tool_bulk *bk = ai->ai_bulk;
+	mdb_tool_bulk_rec *br;
+	struct berval key;
+	size_t len;
+	int k, rc;
+#ifndef MISALIGNED_OK
+	int kbuf[2];
+#endif
+
+	if ( !bk->bk_buf )
+		bk->bk_buf = ch_malloc( MDB_TOOL_BULK_RUN );
+
+	for ( k=0; keys[k].bv_val; k++ ) {
+		key = keys[k];
+#ifndef MISALIGNED_OK
+		/* store the key as mdb_idl_insert_keys() would */
+		if ( key.bv_len & ALIGNER ) {
+			kbuf[1] = 0;
+			memcpy( kbuf, key.bv_val, key.bv_len );
+			key.bv_val = (char *)kbuf;
+			key.bv_len = sizeof( kbuf );
+		}
+#endif
+		if ( key.bv_len > (ber_len_t)mdb_env_get_maxkeysize( mdb->mi_dbenv )) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_bulk_add)
+				": %s key too long (%lu)\n",
+				ai->ai_desc->ad_cname.bv_val, key.bv_len );
+			return LDAP_OTHER;
+		}
+		len = BULK_RECSIZE( key.bv_len );
+		if ( bk->bk_used + len > MDB_TOOL_BULK_RUN ) {
+			rc = mdb_tool_bulk_spill( mdb, bk );
+			if ( rc )
+				return rc;
+		}
+		if ( bk->bk_nrecs == bk->bk_maxrecs ) {
+			bk->bk_maxrecs = bk->bk_maxrecs ? bk->bk_maxrecs * 2 : 4096;
+			bk->bk_recs = ch_realloc( bk->bk_recs,
+				bk->bk_maxrecs * sizeof( mdb_tool_bulk_rec * ));
+		}
+		br = (mdb_tool_bulk_rec *)( bk->bk_buf + bk->bk_used );
+		br->br_id = id;
+		br->br_len = key.bv_len;
+		memcpy( br->br_key, key.bv_val, key.bv_len );
+		bk->bk_recs[bk->bk_nrecs++] = br;
+		bk->bk_used += len;
+	}
+	return 0;
+}
+
+/* Advance a merge input, returns non-zero at its end */
+static int
+mdb_tool_bulk_next( mdb_tool_bulk_src *bs )
+{
+	if ( !bs->bs_fp ) {
+		if ( !bs->bs_nrecs )
+			return 1;
+		bs->bs_cur = *bs->bs_recs++;
+		bs->bs_nrecs--;
+		return 0;
+	}
+	if ( fread( bs->bs_buf, BULK_HDRSIZE, 1, bs->bs_fp ) != 1 ||
+		( bs->bs_buf->br_len && fread( bs->bs_buf->br_key,
+			bs->bs_buf->br_len, 1, bs->bs_fp ) != 1 ))
+		return 1;
+	bs->bs_cur = bs->bs_buf;
+	return 0;
+}
+
+/* Restore the heap order below slot i */
+static void
+mdb_tool_bulk_sift( mdb_tool_bulk_src **heap, int n, int i )
+{
+	mdb_tool_bulk_src *bs = heap[i];
+	int c;
+
+	while (( c = 2*i + 1 ) < n ) {
+		if ( c + 1 < n &&
+			mdb_tool_bulk_cmp( heap[c+1]->bs_cur, heap[c]->bs_cur ) < 0 )
+			c++;
+		if ( mdb_tool_bulk_cmp( bs->bs_cur, heap[c]->bs_cur ) <= 0 )
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = bs;
+}
+
+/* Set up the merge of the runs from the given one on, and of the
+ * in-memory run if recs is set. The result holds the inputs, their
+ * heap and the record buffers; the first buffer is left for the
+ * caller to copy the current key into.
+ */
+static mdb_tool_bulk_src *
+mdb_tool_bulk_sources(
+	struct mdb_info *mdb,
+	mdb_tool_bulk *bk,
+	int from,
+	mdb_tool_bulk_rec **recs,
+	mdb_tool_bulk_src ***heapp,
+	int *nheapp,
+	mdb_tool_bulk_rec **krp )
+{
+	mdb_tool_bulk_src *srcs, **heap, *bs;
+	mdb_tool_bulk_rec *kr;
+	int i, n, nheap = 0, maxkey;
+
+	n = bk->bk_nruns - from;
+	maxkey = mdb_env_get_maxkeysize( mdb->mi_dbenv );
+	srcs = ch_calloc( n + 1, sizeof( mdb_tool_bulk_src ) +
+		sizeof( mdb_tool_bulk_src * ) + BULK_RECSIZE( maxkey ));
+	heap = (mdb_tool_bulk_src **)( srcs + n + 1 );
+	kr = (mdb_tool_bulk_rec *)( heap + n + 1 );
+	for ( i=0; i<n; i++ ) {
+		bs = &srcs[i];
+		bs->bs_fp = bk->bk_runs[from + i];
+		bs->bs_buf = (mdb_tool_bulk_rec *)((char *)kr +
+			( i + 1 ) * BULK_RECSIZE( maxkey ));
+		rewind( bs->bs_fp );
+		if ( !mdb_tool_bulk_next( bs ))
+			heap[nheap++] = bs;
+	}
+	if ( recs ) {
+		bs = &srcs[i];
+		bs->bs_recs = recs;
+		bs->bs_nrecs = bk->bk_nrecs;
+		if ( !mdb_tool_bulk_next( bs ))
+			heap[nheap++] = bs;
+	}
+	for ( i = nheap / 2 - 1; i >= 0; i-- )
+		mdb_tool_bulk_sift( heap, nheap, i );
+
+	*heapp = heap;
+	*nheapp = nheap;
+	*krp = kr;
+	return srcs;
+}
+
+/* Move on to the next record of the merge */
+static void
+mdb_tool_bulk_pop( mdb_tool_bulk_src **heap, int *nheap )
+{
+	if ( mdb_tool_bulk_next( heap[0] ))
+		heap[0] = heap[--*nheap];
+	if ( *nheap )
+		mdb_tool_bulk_sift( heap, *nheap, 0 );
+}
+
+/* Merge the runs from the given one on into a single run */
+static int
+mdb_tool_bulk_collapse( struct mdb_info *mdb, mdb_tool_bulk *bk, int from )
+{
+	mdb_tool_bulk_src *srcs, **heap;
+	mdb_tool_bulk_rec *br, *kr;
+	FILE *fp;
+	int i, nheap, gen, rc = 0, started = 0;
+
+	fp = mdb_tool_bulk_tmpfile( mdb );
+	if ( !fp )
+		return LDAP_OTHER;
+
+	srcs = mdb_tool_bulk_sources( mdb, bk, from, NULL, &heap, &nheap, &kr );
+	while ( nheap ) {
+		br = heap[0]->bs_cur;
+		if ( !started || mdb_tool_bulk_cmp( kr, br )) {
+			rc = mdb_tool_bulk_fwrite( br, fp );
+			if ( rc )
+				break;
+			memcpy( kr, br, BULK_HDRSIZE + br->br_len );
+			started = 1;
+		}
+		mdb_tool_bulk_pop( heap, &nheap );
+	}
+	ch_free( srcs );
+	if ( !rc && fflush( fp ))
+		rc = LDAP_OTHER;
+	if ( rc ) {
+		fclose( fp );
+		return rc;
+	}
+
+	gen = bk->bk_gens[from] + 1;
+	for ( i=from; i<bk->bk_nruns; i++ )
+		fclose( bk->bk_runs[i] );
+	bk->bk_nruns = from;
+	mdb_tool_bulk_addrun( bk, fp, gen );
+	return 0;
+}
+
+/* Store a list of IDs under a key. The first ID creates the key,
+ * the rest are appended in one call.
+ */
+static int
+mdb_tool_bulk_put( MDB_cursor *mc, MDB_val *key, ID *ids, size_t n, int first )
+{
+	MDB_val data[2];
+	int rc;
+
+	data[0].mv_size = sizeof(ID);
+	if ( first ) {
+		data[0].mv_data = ids;
+		rc = mdb_cursor_put( mc, key, data, MDB_APPEND );
+		if ( rc || n == 1 )
+			return rc;
+		ids++;
+		n--;
+	}
+	data[0].mv_data = ids;
+	data[1].mv_size = n;
+	return mdb_cursor_put( mc, key, data, MDB_APPENDDUP|MDB_MULTIPLE );
+}
+
+/* Merge all runs of an index and write them out */
+static int
+mdb_tool_bulk_write( BackendDB *be, AttrInfo *ai )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_bulk *bk = ai->ai_bulk;
+	mdb_tool_bulk_src *srcs, **heap;
+	mdb_tool_bulk_rec *br, *kr;
+	MDB_txn *txn = NULL;
+	MDB_cursor *mc = NULL;
+	MDB_val key;
+	ID *ids, range[3];
+	size_t n = 0, nput = 0;
+	int nheap, rc = 0, started = 0, isrange = 0;
+	char *err = "";
+
+	if ( !bk->bk_nruns && !bk->bk_nrecs )
+		return 0;
+
+	/* leave room for the in-memory run in the last merge */
+	while ( bk->bk_nruns >= MDB_TOOL_BULK_FANIN ) {
+		rc = mdb_tool_bulk_collapse( mdb, bk,
+			bk->bk_nruns - MDB_TOOL_BULK_FANIN );
+		if ( rc )
+			return rc;
+	}
+
+	qsort( bk->bk_recs, bk->bk_nrecs, sizeof( mdb_tool_bulk_rec * ),
+		mdb_tool_bulk_qcmp );
+
+	/* kr holds the current key, copied out of its input */
+	srcs = mdb_tool_bulk_sources( mdb, bk, 0, bk->bk_recs,
+		&heap, &nheap, &kr );
+
+	ids = ch_malloc( MDB_idl_db_max * sizeof(ID) );
+	kr->br_len = 0;
+
+	for (;;) {
+		br = nheap ? heap[0]->bs_cur : NULL;
+
+		if ( br && started && br->br_len == kr->br_len &&
+			!memcmp( br->br_key, kr->br_key, br->br_len )) {
+			/* another ID for the current key */
+			if ( br->br_id != kr->br_id ) {
+				kr->br_id = br->br_id;
+				if ( isrange ) {
+					range[2] = br->br_id;
+				} else if ( n == MDB_idl_db_max ) {
+					if ( mdb->mi_idl_exact ) {
+						err = "put";
+						rc = mdb_tool_bulk_put( mc, &key, ids, n, started == 1 );
+						if ( rc )
+							break;
+						nput += n;
+						n = 0;
+						started = 2;
+						ids[n++] = br->br_id;
+					} else {
+						/* No room, store a range */
+						isrange = 1;
+						range[0] = 0;
+						range[1] = ids[0];
+						range[2] = br->br_id;
+					}
+				} else {
+					ids[n++] = br->br_id;
+				}
+			}
+		} else {
+			/* finish the previous key */
+			if ( started ) {
+				err = "put";
+				if ( isrange )
+					rc = mdb_tool_bulk_put( mc, &key, range, 3, 1 );
+				else
+					rc = mdb_tool_bulk_put( mc, &key, ids, n, started == 1 );
+				if ( rc )
+					break;
+				nput += isrange ? 3 : n;
+			}
+			if ( !br )
+				break;
+			if ( !txn || nput >= MDB_TOOL_BULK_TXN ) {
+				if ( txn ) {
+					err = "txn_commit";
+					mdb_cursor_close( mc );
+					rc = mdb_txn_commit( txn );
+					txn = NULL;
+					if ( rc )
+						break;
+				}
+				err = "txn_begin";
+				rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+				if ( rc )
+					break;
+				err = "cursor_open";
+				rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
+				if ( rc )
+					break;
+				nput = 0;
+			}
+			memcpy( kr, br, BULK_HDRSIZE + br->br_len );
+			key.mv_data = kr->br_key;
+			key.mv_size = kr->br_len;
+			ids[0] = br->br_id;
+			n = 1;
+			started = 1;
+			isrange = 0;
+		}
+
+		mdb_tool_bulk_pop( heap, &nheap );
+	}
+
+	if ( txn ) {
+		if ( rc ) {
+			mdb_txn_abort( txn );
+		} else {
+			mdb_cursor_close( mc );
+			err = "txn_commit";
+			rc = mdb_txn_commit( txn );
+		}
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_bulk_write)
+			": %s index %s failed: %s (%d)\n",
+			ai->ai_desc->ad_cname.bv_val, err, mdb_strerror(rc), rc );
+	}
+	ch_free( ids );
+	ch_free( srcs );
+	return rc;
+}
+
+/* Write out the keys collected so far. The entries they belong to
+ * are committed first, the index writes use their own txns.
+ */
+static int
+mdb_tool_bulk_finish( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	mdb_tool_bulk *bk;
+	int i, rc = 0;
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		bk = mdb->mi_attrs[i]->ai_bulk;
+		if ( bk && bk->bk_active )
+			break;
+	}
+	if ( i < mdb->mi_nattrs && mdb_tool_txn ) {
+		rc = mdb_txn_commit( mdb_tool_txn );
+		mdb_tool_txn = NULL;
+		idcursor = NULL;
+		mdb_writes = 0;
+		for ( i=0; i<mdb->mi_nattrs; i++ )
+			mdb->mi_attrs[i]->ai_cursor = NULL;
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY, LDAP_XSTRING(mdb_tool_bulk_finish)
+				": txn_commit failed: %s (%d)\n",
+				mdb_strerror(rc), rc );
+		}
+	}
+
+	for ( i=0; i<mdb->mi_nattrs; i++ ) {
+		bk = mdb->mi_attrs[i]->ai_bulk;
+		if ( !bk )
+			continue;
+		if ( bk->bk_active && !rc )
+			rc = mdb_tool_bulk_write( be, mdb->mi_attrs[i] );
+		mdb_tool_bulk_free( bk );
+		mdb->mi_attrs[i]->ai_bulk = NULL;
+	}
+	return rc;
+}
+
 /* Upgrade from pre 2.4.34 dn2id format */
 
 #include <ac/unistd.h>
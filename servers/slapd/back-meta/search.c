@@ -1776,6 +1776,9 @@ free_message:;
 				lutil_timermul( &save_tv, 2, &save_tv );
 			}
 
+			/* don't keep entries from the client while waiting */
+			slap_stream_flush( op );
+
 			if ( alreadybound == 0 ) {
 				tv = save_tv;
 				(void)select( 0, NULL, NULL, NULL, &tv );
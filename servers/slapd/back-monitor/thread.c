@@ -33,6 +33,7 @@ typedef enum {
 	MT_UNKNOWN,
 	MT_RUNQUEUE,
 	MT_TASKLIST,
+	MT_MEMCTX,
 
 	MT_LAST
 } monitor_thread_t;
@@ -86,6 +87,9 @@ static struct {
 	{ BER_BVC( "cn=Tasklist" ),
 		BER_BVC("List of running plus standby threads - besides those handling operations"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKLIST },
+	{ BER_BVC( "cn=Memory Contexts" ),
+		BER_BVC("Per-thread slab allocator statistics"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_MEMCTX },
 
 	{ BER_BVNULL }
 };
@@ -96,6 +100,33 @@ monitor_subsys_thread_update(
 	SlapReply		*rs,
 	Entry 			*e );
 
+typedef struct monitor_memctx_t {
+	BerVarray		vals;
+	int			i;
+} monitor_memctx_t;
+
+static int
+monitor_subsys_thread_memctx(
+	slap_sl_stats_t		*ss,
+	void			*arg )
+{
+	monitor_memctx_t	*mm = arg;
+	char			buf[ BACKMONITOR_BUFSIZE ];
+	struct berval		bv;
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ),
+		"{%d}size=%lu hiwat=%lu reused=%lu chained=%lu fallback=%lu",
+		mm->i, (unsigned long)ss->ss_size, (unsigned long)ss->ss_hiwat,
+		ss->ss_reused, ss->ss_chained, ss->ss_fallback );
+	if ( bv.bv_len < sizeof( buf ) ) {
+		value_add_one( &mm->vals, &bv );
+	}
+	mm->i++;
+
+	return 0;
+}
+
 /*
  * initializes log subentry
  */
@@ -312,6 +343,33 @@ monitor_subsys_thread_update(
 			}
 			break;
 
+		case MT_MEMCTX:
+			if ( a != NULL ) {
+				if ( a->a_nvals != a->a_vals ) {
+					ber_bvarray_free( a->a_nvals );
+				}
+				ber_bvarray_free( a->a_vals );
+				a->a_vals = NULL;
+				a->a_nvals = NULL;
+				a->a_numvals = 0;
+			}
+
+			{
+				monitor_memctx_t	mm = { NULL, 0 };
+
+				(void)slap_sl_mem_stats( monitor_subsys_thread_memctx, &mm );
+				vals = mm.vals;
+			}
+
+			if ( vals ) {
+				attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+				ber_bvarray_free( vals );
+
+			} else {
+				attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			}
+			break;
+
 		default:
 			assert( 0 );
 		}
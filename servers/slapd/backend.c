@@ -1085,6 +1085,30 @@ done:;
 	return rs->sr_err;
 }
 
+/* Classify op in its target database op->o_bd: o_prio gets the class
+ * of the limits matching identity ndn, o_dbprio the class of the
+ * operation type, falling back to the global one.
+ */
+void
+backend_op_prio( Operation *op, struct berval *ndn )
+{
+	slap_op_t opidx = slap_req2op( op->o_tag );
+	int prio;
+
+	if ( op->o_bd == NULL || op->o_bd->bd_self == frontendDB ||
+			opidx == SLAP_OP_LAST )
+		return;
+
+	op->o_prio = limits_get_prio( op, ndn );
+
+	prio = SLAP_OPPRIO( op->o_bd, opidx );
+	if ( prio == SLAP_PRIO_DEFAULT )
+		prio = SLAP_OPPRIO( frontendDB, opidx );
+	if ( prio == SLAP_PRIO_DEFAULT )
+		prio = SLAP_PRIO_NORMAL;
+	op->o_dbprio = prio;
+}
+
 int
 backend_check_restrictions(
 	Operation *op,
@@ -1109,6 +1133,10 @@ backend_check_restrictions(
 		slap_ssf_t *fssf, *bssf;
 		int	rc = SLAP_CB_CONTINUE, i;
 
+		/* a Bind is classified once it succeeded, by the new identity */
+		if ( op->o_tag != LDAP_REQ_BIND )
+			backend_op_prio( op, &op->o_ndn );
+
 		if ( op->o_bd->be_chk_controls ) {
 			rc = ( *op->o_bd->be_chk_controls )( op, rs );
 		}
@@ -1456,6 +1484,8 @@ fe_acl_group(
 	GroupAssertion *g;
 	Backend *be = op->o_bd;
 	OpExtra		*oex;
+	struct berval	gckey = BER_BVNULL;
+	int		grc = LDAP_SUCCESS;
 
 	LDAP_SLIST_FOREACH(oex, &op->o_extra, oe_next) {
 		if ( oex->oe_key == (void *)backend_group )
@@ -1484,6 +1514,25 @@ fe_acl_group(
 		goto done;
 	}
 
+	/* The shared cache can't know about the target, which may be
+	 * a modified copy, nor when the members of a dynamic group
+	 * change */
+	if ( slap_groupcache_ttl && op->o_bd && !SLAP_DBHIDDEN( op->o_bd ) &&
+		group_oc && group_at &&
+		!is_at_subtype( group_at->ad_type,
+			slap_schema.si_ad_labeledURI->ad_type ) &&
+		!( target && dn_match( &target->e_nname, gr_ndn ) ) )
+	{
+		slap_group_cache_key( op, &gckey, SLAP_GC_GROUP,
+			&group_oc->soc_cname, &group_at->ad_cname, op_ndn );
+		if ( slap_group_cache_get( gr_ndn, &gckey, &rc, NULL, NULL ) )
+		{
+			op->o_tmpfree( gckey.bv_val, op->o_tmpmemctx );
+			BER_BVZERO( &gckey );
+			goto cache;
+		}
+	}
+
 	if ( target && dn_match( &target->e_nname, gr_ndn ) ) {
 		e = target;
 		rc = 0;
@@ -1491,6 +1540,7 @@ fe_acl_group(
 	} else {
 		op->o_private = NULL;
 		rc = be_entry_get_rw( op, gr_ndn, group_oc, group_at, 0, &e );
+		grc = rc;
 		e_priv = op->o_private;
 		op->o_private = o_priv;
 	}
@@ -1644,6 +1694,25 @@ loopit:
 		rc = LDAP_NO_SUCH_OBJECT;
 	}
 
+	if ( !BER_BVISNULL( &gckey ) ) {
+		/* don't remember transient errors */
+		if ( grc == LDAP_SUCCESS || grc == LDAP_NO_SUCH_OBJECT ||
+			grc == LDAP_NO_SUCH_ATTRIBUTE )
+		{
+			switch ( rc ) {
+			case LDAP_SUCCESS:
+			case LDAP_COMPARE_FALSE:
+			case LDAP_NO_SUCH_ATTRIBUTE:
+			case LDAP_NO_SUCH_OBJECT:
+				slap_group_cache_put( gr_ndn, &gckey, rc, NULL,
+					op->o_gcgen );
+				break;
+			}
+		}
+		op->o_tmpfree( gckey.bv_val, op->o_tmpmemctx );
+	}
+
+cache:
 	if ( op->o_tag != LDAP_REQ_BIND && !op->o_do_not_cache ) {
 		g = op->o_tmpalloc( sizeof( GroupAssertion ) + gr_ndn->bv_len,
 			op->o_tmpmemctx );
@@ -1709,6 +1778,7 @@ fe_acl_attribute(
 	AccessControlState	acl_state = ACL_STATE_INIT;
 	Backend			*be = op->o_bd;
 	OpExtra		*oex;
+	struct berval	gckey = BER_BVNULL;
 
 	LDAP_SLIST_FOREACH(oex, &op->o_extra, oe_next) {
 		if ( oex->oe_key == (void *)backend_attribute )
@@ -1721,6 +1791,25 @@ fe_acl_attribute(
 	if ( !op->o_bd || !SLAP_DBHIDDEN( op->o_bd ))
 		op->o_bd = select_backend( edn, 0 );
 
+	/* Sets read group members without access control; the shared
+	 * group cache also serves each step of their nested expansion */
+	if ( slap_groupcache_ttl && access == ACL_NONE && vals != NULL &&
+		op->o_bd && !SLAP_DBHIDDEN( op->o_bd ) &&
+		entry_at != slap_schema.si_ad_entry &&
+		entry_at != slap_schema.si_ad_children &&
+		!( target && dn_match( &target->e_nname, edn ) ) )
+	{
+		slap_group_cache_key( op, &gckey, SLAP_GC_ATTR,
+			&entry_at->ad_cname, NULL, NULL );
+		if ( slap_group_cache_get( edn, &gckey, &rc, vals,
+			op->o_tmpmemctx ) )
+		{
+			op->o_tmpfree( gckey.bv_val, op->o_tmpmemctx );
+			op->o_bd = be;
+			return rc;
+		}
+	}
+
 	if ( target && dn_match( &target->e_nname, edn ) ) {
 		e = target;
 
@@ -1823,6 +1912,18 @@ freeit:		if ( e != target ) {
 		}
 	}
 
+	if ( !BER_BVISNULL( &gckey ) ) {
+		/* values computed by overlays can't be invalidated */
+		if ( !freeattr && ( rc == LDAP_SUCCESS ||
+			rc == LDAP_NO_SUCH_ATTRIBUTE || rc == LDAP_NO_SUCH_OBJECT ) )
+		{
+			slap_group_cache_put( edn, &gckey, rc,
+				rc == LDAP_SUCCESS ? *vals : NULL,
+				op->o_gcgen );
+		}
+		op->o_tmpfree( gckey.bv_val, op->o_tmpmemctx );
+	}
+
 	op->o_bd = be;
 	return rc;
 }
@@ -125,6 +125,7 @@ static ConfigDriver config_tcp_buffer;
 static ConfigDriver config_rootdn;
 static ConfigDriver config_rootpw;
 static ConfigDriver config_restrict;
+static ConfigDriver config_oppriority;
 static ConfigDriver config_allows;
 static ConfigDriver config_disallows;
 static ConfigDriver config_requires;
@@ -197,10 +198,15 @@ enum {
 	CFG_IX_HASH64,
 	CFG_DISABLED,
 	CFG_THREADQS,
+	CFG_THREADSTEAL,
+	CFG_THREADWEIGHTS,
 	CFG_TLS_ECNAME,
 	CFG_TLS_CACERT,
 	CFG_TLS_CERT,
 	CFG_TLS_KEY,
+	CFG_DNCACHE,
+	CFG_PWCACHE,
+	CFG_BINDTHREADS,
 
 	CFG_LAST
 };
@@ -349,6 +355,12 @@ static ConfigTable config_back_cf_table[] = {
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE X-ORDERED 'SIBLINGS' )",
 				NULL, NULL },
+	{ "bind-threads", "count", 2, 2, 0,
+		ARG_UINT|ARG_MAGIC|CFG_BINDTHREADS, &config_generic,
+		"( OLcfgGlAt:110 NAME 'olcBindThreads' "
+			"DESC 'Max number of threads running simple binds at once, 0 for no limit' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "concurrency", "level", 2, 2, 0, ARG_INT|ARG_MAGIC|CFG_CONCUR,
 		&config_generic, "( OLcfgGlAt:10 NAME 'olcConcurrency' "
 			"EQUALITY integerMatch "
@@ -384,6 +396,11 @@ static ConfigTable config_back_cf_table[] = {
 			"SUBSTR caseIgnoreSubstringsMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )",
 			NULL, NULL },
+	{ "dncache-size", "entries", 2, 2, 0, ARG_UINT|ARG_MAGIC|CFG_DNCACHE,
+		&config_generic, "( OLcfgGlAt:107 NAME 'olcDNCacheSize' "
+			"DESC 'Number of slots in the DN normalization cache, 0 disables it' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "extra_attrs", "attrlist", 2, 2, 0, ARG_DB|ARG_MAGIC,
 		&config_extra_attrs, "( OLcfgDbAt:0.20 NAME 'olcExtraAttrs' "
 			"EQUALITY caseIgnoreMatch "
@@ -397,6 +414,16 @@ static ConfigTable config_back_cf_table[] = {
 		"( OLcfgGlAt:17 NAME 'olcGentleHUP' "
 			"EQUALITY booleanMatch "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "groupcache-size", "entries", 2, 2, 0, ARG_UINT,
+		&slap_groupcache_max, "( OLcfgGlAt:106 NAME 'olcGroupCacheSize' "
+			"DESC 'Max number of entries in the shared group cache' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "groupcache-ttl", "seconds", 2, 2, 0, ARG_UINT,
+		&slap_groupcache_ttl, "( OLcfgGlAt:105 NAME 'olcGroupCacheTTL' "
+			"DESC 'Lifetime of shared group cache entries, 0 disables it' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "hidden", "on|off", 2, 2, 0, ARG_DB|ARG_ON_OFF|ARG_MAGIC|CFG_HIDDEN,
 		&config_generic, "( OLcfgDbAt:0.17 NAME 'olcHidden' "
 			"EQUALITY booleanMatch "
@@ -512,9 +539,24 @@ static ConfigTable config_back_cf_table[] = {
 			"EQUALITY caseIgnoreMatch "
 			"SUBSTR caseIgnoreSubstringsMatch "
 			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "oppriority", "class> <op_list", 3, 0, 0, ARG_MAY_DB|ARG_MAGIC,
+		&config_oppriority, "( OLcfgGlAt:103 NAME 'olcOpPriority' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString )", NULL, NULL },
 	{ "overlay", "overlay", 2, 2, 0, ARG_MAGIC,
 		&config_overlay, "( OLcfgGlAt:34 NAME 'olcOverlay' "
 			"SUP olcDatabase SINGLE-VALUE X-ORDERED 'SIBLINGS' )", NULL, NULL },
+	{ "password-cache-size", "entries", 2, 2, 0,
+		ARG_UINT|ARG_MAGIC|CFG_PWCACHE, &config_generic,
+		"( OLcfgGlAt:109 NAME 'olcPasswordCacheSize' "
+			"DESC 'Number of slots in the verified password cache' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "password-cache-ttl", "seconds", 2, 2, 0, ARG_UINT,
+		&slap_pwcache_ttl, "( OLcfgGlAt:108 NAME 'olcPasswordCacheTTL' "
+			"DESC 'Lifetime of verified password cache entries, 0 disables it' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "password-crypt-salt-format", "salt", 2, 2, 0, ARG_STRING|ARG_MAGIC|CFG_SALT,
 		&config_generic, "( OLcfgGlAt:35 NAME 'olcPasswordCryptSaltFormat' "
 			"EQUALITY caseIgnoreMatch "
@@ -682,6 +724,11 @@ static ConfigTable config_back_cf_table[] = {
 		&config_sizelimit, "( OLcfgGlAt:60 NAME 'olcSizeLimit' "
 			"EQUALITY caseExactMatch "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "slabchain", "count", 2, 2, 0, ARG_UINT,
+		&slap_sl_chain_max, "( OLcfgGlAt:104 NAME 'olcSlabChain' "
+			"DESC 'Max extra slabs per thread memory context' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ "sockbuf_max_incoming", "max", 2, 2, 0, ARG_BER_LEN_T,
 		&sockbuf_max_incoming, "( OLcfgGlAt:61 NAME 'olcSockbufMaxIncoming' "
 			"EQUALITY integerMatch "
@@ -732,6 +779,16 @@ static ConfigTable config_back_cf_table[] = {
 		"( OLcfgGlAt:95 NAME 'olcThreadQueues' "
 			"EQUALITY integerMatch "
 			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "threadsteal", "on|off", 2, 2, 0,
+		ARG_ON_OFF|ARG_MAGIC|CFG_THREADSTEAL, &config_generic,
+		"( OLcfgGlAt:101 NAME 'olcThreadSteal' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "threadweights", "high> <normal> <low", 4, 4, 0,
+		ARG_MAGIC|CFG_THREADWEIGHTS, &config_generic,
+		"( OLcfgGlAt:102 NAME 'olcThreadWeights' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "timelimit", "limit", 2, 0, 0, ARG_MAY_DB|ARG_MAGIC,
 		&config_timelimit, "( OLcfgGlAt:67 NAME 'olcTimeLimit' "
 			"EQUALITY caseExactMatch "
@@ -936,23 +993,27 @@ static ConfigOCs cf_ocs[] = {
 		"SUP olcConfig STRUCTURAL "
 		"MAY ( cn $ olcConfigFile $ olcConfigDir $ olcAllows $ olcArgsFile $ "
 		 "olcAttributeOptions $ olcAuthIDRewrite $ "
-		 "olcAuthzPolicy $ olcAuthzRegexp $ olcConcurrency $ "
+		 "olcAuthzPolicy $ olcAuthzRegexp $ olcBindThreads $ "
+		 "olcConcurrency $ "
 		 "olcConnMaxPending $ olcConnMaxPendingAuth $ "
-		 "olcDisallows $ olcGentleHUP $ olcIdleTimeout $ "
+		 "olcDisallows $ olcDNCacheSize $ olcGentleHUP $ "
+		 "olcGroupCacheSize $ olcGroupCacheTTL $ "
+		 "olcIdleTimeout $ "
 		 "olcIndexSubstrIfMaxLen $ olcIndexSubstrIfMinLen $ "
 		 "olcIndexSubstrAnyLen $ olcIndexSubstrAnyStep $ olcIndexHash64 $ "
 		 "olcIndexIntLen $ "
 		 "olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogLevel $ "
+		 "olcPasswordCacheSize $ olcPasswordCacheTTL $ "
 		 "olcPasswordCryptSaltFormat $ olcPasswordHash $ olcPidFile $ "
 		 "olcPluginLogFile $ olcReadOnly $ olcReferral $ "
 		 "olcReplogFile $ olcRequires $ olcRestrict $ olcReverseLookup $ "
 		 "olcRootDSE $ "
 		 "olcSaslAuxprops $ olcSaslAuxpropsDontUseCopy $ olcSaslAuxpropsDontUseCopyIgnore $ "
 		 "olcSaslCBinding $ olcSaslHost $ olcSaslRealm $ olcSaslSecProps $ "
-		 "olcSecurity $ olcServerID $ olcSizeLimit $ "
+		 "olcSecurity $ olcServerID $ olcSizeLimit $ olcSlabChain $ "
 		 "olcSockbufMaxIncoming $ olcSockbufMaxIncomingAuth $ "
 		 "olcTCPBuffer $ "
-		 "olcThreads $ olcThreadQueues $ "
+		 "olcThreads $ olcThreadQueues $ olcThreadSteal $ olcThreadWeights $ "
 		 "olcTimeLimit $ olcTLSCACertificateFile $ "
 		 "olcTLSCACertificatePath $ olcTLSCertificateFile $ "
 		 "olcTLSCertificateKeyFile $ olcTLSCipherSuite $ olcTLSCRLCheck $ "
@@ -980,7 +1041,7 @@ static ConfigOCs cf_ocs[] = {
 		"MUST olcDatabase "
 		"MAY ( olcDisabled $ olcHidden $ olcSuffix $ olcSubordinate $ olcAccess $ "
 		 "olcAddContentAcl $ olcLastMod $ olcLastBind $ olcLimits $ "
-		 "olcMaxDerefDepth $ olcPlugin $ olcReadOnly $ olcReplica $ "
+		 "olcMaxDerefDepth $ olcOpPriority $ olcPlugin $ olcReadOnly $ olcReplica $ "
 		 "olcReplicaArgsFile $ olcReplicaPidFile $ olcReplicationInterval $ "
 		 "olcReplogFile $ olcRequires $ olcRestrict $ olcRootDN $ olcRootPW $ "
 		 "olcSchemaDN $ olcSecurity $ olcSizeLimit $ olcSyncUseSubentry $ olcSyncrepl $ "
@@ -1067,12 +1128,39 @@ config_generic(ConfigArgs *c) {
 		case CFG_THREADQS:
 			c->value_int = connection_pool_queues;
 			break;
+		case CFG_THREADSTEAL:
+			c->value_int = connection_pool_steal;
+			break;
+		case CFG_THREADWEIGHTS:
+			if ( connection_pool_weights[0] ) {
+				char buf[64];
+				struct berval bv;
+
+				bv.bv_len = snprintf( buf, sizeof( buf ), "%d %d %d",
+					connection_pool_weights[0],
+					connection_pool_weights[1],
+					connection_pool_weights[2] );
+				bv.bv_val = buf;
+				value_add_one( &c->rvalue_vals, &bv );
+			} else {
+				rc = 1;
+			}
+			break;
 		case CFG_TTHREADS:
 			c->value_int = slap_tool_thread_max;
 			break;
 		case CFG_LTHREADS:
 			c->value_uint = slapd_daemon_threads;
 			break;
+		case CFG_DNCACHE:
+			c->value_uint = slap_dncache_size;
+			break;
+		case CFG_PWCACHE:
+			c->value_uint = slap_pwcache_size;
+			break;
+		case CFG_BINDTHREADS:
+			c->value_uint = slap_bind_threads;
+			break;
 		case CFG_SALT:
 			if ( passwd_salt )
 				c->value_string = ch_strdup( passwd_salt );
@@ -1414,6 +1502,7 @@ config_generic(ConfigArgs *c) {
 		case CFG_CONCUR:
 		case CFG_THREADS:
 		case CFG_THREADQS:
+		case CFG_THREADSTEAL:
 		case CFG_TTHREADS:
 		case CFG_LTHREADS:
 		case CFG_RO:
@@ -1429,6 +1518,18 @@ config_generic(ConfigArgs *c) {
 		case CFG_SYNC_SUBENTRY:
 			break;
 
+		case CFG_DNCACHE:
+			dn_cache_resize( 0 );
+			break;
+
+		case CFG_PWCACHE:
+			slap_passwd_cache_resize( SLAP_PWCACHE_SIZE );
+			break;
+
+		case CFG_BINDTHREADS:
+			slap_bind_limit_set( 0 );
+			break;
+
 #ifdef LDAP_SLAPI
 		case CFG_PLUGIN:
 			slapi_int_unregister_plugins(c->be, c->valx);
@@ -1539,6 +1640,12 @@ config_generic(ConfigArgs *c) {
 			slap_hash64( 0 );
 			break;
 
+		case CFG_THREADWEIGHTS:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_weights(&connection_pool, NULL);
+			connection_pool_weights[0] = 0;
+			break;
+
 		case CFG_IX_INTLEN:
 			index_intlen = SLAP_INDEX_INTLEN_DEFAULT;
 			index_intlen_strlen = SLAP_INDEX_INTLEN_STRLEN(
@@ -1825,12 +1932,51 @@ config_generic(ConfigArgs *c) {
 			connection_pool_queues = c->value_int;	/* save for reference */
 			break;
 
+		case CFG_THREADSTEAL:
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_worksteal(&connection_pool, c->value_int);
+			connection_pool_steal = c->value_int;	/* save for reference */
+			break;
+
+		case CFG_THREADWEIGHTS: {
+			int w[LDAP_PVT_THREAD_POOL_NPRIO];
+
+			for ( i = 0; i < LDAP_PVT_THREAD_POOL_NPRIO; i++ ) {
+				if ( lutil_atoi( &w[i], c->argv[i+1] ) != 0 || w[i] < 1 ) {
+					snprintf( c->cr_msg, sizeof( c->cr_msg ),
+						"<%s> invalid weight \"%s\"",
+						c->argv[0], c->argv[i+1] );
+					Debug(LDAP_DEBUG_ANY, "%s: %s.\n",
+						c->log, c->cr_msg );
+					return 1;
+				}
+			}
+			if ( slapMode & SLAP_SERVER_MODE )
+				ldap_pvt_thread_pool_weights(&connection_pool, w);
+			for ( i = 0; i < LDAP_PVT_THREAD_POOL_NPRIO; i++ )
+				connection_pool_weights[i] = w[i];
+			}
+			break;
+
 		case CFG_TTHREADS:
 			if ( slapMode & SLAP_TOOL_MODE )
 				ldap_pvt_thread_pool_maxthreads(&connection_pool, c->value_int);
 			slap_tool_thread_max = c->value_int;	/* save for reference */
 			break;
 
+		case CFG_DNCACHE:
+			/* the server is paused while cn=config is changed */
+			dn_cache_resize( c->value_uint );
+			break;
+
+		case CFG_PWCACHE:
+			slap_passwd_cache_resize( c->value_uint );
+			break;
+
+		case CFG_BINDTHREADS:
+			slap_bind_limit_set( c->value_uint );
+			break;
+
 		case CFG_LTHREADS:
 			if ( c->value_uint < 1 ) {
 				snprintf( c->cr_msg, sizeof( c->cr_msg ),
@@ -3431,6 +3577,113 @@ config_restrict(ConfigArgs *c) {
 	return(0);
 }
 
+static slap_verbmasks oppriority_classes[] = {
+	{ BER_BVC("high"),		SLAP_PRIO_HIGH },
+	{ BER_BVC("normal"),	SLAP_PRIO_NORMAL },
+	{ BER_BVC("low"),		SLAP_PRIO_LOW },
+	{ BER_BVNULL,	0 }
+};
+
+static slap_verbmasks oppriority_ops[] = {
+	{ BER_BVC("bind"),		SLAP_OP_BIND },
+	{ BER_BVC("search"),	SLAP_OP_SEARCH },
+	{ BER_BVC("compare"),	SLAP_OP_COMPARE },
+	{ BER_BVC("modify"),	SLAP_OP_MODIFY },
+	{ BER_BVC("rename"),	SLAP_OP_MODRDN },
+	{ BER_BVC("add"),		SLAP_OP_ADD },
+	{ BER_BVC("delete"),	SLAP_OP_DELETE },
+	{ BER_BVC("extended"),	SLAP_OP_EXTENDED },
+	{ BER_BVNULL,	0 }
+};
+
+#define OPPRIO_SHIFT(opidx)	((opidx) * SLAP_OPPRIO_BITS)
+
+/* Render the operations in class prio as "<class> <op> [...]" */
+static int
+oppriority_unparse( BackendDB *be, int i, struct berval *bv, char *buf )
+{
+	char *ptr = buf;
+	int j, prio = oppriority_classes[i].mask;
+
+	for ( j = 0; !BER_BVISNULL( &oppriority_ops[j].word ); j++ ) {
+		if ( SLAP_OPPRIO( be, oppriority_ops[j].mask ) != prio )
+			continue;
+		if ( ptr == buf )
+			ptr = lutil_strcopy( ptr, oppriority_classes[i].word.bv_val );
+		*ptr++ = ' ';
+		ptr = lutil_strcopy( ptr, oppriority_ops[j].word.bv_val );
+	}
+	bv->bv_val = buf;
+	bv->bv_len = ptr - buf;
+	return bv->bv_len != 0;
+}
+
+/* One value per class in use: "<class> <op> [...]" */
+static int
+config_oppriority(ConfigArgs *c) {
+	slap_mask_t opprio = 0, shift;
+	struct berval bv;
+	char buf[ 256 ];
+	int i, j, prio;
+
+	if (c->op == SLAP_CONFIG_EMIT) {
+		for ( i = 0; !BER_BVISNULL( &oppriority_classes[i].word ); i++ ) {
+			if ( oppriority_unparse( c->be, i, &bv, buf ))
+				value_add_one( &c->rvalue_vals, &bv );
+		}
+		return c->rvalue_vals == NULL;
+
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		if ( c->valx < 0 ) {
+			c->be->be_opprio = 0;
+			return 0;
+		}
+		for ( i = 0, j = 0; !BER_BVISNULL( &oppriority_classes[i].word ); i++ ) {
+			if ( oppriority_unparse( c->be, i, &bv, buf ) && j++ == c->valx )
+				break;
+		}
+		if ( BER_BVISNULL( &oppriority_classes[i].word ))
+			return 1;
+		prio = oppriority_classes[i].mask;
+		for ( j = 0; !BER_BVISNULL( &oppriority_ops[j].word ); j++ ) {
+			shift = OPPRIO_SHIFT( oppriority_ops[j].mask );
+			if ( SLAP_OPPRIO( c->be, oppriority_ops[j].mask ) == prio )
+				c->be->be_opprio &= ~((slap_mask_t)SLAP_OPPRIO_MASK << shift);
+		}
+		return 0;
+	}
+
+	i = verb_to_mask( c->argv[1], oppriority_classes );
+	if ( BER_BVISNULL( &oppriority_classes[i].word )) {
+		snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> unknown class", c->argv[0] );
+		Debug(LDAP_DEBUG_ANY, "%s: %s %s\n",
+			c->log, c->cr_msg, c->argv[1]);
+		return(1);
+	}
+	prio = oppriority_classes[i].mask;
+
+	for ( i = 2; i < c->argc; i++ ) {
+		j = verb_to_mask( c->argv[i], oppriority_ops );
+		if ( BER_BVISNULL( &oppriority_ops[j].word )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "<%s> unknown operation", c->argv[0] );
+			Debug(LDAP_DEBUG_ANY, "%s: %s %s\n",
+				c->log, c->cr_msg, c->argv[i]);
+			return(1);
+		}
+		shift = OPPRIO_SHIFT( oppriority_ops[j].mask );
+		opprio &= ~((slap_mask_t)SLAP_OPPRIO_MASK << shift);
+		opprio |= (slap_mask_t)prio << shift;
+	}
+	/* an operation listed again moves to the new class */
+	for ( j = 0; !BER_BVISNULL( &oppriority_ops[j].word ); j++ ) {
+		shift = OPPRIO_SHIFT( oppriority_ops[j].mask );
+		if ( opprio & ((slap_mask_t)SLAP_OPPRIO_MASK << shift ))
+			c->be->be_opprio &= ~((slap_mask_t)SLAP_OPPRIO_MASK << shift);
+	}
+	c->be->be_opprio |= opprio;
+	return(0);
+}
+
 static int
 config_allows(ConfigArgs *c) {
 	slap_mask_t allows = 0;
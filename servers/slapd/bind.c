@@ -34,6 +34,193 @@
 #include "lutil.h"
 #include "slap.h"
 
+/*
+ * Checking a password against a slow scheme can keep a worker thread
+ * busy for a long time, and a burst of such binds could occupy every
+ * thread and starve all other operations. With slap_bind_threads set,
+ * no more than that many threads run simple binds at once. Further
+ * binds are parked with SLAPD_ASYNCOP without holding a thread, and
+ * each completing bind hands its slot to the oldest parked one, which
+ * is resubmitted to the pool. Meanwhile later requests on a parked
+ * connection wait in its pending list, as for any bind in progress.
+ * Binds are parked before they enter the frontend, so overlays on it
+ * see the whole bind on the thread that runs it.
+ */
+unsigned slap_bind_threads;
+
+typedef struct bind_parked {
+	Operation		*bp_op;
+	LDAP_STAILQ_ENTRY(bind_parked) bp_next;
+} bind_parked;
+
+static LDAP_STAILQ_HEAD(bpq, bind_parked) bind_queue =
+	LDAP_STAILQ_HEAD_INITIALIZER(bind_queue);
+static ldap_pvt_thread_mutex_t	bind_mutex;
+static unsigned			bind_running;
+
+static void *fe_op_bind_task( void *ctx, void *arg );
+static void bind_done( Operation *op, SlapReply *rs, struct berval *mech );
+static void bind_finish( Operation *op, SlapReply *rs, void *ctx );
+
+void
+slap_bind_limit_init( void )
+{
+	ldap_pvt_thread_mutex_init( &bind_mutex );
+}
+
+/* Binds still parked now will never get a thread: fail them, and
+ * finish them like any other operation, so that their connections
+ * can go away
+ */
+void
+slap_bind_limit_destroy( void )
+{
+	bind_parked *bp;
+	Operation *op;
+	void *ctx = ldap_pvt_thread_pool_context();
+	void *memctx;
+
+	while (( bp = LDAP_STAILQ_FIRST( &bind_queue )) != NULL ) {
+		SlapReply rs = { REP_RESULT };
+
+		LDAP_STAILQ_REMOVE_HEAD( &bind_queue, bp_next );
+		op = bp->bp_op;
+		ch_free( bp );
+
+		op->o_threadctx = ctx;
+		op->o_tid = ldap_pvt_thread_pool_tid( ctx );
+		memctx = op->o_tmpmemctx;
+		send_ldap_error( op, &rs, LDAP_UNAVAILABLE, "shutting down" );
+		bind_finish( op, &rs, ctx );
+		slap_sl_mem_destroy( (void *)1, memctx );
+	}
+	ldap_pvt_thread_mutex_destroy( &bind_mutex );
+}
+
+/* Resume a parked bind, which already owns a slot */
+static void
+bind_resume( Operation *op )
+{
+	if ( ldap_pvt_thread_pool_submit( &connection_pool,
+		fe_op_bind_task, op ) != 0 )
+	{
+		/* shutting down, finish it here */
+		fe_op_bind_task( ldap_pvt_thread_pool_context(), op );
+	}
+}
+
+/* Take a slot, or park op and return 1 */
+static int
+bind_slot_get( Operation *op )
+{
+	bind_parked *bp;
+
+	ldap_pvt_thread_mutex_lock( &bind_mutex );
+	if ( bind_running < slap_bind_threads ) {
+		bind_running++;
+		ldap_pvt_thread_mutex_unlock( &bind_mutex );
+		return 0;
+	}
+
+	bp = ch_malloc( sizeof( bind_parked ));
+	bp->bp_op = op;
+	LDAP_STAILQ_INSERT_TAIL( &bind_queue, bp, bp_next );
+	ldap_pvt_thread_mutex_unlock( &bind_mutex );
+
+	Debug( LDAP_DEBUG_TRACE, "%s do_bind: parked, %u binds already running\n",
+		op->o_log_prefix, bind_running );
+	return 1;
+}
+
+/* Release a slot, handing it to the oldest parked bind if any */
+static void
+bind_slot_put( void )
+{
+	bind_parked *bp;
+	Operation *op = NULL;
+
+	ldap_pvt_thread_mutex_lock( &bind_mutex );
+	bp = LDAP_STAILQ_FIRST( &bind_queue );
+	if ( bp && ( !slap_bind_threads || bind_running <= slap_bind_threads )) {
+		LDAP_STAILQ_REMOVE_HEAD( &bind_queue, bp_next );
+		op = bp->bp_op;
+		ch_free( bp );
+	} else {
+		bind_running--;
+	}
+	ldap_pvt_thread_mutex_unlock( &bind_mutex );
+
+	if ( op )
+		bind_resume( op );
+}
+
+/* Only call with the server paused, or before it starts */
+void
+slap_bind_limit_set( unsigned threads )
+{
+	bind_parked *bp;
+
+	slap_bind_threads = threads;
+
+	/* let go of the binds a higher limit, or none, admits now */
+	while (( bp = LDAP_STAILQ_FIRST( &bind_queue )) != NULL &&
+		( !threads || bind_running < threads ))
+	{
+		LDAP_STAILQ_REMOVE_HEAD( &bind_queue, bp_next );
+		bind_running++;
+		bind_resume( bp->bp_op );
+		ch_free( bp );
+	}
+}
+
+/*
+ * Run a parked simple bind on whatever thread picked it up: what
+ * do_bind would have done from entering the frontend on, and then
+ * what connection_operation does once an operation is over.
+ */
+static void *
+fe_op_bind_task( void *ctx, void *arg )
+{
+	Operation	*op = arg;
+	SlapReply	rs = { REP_RESULT };
+	void		*memctx, *oldctx;
+
+	/* the operation brought its own memctx along */
+	op->o_threadctx = ctx;
+	op->o_tid = ldap_pvt_thread_pool_tid( ctx );
+	oldctx = slap_sl_mem_create( SLAP_SLAB_SIZE, SLAP_SLAB_STACK, ctx, 0 );
+	memctx = op->o_tmpmemctx;
+	slap_sl_mem_setctx( ctx, memctx );
+
+	rs.sr_err = frontendDB->be_bind( op, &rs );
+
+	if ( rs.sr_err == SLAPD_ASYNCOP ) {
+		/* someone else took it over, memctx included */
+		slap_sl_mem_setctx( ctx, oldctx );
+	} else {
+		bind_finish( op, &rs, ctx );
+		slap_sl_mem_setctx( ctx, oldctx );
+		slap_sl_mem_destroy( (void *)1, memctx );
+	}
+
+	bind_slot_put();
+
+	return NULL;
+}
+
+/* Finish a bind that was parked */
+static void
+bind_finish( Operation *op, SlapReply *rs, void *ctx )
+{
+	struct berval mech = BER_BVNULL;
+
+	bind_done( op, rs, &mech );
+
+	/* counts the operation completed */
+	connection_op_finish( op );
+	slap_op_free( op, ctx );
+}
+
 int
 do_bind(
     Operation	*op,
@@ -46,6 +233,7 @@ do_bind(
 	struct berval dn = BER_BVNULL;
 	ber_tag_t tag;
 	Backend *be = NULL;
+	int limited;
 
 	Debug( LDAP_DEBUG_TRACE, "%s do_bind\n",
 		op->o_log_prefix );
@@ -203,12 +391,39 @@ do_bind(
 	op->orb_mech = mech;
 
 	op->o_bd = frontendDB;
+
+	/* only binds checking a password count against the limit */
+	limited = slap_bind_threads != 0 &&
+		op->orb_method == LDAP_AUTH_SIMPLE &&
+		!BER_BVISEMPTY( &op->orb_cred ) &&
+		!BER_BVISEMPTY( &op->o_req_ndn );
+	if ( limited && bind_slot_get( op )) {
+		/* parked, fe_op_bind_task() will complete it */
+		return SLAPD_ASYNCOP;
+	}
+
 	rs->sr_err = frontendDB->be_bind( op, rs );
 
+	if ( limited )
+		bind_slot_put();
+
+	if ( rs->sr_err == SLAPD_ASYNCOP ) {
+		/* op is no longer ours */
+		return rs->sr_err;
+	}
+
 cleanup:
+	bind_done( op, rs, &mech );
+
+	return rs->sr_err;
+}
+
+static void
+bind_done( Operation *op, SlapReply *rs, struct berval *mech )
+{
 	if ( rs->sr_err == LDAP_SUCCESS ) {
 		if ( op->orb_method != LDAP_AUTH_SASL ) {
-			ber_dupbv( &op->o_conn->c_authmech, &mech );
+			ber_dupbv( &op->o_conn->c_authmech, mech );
 		}
 		op->o_conn->c_authtype = op->orb_method;
 	}
@@ -221,8 +436,6 @@ cleanup:
 		slap_sl_free( op->o_req_ndn.bv_val, op->o_tmpmemctx );
 		BER_BVZERO( &op->o_req_ndn );
 	}
-
-	return rs->sr_err;
 }
 
 int
@@ -544,6 +757,8 @@ fe_op_bind_success( Operation *op, SlapReply *rs )
 
 	ldap_pvt_thread_mutex_unlock( &op->o_conn->c_mutex );
 
+	backend_op_prio( op, &op->o_req_ndn );
+
 	if ( SLAP_LASTBIND( op->o_bd ) ) {
 		fe_op_lastbind( op );
 	}
@@ -92,6 +92,44 @@ static void connection_destroy( Connection *c );
 
 static ldap_pvt_thread_start_t connection_operation;
 
+/* Thread pool priority class for a request of type opidx on
+ * connection c; c_mutex must be held. In order, the class is taken
+ * from the limits matching the client's identity, from the database
+ * the last request went to if it was of the same type, or from the
+ * global class of the operation type. If the request hasn't been
+ * read yet (SLAP_OP_LAST), it is expected to be like the last one.
+ */
+static int
+connection_prio( Connection *c, slap_op_t opidx )
+{
+	int prio = c->c_prio;
+
+	if ( opidx == SLAP_OP_LAST )
+		opidx = c->c_lastop;
+	if ( prio == SLAP_PRIO_DEFAULT && opidx == c->c_lastop )
+		prio = c->c_dbprio;
+	if ( prio == SLAP_PRIO_DEFAULT )
+		prio = SLAP_OPPRIO( frontendDB, opidx );
+	if ( prio == SLAP_PRIO_DEFAULT )
+		prio = SLAP_PRIO_NORMAL;
+
+	return SLAP_PRIO2POOL( prio );
+}
+
+/* Remember how op was classified for the next requests of its
+ * connection; c_mutex must be held
+ */
+static void
+connection_prio_update( Connection *c, Operation *op, slap_op_t opidx )
+{
+	c->c_lastop = opidx;
+	c->c_dbprio = op->o_dbprio;
+	/* the limits are only looked at in a database, but a Bind
+	 * always replaces the identity */
+	if ( op->o_dbprio != SLAP_PRIO_DEFAULT || opidx == SLAP_OP_BIND )
+		c->c_prio = op->o_prio;
+}
+
 /*
  * Initialize connection management infrastructure.
  */
@@ -450,6 +488,10 @@ Connection * connection_init(
 	c->c_n_ops_executing = 0;
 	c->c_n_ops_pending = 0;
 	c->c_n_ops_completed = 0;
+	c->c_prio = SLAP_PRIO_DEFAULT;
+	c->c_dbprio = SLAP_PRIO_DEFAULT;
+	/* a fresh connection is expected to Bind first */
+	c->c_lastop = SLAP_OP_BIND;
 
 	c->c_n_get = 0;
 	c->c_n_read = 0;
@@ -502,6 +544,14 @@ Connection * connection_init(
 		INT_MAX, (void*)"ldap_" );
 #endif
 
+#ifdef LDAP_CONNECTIONLESS
+	if ( !c->c_is_udp )
+#endif
+	{
+		ber_len_t max = SLAP_SB_COALESCE_SIZE;
+		ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_COALESCE, &max );
+	}
+
 	if( ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_NONBLOCK,
 		c /* non-NULL */ ) < 0 )
 	{
@@ -655,7 +705,7 @@ connection_destroy( Connection *c )
 	slap_sasl_close( c );
 
 	if ( c->c_currentber != NULL ) {
-		ber_free( c->c_currentber, 1 );
+		slap_iobuf_ber_free( c->c_currentber );
 		c->c_currentber = NULL;
 	}
 
@@ -1041,7 +1091,6 @@ void
 connection_op_finish( Operation *op )
 {
 	Connection *conn = op->o_conn;
-	void *memctx_null = NULL;
 	slap_op_t opidx = slap_req2op( op->o_tag );
 	assert( opidx != SLAP_OP_LAST );
 
@@ -1049,10 +1098,12 @@ connection_op_finish( Operation *op )
 
 	ldap_pvt_thread_mutex_lock( &conn->c_mutex );
 
+	connection_prio_update( conn, op, opidx );
+
 	if ( op->o_tag == LDAP_REQ_BIND && conn->c_conn_state == SLAP_C_BINDING )
 		conn->c_conn_state = SLAP_C_ACTIVE;
 
-	ber_set_option( op->o_ber, LBER_OPT_BER_MEMCTX, &memctx_null );
+	slap_iobuf_ber_detach( op->o_ber );
 
 	LDAP_STAILQ_REMOVE( &conn->c_ops, op, Operation, o_next);
 	LDAP_STAILQ_NEXT(op, o_next) = NULL;
@@ -1072,7 +1123,6 @@ connection_operation( void *ctx, void *arg_v )
 	slap_op_t opidx = SLAP_OP_LAST;
 	Connection *conn = op->o_conn;
 	void *memctx = NULL;
-	void *memctx_null = NULL;
 	ber_len_t memsiz;
 
 	gettimeofday( &op->o_qtime, NULL );
@@ -1160,6 +1210,8 @@ connection_operation( void *ctx, void *arg_v )
 	opidx = slap_req2op( tag );
 	assert( opidx != SLAP_OP_LAST );
 	INCR_OP_INITIATED( opidx );
+	/* before anything is read from a backend */
+	op->o_gcgen = slap_group_cache_gen();
 	rc = (*(opfun[opidx]))( op, &rs );
 
 operations_error:
@@ -1186,6 +1238,9 @@ operations_error:
 
 	ldap_pvt_thread_mutex_lock( &conn->c_mutex );
 
+	if ( opidx != SLAP_OP_LAST )
+		connection_prio_update( conn, op, opidx );
+
 	if ( opidx == SLAP_OP_BIND && conn->c_conn_state == SLAP_C_BINDING )
 		conn->c_conn_state = SLAP_C_ACTIVE;
 
@@ -1210,7 +1265,7 @@ operations_error:
 				&& cancel != SLAP_CANCEL_DONE );
 	}
 
-	ber_set_option( op->o_ber, LBER_OPT_BER_MEMCTX, &memctx_null );
+	slap_iobuf_ber_detach( op->o_ber );
 
 	if ( rc != LDAP_TXN_SPECIFY_OKAY ) {
 		LDAP_STAILQ_REMOVE( &conn->c_ops, op, Operation, o_next);
@@ -1321,7 +1376,8 @@ static void* connection_read_thread( void* ctx, void* argv )
 
 int connection_read_activate( ber_socket_t s )
 {
-	int rc;
+	Connection *c = &connections[s];
+	int rc, prio;
 
 	/*
 	 * suspend reading on this file descriptor until a connection processing
@@ -1332,8 +1388,13 @@ int connection_read_activate( ber_socket_t s )
 	if ( rc )
 		return rc;
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_read_thread, (void *)(long)s );
+	/* connection_input() checks the guess once the request is read */
+	ldap_pvt_thread_mutex_lock( &c->c_mutex );
+	prio = c->c_readprio = connection_prio( c, SLAP_OP_LAST );
+	ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+
+	rc = ldap_pvt_thread_pool_submit_prio( &connection_pool,
+		connection_read_thread, (void *)(long)s, prio, NULL );
 
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1530,7 +1591,7 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	void *ctx;
 
 	if ( conn->c_currentber == NULL &&
-		( conn->c_currentber = ber_alloc()) == NULL )
+		( conn->c_currentber = slap_iobuf_ber_alloc()) == NULL )
 	{
 		Debug( LDAP_DEBUG_ANY, "ber_alloc failed\n" );
 		return -1;
@@ -1603,7 +1664,7 @@ connection_input( Connection *conn , conn_readinfo *cri )
 			Debug( LDAP_DEBUG_TRACE,
 				"ber_get_next on fd %d failed errno=%d (%s)\n",
 			conn->c_sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
-			ber_free( conn->c_currentber, 1 );
+			slap_iobuf_ber_free( conn->c_currentber );
 			conn->c_currentber = NULL;
 
 			return -2;
@@ -1613,18 +1674,19 @@ connection_input( Connection *conn , conn_readinfo *cri )
 
 	ber = conn->c_currentber;
 	conn->c_currentber = NULL;
+	slap_iobuf_ber_detach( ber );
 
 	if ( (tag = ber_get_int( ber, &msgid )) != LDAP_TAG_MSGID ) {
 		/* log, close and send error */
 		Debug( LDAP_DEBUG_ANY, "ber_get_int returns 0x%lx\n", tag );
-		ber_free( ber, 1 );
+		slap_iobuf_ber_free( ber );
 		return -1;
 	}
 
 	if ( (tag = ber_peek_tag( ber, &len )) == LBER_ERROR ) {
 		/* log, close and send error */
 		Debug( LDAP_DEBUG_ANY, "ber_peek_tag returns 0x%lx\n", tag );
-		ber_free( ber, 1 );
+		slap_iobuf_ber_free( ber );
 
 		return -1;
 	}
@@ -1637,7 +1699,7 @@ connection_input( Connection *conn , conn_readinfo *cri )
 		}
 		if( tag != LDAP_REQ_ABANDON && tag != LDAP_REQ_SEARCH ) {
 			Debug( LDAP_DEBUG_ANY, "invalid req for UDP 0x%lx\n", tag );
-			ber_free( ber, 1 );
+			slap_iobuf_ber_free( ber );
 			return 0;
 		}
 	}
@@ -1748,15 +1810,22 @@ connection_input( Connection *conn , conn_readinfo *cri )
 		 * Subsequent ops will be submitted to the pool by
 		 * calling connection_op_activate()
 		 */
-		if ( cri->op == NULL ) {
-			/* the first incoming request */
+		if ( cri->op == NULL &&
+			connection_prio( conn, slap_req2op( tag )) == conn->c_readprio )
+		{
+			/* the first incoming request, of the class the
+			 * reading thread was queued in */
 			connection_op_queue( op );
 			cri->op = op;
+			Debug( LDAP_DEBUG_CONNS, "connection_input: %s class=%d\n",
+				op->o_log_prefix, conn->c_readprio );
 		} else {
-			if ( !cri->nullop ) {
+			if ( cri->op != NULL && !cri->nullop ) {
 				cri->nullop = 1;
-				rc = ldap_pvt_thread_pool_submit( &connection_pool,
-					connection_operation, (void *) cri->op );
+				rc = ldap_pvt_thread_pool_submit_prio( &connection_pool,
+					connection_operation, (void *) cri->op,
+					connection_prio( conn, slap_req2op( cri->op->o_tag )),
+					NULL );
 			}
 			connection_op_activate( op );
 		}
@@ -1935,12 +2004,16 @@ static void connection_op_queue( Operation *op )
 
 static int connection_op_activate( Operation *op )
 {
-	int rc;
+	int rc, prio;
 
 	connection_op_queue( op );
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_operation, (void *) op );
+	prio = connection_prio( op->o_conn, slap_req2op( op->o_tag ));
+	Debug( LDAP_DEBUG_CONNS, "connection_op_activate: %s class=%d\n",
+		op->o_log_prefix, prio );
+
+	rc = ldap_pvt_thread_pool_submit_prio( &connection_pool,
+		connection_operation, (void *) op, prio, NULL );
 
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
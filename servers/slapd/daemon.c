@@ -51,6 +51,11 @@
 # include <sys/time.h>
 #elif defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL)
 # include <sys/epoll.h>
+# ifdef SLAP_X_IO_URING
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <linux/io_uring.h>
+# endif /* SLAP_X_IO_URING */
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_SYS_DEVPOLL_H) && defined(HAVE_DEVPOLL)
 # include <sys/types.h>
 # include <sys/stat.h>
@@ -69,6 +74,11 @@ int deny_severity = LOG_NOTICE;
 # define LDAPI_MOD_URLEXT		"x-mod"
 #endif /* LDAP_PF_LOCAL */
 
+#ifdef SO_REUSEPORT
+# define LDAP_REUSEPORT_URLEXT	"x-reuseport"
+# define SLAP_MAX_SHARDS	64
+#endif /* SO_REUSEPORT */
+
 #ifdef LDAP_PF_INET6
 int slap_inet4or6 = AF_UNSPEC;
 #else /* ! INETv6 */
@@ -96,7 +106,15 @@ static volatile sig_atomic_t listening = 1; /* 0 when slap_listeners closed */
 #define SLAPD_LISTEN_BACKLOG 2048
 #endif /* ! SLAPD_LISTEN_BACKLOG */
 
-#define	DAEMON_ID(fd)	(fd & slapd_daemon_mask)
+/* Descriptors of a SO_REUSEPORT listener shard, and the sessions
+ * accepted on it, are served by the daemon thread of that shard.
+ * All other descriptors are spread over the threads by number.
+ */
+static unsigned char *slapd_sd_shard;
+
+#define	DAEMON_ID_MASK(fd,mask)	( slapd_sd_shard && slapd_sd_shard[fd] \
+	? ( slapd_sd_shard[fd] - 1 ) & (mask) : (fd) & (mask) )
+#define	DAEMON_ID(fd)	DAEMON_ID_MASK(fd, slapd_daemon_mask)
 
 typedef ber_socket_t sdpair[2];
 
@@ -154,6 +172,10 @@ typedef struct slap_daemon_st {
 	struct epoll_event	*sd_epolls;
 	int			*sd_index;
 	int			sd_epfd;
+#ifdef SLAP_X_IO_URING
+	/* eXperimental */
+	struct slap_uring	*sd_uring;	/* NULL if using epoll */
+#endif /* SLAP_X_IO_URING */
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_DEVPOLL)
 	/* eXperimental */
 	struct pollfd		*sd_pollfd;
@@ -416,22 +438,35 @@ static slap_daemon_st *slap_daemon;
 # define SLAP_SOCK_NOT_ACTIVE(t,s)	(SLAP_EPOLL_SOCK_IX(t,s) == -1)
 # define SLAP_EPOLL_SOCK_IS_SET(t,s, mode)	(SLAP_EPOLL_SOCK_EV(t,s) & (mode))
 
+#ifdef SLAP_X_IO_URING
+static int slap_uring_ctl( int t, int op, ber_socket_t s );
+static int slap_uring_wait( int t, struct epoll_event *revents, int max,
+	struct timeval *tvp );
+static struct slap_uring *slap_uring_init( int t );
+static void slap_uring_destroy( struct slap_uring *ur );
+
+# define SLAP_EPOLL_CTL(t,op,s)	( slap_daemon[t].sd_uring ? \
+	slap_uring_ctl( t, (op), (s) ) : \
+	epoll_ctl( slap_daemon[t].sd_epfd, (op), (s), &SLAP_EPOLL_SOCK_EP(t,(s)) ))
+#else /* ! SLAP_X_IO_URING */
+# define SLAP_EPOLL_CTL(t,op,s)	\
+	epoll_ctl( slap_daemon[t].sd_epfd, (op), (s), &SLAP_EPOLL_SOCK_EP(t,(s)) )
+#endif /* ! SLAP_X_IO_URING */
+
 # define SLAP_SOCK_IS_READ(t,s)		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLIN)
 # define SLAP_SOCK_IS_WRITE(t,s)		SLAP_EPOLL_SOCK_IS_SET(t,(s), EPOLLOUT)
 
 # define SLAP_EPOLL_SOCK_SET(t,s, mode)	do { \
 	if ( (SLAP_EPOLL_SOCK_EV(t,s) & (mode)) != (mode) ) {	\
 		SLAP_EPOLL_SOCK_EV(t,s) |= (mode); \
-		epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, (s), \
-			&SLAP_EPOLL_SOCK_EP(t,s) ); \
+		SLAP_EPOLL_CTL( t, EPOLL_CTL_MOD, (s) ); \
 	} \
 } while (0)
 
 # define SLAP_EPOLL_SOCK_CLR(t,s, mode)	do { \
 	if ( (SLAP_EPOLL_SOCK_EV(t,s) & (mode)) ) { \
 		SLAP_EPOLL_SOCK_EV(t,s) &= ~(mode);	\
-		epoll_ctl( slap_daemon[t].sd_epfd, EPOLL_CTL_MOD, s, \
-			&SLAP_EPOLL_SOCK_EP(t,s) ); \
+		SLAP_EPOLL_CTL( t, EPOLL_CTL_MOD, (s) ); \
 	} \
 } while (0)
 
@@ -462,8 +497,7 @@ static slap_daemon_st *slap_daemon;
 	SLAP_EPOLL_SOCK_IX(t,(s)) = slap_daemon[t].sd_nfds; \
 	SLAP_EPOLL_SOCK_EP(t,(s)).data.ptr = (l) ? (l) : (void *)(&SLAP_EPOLL_SOCK_IX(t,s)); \
 	SLAP_EPOLL_SOCK_EV(t,(s)) = EPOLLIN; \
-	rc = epoll_ctl(slap_daemon[t].sd_epfd, EPOLL_CTL_ADD, \
-		(s), &SLAP_EPOLL_SOCK_EP(t,(s))); \
+	rc = SLAP_EPOLL_CTL( t, EPOLL_CTL_ADD, (s) ); \
 	if ( rc == 0 ) { \
 		slap_daemon[t].sd_nfds++; \
 	} else { \
@@ -486,8 +520,7 @@ static slap_daemon_st *slap_daemon;
 # define SLAP_SOCK_DEL(t,s)		do { \
 	int fd, rc, index = SLAP_EPOLL_SOCK_IX(t,(s)); \
 	if ( index < 0 ) break; \
-	rc = epoll_ctl(slap_daemon[t].sd_epfd, EPOLL_CTL_DEL, \
-		(s), &SLAP_EPOLL_SOCK_EP(t,(s))); \
+	rc = SLAP_EPOLL_CTL( t, EPOLL_CTL_DEL, (s) ); \
 	slap_daemon[t].sd_epolls[index] = \
 		slap_daemon[t].sd_epolls[slap_daemon[t].sd_nfds-1]; \
 	fd = SLAP_EPOLL_EV_PTRFD(t,slap_daemon[t].sd_epolls[index].data.ptr); \
@@ -514,10 +547,25 @@ static slap_daemon_st *slap_daemon;
 		( sizeof(struct epoll_event) * 2 \
 			+ sizeof(int) ) * dtblsize * 2); \
 	slap_daemon[t].sd_index = (int *)&slap_daemon[t].sd_epolls[ 2 * dtblsize ]; \
-	slap_daemon[t].sd_epfd = epoll_create( dtblsize / slapd_daemon_threads ); \
+	SLAP_URING_INIT(t); \
 	for ( j = 0; j < dtblsize; j++ ) slap_daemon[t].sd_index[j] = -1; \
 } while (0)
 
+#ifdef SLAP_X_IO_URING
+# define SLAP_URING_INIT(t)	do { \
+	slap_daemon[t].sd_uring = slap_uring_init( t ); \
+	slap_daemon[t].sd_epfd = slap_daemon[t].sd_uring ? -1 : \
+		epoll_create( dtblsize / slapd_daemon_threads ); \
+	/* the ring may report the wake pipe after it was drained */ \
+	if ( slap_daemon[t].sd_uring ) \
+		ber_pvt_socket_set_nonblock( wake_sds[t][0], 1 ); \
+} while (0)
+#else /* ! SLAP_X_IO_URING */
+# define SLAP_URING_INIT(t)	do { \
+	slap_daemon[t].sd_epfd = epoll_create( dtblsize / slapd_daemon_threads ); \
+} while (0)
+#endif /* ! SLAP_X_IO_URING */
+
 # define SLAP_SOCK_INIT2()
 
 # define SLAP_SOCK_DESTROY(t)		do { \
@@ -525,20 +573,490 @@ static slap_daemon_st *slap_daemon;
 		ch_free( slap_daemon[t].sd_epolls ); \
 		slap_daemon[t].sd_epolls = NULL; \
 		slap_daemon[t].sd_index = NULL; \
-		close( slap_daemon[t].sd_epfd ); \
+		SLAP_URING_DESTROY(t); \
 	} \
 } while ( 0 )
 
+#ifdef SLAP_X_IO_URING
+# define SLAP_URING_DESTROY(t)	do { \
+	if ( slap_daemon[t].sd_uring != NULL ) { \
+		slap_uring_destroy( slap_daemon[t].sd_uring ); \
+		slap_daemon[t].sd_uring = NULL; \
+	} else { \
+		close( slap_daemon[t].sd_epfd ); \
+	} \
+} while (0)
+#else /* ! SLAP_X_IO_URING */
+# define SLAP_URING_DESTROY(t)	close( slap_daemon[t].sd_epfd )
+#endif /* ! SLAP_X_IO_URING */
+
 # define SLAP_EVENT_DECL		struct epoll_event *revents
 
 # define SLAP_EVENT_INIT(t)		do { \
 	revents = slap_daemon[t].sd_epolls + dtblsize; \
 } while (0)
 
+#ifdef SLAP_X_IO_URING
+# define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	if ( slap_daemon[t].sd_uring ) { \
+		*(nsp) = slap_uring_wait( t, revents, dtblsize, (tvp) ); \
+	} else { \
+		*(nsp) = epoll_wait( slap_daemon[t].sd_epfd, revents, \
+			dtblsize, (tvp) ? ((tvp)->tv_sec * 1000 + (tvp)->tv_usec / 1000) : -1 ); \
+	} \
+} while (0)
+#else /* ! SLAP_X_IO_URING */
 # define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
 	*(nsp) = epoll_wait( slap_daemon[t].sd_epfd, revents, \
 		dtblsize, (tvp) ? ((tvp)->tv_sec * 1000 + (tvp)->tv_usec / 1000) : -1 ); \
 } while (0)
+#endif /* ! SLAP_X_IO_URING */
+
+#ifdef SLAP_X_IO_URING
+/*
+ * io_uring(7) flavour of the epoll backend: the epoll bookkeeping above
+ * is kept as is, but interest changes are queued as multishot poll
+ * requests and handed to the kernel together with the next wait, so
+ * the daemon loop does not need an epoll_ctl(2) per state change.
+ * Completions are converted into struct epoll_event for the common code.
+ *
+ * Unlike level-triggered epoll, a multishot poll only completes when the
+ * socket is woken up. Connections re-poll whenever their interest is
+ * updated, which happens around every read. Listeners that fired are
+ * re-polled once they are listened to again, so connections still
+ * queued after an accept, or after backing off on EMFILE, are not left
+ * waiting for the next one to arrive.
+ */
+# ifndef SLAP_URING_ENTRIES
+#  define SLAP_URING_ENTRIES	1024
+# endif
+
+/* user_data is the descriptor in the low word and its generation in
+ * the high word; completions of stale generations are dropped. Poll
+ * updates are tagged so that a failed update can be redone. Removals
+ * use user_data 0.
+ */
+# define SLAP_URING_GEN_MASK	0x7fffffffU
+# define SLAP_URING_UPDATE	((__u64)1 << 63)
+# define SLAP_URING_UDATA(ur,s)	\
+	( ((__u64)(ur)->ur_gen[(s)] << 32) | (__u32)(s) )
+
+typedef struct slap_uring {
+	ldap_pvt_thread_mutex_t	ur_mutex;	/* protects the SQ */
+	int		ur_fd;
+	unsigned	ur_sq_entries;
+	unsigned	*ur_sq_head;
+	unsigned	*ur_sq_tail;
+	unsigned	ur_sq_mask;
+	struct io_uring_sqe	*ur_sqes;
+	unsigned	*ur_cq_head;
+	unsigned	*ur_cq_tail;
+	unsigned	ur_cq_mask;
+	struct io_uring_cqe	*ur_cqes;
+	void		*ur_sq_ring;
+	size_t		ur_sq_size;
+	void		*ur_cq_ring;
+	size_t		ur_cq_size;
+	size_t		ur_sqes_size;
+	unsigned	*ur_gen;	/* indexed by fd */
+	int		*ur_slot;	/* indexed by fd, revents slot or -1 */
+	char		*ur_fired;	/* indexed by fd, listener to re-poll */
+	struct io_uring_cqe	*ur_held;	/* reaped to make room */
+	unsigned	ur_nheld;
+	unsigned	ur_maxheld;
+} slap_uring;
+
+static int
+slap_uring_enter( slap_uring *ur, unsigned submit, unsigned wait,
+	unsigned flags, void *arg, size_t argsz )
+{
+	return syscall( __NR_io_uring_enter, ur->ur_fd, submit, wait,
+		flags, arg, argsz );
+}
+
+static unsigned
+slap_uring_pending( slap_uring *ur )
+{
+	return *ur->ur_sq_tail - __atomic_load_n( ur->ur_sq_head, __ATOMIC_ACQUIRE );
+}
+
+/* Move the completions in the CQ aside, for slap_uring_wait() to
+ * handle later; ur_mutex must be held
+ */
+static void
+slap_uring_reap( slap_uring *ur )
+{
+	unsigned head = *ur->ur_cq_head;
+	unsigned tail = __atomic_load_n( ur->ur_cq_tail, __ATOMIC_ACQUIRE );
+
+	for ( ; head != tail; head++ ) {
+		if ( ur->ur_nheld == ur->ur_maxheld ) {
+			ur->ur_maxheld = ur->ur_maxheld ? ur->ur_maxheld * 2 : 64;
+			ur->ur_held = ch_realloc( ur->ur_held,
+				ur->ur_maxheld * sizeof( struct io_uring_cqe ));
+		}
+		ur->ur_held[ ur->ur_nheld++ ] = ur->ur_cqes[ head & ur->ur_cq_mask ];
+	}
+	__atomic_store_n( ur->ur_cq_head, head, __ATOMIC_RELEASE );
+}
+
+/* Get a zeroed SQE; ur_mutex must be held. If the SQ is full, hand it
+ * to the kernel and wait until it takes it. The kernel holds back
+ * submissions while it has completions the CQ has no room for, so
+ * those are reaped here; the caller may hold sd_mutex and the daemon
+ * thread can't do it.
+ */
+static struct io_uring_sqe *
+slap_uring_sqe( slap_uring *ur )
+{
+	struct io_uring_sqe *sqe;
+
+	while ( slap_uring_pending( ur ) >= ur->ur_sq_entries ) {
+		if ( slap_uring_enter( ur, slap_uring_pending( ur ),
+				0, 0, NULL, 0 ) >= 0 )
+			continue;
+		if ( errno == EBUSY )
+			slap_uring_reap( ur );
+		else if ( errno != EINTR )
+			ldap_pvt_thread_yield();
+	}
+	sqe = &ur->ur_sqes[ *ur->ur_sq_tail & ur->ur_sq_mask ];
+	memset( sqe, 0, sizeof( *sqe ));
+	return sqe;
+}
+
+static void
+slap_uring_push( slap_uring *ur )
+{
+	__atomic_store_n( ur->ur_sq_tail, *ur->ur_sq_tail + 1, __ATOMIC_RELEASE );
+}
+
+/* Cancel the poll request of s; ur_mutex must be held */
+static void
+slap_uring_poll_remove( slap_uring *ur, ber_socket_t s )
+{
+	struct io_uring_sqe *sqe = slap_uring_sqe( ur );
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = SLAP_URING_UDATA( ur, s );
+	slap_uring_push( ur );
+}
+
+/* Arm a multishot poll for s; ur_mutex must be held */
+static void
+slap_uring_poll_add( slap_uring *ur, ber_socket_t s, unsigned events )
+{
+	struct io_uring_sqe *sqe = slap_uring_sqe( ur );
+
+	ur->ur_gen[s] = ( ur->ur_gen[s] + 1 ) & SLAP_URING_GEN_MASK;
+	if ( ur->ur_gen[s] == 0 )
+		ur->ur_gen[s] = 1;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = s;
+	sqe->poll32_events = events;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = SLAP_URING_UDATA( ur, s );
+	slap_uring_push( ur );
+}
+
+/* Change the events polled for s; ur_mutex must be held. Updating a
+ * poll request re-polls the descriptor, so data left over from before
+ * the update is not missed.
+ */
+static void
+slap_uring_poll_update( slap_uring *ur, ber_socket_t s, unsigned events )
+{
+	struct io_uring_sqe *sqe = slap_uring_sqe( ur );
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = SLAP_URING_UDATA( ur, s );
+	sqe->poll32_events = events;
+	sqe->len = IORING_POLL_UPDATE_EVENTS | IORING_POLL_ADD_MULTI;
+	sqe->user_data = SLAP_URING_UPDATE | SLAP_URING_UDATA( ur, s );
+	slap_uring_push( ur );
+}
+
+/* The SLAP_EPOLL_CTL() of the io_uring flavour.
+ * Called with sd_mutex held, like epoll_ctl() in the epoll flavour.
+ * Requests are only queued here, so this never fails.
+ */
+static int
+slap_uring_ctl( int t, int op, ber_socket_t s )
+{
+	slap_uring *ur = slap_daemon[t].sd_uring;
+	unsigned events = SLAP_EPOLL_SOCK_EV(t,s) & ( EPOLLIN | EPOLLOUT );
+
+	ldap_pvt_thread_mutex_lock( &ur->ur_mutex );
+	switch ( op ) {
+	case EPOLL_CTL_ADD:
+		ur->ur_fired[s] = 0;
+		slap_uring_poll_add( ur, s, events );
+		break;
+
+	case EPOLL_CTL_MOD:
+		ur->ur_fired[s] = 0;
+		slap_uring_poll_update( ur, s, events );
+		break;
+
+	case EPOLL_CTL_DEL:
+		/* The poll request holds a reference on the socket, so it
+		 * must be cancelled before the caller closes the descriptor.
+		 */
+		slap_uring_poll_remove( ur, s );
+		ur->ur_gen[s] = ( ur->ur_gen[s] + 1 ) & SLAP_URING_GEN_MASK;
+		while ( slap_uring_pending( ur ) &&
+			slap_uring_enter( ur, slap_uring_pending( ur ),
+				0, 0, NULL, 0 ) < 0 ) {
+			if ( errno == EBUSY )
+				slap_uring_reap( ur );
+			else if ( errno != EINTR )
+				ldap_pvt_thread_yield();
+		}
+		break;
+	}
+	ldap_pvt_thread_mutex_unlock( &ur->ur_mutex );
+	return 0;
+}
+
+/* Turn a completion into an event in revents; sd_mutex and ur_mutex
+ * must be held
+ */
+static void
+slap_uring_event( int t, slap_uring *ur, struct io_uring_cqe *cqe,
+	struct epoll_event *revents, int *np )
+{
+	ber_socket_t s = (__u32)cqe->user_data;
+	unsigned events;
+	int i;
+
+	if ( cqe->user_data == 0 || s >= dtblsize ||
+		(( cqe->user_data >> 32 ) & SLAP_URING_GEN_MASK ) != ur->ur_gen[s] ||
+		SLAP_SOCK_NOT_ACTIVE( t, s ))
+		return;
+	events = SLAP_EPOLL_SOCK_EV(t,s) & ( EPOLLIN | EPOLLOUT );
+
+	/* an update fails if it races with the completion of the
+	 * request it updates; replace the request instead.
+	 */
+	if ( cqe->user_data & SLAP_URING_UPDATE ) {
+		if ( cqe->res < 0 ) {
+			slap_uring_poll_remove( ur, s );
+			slap_uring_poll_add( ur, s, events );
+		}
+		return;
+	}
+
+	/* the multishot request has ended, e.g. because the task
+	 * that submitted it exited; arm a new one.
+	 */
+	if ( !( cqe->flags & IORING_CQE_F_MORE )) {
+		slap_uring_poll_add( ur, s, events );
+	}
+	if ( cqe->res <= 0 )
+		return;
+
+	i = ur->ur_slot[s];
+	if ( i < 0 ) {
+		i = ur->ur_slot[s] = (*np)++;
+		revents[i].events = 0;
+		revents[i].data = SLAP_EPOLL_SOCK_EP(t,s).data;
+		if ( SLAP_EPOLL_EV_LISTENER( t, revents[i].data.ptr ))
+			ur->ur_fired[s] = 1;
+	}
+	revents[i].events |= cqe->res;
+}
+
+/* The SLAP_EVENT_WAIT() of the io_uring flavour: submit the queued
+ * changes, wait for completions and turn them into epoll events,
+ * merging several completions for the same descriptor.
+ */
+static int
+slap_uring_wait( int t, struct epoll_event *revents, int max,
+	struct timeval *tvp )
+{
+	slap_uring *ur = slap_daemon[t].sd_uring;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned head, tail, submit, wait = 1;
+	int rc, err = 0, n = 0, i;
+
+	memset( &arg, 0, sizeof( arg ));
+	arg.sigmask_sz = _NSIG / 8;
+	if ( tvp ) {
+		ts.tv_sec = tvp->tv_sec;
+		ts.tv_nsec = tvp->tv_usec * 1000;
+		arg.ts = (__u64)(uintptr_t)&ts;
+	}
+
+	ldap_pvt_thread_mutex_lock( &slap_daemon[t].sd_mutex );
+	ldap_pvt_thread_mutex_lock( &ur->ur_mutex );
+	if ( listening ) {
+		for ( i = 0; slap_listeners[i] != NULL; i++ ) {
+			Listener *lr = slap_listeners[i];
+			ber_socket_t s = lr->sl_sd;
+
+			if ( s == AC_SOCKET_INVALID || DAEMON_ID( s ) != t ||
+				!ur->ur_fired[s] || lr->sl_mute || lr->sl_busy ||
+				SLAP_SOCK_NOT_ACTIVE( t, s ) ||
+				!SLAP_SOCK_IS_READ( t, s ))
+				continue;
+			ur->ur_fired[s] = 0;
+			slap_uring_poll_update( ur, s, SLAP_EPOLL_SOCK_EV(t,s) &
+				( EPOLLIN | EPOLLOUT ));
+		}
+	}
+	/* the kernel does not wait if it submits fewer entries than asked */
+	submit = slap_uring_pending( ur );
+	if ( ur->ur_nheld )
+		wait = 0;
+	ldap_pvt_thread_mutex_unlock( &ur->ur_mutex );
+	ldap_pvt_thread_mutex_unlock( &slap_daemon[t].sd_mutex );
+	if ( *ur->ur_cq_head != __atomic_load_n( ur->ur_cq_tail, __ATOMIC_ACQUIRE ))
+		wait = 0;
+	rc = slap_uring_enter( ur, submit, wait,
+		IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof( arg ));
+	if ( rc < 0 && errno != ETIME && errno != EBUSY )
+		err = errno;
+
+	ldap_pvt_thread_mutex_lock( &slap_daemon[t].sd_mutex );
+	ldap_pvt_thread_mutex_lock( &ur->ur_mutex );
+	for ( i = 0; i < ur->ur_nheld; i++ )
+		slap_uring_event( t, ur, &ur->ur_held[i], revents, &n );
+	ur->ur_nheld = 0;
+	head = *ur->ur_cq_head;
+	tail = __atomic_load_n( ur->ur_cq_tail, __ATOMIC_ACQUIRE );
+	for ( ; head != tail && n < max; head++ )
+		slap_uring_event( t, ur, &ur->ur_cqes[ head & ur->ur_cq_mask ],
+			revents, &n );
+	__atomic_store_n( ur->ur_cq_head, head, __ATOMIC_RELEASE );
+	ldap_pvt_thread_mutex_unlock( &ur->ur_mutex );
+	ldap_pvt_thread_mutex_unlock( &slap_daemon[t].sd_mutex );
+
+	for ( i = 0; i < n; i++ )
+		ur->ur_slot[ SLAP_EPOLL_EV_PTRFD( t, revents[i].data.ptr ) ] = -1;
+
+	if ( n == 0 && err ) {
+		errno = err;
+		return -1;
+	}
+	return n;
+}
+
+static void
+slap_uring_destroy( slap_uring *ur )
+{
+	if ( ur->ur_sqes )
+		munmap( ur->ur_sqes, ur->ur_sqes_size );
+	if ( ur->ur_cq_ring && ur->ur_cq_ring != ur->ur_sq_ring )
+		munmap( ur->ur_cq_ring, ur->ur_cq_size );
+	if ( ur->ur_sq_ring )
+		munmap( ur->ur_sq_ring, ur->ur_sq_size );
+	if ( ur->ur_fd >= 0 )
+		close( ur->ur_fd );
+	ldap_pvt_thread_mutex_destroy( &ur->ur_mutex );
+	ch_free( ur->ur_held );
+	ch_free( ur->ur_gen );
+	ch_free( ur );
+}
+
+/* Set up the ring of daemon thread t. Returns NULL if io_uring is not
+ * usable here, in which case the thread falls back to epoll.
+ */
+static slap_uring *
+slap_uring_init( int t )
+{
+	struct io_uring_params p;
+	slap_uring *ur;
+	unsigned *sq_array;
+	unsigned i;
+	int fd, j;
+
+	memset( &p, 0, sizeof( p ));
+	fd = syscall( __NR_io_uring_setup, SLAP_URING_ENTRIES, &p );
+	if ( fd < 0 ) {
+		int err = errno;
+		Debug( LDAP_DEBUG_ANY, "daemon: io_uring_setup failed errno=%d, "
+			"using epoll\n", err );
+		return NULL;
+	}
+	/* multishot poll arrived in Linux 5.13, together with RSRC_TAGS */
+	if ( !( p.features & IORING_FEAT_EXT_ARG ) ||
+		!( p.features & IORING_FEAT_NODROP ) ||
+		!( p.features & IORING_FEAT_RSRC_TAGS ))
+	{
+		Debug( LDAP_DEBUG_ANY, "daemon: io_uring lacks needed features "
+			"(0x%x), using epoll\n", p.features );
+		close( fd );
+		return NULL;
+	}
+
+	ur = ch_calloc( 1, sizeof( slap_uring ));
+	ldap_pvt_thread_mutex_init( &ur->ur_mutex );
+	ur->ur_fd = fd;
+	ur->ur_sq_entries = p.sq_entries;
+
+	ur->ur_sq_size = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	ur->ur_cq_size = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		if ( ur->ur_cq_size > ur->ur_sq_size )
+			ur->ur_sq_size = ur->ur_cq_size;
+		ur->ur_cq_size = ur->ur_sq_size;
+	}
+	ur->ur_sq_ring = mmap( NULL, ur->ur_sq_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+	if ( ur->ur_sq_ring == MAP_FAILED ) {
+		ur->ur_sq_ring = NULL;
+		goto fail;
+	}
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+		ur->ur_cq_ring = ur->ur_sq_ring;
+	} else {
+		ur->ur_cq_ring = mmap( NULL, ur->ur_cq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+		if ( ur->ur_cq_ring == MAP_FAILED ) {
+			ur->ur_cq_ring = NULL;
+			goto fail;
+		}
+	}
+	ur->ur_sqes_size = p.sq_entries * sizeof( struct io_uring_sqe );
+	ur->ur_sqes = mmap( NULL, ur->ur_sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+	if ( ur->ur_sqes == MAP_FAILED ) {
+		ur->ur_sqes = NULL;
+		goto fail;
+	}
+
+	ur->ur_sq_head = (unsigned *)((char *)ur->ur_sq_ring + p.sq_off.head);
+	ur->ur_sq_tail = (unsigned *)((char *)ur->ur_sq_ring + p.sq_off.tail);
+	ur->ur_sq_mask = *(unsigned *)((char *)ur->ur_sq_ring + p.sq_off.ring_mask);
+	sq_array = (unsigned *)((char *)ur->ur_sq_ring + p.sq_off.array);
+	for ( i = 0; i < p.sq_entries; i++ )
+		sq_array[i] = i;
+	ur->ur_cq_head = (unsigned *)((char *)ur->ur_cq_ring + p.cq_off.head);
+	ur->ur_cq_tail = (unsigned *)((char *)ur->ur_cq_ring + p.cq_off.tail);
+	ur->ur_cq_mask = *(unsigned *)((char *)ur->ur_cq_ring + p.cq_off.ring_mask);
+	ur->ur_cqes = (struct io_uring_cqe *)((char *)ur->ur_cq_ring + p.cq_off.cqes);
+
+	ur->ur_gen = ch_calloc( dtblsize,
+		sizeof( unsigned ) + sizeof( int ) + sizeof( char ));
+	ur->ur_slot = (int *)&ur->ur_gen[ dtblsize ];
+	ur->ur_fired = (char *)&ur->ur_slot[ dtblsize ];
+	for ( j = 0; j < dtblsize; j++ )
+		ur->ur_slot[j] = -1;
+
+	Debug( LDAP_DEBUG_TRACE, "daemon: thread %d using io_uring\n", t );
+	return ur;
+
+fail:
+	j = errno;
+	Debug( LDAP_DEBUG_ANY, "daemon: io_uring mmap failed errno=%d, "
+		"using epoll\n", j );
+	slap_uring_destroy( ur );
+	return NULL;
+}
+#endif /* SLAP_X_IO_URING */
 
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_DEVPOLL)
 
@@ -1189,6 +1707,8 @@ slapd_remove(
 
 	SLAP_SOCK_DEL(id, s);
 	CLR_CLOSE(s);
+	if ( slapd_sd_shard )
+		slapd_sd_shard[s] = 0;
 
 	if ( sb )
 		ber_sockbuf_free(sb);
@@ -1297,6 +1817,8 @@ slapd_close( ber_socket_t s )
 	Debug( LDAP_DEBUG_CONNS, "daemon: closing %ld\n",
 		(long) s );
 	CLR_CLOSE( SLAP_FD2SOCK(s) );
+	if ( slapd_sd_shard )
+		slapd_sd_shard[s] = 0;
 	tcp_close( SLAP_FD2SOCK(s) );
 #ifdef HAVE_WINSOCK
 	slapd_sockdel( s );
@@ -1401,6 +1923,54 @@ get_url_perms(
 }
 #endif /* LDAP_PF_LOCAL || SLAP_X_LISTENER_MOD */
 
+#ifdef LDAP_REUSEPORT_URLEXT
+/* Parse and remove the "x-reuseport=<n>" extension, so that the
+ * remaining extensions can be handled by get_url_perms().
+ */
+static int
+get_url_shards(
+	char	**exts,
+	int	*shards )
+{
+	int	i, j;
+
+	assert( exts != NULL );
+	assert( shards != NULL );
+
+	for ( i = 0; exts[ i ]; i++ ) {
+		char	*type = exts[ i ];
+		int	n;
+
+		if ( type[ 0 ] == '!' ) {
+			type++;
+		}
+
+		if ( strncasecmp( type, LDAP_REUSEPORT_URLEXT "=",
+			sizeof(LDAP_REUSEPORT_URLEXT "=") - 1 ) != 0 )
+		{
+			continue;
+		}
+
+		type += sizeof(LDAP_REUSEPORT_URLEXT "=") - 1;
+		if ( lutil_atoi( &n, type ) != 0 || n < 1 || n > SLAP_MAX_SHARDS ) {
+			Debug( LDAP_DEBUG_ANY, "daemon: invalid "
+				LDAP_REUSEPORT_URLEXT " value \"%s\" (1..%d)\n",
+				type, SLAP_MAX_SHARDS );
+			return LDAP_OTHER;
+		}
+		*shards = n;
+
+		ber_memfree( exts[ i ] );
+		for ( j = i; exts[ j ]; j++ ) {
+			exts[ j ] = exts[ j + 1 ];
+		}
+		i--;
+	}
+
+	return LDAP_SUCCESS;
+}
+#endif /* LDAP_REUSEPORT_URLEXT */
+
 /* port = 0 indicates AF_LOCAL */
 static int
 slap_get_listener_addresses(
@@ -1549,6 +2119,144 @@ errexit:
 	return -1;
 }
 
+/* Create and bind one listening socket for the given address */
+static ber_socket_t
+slap_listener_socket(
+	struct sockaddr *sa,
+	int socktype,
+	int reuseport,
+	const char *af,
+	int *addrlen )
+{
+	ber_socket_t s, sd;
+	int tmp, rc, err;
+	char ebuf[128];
+
+	s = socket( sa->sa_family, socktype, 0);
+	if ( s == AC_SOCKET_INVALID ) {
+		int err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: %s socket() failed errno=%d (%s)\n",
+			af, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+		return AC_SOCKET_INVALID;
+	}
+	sd = SLAP_SOCKNEW( s );
+
+	if ( sd >= dtblsize ) {
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: listener descriptor %ld is too great %ld\n",
+			(long) sd, (long) dtblsize );
+		tcp_close( s );
+		return AC_SOCKET_INVALID;
+	}
+
+#ifdef LDAP_PF_LOCAL
+	if ( sa->sa_family == AF_LOCAL ) {
+		unlink( ((struct sockaddr_un *)sa)->sun_path );
+	} else
+#endif /* LDAP_PF_LOCAL */
+	{
+#ifdef SO_REUSEADDR
+		/* enable address reuse */
+		tmp = 1;
+		rc = setsockopt( s, SOL_SOCKET, SO_REUSEADDR,
+			(char *) &tmp, sizeof(tmp) );
+		if ( rc == AC_SOCKET_ERROR ) {
+			int err = sock_errno();
+			Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+				"setsockopt(SO_REUSEADDR) failed errno=%d (%s)\n",
+				(long) sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+		}
+#endif /* SO_REUSEADDR */
+#ifdef LDAP_REUSEPORT_URLEXT
+		if ( reuseport ) {
+			/* let the kernel spread accepts over the listener shards */
+			tmp = 1;
+			rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+				(char *) &tmp, sizeof(tmp) );
+			if ( rc == AC_SOCKET_ERROR ) {
+				int err = sock_errno();
+				Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+					"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+					(long) sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+				tcp_close( s );
+				return AC_SOCKET_INVALID;
+			}
+		}
+#endif /* LDAP_REUSEPORT_URLEXT */
+	}
+
+	switch( sa->sa_family ) {
+	case AF_INET:
+		*addrlen = sizeof(struct sockaddr_in);
+		break;
+#ifdef LDAP_PF_INET6
+	case AF_INET6:
+#ifdef IPV6_V6ONLY
+		/* Try to use IPv6 sockets for IPv6 only */
+		tmp = 1;
+		rc = setsockopt( s , IPPROTO_IPV6, IPV6_V6ONLY,
+			(char *) &tmp, sizeof(tmp) );
+		if ( rc == AC_SOCKET_ERROR ) {
+			int err = sock_errno();
+			Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+				"setsockopt(IPV6_V6ONLY) failed errno=%d (%s)\n",
+				(long) sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
+		}
+#endif /* IPV6_V6ONLY */
+		*addrlen = sizeof(struct sockaddr_in6);
+		break;
+#endif /* LDAP_PF_INET6 */
+
+#ifdef LDAP_PF_LOCAL
+	case AF_LOCAL:
+#ifdef LOCAL_CREDS
+		{
+			int one = 1;
+			setsockopt( s, 0, LOCAL_CREDS, &one, sizeof( one ) );
+		}
+#endif /* LOCAL_CREDS */
+
+		*addrlen = sizeof( struct sockaddr_un );
+		break;
+#endif /* LDAP_PF_LOCAL */
+	}
+
+#ifdef LDAP_PF_LOCAL
+	/* create socket with all permissions set for those systems
+	 * that honor permissions on sockets (e.g. Linux); typically,
+	 * only write is required.  To exploit filesystem permissions,
+	 * place the socket in a directory and use directory's
+	 * permissions.  Need write perms to the directory to 
+	 * create/unlink the socket; likely need exec perms to access
+	 * the socket (ITS#4709) */
+	{
+		mode_t old_umask = 0;
+
+		if ( sa->sa_family == AF_LOCAL ) {
+			old_umask = umask( 0 );
+		}
+#endif /* LDAP_PF_LOCAL */
+		rc = bind( s, sa, *addrlen );
+#ifdef LDAP_PF_LOCAL
+		if ( old_umask != 0 ) {
+			umask( old_umask );
+		}
+	}
+#endif /* LDAP_PF_LOCAL */
+	if ( rc ) {
+		err = sock_errno();
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: bind(%ld) failed errno=%d (%s)\n",
+			(long)sd, err, sock_errstr( err, ebuf, sizeof(ebuf) ) );
+		tcp_close( s );
+		return AC_SOCKET_INVALID;
+	}
+
+
+	return sd;
+}
+
 static int
 slap_open_listener(
 	const char* url,
@@ -1563,8 +2271,7 @@ slap_open_listener(
 	int err, addrlen = 0;
 	struct sockaddr **sal = NULL, **psal;
 	int socktype = SOCK_STREAM;	/* default to COTS */
-	ber_socket_t s;
-	char ebuf[128];
+	int nshards = 1, i;
 
 #if defined(LDAP_PF_LOCAL) || defined(SLAP_X_LISTENER_MOD)
 	/*
@@ -1585,6 +2292,7 @@ slap_open_listener(
 	l.sl_url.bv_val = NULL;
 	l.sl_mute = 0;
 	l.sl_busy = 0;
+	l.sl_shard = 0;
 
 #ifndef HAVE_TLS
 	if( ldap_pvt_url_scheme2tls( lud->lud_scheme ) ) {
@@ -1640,6 +2348,24 @@ slap_open_listener(
 	l.sl_is_udp = ( tmp == LDAP_PROTO_UDP );
 #endif /* LDAP_CONNECTIONLESS */
 
+#ifdef LDAP_REUSEPORT_URLEXT
+	if ( !err && lud->lud_exts ) {
+		err = get_url_shards( lud->lud_exts, &nshards );
+		if ( !err && nshards > 1 &&
+			( tmp == LDAP_PROTO_IPC || tmp == LDAP_PROTO_UDP ))
+		{
+			Debug( LDAP_DEBUG_ANY, "daemon: "
+				LDAP_REUSEPORT_URLEXT " needs a TCP listener (%s)\n",
+				url );
+			err = -1;
+		}
+		if ( lud->lud_exts[0] == NULL ) {
+			ber_memfree( lud->lud_exts );
+			lud->lud_exts = NULL;
+		}
+	}
+#endif /* LDAP_REUSEPORT_URLEXT */
+
 #if defined(LDAP_PF_LOCAL) || defined(SLAP_X_LISTENER_MOD)
 	if ( lud->lud_exts ) {
 		err = get_url_perms( lud->lud_exts, &l.sl_perms, &crit );
@@ -1654,10 +2380,15 @@ slap_open_listener(
 		return -1;
 	}
 
-	/* If we got more than one address returned, we need to make space
-	 * for it in the slap_listeners array.
+	if ( nshards > 1 && slapd_sd_shard == NULL ) {
+		slapd_sd_shard = ch_calloc( dtblsize, sizeof( *slapd_sd_shard ));
+	}
+
+	/* If we got more than one address returned, or the listener is
+	 * sharded, we need to make space for it in the slap_listeners array.
 	 */
 	for ( num=0; sal[num]; num++ ) /* empty */;
+	num *= nshards;
 	if ( num > 1 ) {
 		*listeners += num-1;
 		slap_listeners = ch_realloc( slap_listeners,
@@ -1690,110 +2421,9 @@ slap_open_listener(
 		if( l.sl_is_udp ) socktype = SOCK_DGRAM;
 #endif /* LDAP_CONNECTIONLESS */
 
-		s = socket( (*sal)->sa_family, socktype, 0);
-		if ( s == AC_SOCKET_INVALID ) {
-			int err = sock_errno();
-			Debug( LDAP_DEBUG_ANY,
-				"daemon: %s socket() failed errno=%d (%s)\n",
-				af, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
-			sal++;
-			continue;
-		}
-		l.sl_sd = SLAP_SOCKNEW( s );
-
-		if ( l.sl_sd >= dtblsize ) {
-			Debug( LDAP_DEBUG_ANY,
-				"daemon: listener descriptor %ld is too great %ld\n",
-				(long) l.sl_sd, (long) dtblsize );
-			tcp_close( s );
-			sal++;
-			continue;
-		}
-
-#ifdef LDAP_PF_LOCAL
-		if ( (*sal)->sa_family == AF_LOCAL ) {
-			unlink( ((struct sockaddr_un *)*sal)->sun_path );
-		} else
-#endif /* LDAP_PF_LOCAL */
-		{
-#ifdef SO_REUSEADDR
-			/* enable address reuse */
-			tmp = 1;
-			rc = setsockopt( s, SOL_SOCKET, SO_REUSEADDR,
-				(char *) &tmp, sizeof(tmp) );
-			if ( rc == AC_SOCKET_ERROR ) {
-				int err = sock_errno();
-				Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
-					"setsockopt(SO_REUSEADDR) failed errno=%d (%s)\n",
-					(long) l.sl_sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
-			}
-#endif /* SO_REUSEADDR */
-		}
-
-		switch( (*sal)->sa_family ) {
-		case AF_INET:
-			addrlen = sizeof(struct sockaddr_in);
-			break;
-#ifdef LDAP_PF_INET6
-		case AF_INET6:
-#ifdef IPV6_V6ONLY
-			/* Try to use IPv6 sockets for IPv6 only */
-			tmp = 1;
-			rc = setsockopt( s , IPPROTO_IPV6, IPV6_V6ONLY,
-				(char *) &tmp, sizeof(tmp) );
-			if ( rc == AC_SOCKET_ERROR ) {
-				int err = sock_errno();
-				Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
-					"setsockopt(IPV6_V6ONLY) failed errno=%d (%s)\n",
-					(long) l.sl_sd, err, sock_errstr(err, ebuf, sizeof(ebuf)) );
-			}
-#endif /* IPV6_V6ONLY */
-			addrlen = sizeof(struct sockaddr_in6);
-			break;
-#endif /* LDAP_PF_INET6 */
-
-#ifdef LDAP_PF_LOCAL
-		case AF_LOCAL:
-#ifdef LOCAL_CREDS
-			{
-				int one = 1;
-				setsockopt( s, 0, LOCAL_CREDS, &one, sizeof( one ) );
-			}
-#endif /* LOCAL_CREDS */
-
-			addrlen = sizeof( struct sockaddr_un );
-			break;
-#endif /* LDAP_PF_LOCAL */
-		}
-
-#ifdef LDAP_PF_LOCAL
-		/* create socket with all permissions set for those systems
-		 * that honor permissions on sockets (e.g. Linux); typically,
-		 * only write is required.  To exploit filesystem permissions,
-		 * place the socket in a directory and use directory's
-		 * permissions.  Need write perms to the directory to 
-		 * create/unlink the socket; likely need exec perms to access
-		 * the socket (ITS#4709) */
-		{
-			mode_t old_umask = 0;
-
-			if ( (*sal)->sa_family == AF_LOCAL ) {
-				old_umask = umask( 0 );
-			}
-#endif /* LDAP_PF_LOCAL */
-			rc = bind( s, *sal, addrlen );
-#ifdef LDAP_PF_LOCAL
-			if ( old_umask != 0 ) {
-				umask( old_umask );
-			}
-		}
-#endif /* LDAP_PF_LOCAL */
-		if ( rc ) {
-			err = sock_errno();
-			Debug( LDAP_DEBUG_ANY,
-				"daemon: bind(%ld) failed errno=%d (%s)\n",
-				(long)l.sl_sd, err, sock_errstr( err, ebuf, sizeof(ebuf) ) );
-			tcp_close( s );
+		l.sl_sd = slap_listener_socket( *sal, socktype, nshards > 1,
+			af, &addrlen );
+		if ( l.sl_sd == AC_SOCKET_INVALID ) {
 			sal++;
 			continue;
 		}
@@ -1851,10 +2481,36 @@ slap_open_listener(
 
 		AC_MEMCPY(&l.sl_sa, *sal, addrlen);
 		ber_str2bv( url, 0, 1, &l.sl_url);
+		if ( nshards > 1 ) {
+			l.sl_shard = 1;
+			slapd_sd_shard[l.sl_sd] = l.sl_shard;
+		}
 		li = ch_malloc( sizeof( Listener ) );
 		*li = l;
 		slap_listeners[*cur] = li;
 		(*cur)++;
+
+		/* The remaining shards share the address of the first one */
+		for ( i = 1; i < nshards; i++ ) {
+			ber_socket_t sd = slap_listener_socket( *sal, socktype, 1,
+				af, &addrlen );
+			if ( sd == AC_SOCKET_INVALID )
+				break;
+			li = ch_malloc( sizeof( Listener ) );
+			*li = l;
+			li->sl_sd = sd;
+			li->sl_shard = i + 1;
+			slapd_sd_shard[sd] = li->sl_shard;
+			ber_dupbv( &li->sl_name, &l.sl_name );
+			ber_dupbv( &li->sl_url, &l.sl_url );
+			slap_listeners[*cur] = li;
+			(*cur)++;
+		}
+		if ( i < nshards ) {
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: only %d of %d listener shards opened for %s\n",
+				i, nshards, l.sl_url.bv_val );
+		}
 		sal++;
 	}
 
@@ -2003,7 +2659,7 @@ slapd_socket_realloc( int newnum )
 		if ( skip ) continue;
 
 		oldid = DAEMON_ID(i);
-		newid = i & newmask;
+		newid = DAEMON_ID_MASK(i, newmask);
 		if ( oldid == newid ) continue;
 		if ( !SLAP_SOCK_IS_ACTIVE( oldid, i )) continue;
 		sl = NULL;
@@ -2055,6 +2711,10 @@ slapd_daemon_destroy( void )
 			SLAP_SOCK_DESTROY(i);
 		}
 		daemon_inited = 0;
+		if ( slapd_sd_shard ) {
+			ch_free( slapd_sd_shard );
+			slapd_sd_shard = NULL;
+		}
 		ldap_pvt_thread_mutex_destroy( &emfile_mutex );
 #ifdef HAVE_TCPD
 		ldap_pvt_thread_mutex_destroy( &sd_tcpd_mutex );
@@ -2292,6 +2952,10 @@ slap_listener(
 		ldap_pvt_thread_yield();
 		return 0;
 	}
+
+	/* keep sessions accepted on a shard on the shard's thread */
+	if ( slapd_sd_shard )
+		slapd_sd_shard[sfd] = sl->sl_shard;
 	tid = DAEMON_ID(sfd);
 
 #ifdef LDAP_DEBUG
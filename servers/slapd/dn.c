@@ -55,6 +55,198 @@
 
 int slap_DN_strict = SLAP_AD_NOINSERT;
 
+/*
+ * Most requests name the same few thousand DNs over and over, as bind
+ * DNs, search bases or member values. Their pretty and normalized forms
+ * are kept in a direct-mapped table indexed by a hash of the DN as it
+ * was received, so that they don't need to be parsed and rewritten
+ * again. A new DN simply replaces whatever was in its slot.
+ *
+ * The table is only resized with the server paused or single-threaded;
+ * slots are protected by a fixed set of mutexes. Since the forms depend
+ * on the schema, the table is emptied whenever attribute types change.
+ * They also depend on slap_DN_strict, which lets unknown attributes
+ * through while the config is read back; it is part of the key.
+ */
+typedef struct dn_cache_entry {
+	int		dce_strict;	/* slap_DN_strict they were made with */
+	struct berval	dce_val;
+	struct berval	dce_pretty;	/* BER_BVNULL if unknown */
+	struct berval	dce_normal;	/* BER_BVNULL if unknown */
+} dn_cache_entry;
+
+#define	DN_CACHE_LOCKS	64
+#define	DN_CACHE_MAXLEN	512	/* longer DNs are not worth keeping */
+
+unsigned slap_dncache_size;
+
+static dn_cache_entry		**dn_cache;
+static int			dn_cache_used;
+static ldap_pvt_thread_mutex_t	dn_cache_mutex[DN_CACHE_LOCKS];
+
+static unsigned
+dn_cache_slot( struct berval *val )
+{
+	unsigned h = 2166136261U;
+	ber_len_t i;
+
+	for ( i = 0; i < val->bv_len; i++ ) {
+		h ^= (unsigned char)val->bv_val[i];
+		h *= 16777619U;
+	}
+	return h % slap_dncache_size;
+}
+
+/*
+ * Copy the cached forms of val in ctx; pretty or normal may be NULL if
+ * that form is not wanted. Return 1 if all wanted forms were found.
+ */
+static int
+dn_cache_get(
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal,
+	void *ctx )
+{
+	dn_cache_entry	*dce;
+	unsigned	slot;
+	int		hit = 0;
+
+	if ( !slap_dncache_size || !val->bv_len || val->bv_len > DN_CACHE_MAXLEN )
+		return 0;
+
+	slot = dn_cache_slot( val );
+	ldap_pvt_thread_mutex_lock( &dn_cache_mutex[slot % DN_CACHE_LOCKS] );
+	dce = dn_cache[slot];
+	if ( dce && dce->dce_strict == slap_DN_strict &&
+		bvmatch( &dce->dce_val, val ) &&
+		( !pretty || !BER_BVISNULL( &dce->dce_pretty )) &&
+		( !normal || !BER_BVISNULL( &dce->dce_normal )))
+	{
+		if ( pretty )
+			ber_dupbv_x( pretty, &dce->dce_pretty, ctx );
+		if ( normal )
+			ber_dupbv_x( normal, &dce->dce_normal, ctx );
+		hit = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &dn_cache_mutex[slot % DN_CACHE_LOCKS] );
+
+	return hit;
+}
+
+static void
+dn_cache_copy( struct berval *dst, struct berval *src, char **ptr )
+{
+	if ( !src || BER_BVISNULL( src )) {
+		BER_BVZERO( dst );
+		return;
+	}
+	dst->bv_val = *ptr;
+	dst->bv_len = src->bv_len;
+	AC_MEMCPY( dst->bv_val, src->bv_val, src->bv_len );
+	dst->bv_val[src->bv_len] = '\0';
+	*ptr += src->bv_len + 1;
+}
+
+/*
+ * Remember the forms of val just computed; either may be NULL. Forms
+ * already known for the same DN are kept.
+ */
+static void
+dn_cache_put(
+	struct berval *val,
+	struct berval *pretty,
+	struct berval *normal )
+{
+	dn_cache_entry	*dce, *old;
+	unsigned	slot;
+	char		*ptr;
+
+	if ( !slap_dncache_size || val->bv_len > DN_CACHE_MAXLEN )
+		return;
+
+	slot = dn_cache_slot( val );
+	ldap_pvt_thread_mutex_lock( &dn_cache_mutex[slot % DN_CACHE_LOCKS] );
+	old = dn_cache[slot];
+	if ( old && old->dce_strict == slap_DN_strict &&
+		bvmatch( &old->dce_val, val ))
+	{
+		if ( !pretty && !BER_BVISNULL( &old->dce_pretty ))
+			pretty = &old->dce_pretty;
+		if ( !normal && !BER_BVISNULL( &old->dce_normal ))
+			normal = &old->dce_normal;
+	}
+	dce = ch_malloc( sizeof( dn_cache_entry ) + val->bv_len + 3 +
+		( pretty ? pretty->bv_len : 0 ) +
+		( normal ? normal->bv_len : 0 ));
+	ptr = (char *)( dce + 1 );
+	dce->dce_strict = slap_DN_strict;
+	dn_cache_copy( &dce->dce_val, val, &ptr );
+	dn_cache_copy( &dce->dce_pretty, pretty, &ptr );
+	dn_cache_copy( &dce->dce_normal, normal, &ptr );
+	dn_cache[slot] = dce;
+	dn_cache_used = 1;
+	ldap_pvt_thread_mutex_unlock( &dn_cache_mutex[slot % DN_CACHE_LOCKS] );
+
+	if ( old )
+		ch_free( old );
+}
+
+/* Empty the cache */
+void
+dn_cache_flush( void )
+{
+	unsigned	i;
+
+	if ( !dn_cache_used )
+		return;
+
+	for ( i = 0; i < DN_CACHE_LOCKS; i++ )
+		ldap_pvt_thread_mutex_lock( &dn_cache_mutex[i] );
+	for ( i = 0; i < slap_dncache_size; i++ ) {
+		if ( dn_cache[i] ) {
+			ch_free( dn_cache[i] );
+			dn_cache[i] = NULL;
+		}
+	}
+	dn_cache_used = 0;
+	for ( i = 0; i < DN_CACHE_LOCKS; i++ )
+		ldap_pvt_thread_mutex_unlock( &dn_cache_mutex[i] );
+}
+
+/* Only call with the server paused, or before it starts */
+void
+dn_cache_resize( unsigned size )
+{
+	dn_cache_flush();
+	ch_free( dn_cache );
+	dn_cache = NULL;
+	slap_dncache_size = 0;
+	if ( size ) {
+		dn_cache = ch_calloc( size, sizeof( dn_cache_entry * ));
+		slap_dncache_size = size;
+	}
+}
+
+void
+dn_cache_init( void )
+{
+	int		i;
+
+	for ( i = 0; i < DN_CACHE_LOCKS; i++ )
+		ldap_pvt_thread_mutex_init( &dn_cache_mutex[i] );
+}
+
+void
+dn_cache_destroy( void )
+{
+	int		i;
+
+	dn_cache_resize( 0 );
+	for ( i = 0; i < DN_CACHE_LOCKS; i++ )
+		ldap_pvt_thread_mutex_destroy( &dn_cache_mutex[i] );
+}
+
 static int
 LDAPRDN_validate( LDAPRDN rdn )
 {
@@ -426,7 +618,10 @@ dnNormalize(
 
 	Debug( LDAP_DEBUG_TRACE, ">>> dnNormalize: <%s>\n", val->bv_val ? val->bv_val : "" );
 
-	if ( val->bv_len != 0 ) {
+	if ( dn_cache_get( val, NULL, out, ctx )) {
+		/* seen before */
+
+	} else if ( val->bv_len != 0 ) {
 		LDAPDN		dn = NULL;
 		int		rc;
 
@@ -459,6 +654,8 @@ dnNormalize(
 		if ( rc != LDAP_SUCCESS ) {
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dn_cache_put( val, NULL, out );
 	} else {
 		ber_dupbv_x( out, val, ctx );
 	}
@@ -544,6 +741,9 @@ dnPretty(
 	} else if ( val->bv_len > SLAP_LDAPDN_MAXLEN ) {
 		return LDAP_INVALID_SYNTAX;
 
+	} else if ( dn_cache_get( val, out, NULL, ctx )) {
+		/* seen before */
+
 	} else {
 		LDAPDN		dn = NULL;
 		int		rc;
@@ -576,6 +776,8 @@ dnPretty(
 		if ( rc != LDAP_SUCCESS ) {
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dn_cache_put( val, out, NULL );
 	}
 
 	Debug( LDAP_DEBUG_TRACE, "<<< dnPretty: <%s>\n", out->bv_val ? out->bv_val : "" );
@@ -715,6 +917,9 @@ dnPrettyNormal(
 		/* too big */
 		return LDAP_INVALID_SYNTAX;
 
+	} else if ( dn_cache_get( val, pretty, normal, ctx )) {
+		/* seen before */
+
 	} else {
 		LDAPDN		dn = NULL;
 		int		rc;
@@ -766,6 +971,8 @@ dnPrettyNormal(
 			pretty->bv_len = 0;
 			return LDAP_INVALID_SYNTAX;
 		}
+
+		dn_cache_put( val, pretty, normal );
 	}
 
 	Debug( LDAP_DEBUG_TRACE, "<<< dnPrettyNormal: <%s>, <%s>\n",
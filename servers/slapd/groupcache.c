@@ -0,0 +1,491 @@
+/* groupcache.c - shared cache of group membership lookups */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/string.h>
+
+#include "slap.h"
+
+/*
+ * ACL group clauses, set gathering and SASL authz group rules keep
+ * reading the same group entries. Their answers are kept here, shared
+ * by all operations, and indexed by the DN of the entry they were read
+ * from. Any successful write to that entry drops them; otherwise they
+ * live for slap_groupcache_ttl seconds. Each invalidation bumps a
+ * generation number and remembers a hash of the DN. Operations note
+ * the generation when they start, before the backend reads anything,
+ * and an answer is only stored if its entry wasn't invalidated since;
+ * otherwise it may come from a snapshot older than the write. Renames
+ * invalidate whole subtrees, and skip the generation far enough ahead
+ * that no answer in flight gets stored.
+ *
+ * The cache is disabled while slap_groupcache_ttl is 0.
+ */
+
+typedef struct group_cache_entry {
+	struct berval		gce_ndn;	/* entry the answer was read from */
+	struct berval		gce_key;	/* question asked about it */
+	int			gce_rc;
+	BerVarray		gce_vals;
+	time_t			gce_expire;
+	struct group_cache_entry *gce_next;	/* in insertion order */
+	struct group_cache_entry *gce_prev;
+} group_cache_entry;
+
+unsigned slap_groupcache_ttl;
+unsigned slap_groupcache_max = SLAP_GROUPCACHE_MAX;
+
+static ldap_pvt_thread_rdwr_t	gc_rwlock;
+static Avlnode			*gc_tree;
+static group_cache_entry	*gc_head, *gc_tail;
+static unsigned			gc_count;
+static unsigned long		gc_gen;
+
+#define	GC_RECENT	64
+static unsigned			gc_recent[GC_RECENT];	/* by gc_gen */
+
+static unsigned
+gc_hash( struct berval *ndn )
+{
+	unsigned h = 2166136261U;
+	ber_len_t i;
+
+	for ( i = 0; i < ndn->bv_len; i++ ) {
+		h ^= (unsigned char)ndn->bv_val[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static int
+gc_ndn_cmp( const void *v1, const void *v2 )
+{
+	const group_cache_entry *g1 = v1, *g2 = v2;
+	int rc;
+
+	rc = g1->gce_ndn.bv_len - g2->gce_ndn.bv_len;
+	if ( rc == 0 )
+		rc = memcmp( g1->gce_ndn.bv_val, g2->gce_ndn.bv_val,
+			g1->gce_ndn.bv_len );
+	return rc;
+}
+
+static int
+gc_cmp( const void *v1, const void *v2 )
+{
+	const group_cache_entry *g1 = v1, *g2 = v2;
+	int rc;
+
+	rc = gc_ndn_cmp( v1, v2 );
+	if ( rc == 0 ) {
+		rc = g1->gce_key.bv_len - g2->gce_key.bv_len;
+		if ( rc == 0 )
+			rc = memcmp( g1->gce_key.bv_val, g2->gce_key.bv_val,
+				g1->gce_key.bv_len );
+	}
+	return rc;
+}
+
+static void
+gc_free( void *v )
+{
+	group_cache_entry *gce = v;
+
+	if ( gce->gce_vals )
+		ber_bvarray_free( gce->gce_vals );
+	ch_free( gce );
+}
+
+/* caller must hold the write lock */
+static void
+gc_remove( group_cache_entry *gce )
+{
+	avl_delete( &gc_tree, gce, gc_cmp );
+	if ( gce->gce_prev )
+		gce->gce_prev->gce_next = gce->gce_next;
+	else
+		gc_head = gce->gce_next;
+	if ( gce->gce_next )
+		gce->gce_next->gce_prev = gce->gce_prev;
+	else
+		gc_tail = gce->gce_prev;
+	gc_count--;
+	gc_free( gce );
+}
+
+void
+slap_group_cache_init( void )
+{
+	ldap_pvt_thread_rdwr_init( &gc_rwlock );
+}
+
+void
+slap_group_cache_destroy( void )
+{
+	avl_free( gc_tree, gc_free );
+	gc_tree = NULL;
+	gc_head = gc_tail = NULL;
+	gc_count = 0;
+	ldap_pvt_thread_rdwr_destroy( &gc_rwlock );
+}
+
+/*
+ * Current generation; operations record it in o_gcgen as they start,
+ * to hand to slap_group_cache_put() later.
+ */
+unsigned long
+slap_group_cache_gen( void )
+{
+	unsigned long	gen;
+
+	if ( !slap_groupcache_ttl )
+		return 0;
+
+	ldap_pvt_thread_rdwr_rlock( &gc_rwlock );
+	gen = gc_gen;
+	ldap_pvt_thread_rdwr_runlock( &gc_rwlock );
+
+	return gen;
+}
+
+/*
+ * Look up the answer to question key about entry ndn. On a hit, return
+ * 1 and the stored result code; the stored values, if wanted, are
+ * duplicated in memctx. On a miss return 0.
+ */
+int
+slap_group_cache_get(
+	struct berval	*ndn,
+	struct berval	*key,
+	int		*rc,
+	BerVarray	*vals,
+	void		*memctx )
+{
+	group_cache_entry	tmp, *gce;
+	int			hit = 0;
+
+	if ( !slap_groupcache_ttl )
+		return 0;
+
+	tmp.gce_ndn = *ndn;
+	tmp.gce_key = *key;
+
+	ldap_pvt_thread_rdwr_rlock( &gc_rwlock );
+	gce = avl_find( gc_tree, &tmp, gc_cmp );
+	if ( gce && gce->gce_expire > slap_get_time() ) {
+		*rc = gce->gce_rc;
+		if ( vals ) {
+			*vals = NULL;
+			if ( gce->gce_vals ) {
+				int i;
+
+				for ( i = 0; !BER_BVISNULL( &gce->gce_vals[i] ); i++ )
+					/* count */ ;
+				*vals = ber_memalloc_x( ( i + 1 ) * sizeof( struct berval ),
+					memctx );
+				for ( i = 0; !BER_BVISNULL( &gce->gce_vals[i] ); i++ )
+					ber_dupbv_x( &(*vals)[i], &gce->gce_vals[i], memctx );
+				BER_BVZERO( &(*vals)[i] );
+			}
+		}
+		hit = 1;
+	}
+	ldap_pvt_thread_rdwr_runlock( &gc_rwlock );
+
+	return hit;
+}
+
+/*
+ * Store the answer read by an operation that started at generation gen
+ */
+void
+slap_group_cache_put(
+	struct berval	*ndn,
+	struct berval	*key,
+	int		rc,
+	BerVarray	vals,
+	unsigned long	gen )
+{
+	group_cache_entry	*gce, *old;
+	unsigned		h;
+	int			stale = 0;
+
+	if ( !slap_groupcache_ttl || !slap_groupcache_max )
+		return;
+
+	h = gc_hash( ndn );
+
+	gce = ch_malloc( sizeof( group_cache_entry ) +
+		ndn->bv_len + key->bv_len + 2 );
+	gce->gce_ndn.bv_val = (char *)( gce + 1 );
+	gce->gce_ndn.bv_len = ndn->bv_len;
+	AC_MEMCPY( gce->gce_ndn.bv_val, ndn->bv_val, ndn->bv_len );
+	gce->gce_ndn.bv_val[ndn->bv_len] = '\0';
+	gce->gce_key.bv_val = gce->gce_ndn.bv_val + ndn->bv_len + 1;
+	gce->gce_key.bv_len = key->bv_len;
+	AC_MEMCPY( gce->gce_key.bv_val, key->bv_val, key->bv_len );
+	gce->gce_key.bv_val[key->bv_len] = '\0';
+	gce->gce_rc = rc;
+	gce->gce_vals = NULL;
+	if ( vals )
+		ber_bvarray_dup_x( &gce->gce_vals, vals, NULL );
+	gce->gce_expire = slap_get_time() + slap_groupcache_ttl;
+	gce->gce_next = NULL;
+
+	ldap_pvt_thread_rdwr_wlock( &gc_rwlock );
+	if ( gc_gen - gen >= GC_RECENT ) {
+		/* too many writes since to tell which entries they hit */
+		stale = 1;
+	} else {
+		for ( ; gen != gc_gen; gen++ ) {
+			if ( gc_recent[( gen + 1 ) % GC_RECENT] == h ) {
+				stale = 1;
+				break;
+			}
+		}
+	}
+	if ( stale ) {
+		/* the entry may have been written since the answer was read */
+		ldap_pvt_thread_rdwr_wunlock( &gc_rwlock );
+		gc_free( gce );
+		return;
+	}
+
+	old = avl_find( gc_tree, gce, gc_cmp );
+	if ( old )
+		gc_remove( old );
+	while ( gc_count >= slap_groupcache_max && gc_head )
+		gc_remove( gc_head );
+
+	avl_insert( &gc_tree, gce, gc_cmp, avl_dup_error );
+	gce->gce_prev = gc_tail;
+	if ( gc_tail )
+		gc_tail->gce_next = gce;
+	else
+		gc_head = gce;
+	gc_tail = gce;
+	gc_count++;
+	ldap_pvt_thread_rdwr_wunlock( &gc_rwlock );
+}
+
+/*
+ * Build in op's temporary memory the key of a question of the given
+ * type, made of up to three parts. The caller frees key->bv_val.
+ */
+void
+slap_group_cache_key(
+	Operation	*op,
+	struct berval	*key,
+	int		type,
+	struct berval	*p1,
+	struct berval	*p2,
+	struct berval	*p3 )
+{
+	struct berval	*parts[3];
+	char		*ptr;
+	int		i;
+
+	parts[0] = p1;
+	parts[1] = p2;
+	parts[2] = p3;
+
+	key->bv_len = 1;
+	for ( i = 0; i < 3 && parts[i]; i++ )
+		key->bv_len += parts[i]->bv_len + 1;
+	key->bv_val = op->o_tmpalloc( key->bv_len + 1, op->o_tmpmemctx );
+
+	ptr = key->bv_val;
+	*ptr++ = type;
+	for ( i = 0; i < 3 && parts[i]; i++ ) {
+		AC_MEMCPY( ptr, parts[i]->bv_val, parts[i]->bv_len );
+		ptr += parts[i]->bv_len;
+		*ptr++ = '\0';
+	}
+	*ptr = '\0';
+}
+
+/* Drop everything read from entry ndn, or from anywhere below it */
+static void
+gc_invalidate( struct berval *ndn, int subtree )
+{
+	group_cache_entry	tmp, *gce, *next;
+
+	/* nothing to drop, and nothing in flight */
+	if ( !gc_count && !slap_groupcache_ttl )
+		return;
+
+	tmp.gce_ndn = *ndn;
+
+	ldap_pvt_thread_rdwr_wlock( &gc_rwlock );
+	if ( subtree ) {
+		/* no telling which entries below were read in flight */
+		gc_gen += GC_RECENT;
+		for ( gce = gc_head; gce; gce = next ) {
+			next = gce->gce_next;
+			if ( dnIsSuffix( &gce->gce_ndn, ndn ) )
+				gc_remove( gce );
+		}
+	} else {
+		gc_gen++;
+		gc_recent[gc_gen % GC_RECENT] = gc_hash( ndn );
+		while (( gce = avl_find( gc_tree, &tmp, gc_ndn_cmp )) != NULL )
+			gc_remove( gce );
+	}
+	ldap_pvt_thread_rdwr_wunlock( &gc_rwlock );
+}
+
+/* Drop everything read from entry ndn */
+void
+slap_group_cache_invalidate( struct berval *ndn )
+{
+	gc_invalidate( ndn, 0 );
+}
+
+/*
+ * Writes made in a transaction shared by several operations, such as
+ * an LDAP transaction or a batched syncrepl refresh, have their result
+ * sent before the transaction commits. Until it does, other operations
+ * still read the old entries and may cache answers from them again.
+ * The DNs written are kept in a batch attached to the operation, and
+ * invalidated once more after the commit.
+ */
+typedef struct group_cache_batch {
+	OpExtra		gcb_oe;
+	BerVarray	gcb_ndns;
+	BerVarray	gcb_subtrees;
+} group_cache_batch;
+
+static int gc_batch_key;
+
+static group_cache_batch *
+gc_batch_find( Operation *op )
+{
+	OpExtra		*oex;
+
+	LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+		if ( oex->oe_key == &gc_batch_key )
+			return (group_cache_batch *)oex;
+	}
+	return NULL;
+}
+
+static void
+gc_written( group_cache_batch *gcb, struct berval *ndn, int subtree )
+{
+	gc_invalidate( ndn, subtree );
+	if ( gcb )
+		ber_bvarray_add( subtree ? &gcb->gcb_subtrees : &gcb->gcb_ndns,
+			ber_dupbv( NULL, ndn ) );
+}
+
+/* Start recording the DNs written by op until slap_group_cache_commit() */
+void
+slap_group_cache_batch( Operation *op )
+{
+	group_cache_batch	*gcb;
+
+	gcb = ch_calloc( 1, sizeof( group_cache_batch ) );
+	gcb->gcb_oe.oe_key = &gc_batch_key;
+	LDAP_SLIST_INSERT_HEAD( &op->o_extra, &gcb->gcb_oe, oe_next );
+}
+
+/* The writes recorded for op are settled, committed or not */
+void
+slap_group_cache_commit( Operation *op, int commit )
+{
+	group_cache_batch	*gcb = gc_batch_find( op );
+	int			i;
+
+	if ( !gcb )
+		return;
+	LDAP_SLIST_REMOVE( &op->o_extra, &gcb->gcb_oe, OpExtra, oe_next );
+
+	if ( commit ) {
+		for ( i = 0; gcb->gcb_subtrees && !BER_BVISNULL( &gcb->gcb_subtrees[i] ); i++ )
+			gc_invalidate( &gcb->gcb_subtrees[i], 1 );
+		for ( i = 0; gcb->gcb_ndns && !BER_BVISNULL( &gcb->gcb_ndns[i] ); i++ )
+			gc_invalidate( &gcb->gcb_ndns[i], 0 );
+	}
+	ber_bvarray_free( gcb->gcb_subtrees );
+	ber_bvarray_free( gcb->gcb_ndns );
+	ch_free( gcb );
+}
+
+/* Drop everything op's write may have changed, noting it in the
+ * batch op belongs to if asked to
+ */
+static void
+gc_op_written( Operation *op, int batched )
+{
+	group_cache_batch	*gcb = NULL;
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_ADD:
+	case LDAP_REQ_DELETE:
+	case LDAP_REQ_MODIFY:
+	case LDAP_REQ_MODRDN:
+		break;
+	default:
+		return;
+	}
+	if ( batched )
+		gcb = gc_batch_find( op );
+
+	if ( op->o_tag == LDAP_REQ_MODRDN ) {
+		/* the entry may have children, all of them renamed;
+		 * answers about the new DNs said they didn't exist */
+		if ( !BER_BVISNULL( &op->orr_nnewrdn ) ) {
+			struct berval	pdn, nndn;
+
+			if ( op->orr_nnewSup )
+				pdn = *op->orr_nnewSup;
+			else
+				dnParent( &op->o_req_ndn, &pdn );
+			build_new_dn( &nndn, &pdn, &op->orr_nnewrdn, op->o_tmpmemctx );
+			gc_written( gcb, &nndn, 1 );
+			op->o_tmpfree( nndn.bv_val, op->o_tmpmemctx );
+		}
+		gc_written( gcb, &op->o_req_ndn, 1 );
+	} else {
+		gc_written( gcb, &op->o_req_ndn, 0 );
+	}
+}
+
+/*
+ * Drop everything op's successful write may have changed, for callers
+ * that settle a shared transaction themselves. op's extras may refer
+ * to the finished transaction and are left alone.
+ */
+void
+slap_group_cache_written( Operation *op )
+{
+	gc_op_written( op, 0 );
+}
+
+/*
+ * Called with the result of every operation, abandoned or not: a write
+ * that was abandoned after the backend committed it still changed the
+ * entry.
+ */
+void
+slap_group_cache_result( Operation *op, SlapReply *rs )
+{
+	if ( rs->sr_err == LDAP_SUCCESS )
+		gc_op_written( op, 1 );
+}
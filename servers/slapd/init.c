@@ -61,6 +61,8 @@ BerVarray default_referral = NULL;
 ldap_pvt_thread_pool_t	connection_pool;
 int		connection_pool_max = SLAP_MAX_WORKER_THREADS;
 int		connection_pool_queues = 1;
+int		connection_pool_steal = 0;
+int		connection_pool_weights[LDAP_PVT_THREAD_POOL_NPRIO];
 int		slap_tool_thread_max = 1;
 
 slap_counters_t			slap_counters, *slap_counters_list;
@@ -146,6 +148,12 @@ slap_init( int mode, const char *name )
 
 		slap_passwd_init();
 
+		slap_group_cache_init();
+
+		dn_cache_init();
+
+		slap_bind_limit_init();
+
 		rc = slap_sasl_init();
 
 		if( rc == 0 ) {
@@ -265,6 +273,10 @@ int slap_destroy(void)
 	case SLAP_SERVER_MODE:
 	case SLAP_TOOL_MODE:
 		slap_counters_destroy( &slap_counters );
+		slap_group_cache_destroy();
+		dn_cache_destroy();
+		slap_passwd_destroy();
+		slap_bind_limit_destroy();
 		break;
 
 	default:
@@ -277,6 +289,7 @@ int slap_destroy(void)
 	}
 
 	slap_op_destroy();
+	slap_iobuf_destroy();
 
 	ldap_pvt_thread_destroy();
 
@@ -62,26 +62,31 @@ limits2str( unsigned i )
 }
 #endif /* LDAP_DEBUG */
 
+/* number of limits clauses with a priority class */
+static int limits_nprio;
+
+static const char *const prio_names[] = {
+	NULL, "high", "normal", "low"
+};
+
+/* Find the limits of op->o_bd that apply to identity ndns[0] and
+ * target ndns[1]; clauses about the target are skipped if there is
+ * none (ndns[1] == NULL)
+ */
 static int
-limits_get( 
+limits_find(
 	Operation		*op,
+	struct berval		*ndns[2],
 	struct slap_limits_set 	**limit
 )
 {
 	static struct berval empty_dn = BER_BVC( "" );
 	struct slap_limits **lm;
-	struct berval		*ndns[2];
-
-	assert( op != NULL );
-	assert( limit != NULL );
-
-	ndns[0] = &op->o_ndn;
-	ndns[1] = &op->o_req_ndn;
 
 	Debug( LDAP_DEBUG_TRACE, "==> limits_get: %s self=\"%s\" this=\"%s\"\n",
 			op->o_log_prefix,
 			BER_BVISNULL( ndns[0] ) ? "[anonymous]" : ndns[0]->bv_val,
-			BER_BVISNULL( ndns[1] ) ? "" : ndns[1]->bv_val );
+			ndns[1] == NULL || BER_BVISNULL( ndns[1] ) ? "" : ndns[1]->bv_val );
 	/*
 	 * default values
 	 */
@@ -97,6 +102,9 @@ limits_get(
 		unsigned	isthis = type == SLAP_LIMITS_TYPE_THIS;
 		struct berval *ndn = ndns[isthis];
 
+		if ( ndn == NULL )
+			continue;
+
 		if ( style == SLAP_LIMITS_ANY )
 			goto found_any;
 
@@ -205,6 +213,47 @@ limits_get(
 	return( 0 );
 }
 
+static int
+limits_get( 
+	Operation		*op,
+	struct slap_limits_set 	**limit
+)
+{
+	struct berval		*ndns[2];
+
+	assert( op != NULL );
+	assert( limit != NULL );
+
+	ndns[0] = &op->o_ndn;
+	ndns[1] = &op->o_req_ndn;
+
+	return limits_find( op, ndns, limit );
+}
+
+/* Priority class that the limits of op->o_bd give to identity ndn.
+ * Only clauses about the identity are considered, the class is
+ * used for the connection's subsequent requests.
+ */
+int
+limits_get_prio(
+	Operation		*op,
+	struct berval		*ndn
+)
+{
+	struct slap_limits_set	*limit;
+	struct berval		*ndns[2];
+
+	if ( !limits_nprio || op->o_bd == NULL || op->o_bd->be_limits == NULL )
+		return SLAP_PRIO_DEFAULT;
+
+	ndns[0] = ndn;
+	ndns[1] = NULL;
+	if ( limits_find( op, ndns, &limit ) != 0 )
+		return SLAP_PRIO_DEFAULT;
+
+	return limit->lms_prio;
+}
+
 static int
 limits_add(
 	Backend 	        *be,
@@ -301,6 +350,9 @@ limits_add(
 			sizeof( struct slap_limits * ) * ( i + 2 ) );
 	be->be_limits[i] = lm;
 	be->be_limits[i+1] = NULL;
+
+	if ( lm->lm_limits.lms_prio != SLAP_PRIO_DEFAULT )
+		limits_nprio++;
 	
 	return( 0 );
 }
@@ -366,6 +418,8 @@ limits_parse(
 	 * "time" [ "." { "soft" | "hard" } ] "=" <integer>
 	 *
 	 * "size" [ "." { "soft" | "hard" | "unchecked" } ] "=" <integer>
+	 *
+	 * "prio" "=" { "high" | "normal" | "low" }
 	 */
 	
 	pattern = argv[1];
@@ -634,7 +688,19 @@ limits_parse_one(
 	assert( arg != NULL );
 	assert( limit != NULL );
 
-	if ( STRSTART( arg, "time" ) ) {
+	if ( STRSTART( arg, "prio=" ) ) {
+		int	i;
+
+		arg += STRLENOF( "prio=" );
+		for ( i = SLAP_PRIO_HIGH; i <= SLAP_PRIO_LOW; i++ ) {
+			if ( strcasecmp( arg, prio_names[i] ) == 0 ) {
+				limit->lms_prio = i;
+				return 0;
+			}
+		}
+		return( 1 );
+
+	} else if ( STRSTART( arg, "time" ) ) {
 		arg += STRLENOF( "time" );
 
 		if ( arg[0] == '.' ) {
@@ -940,6 +1006,13 @@ limits_unparse( struct slap_limits *lim, struct berval *bv, ber_len_t buflen )
 		if ( rc == 0 )
 			bv->bv_len += btmp.bv_len;
 	}
+	if ( rc == 0 && lim->lm_limits.lms_prio != SLAP_PRIO_DEFAULT ) {
+		ptr = bv->bv_val + bv->bv_len;
+		rc = ptr_APPEND_FMT1( " prio=%s",
+			prio_names[lim->lm_limits.lms_prio] );
+		if ( rc == 0 )
+			bv->bv_len = ptr - bv->bv_val;
+	}
 	return rc;
 }
 
@@ -1328,6 +1401,11 @@ void
 limits_free_one( 
 	struct slap_limits	*lm )
 {
+	if ( lm->lm_limits.lms_prio != SLAP_PRIO_DEFAULT ) {
+		assert( limits_nprio > 0 );
+		limits_nprio--;
+	}
+
 	if ( ( lm->lm_flags & SLAP_LIMITS_MASK ) == SLAP_LIMITS_REGEX )
 		regfree( &lm->lm_regex );
 
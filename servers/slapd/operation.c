@@ -41,13 +41,26 @@ static ldap_pvt_thread_mutex_t	slap_op_mutex;
 static time_t last_time;
 static int last_incr;
 
+/* Ops freed beyond the per-thread free list, for any thread to reuse */
+static slap_retq slap_op_retq;
+#define SLAP_OP_RETQ_MAX	256
+
 void slap_op_init(void)
 {
 	ldap_pvt_thread_mutex_init( &slap_op_mutex );
+	slap_retq_init( &slap_op_retq, SLAP_OP_RETQ_MAX,
+		offsetof( Operation, o_next ));
 }
 
 void slap_op_destroy(void)
 {
+	Operation *op, *op2;
+
+	for ( op = slap_retq_take( &slap_op_retq ); op; op = op2 ) {
+		op2 = LDAP_STAILQ_NEXT( op, o_next );
+		ber_memfree_x( op, NULL );
+	}
+	slap_retq_destroy( &slap_op_retq );
 	ldap_pvt_thread_mutex_destroy( &slap_op_mutex );
 }
 
@@ -83,7 +96,7 @@ slap_op_free( Operation *op, void *ctx )
 	op->o_abandon = 1;
 
 	if ( op->o_ber != NULL ) {
-		ber_free( op->o_ber, 1 );
+		slap_iobuf_ber_free( op->o_ber );
 	}
 	if ( !BER_BVISNULL( &op->o_dn ) ) {
 		ch_free( op->o_dn.bv_val );
@@ -142,16 +155,19 @@ slap_op_free( Operation *op, void *ctx )
 		LDAP_STAILQ_NEXT( op, o_next ) = op2;
 		if ( op2 ) {
 			op->o_tincr = op2->o_tincr + 1;
-			/* No more than 10 ops on per-thread free list */
+			/* No more than 10 ops on per-thread free list,
+			 * pass the rest on to threads which run short */
 			if ( op->o_tincr > 10 ) {
 				ldap_pvt_thread_pool_setkey( ctx, (void *)slap_op_free,
 					op2, slap_op_q_destroy, NULL, NULL );
-				ber_memfree_x( op, NULL );
+				LDAP_STAILQ_NEXT( op, o_next ) = NULL;
+				if ( slap_retq_put( &slap_op_retq, op ))
+					ber_memfree_x( op, NULL );
 			}
 		} else {
 			op->o_tincr = 1;
 		}
-	} else {
+	} else if ( slap_retq_put( &slap_op_retq, op )) {
 		ber_memfree_x( op, NULL );
 	}
 }
@@ -187,6 +203,15 @@ slap_op_alloc(
 	if ( ctx ) {
 		void *otmp = NULL;
 		ldap_pvt_thread_pool_getkey( ctx, (void *)slap_op_free, &otmp, NULL );
+		if ( !otmp && ( otmp = slap_retq_take( &slap_op_retq )) != NULL ) {
+			/* Adopt the queued ops as our free list, recounting it */
+			int n = 0;
+			for ( op = otmp; op; op = LDAP_STAILQ_NEXT( op, o_next ))
+				n++;
+			for ( op = otmp; op; op = LDAP_STAILQ_NEXT( op, o_next ))
+				op->o_tincr = n--;
+			op = NULL;
+		}
 		if ( otmp ) {
 			op = otmp;
 			otmp = LDAP_STAILQ_NEXT( op, o_next );
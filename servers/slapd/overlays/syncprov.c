@@ -167,6 +167,10 @@ typedef struct syncprov_info_t {
 	time_t	si_chklast;	/* time of last checkpoint */
 	Avlnode	*si_mods;	/* entries being modified */
 	sessionlog	*si_logs;
+	int		si_slpersist;	/* keep the sessionlog across restarts */
+	int		si_slmaxage;	/* max age of sessionlog entries, in seconds */
+	BackendDB	*si_slbe;	/* database holding the persisted sessionlog */
+	void		*si_slaux;	/* its record set, if persisting */
 	ldap_pvt_thread_rdwr_t	si_csn_rwlock;
 	ldap_pvt_thread_mutex_t	si_ops_mutex;
 	ldap_pvt_thread_mutex_t	si_mods_mutex;
@@ -185,6 +189,7 @@ typedef struct opcookie {
 	short osid;	/* sid of op csn */
 	short rsid;	/* sid of relay */
 	short sreference;	/* Is the entry a reference? */
+	short slogged;	/* persisted log record already written */
 	syncres ssres;
 } opcookie;
 
@@ -1627,6 +1632,95 @@ syncprov_checkpoint( Operation *op, slap_overinst *on )
 #endif
 }
 
+/* Move the mincsn of the log past an expired entry */
+static void
+syncprov_slog_setmin( const char *prefix, sessionlog *sl, slog_entry *se )
+{
+	int i;
+
+	for ( i=0; i<sl->sl_numcsns; i++ )
+		if ( sl->sl_sids[i] >= se->se_sid )
+			break;
+	if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
+			"adding csn=%s to mincsn\n",
+			prefix, se->se_csn.bv_val );
+		slap_insert_csn_sids( (struct sync_cookie *)sl,
+			i, se->se_sid, &se->se_csn );
+	} else {
+		Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
+			"updating mincsn for sid=%d csn=%s to %s\n",
+			prefix, se->se_sid, sl->sl_mincsn[i].bv_val, se->se_csn.bv_val );
+		ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
+	}
+}
+
+/* Drop the oldest entry of the sessionlog, moving mincsn past it.
+ * Returns the next oldest entry.
+ */
+static TAvlnode *
+syncprov_slog_drop( const char *prefix, sessionlog *sl, TAvlnode *edge,
+	const char *why )
+{
+	TAvlnode *next = tavl_next( edge, TAVL_DIR_RIGHT );
+	slog_entry *se = edge->avl_data;
+
+	Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
+		"expiring csn=%s from sessionlog (%s, sessionlog size=%d)\n",
+		prefix, se->se_csn.bv_val, why, sl->sl_num );
+	syncprov_slog_setmin( prefix, sl, se );
+	tavl_delete( &sl->sl_entries, se, syncprov_sessionlog_cmp );
+	ch_free( se );
+	sl->sl_num--;
+	return next;
+}
+
+/* CSNs start with a GeneralizedTime without the trailing Z. Get the
+ * one for the configured max age, buf must be LDAP_LUTIL_GENTIME_BUFSIZE.
+ */
+static void
+syncprov_slog_cutoff( syncprov_info_t *si, char *buf, struct berval *cutoff )
+{
+	time_t t = slap_get_time() - si->si_slmaxage;
+
+	cutoff->bv_val = buf;
+	cutoff->bv_len = LDAP_LUTIL_GENTIME_BUFSIZE;
+	slap_timestamp( &t, cutoff );
+	cutoff->bv_len--;
+}
+
+static int
+syncprov_slog_expired( struct berval *csn, struct berval *cutoff )
+{
+	return csn->bv_len >= cutoff->bv_len &&
+		memcmp( csn->bv_val, cutoff->bv_val, cutoff->bv_len ) < 0;
+}
+
+/* Expire entries beyond the configured size, and those older than
+ * the configured max age. Must be called with the log write-locked.
+ */
+static void
+syncprov_slog_trim( const char *prefix, syncprov_info_t *si, sessionlog *sl )
+{
+	TAvlnode *edge = tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
+
+	while ( edge && sl->sl_num > sl->sl_size )
+		edge = syncprov_slog_drop( prefix, sl, edge, "size" );
+
+	if ( edge && si->si_slmaxage ) {
+		char timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+		struct berval cutoff;
+
+		syncprov_slog_cutoff( si, timebuf, &cutoff );
+		while ( edge ) {
+			slog_entry *se = edge->avl_data;
+			if ( !syncprov_slog_expired( &se->se_csn, &cutoff ))
+				break;
+			edge = syncprov_slog_drop( prefix, sl, edge, "age" );
+		}
+	}
+}
+
 static void
 syncprov_add_slog( Operation *op )
 {
@@ -1696,40 +1790,268 @@ syncprov_add_slog( Operation *op )
 		rc = tavl_insert( &sl->sl_entries, se, syncprov_sessionlog_cmp, avl_dup_error );
 		assert( rc == LDAP_SUCCESS );
 		sl->sl_num++;
-		if ( !sl->sl_playing && sl->sl_num > sl->sl_size ) {
-			TAvlnode *edge = tavl_end( sl->sl_entries, TAVL_DIR_LEFT );
-			while ( sl->sl_num > sl->sl_size ) {
-				int i;
-				TAvlnode *next = tavl_next( edge, TAVL_DIR_RIGHT );
-				se = edge->avl_data;
-				Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
-					"expiring csn=%s from sessionlog (sessionlog size=%d)\n",
-					op->o_log_prefix, se->se_csn.bv_val, sl->sl_num );
-				for ( i=0; i<sl->sl_numcsns; i++ )
-					if ( sl->sl_sids[i] >= se->se_sid )
-						break;
-				if  ( i == sl->sl_numcsns || sl->sl_sids[i] != se->se_sid ) {
-					Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
-						"adding csn=%s to mincsn\n",
-						op->o_log_prefix, se->se_csn.bv_val );
-					slap_insert_csn_sids( (struct sync_cookie *)sl,
-						i, se->se_sid, &se->se_csn );
-				} else {
-					Debug( LDAP_DEBUG_SYNC, "%s syncprov_add_slog: "
-						"updating mincsn for sid=%d csn=%s to %s\n",
-						op->o_log_prefix, se->se_sid, sl->sl_mincsn[i].bv_val, se->se_csn.bv_val );
-					ber_bvreplace( &sl->sl_mincsn[i], &se->se_csn );
-				}
-				tavl_delete( &sl->sl_entries, se, syncprov_sessionlog_cmp );
-				ch_free( se );
-				edge = next;
-				sl->sl_num--;
-			}
+		if ( !sl->sl_playing ) {
+			syncprov_slog_trim( op->o_log_prefix, si, sl );
 		}
 		ldap_pvt_thread_rdwr_wunlock( &sl->sl_mutex );
 	}
 }
 
+/* Persisted sessionlog. Each logged change is written in the txn of
+ * the change itself, with its CSN, UUID and op tag as the key, so the
+ * sub-database is kept in CSN order, and the CSN length as the data.
+ * Adds are not recorded, they are never replayed. The "#mincsn" record
+ * sorts before any CSN and holds the CSNs below which the log is
+ * incomplete. Records older than syncprov-sessionlog-maxage expire as
+ * new ones are written, whatever the size of the in-memory log; the
+ * consumers whose state predates the in-memory log are served from here.
+ */
+#define SLOG_DBNAME	"syncprov_slog"
+#define SLOG_KEYSIZE	( LDAP_PVT_CSNSTR_BUFSIZE + UUID_LEN + 1 )
+#define SLOG_EXPIRE_MAX	64	/* most records expired by one write */
+
+static struct berval slog_mincsn_key = BER_BVC("#mincsn");
+
+typedef struct slog_walk {
+	sessionlog	*sw_log;	/* mincsn, and entries if loading */
+	syncprov_info_t	*sw_si;
+	struct berval	sw_cutoff;
+	int		sw_meta;	/* found the mincsn */
+	int		sw_num;
+} slog_walk;
+
+/* A decoded record, with room for its CSN and UUID */
+typedef struct slog_rec {
+	slog_entry	sr_se;
+	char		sr_buf[ SLOG_KEYSIZE + 1 ];
+} slog_rec;
+
+/* CSN sets are stored as one space-separated string */
+static void
+syncprov_slog_csns2bv( BerVarray csns, int num, struct berval *bv )
+{
+	char *ptr;
+	int i;
+
+	bv->bv_len = 0;
+	for ( i=0; i<num; i++ )
+		bv->bv_len += csns[i].bv_len + 1;
+	bv->bv_val = ch_malloc( bv->bv_len + 1 );
+	ptr = bv->bv_val;
+	for ( i=0; i<num; i++ ) {
+		if ( i )
+			*ptr++ = ' ';
+		ptr = lutil_strncopy( ptr, csns[i].bv_val, csns[i].bv_len );
+	}
+	*ptr = '\0';
+	bv->bv_len = ptr - bv->bv_val;
+}
+
+static void
+syncprov_slog_bv2min( struct berval *bv, sessionlog *sl )
+{
+	struct berval csn;
+	char *ptr = bv->bv_val, *end = bv->bv_val + bv->bv_len;
+
+	while ( ptr < end ) {
+		csn.bv_val = ptr;
+		while ( ptr < end && *ptr != ' ' )
+			ptr++;
+		csn.bv_len = ptr - csn.bv_val;
+		if ( csn.bv_len ) {
+			value_add_one( &sl->sl_mincsn, &csn );
+			sl->sl_numcsns++;
+		}
+		ptr++;
+	}
+	if ( sl->sl_numcsns ) {
+		sl->sl_sids = slap_parse_csn_sids( sl->sl_mincsn, sl->sl_numcsns, NULL );
+		slap_sort_csn_sids( sl->sl_mincsn, sl->sl_sids, sl->sl_numcsns, NULL );
+	}
+}
+
+static void
+syncprov_slog_free( sessionlog *sl )
+{
+	if ( sl->sl_entries )
+		tavl_free( sl->sl_entries, (AVL_FREE)ch_free );
+	if ( sl->sl_mincsn )
+		ber_bvarray_free( sl->sl_mincsn );
+	if ( sl->sl_sids )
+		ch_free( sl->sl_sids );
+}
+
+/* Decode a record into se, which must be followed by room for
+ * key->bv_len + 1 bytes. Fails on the meta records.
+ */
+static int
+syncprov_slog_decode( struct berval *key, struct berval *data,
+	slog_entry *se )
+{
+	ber_len_t csnlen, uuidlen;
+
+	if ( !key->bv_len || key->bv_val[0] == '#' ||
+		key->bv_len > SLOG_KEYSIZE || data->bv_len != 1 )
+		return -1;
+	csnlen = (unsigned char)data->bv_val[0];
+	if ( !csnlen || key->bv_len < csnlen + 1 )
+		return -1;
+	uuidlen = key->bv_len - csnlen - 1;
+
+	se->se_tag = (unsigned char)key->bv_val[key->bv_len - 1];
+	se->se_csn.bv_val = (char *)(&se[1]);
+	AC_MEMCPY( se->se_csn.bv_val, key->bv_val, csnlen );
+	se->se_csn.bv_val[csnlen] = '\0';
+	se->se_csn.bv_len = csnlen;
+	se->se_uuid.bv_val = se->se_csn.bv_val + csnlen + 1;
+	AC_MEMCPY( se->se_uuid.bv_val, key->bv_val + csnlen, uuidlen );
+	se->se_uuid.bv_len = uuidlen;
+	se->se_sid = slap_parse_csn_sid( &se->se_csn );
+	return 0;
+}
+
+/* Read the mincsn, the meta records come first */
+static int
+syncprov_slog_meta_cb( void *arg, struct berval *key, struct berval *data )
+{
+	slog_walk *sw = arg;
+
+	if ( !key->bv_len || key->bv_val[0] != '#' )
+		return SLAP_AUX_STOP;
+	if ( ber_bvcmp( key, &slog_mincsn_key ) == 0 && !sw->sw_meta ) {
+		syncprov_slog_bv2min( data, sw->sw_log );
+		sw->sw_meta = 1;
+	}
+	return 0;
+}
+
+/* Drop all records, see syncprov_add_slog */
+static int
+syncprov_slog_wipe_cb( void *arg, struct berval *key, struct berval *data )
+{
+	if ( key->bv_len && key->bv_val[0] == '#' )
+		return 0;
+	return SLAP_AUX_DELETE;
+}
+
+/* Expire the oldest records, moving mincsn past them */
+static int
+syncprov_slog_expire_cb( void *arg, struct berval *key, struct berval *data )
+{
+	slog_walk *sw = arg;
+	slog_rec sr;
+
+	if ( key->bv_len && key->bv_val[0] == '#' )
+		return syncprov_slog_meta_cb( arg, key, data );
+
+	if ( !sw->sw_meta || sw->sw_num >= SLOG_EXPIRE_MAX ||
+		syncprov_slog_decode( key, data, &sr.sr_se ) ||
+		!syncprov_slog_expired( &sr.sr_se.se_csn, &sw->sw_cutoff ))
+		return SLAP_AUX_STOP;
+
+	syncprov_slog_setmin( "syncprov_slog_persist:", sw->sw_log, &sr.sr_se );
+	sw->sw_num++;
+	return SLAP_AUX_DELETE;
+}
+
+/* Op must not be logged, see syncprov_op_response */
+static int
+syncprov_slog_unlogged( Operation *op )
+{
+	return op->o_dont_replicate ||
+		( SLAPD_SYNC_IS_SYNCCONN( op->o_connid ) &&
+		op->o_tag == LDAP_REQ_MODIFY &&
+		op->orm_modlist &&
+		op->orm_modlist->sml_op == LDAP_MOD_REPLACE &&
+		op->orm_modlist->sml_desc == slap_schema.si_ad_contextCSN );
+}
+
+/* Write the record for a change, and expire old ones, in the write txn
+ * op holds in the database if any.
+ */
+static int
+syncprov_slog_persist( Operation *op, opcookie *opc )
+{
+	slap_overinst *on = opc->son;
+	syncprov_info_t *si = on->on_bi.bi_private;
+	BackendInfo *bi = on->on_info->oi_orig;
+	Operation *txnop = op;
+	sessionlog sl = { 0 };
+	slog_walk sw = { 0 };
+	char kbuf[ SLOG_KEYSIZE + 1 ], timebuf[ LDAP_LUTIL_GENTIME_BUFSIZE ];
+	char *ptr;
+	struct berval key, data;
+	int rc;
+
+	/* a glued database has a txn of its own */
+	if ( op->o_bd->be_private != si->si_slbe->be_private )
+		txnop = NULL;
+
+	if ( BER_BVISEMPTY( &op->o_csn )) {
+		rc = bi->bi_aux_walk( si->si_slbe, txnop, si->si_slaux, NULL,
+			syncprov_slog_wipe_cb, NULL );
+		goto done;
+	}
+
+	if ( op->o_tag != LDAP_REQ_ADD && opc->suuid.bv_len == UUID_LEN &&
+		op->o_csn.bv_len < LDAP_PVT_CSNSTR_BUFSIZE ) {
+		ptr = lutil_memcopy( kbuf, op->o_csn.bv_val, op->o_csn.bv_len );
+		ptr = lutil_memcopy( ptr, opc->suuid.bv_val, UUID_LEN );
+		*ptr++ = op->o_tag;
+		key.bv_val = kbuf;
+		key.bv_len = ptr - kbuf;
+		/* the CSN length lives right after the key */
+		*ptr = op->o_csn.bv_len;
+		data.bv_val = ptr;
+		data.bv_len = 1;
+		rc = bi->bi_aux_put( si->si_slbe, txnop, si->si_slaux, &key, &data );
+		if ( rc )
+			goto done;
+	}
+
+	sw.sw_log = &sl;
+	syncprov_slog_cutoff( si, timebuf, &sw.sw_cutoff );
+	rc = bi->bi_aux_walk( si->si_slbe, txnop, si->si_slaux, NULL,
+		syncprov_slog_expire_cb, &sw );
+	if ( rc == LDAP_SUCCESS && ( sw.sw_num || !sw.sw_meta )) {
+		/* a new log is complete from its first change on */
+		if ( !sw.sw_meta )
+			ber_dupbv( &data, &op->o_csn );
+		else
+			syncprov_slog_csns2bv( sl.sl_mincsn, sl.sl_numcsns, &data );
+		rc = bi->bi_aux_put( si->si_slbe, txnop, si->si_slaux,
+			&slog_mincsn_key, &data );
+		ch_free( data.bv_val );
+		if ( sw.sw_num )
+			Debug( LDAP_DEBUG_SYNC, "%s syncprov_slog_persist: "
+				"expired %d persisted sessionlog entries\n",
+				op->o_log_prefix, sw.sw_num );
+	}
+	syncprov_slog_free( &sl );
+
+done:
+	if ( rc )
+		Debug( LDAP_DEBUG_ANY, "%s syncprov_slog_persist: "
+			"cannot update the persisted sessionlog\n",
+			op->o_log_prefix );
+	return rc;
+}
+
+/* Write the persisted log record in the txn of the change itself */
+static int
+syncprov_op_precommit( Operation *op, slap_callback *sc )
+{
+	opcookie *opc = sc->sc_private;
+	syncprov_info_t *si = opc->son->on_bi.bi_private;
+
+	if ( op->o_bd->be_private != si->si_slbe->be_private )
+		return LDAP_SUCCESS;
+	opc->slogged = 1;
+	if ( syncprov_slog_unlogged( op ))
+		return LDAP_SUCCESS;
+	return syncprov_slog_persist( op, opc );
+}
+
 /* Just set a flag if we found the matching entry */
 static int
 playlog_cb( Operation *op, SlapReply *rs )
@@ -1948,12 +2270,9 @@ syncprov_accesslog_uuid_cb( Operation *op, SlapReply *rs )
 
 static int
 syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
-		BerVarray ctxcsn, int numcsns, int *sids,
+		sessionlog *sl, BerVarray ctxcsn, int numcsns, int *sids,
 		struct berval *mincsn, int minsid )
 {
-	slap_overinst		*on = (slap_overinst *)op->o_bd->bd_info;
-	syncprov_info_t *si = (syncprov_info_t *)on->on_bi.bi_private;
-	sessionlog *sl = si->si_logs;
 	int i, j, ndel, num, nmods, mmods, do_play = 0, rc = -1;
 	BerVarray uuids, csns;
 	struct berval uuid[2] = {}, csn[2] = {};
@@ -2177,6 +2496,61 @@ syncprov_play_sessionlog( Operation *op, SlapReply *rs, sync_control *srs,
 	return LDAP_SUCCESS;
 }
 
+static int
+syncprov_slog_load_cb( void *arg, struct berval *key, struct berval *data )
+{
+	slog_walk *sw = arg;
+	sessionlog *sl = sw->sw_log;
+	slog_entry *se;
+
+	se = ch_malloc( sizeof( slog_entry ) + key->bv_len + 1 );
+	if ( syncprov_slog_decode( key, data, se ) ||
+		tavl_insert( &sl->sl_entries, se, syncprov_sessionlog_cmp,
+			avl_dup_error )) {
+		ch_free( se );
+		return 0;
+	}
+	sl->sl_num++;
+	return 0;
+}
+
+/* Replay from the persisted sessionlog, for a consumer whose state
+ * predates the in-memory one.
+ */
+static int
+syncprov_play_slog_persist( Operation *op, SlapReply *rs, sync_control *srs,
+		BerVarray ctxcsn, int numcsns, int *sids,
+		struct berval *mincsn, int minsid )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	syncprov_info_t *si = on->on_bi.bi_private;
+	BackendInfo *bi = on->on_info->oi_orig;
+	sessionlog sl = { 0 };
+	slog_walk sw = { 0 };
+	int rc = -1;
+
+	/* Read the mincsn last, it covers any records expired meanwhile */
+	sw.sw_log = &sl;
+	if ( bi->bi_aux_walk( si->si_slbe, op, si->si_slaux, mincsn,
+			syncprov_slog_load_cb, &sw ) ||
+		bi->bi_aux_walk( si->si_slbe, op, si->si_slaux, NULL,
+			syncprov_slog_meta_cb, &sw ) ||
+		!sw.sw_meta )
+		goto done;
+
+	Debug( LDAP_DEBUG_SYNC, "%s syncprov_play_slog_persist: "
+		"read %d entries from the persisted sessionlog\n",
+		op->o_log_prefix, sl.sl_num );
+	ldap_pvt_thread_rdwr_init( &sl.sl_mutex );
+	rc = syncprov_play_sessionlog( op, rs, srs, &sl, ctxcsn, numcsns, sids,
+		mincsn, minsid );
+	ldap_pvt_thread_rdwr_destroy( &sl.sl_mutex );
+
+done:
+	syncprov_slog_free( &sl );
+	return rc;
+}
+
 static int
 syncprov_play_accesslog( Operation *op, SlapReply *rs, sync_control *srs,
 		BerVarray ctxcsn, int numcsns, int *sids,
@@ -2512,6 +2886,9 @@ added:
 		/* Add any log records */
 		if ( si->si_logs ) {
 			syncprov_add_slog( op );
+			/* in a shared txn, there was no precommit */
+			if ( si->si_slaux && !opc->slogged )
+				syncprov_slog_persist( op, opc );
 		}
 leave:		ldap_pvt_thread_mutex_unlock( &si->si_resp_mutex );
 	}
@@ -2609,6 +2986,8 @@ syncprov_op_mod( Operation *op, SlapReply *rs )
 	opc->son = on;
 	cb->sc_response = syncprov_op_response;
 	cb->sc_cleanup = syncprov_op_cleanup;
+	if ( si->si_slaux )
+		cb->sc_precommit = syncprov_op_precommit;
 	cb->sc_private = opc;
 	cb->sc_next = op->o_callback;
 	op->o_callback = cb;
@@ -3245,8 +3624,10 @@ no_change:	if ( !(op->o_sync_mode & SLAP_SYNC_PERSIST) ) {
 			}
 		} else if ( si->si_logs ) {
 			do_present = 0;
-			if ( syncprov_play_sessionlog( op, rs, srs, ctxcsn,
-					numcsns, sids, &mincsn, minsid ) ) {
+			if ( syncprov_play_sessionlog( op, rs, srs, si->si_logs,
+					ctxcsn, numcsns, sids, &mincsn, minsid ) &&
+				( !si->si_slaux || syncprov_play_slog_persist( op, rs,
+					srs, ctxcsn, numcsns, sids, &mincsn, minsid ))) {
 				do_present = SS_PRESENT;
 			}
 		}
@@ -3491,7 +3872,9 @@ enum {
 	SP_SESSL,
 	SP_NOPRES,
 	SP_USEHINT,
-	SP_LOGDB
+	SP_LOGDB,
+	SP_SLPERSIST,
+	SP_SLMAXAGE
 };
 
 static ConfigDriver sp_cf_gen;
@@ -3521,6 +3904,16 @@ static ConfigTable spcfg[] = {
 		sp_cf_gen, "( OLcfgOvAt:1.5 NAME 'olcSpSessionlogSource' "
 			"DESC 'On startup, try loading sessionlog from this subtree' "
 			"SYNTAX OMsDN SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-persist", NULL, 2, 2, 0, ARG_ON_OFF|ARG_MAGIC|SP_SLPERSIST,
+		sp_cf_gen, "( OLcfgOvAt:1.6 NAME 'olcSpSessionlogPersist' "
+			"DESC 'Keep the sessionlog across restarts' "
+			"EQUALITY booleanMatch "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "syncprov-sessionlog-maxage", "seconds", 2, 2, 0, ARG_INT|ARG_MAGIC|SP_SLMAXAGE,
+		sp_cf_gen, "( OLcfgOvAt:1.7 NAME 'olcSpSessionlogMaxAge' "
+			"DESC 'Maximum age of sessionlog entries in seconds' "
+			"EQUALITY integerMatch "
+			"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED }
 };
 
@@ -3534,6 +3927,8 @@ static ConfigOCs spocs[] = {
 			"$ olcSpNoPresent "
 			"$ olcSpReloadHint "
 			"$ olcSpSessionlogSource "
+			"$ olcSpSessionlogPersist "
+			"$ olcSpSessionlogMaxAge "
 		") )",
 			Cft_Overlay, spcfg },
 	{ NULL, 0, NULL }
@@ -3595,6 +3990,20 @@ sp_cf_gen(ConfigArgs *c)
 				value_add_one( &c->rvalue_nvals, &si->si_logbase );
 			}
 			break;
+		case SP_SLPERSIST:
+			if ( si->si_slpersist ) {
+				c->value_int = 1;
+			} else {
+				rc = 1;
+			}
+			break;
+		case SP_SLMAXAGE:
+			if ( si->si_slmaxage ) {
+				c->value_int = si->si_slmaxage;
+			} else {
+				rc = 1;
+			}
+			break;
 		}
 		return rc;
 	} else if ( c->op == LDAP_MOD_DELETE ) {
@@ -3618,6 +4027,12 @@ sp_cf_gen(ConfigArgs *c)
 				BER_BVZERO( &si->si_logbase );
 			}
 			break;
+		case SP_SLPERSIST:
+			si->si_slpersist = 0;
+			break;
+		case SP_SLMAXAGE:
+			si->si_slmaxage = 0;
+			break;
 		}
 		return rc;
 	}
@@ -3707,10 +4122,132 @@ sp_cf_gen(ConfigArgs *c)
 		rc = syncprov_setup_accesslog();
 		ch_free( c->value_dn.bv_val );
 		break;
+	case SP_SLPERSIST:
+		si->si_slpersist = c->value_int;
+		break;
+	case SP_SLMAXAGE:
+		if ( c->value_int < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ), "%s age %d is negative",
+				c->argv[0], c->value_int );
+			Debug( LDAP_DEBUG_CONFIG|LDAP_DEBUG_NONE,
+				"%s: %s\n", c->log, c->cr_msg );
+			return ARG_BAD_CONF;
+		}
+		si->si_slmaxage = c->value_int;
+		break;
 	}
 	return rc;
 }
 
+/* Find the record set for the persisted sessionlog */
+static int
+syncprov_slog_setup( BackendDB *be, slap_overinst *on, syncprov_info_t *si )
+{
+	BackendInfo *bi = on->on_info->oi_orig;
+
+	if ( !si->si_logs || !si->si_slmaxage ) {
+		Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+			"syncprov-sessionlog-persist requires syncprov-sessionlog "
+			"and syncprov-sessionlog-maxage\n" );
+		return -1;
+	}
+	if ( !bi->bi_aux_open || !bi->bi_aux_put || !bi->bi_aux_walk ) {
+		Debug( LDAP_DEBUG_ANY, "syncprov_db_open: "
+			"syncprov-sessionlog-persist is not supported by back-%s, "
+			"database %s\n",
+			bi->bi_type, be->be_suffix[0].bv_val );
+		return -1;
+	}
+	if ( bi->bi_aux_open( be, SLOG_DBNAME, &si->si_slaux ))
+		return -1;
+	/* be is a copy made by the overlay framework */
+	si->si_slbe = be->bd_self;
+	return 0;
+}
+
+static int
+syncprov_slog_clear_cb( void *arg, struct berval *key, struct berval *data )
+{
+	return SLAP_AUX_DELETE;
+}
+
+/* Move the contextCSN past a change found in the log */
+static int
+syncprov_slog_recover_cb( void *arg, struct berval *key, struct berval *data )
+{
+	slog_walk *sw = arg;
+	syncprov_info_t *si = sw->sw_si;
+	slog_rec sr;
+	slog_entry *se = &sr.sr_se;
+	int i;
+
+	if ( syncprov_slog_decode( key, data, se ))
+		return 0;
+	for ( i=0; i<si->si_numcsns; i++ ) {
+		if ( si->si_sids[i] >= se->se_sid )
+			break;
+	}
+	if ( i == si->si_numcsns || si->si_sids[i] != se->se_sid ) {
+		slap_insert_csn_sids( (struct sync_cookie *)&si->si_ctxcsn,
+			i, se->se_sid, &se->se_csn );
+	} else if ( ber_bvcmp( &se->se_csn, &si->si_ctxcsn[i] ) > 0 ) {
+		ber_bvreplace( &si->si_ctxcsn[i], &se->se_csn );
+	} else {
+		return 0;
+	}
+	sw->sw_num++;
+	return 0;
+}
+
+/* The log holds every change committed since it was started, even
+ * after a crash. Changes made after the last checkpoint were lost from
+ * the contextCSN then, and deletes can't be found in the database, so
+ * recover the contextCSN from the log. A new log is complete from the
+ * current contextCSN on.
+ */
+static void
+syncprov_slog_recover( BackendDB *be, slap_overinst *on, syncprov_info_t *si )
+{
+	BackendInfo *bi = on->on_info->oi_orig;
+	sessionlog sl = { 0 };
+	slog_walk sw = { 0 };
+	struct berval *from, bv;
+	int i;
+
+	sw.sw_log = &sl;
+	sw.sw_si = si;
+	bi->bi_aux_walk( be, NULL, si->si_slaux, NULL,
+		syncprov_slog_meta_cb, &sw );
+
+	from = &si->si_ctxcsn[0];
+	for ( i=1; i<si->si_numcsns; i++ ) {
+		if ( ber_bvcmp( &si->si_ctxcsn[i], from ) < 0 )
+			from = &si->si_ctxcsn[i];
+	}
+	ber_dupbv( &bv, from );
+	bi->bi_aux_walk( be, NULL, si->si_slaux, &bv,
+		syncprov_slog_recover_cb, &sw );
+	ch_free( bv.bv_val );
+	if ( sw.sw_num ) {
+		Debug( LDAP_DEBUG_SYNC, "syncprov_db_open: "
+			"recovered contextCSN from %d persisted sessionlog entries "
+			"for suffix %s\n",
+			sw.sw_num, be->be_suffix[0].bv_val );
+		/* make sure we do a checkpoint on close */
+		si->si_numops++;
+	}
+
+	if ( !sw.sw_meta ) {
+		syncprov_slog_csns2bv( si->si_ctxcsn, si->si_numcsns, &bv );
+		bi->bi_aux_put( be, NULL, si->si_slaux, &slog_mincsn_key, &bv );
+		ch_free( bv.bv_val );
+		Debug( LDAP_DEBUG_SYNC, "syncprov_db_open: "
+			"starting a new persisted sessionlog for suffix %s\n",
+			be->be_suffix[0].bv_val );
+	}
+	syncprov_slog_free( &sl );
+}
+
 /* ITS#3456 we cannot run this search on the main thread, must use a
  * child thread in order to insure we have a big enough stack.
  */
@@ -3794,6 +4331,15 @@ syncprov_db_open(
 		return -1;
 	}
 
+	if ( si->si_slpersist && !( slapMode & SLAP_TOOL_READONLY )) {
+		if ( syncprov_slog_setup( be, on, si ))
+			return -1;
+		/* offline changes aren't logged, start a new log */
+		if ( slapMode & SLAP_TOOL_MODE )
+			on->on_info->oi_orig->bi_aux_walk( be, NULL, si->si_slaux,
+				NULL, syncprov_slog_clear_cb, NULL );
+	}
+
 	if ( slapMode & SLAP_TOOL_MODE ) {
 		return 0;
 	}
@@ -3887,6 +4433,9 @@ syncprov_db_open(
 		si->si_numops++;
 	}
 
+	if ( si->si_slaux && si->si_numcsns )
+		syncprov_slog_recover( be, on, si );
+
 	/* Initialize the sessionlog mincsn */
 	if ( si->si_logs && si->si_numcsns ) {
 		sessionlog *sl = si->si_logs;
@@ -3944,6 +4493,8 @@ syncprov_db_close(
 		op->o_ndn = be->be_rootndn;
 		syncprov_checkpoint( op, on );
 	}
+	/* the handle is gone with the database */
+	si->si_slaux = NULL;
 
 #ifdef SLAP_CONFIG_DELETE
 	if ( !slapd_shutdown ) {
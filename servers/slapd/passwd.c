@@ -488,6 +488,146 @@ struct berval * slap_passwd_return(
 	return bv;
 }
 
+/*
+ * Pooled clients keep binding with the same password, and checking it
+ * against a salted hash or a KDF is deliberately expensive. Successful
+ * checks are remembered for slap_pwcache_ttl seconds, in a direct-mapped
+ * table holding a salted digest of the entry DN, the stored value and
+ * the supplied credentials; the credentials themselves are never kept.
+ * A changed password has a different stored value, so it never matches
+ * what was remembered for the old one. Only values hashed with a known
+ * local scheme are remembered, see pw_cache_schemes.
+ */
+typedef struct pw_cache_entry {
+	unsigned char	pce_digest[LUTIL_SHA1_BYTES];
+	time_t		pce_expire;
+} pw_cache_entry;
+
+#define	PW_CACHE_LOCKS	16
+
+unsigned slap_pwcache_ttl;
+unsigned slap_pwcache_size;
+
+static pw_cache_entry		*pw_cache;
+static ldap_pvt_thread_mutex_t	pw_cache_mutex[PW_CACHE_LOCKS];
+static unsigned char		pw_cache_salt[16];
+
+/* Local hash schemes, whose outcome depends on nothing but the stored
+ * value and the credentials. Others may be checked by an external
+ * service, or accept a credential only once or only for a while.
+ */
+static struct berval pw_cache_schemes[] = {
+	BER_BVC("{SSHA}"),
+	BER_BVC("{SHA}"),
+	BER_BVC("{SMD5}"),
+	BER_BVC("{MD5}"),
+	BER_BVC("{CRYPT}"),
+	BER_BVC("{SSHA256}"),
+	BER_BVC("{SSHA384}"),
+	BER_BVC("{SSHA512}"),
+	BER_BVC("{SHA256}"),
+	BER_BVC("{SHA384}"),
+	BER_BVC("{SHA512}"),
+	BER_BVC("{PBKDF2}"),
+	BER_BVC("{PBKDF2-SHA1}"),
+	BER_BVC("{PBKDF2-SHA256}"),
+	BER_BVC("{PBKDF2-SHA512}"),
+	BER_BVC("{ARGON2}"),
+	BER_BVNULL
+};
+
+static int
+pw_cache_cacheable( struct berval *val )
+{
+	char	*end;
+	int	i;
+
+	/* cleartext is cheap to check */
+	if ( val->bv_len == 0 || val->bv_val[0] != '{' )
+		return 0;
+
+	end = memchr( val->bv_val, '}', val->bv_len );
+	if ( end == NULL )
+		return 0;
+
+	for ( i = 0; !BER_BVISNULL( &pw_cache_schemes[i] ); i++ ) {
+		if ( end - val->bv_val + 1 == pw_cache_schemes[i].bv_len &&
+			!strncasecmp( val->bv_val, pw_cache_schemes[i].bv_val,
+				pw_cache_schemes[i].bv_len ))
+			return 1;
+	}
+	return 0;
+}
+
+static void
+pw_cache_update( lutil_SHA1_CTX *ctx, struct berval *bv )
+{
+	ber_len_t len = bv ? bv->bv_len : 0;
+
+	lutil_SHA1Update( ctx, (const unsigned char *)&len, sizeof( len ));
+	if ( len )
+		lutil_SHA1Update( ctx, (const unsigned char *)bv->bv_val, len );
+}
+
+static unsigned
+pw_cache_digest(
+	Entry		*e,
+	struct berval	*val,
+	struct berval	*cred,
+	unsigned char	*digest )
+{
+	lutil_SHA1_CTX	ctx;
+	unsigned	slot;
+
+	lutil_SHA1Init( &ctx );
+	lutil_SHA1Update( &ctx, pw_cache_salt, sizeof( pw_cache_salt ));
+	pw_cache_update( &ctx, e ? &e->e_nname : NULL );
+	pw_cache_update( &ctx, val );
+	pw_cache_update( &ctx, cred );
+	lutil_SHA1Final( digest, &ctx );
+
+	AC_MEMCPY( &slot, digest, sizeof( slot ));
+	return slot % slap_pwcache_size;
+}
+
+static int
+pw_cache_find( unsigned slot, unsigned char *digest )
+{
+	pw_cache_entry	*pce = &pw_cache[slot];
+	int		hit;
+
+	ldap_pvt_thread_mutex_lock( &pw_cache_mutex[slot % PW_CACHE_LOCKS] );
+	hit = pce->pce_expire > slap_get_time() &&
+		!memcmp( pce->pce_digest, digest, LUTIL_SHA1_BYTES );
+	ldap_pvt_thread_mutex_unlock( &pw_cache_mutex[slot % PW_CACHE_LOCKS] );
+
+	return hit;
+}
+
+static void
+pw_cache_store( unsigned slot, unsigned char *digest )
+{
+	pw_cache_entry	*pce = &pw_cache[slot];
+
+	ldap_pvt_thread_mutex_lock( &pw_cache_mutex[slot % PW_CACHE_LOCKS] );
+	AC_MEMCPY( pce->pce_digest, digest, LUTIL_SHA1_BYTES );
+	pce->pce_expire = slap_get_time() + slap_pwcache_ttl;
+	ldap_pvt_thread_mutex_unlock( &pw_cache_mutex[slot % PW_CACHE_LOCKS] );
+}
+
+/* Only call with the server paused, or before it starts */
+void
+slap_passwd_cache_resize( unsigned size )
+{
+	ch_free( pw_cache );
+	pw_cache = NULL;
+	slap_pwcache_size = 0;
+	if ( size ) {
+		pw_cache = ch_calloc( size, sizeof( pw_cache_entry ));
+		slap_pwcache_size = size;
+	}
+}
+
 /*
  * if "e" is provided, access to each value of the password is checked first
  */
@@ -503,6 +643,9 @@ slap_passwd_check(
 	struct berval		*bv;
 	AccessControlState	acl_state = ACL_STATE_INIT;
 	char		credNul = cred->bv_val[cred->bv_len];
+	unsigned char	digest[LUTIL_SHA1_BYTES];
+	unsigned	slot = 0;
+	int		cache;
 
 #ifdef SLAPD_SPASSWD
 	void		*old_authctx = NULL;
@@ -521,7 +664,19 @@ slap_passwd_check(
 			continue;
 		}
 		
+		cache = slap_pwcache_ttl && slap_pwcache_size &&
+			pw_cache_cacheable( bv );
+		if ( cache ) {
+			slot = pw_cache_digest( e, bv, cred, digest );
+			if ( pw_cache_find( slot, digest )) {
+				result = 0;
+				break;
+			}
+		}
+
 		if ( !lutil_passwd( bv, cred, NULL, text ) ) {
+			if ( cache )
+				pw_cache_store( slot, digest );
 			result = 0;
 			break;
 		}
@@ -639,9 +794,29 @@ static int slapd_crypt( const char *key, const char *salt, char **hash )
 
 void slap_passwd_init()
 {
+	int i;
+
 #ifdef SLAPD_CRYPT
 	ldap_pvt_thread_mutex_init( &passwd_mutex );
 	lutil_cryptptr = slapd_crypt;
 #endif
+
+	for ( i = 0; i < PW_CACHE_LOCKS; i++ )
+		ldap_pvt_thread_mutex_init( &pw_cache_mutex[i] );
+	if ( lutil_entropy( pw_cache_salt, sizeof( pw_cache_salt )) < 0 ) {
+		time_t now = time( NULL );
+
+		AC_MEMCPY( pw_cache_salt, &now, sizeof( now ));
+	}
+	slap_passwd_cache_resize( SLAP_PWCACHE_SIZE );
+}
+
+void slap_passwd_destroy()
+{
+	int i;
+
+	slap_passwd_cache_resize( 0 );
+	for ( i = 0; i < PW_CACHE_LOCKS; i++ )
+		ldap_pvt_thread_mutex_destroy( &pw_cache_mutex[i] );
 }
 
@@ -99,6 +99,7 @@ LDAP_SLAPD_F (int) acl_string_expand LDAP_P((
  * aclparse.c
  */
 LDAP_SLAPD_V (LDAP_CONST char *) style_strings[];
+LDAP_SLAPD_V (unsigned long) acl_generation;
 
 LDAP_SLAPD_F (int) parse_acl LDAP_P(( Backend *be,
 	const char *fname, int lineno,
@@ -398,6 +399,9 @@ LDAP_SLAPD_F (int) backend_connection_destroy LDAP_P((Connection *conn));
 LDAP_SLAPD_F( int ) backend_check_controls LDAP_P((
 	Operation *op,
 	SlapReply *rs ));
+LDAP_SLAPD_F( void )	backend_op_prio LDAP_P((
+	Operation *op,
+	struct berval *ndn ));
 LDAP_SLAPD_F( int )	backend_check_restrictions LDAP_P((
 	Operation *op,
 	SlapReply *rs,
@@ -1023,6 +1027,12 @@ LDAP_SLAPD_F (int) dnPrettyNormalDN LDAP_P(( Syntax *syntax, struct berval *val,
 typedef int (SLAP_CERT_MAP_FN) LDAP_P(( void *ssl, struct berval *dn ));
 LDAP_SLAPD_F (int) register_certificate_map_function LDAP_P(( SLAP_CERT_MAP_FN *fn ));
 
+LDAP_SLAPD_V (unsigned) slap_dncache_size;
+LDAP_SLAPD_F (void) dn_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_flush LDAP_P(( void ));
+LDAP_SLAPD_F (void) dn_cache_resize LDAP_P(( unsigned size ));
+
 /*
  * entry.c
  */
@@ -1169,6 +1179,29 @@ LDAP_SLAPD_V( struct slap_sync_cookie_s ) slap_sync_cookie;
 LDAP_SLAPD_V( void * ) slap_tls_ctx;
 LDAP_SLAPD_V( LDAP * ) slap_tls_ld;
 
+/*
+ * groupcache.c
+ */
+LDAP_SLAPD_V (unsigned) slap_groupcache_ttl;
+LDAP_SLAPD_V (unsigned) slap_groupcache_max;
+LDAP_SLAPD_F (void) slap_group_cache_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_group_cache_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (unsigned long) slap_group_cache_gen LDAP_P(( void ));
+LDAP_SLAPD_F (int) slap_group_cache_get LDAP_P((
+	struct berval *ndn, struct berval *key, int *rc,
+	BerVarray *vals, void *memctx ));
+LDAP_SLAPD_F (void) slap_group_cache_put LDAP_P((
+	struct berval *ndn, struct berval *key, int rc,
+	BerVarray vals, unsigned long gen ));
+LDAP_SLAPD_F (void) slap_group_cache_key LDAP_P(( Operation *op,
+	struct berval *key, int type,
+	struct berval *p1, struct berval *p2, struct berval *p3 ));
+LDAP_SLAPD_F (void) slap_group_cache_invalidate LDAP_P(( struct berval *ndn ));
+LDAP_SLAPD_F (void) slap_group_cache_batch LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_group_cache_commit LDAP_P(( Operation *op, int commit ));
+LDAP_SLAPD_F (void) slap_group_cache_written LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_group_cache_result LDAP_P(( Operation *op, SlapReply *rs ));
+
 /*
  * index.c
  */
@@ -1224,6 +1257,8 @@ LDAP_SLAPD_F (int) limits_parse_one LDAP_P(( const char *arg,
 	struct slap_limits_set *limit ));
 LDAP_SLAPD_F (int) limits_check LDAP_P((
 	Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (int) limits_get_prio LDAP_P((
+	Operation *op, struct berval *ndn ));
 LDAP_SLAPD_F (int) limits_unparse_one LDAP_P(( 
 	struct slap_limits_set *limit, int which, struct berval *bv, ber_len_t buflen ));
 LDAP_SLAPD_F (int) limits_unparse LDAP_P(( 
@@ -1550,7 +1585,12 @@ LDAP_SLAPD_F (int) slap_passwd_parse(
 	struct berval		*newpass,
 	const char		**text );
 
+LDAP_SLAPD_V (unsigned) slap_pwcache_ttl;
+LDAP_SLAPD_V (unsigned) slap_pwcache_size;
+LDAP_SLAPD_F (void) slap_passwd_cache_resize (unsigned size);
+
 LDAP_SLAPD_F (void) slap_passwd_init (void);
+LDAP_SLAPD_F (void) slap_passwd_destroy (void);
 
 /*
  * phonetic.c
@@ -1628,6 +1668,11 @@ LDAP_SLAPD_F (void) slap_send_ldap_intermediate LDAP_P(( Operation *op, SlapRepl
 LDAP_SLAPD_F (void) slap_send_search_result LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_reference LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_entry LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (void) slap_stream_begin LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_stream_flush LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_stream_check LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) slap_stream_end LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (int) slap_precommit_play LDAP_P(( Operation *op ));
 LDAP_SLAPD_F (int) slap_null_cb LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_freeself_cb LDAP_P(( Operation *op, SlapReply *rs ));
 
@@ -1882,6 +1927,18 @@ LDAP_SLAPD_F (void *) slap_sl_mem_create LDAP_P((
 LDAP_SLAPD_F (void) slap_sl_mem_setctx LDAP_P(( void *ctx, void *memctx ));
 LDAP_SLAPD_F (void) slap_sl_mem_destroy LDAP_P(( void *key, void *data ));
 LDAP_SLAPD_F (void *) slap_sl_context LDAP_P(( void *ptr ));
+LDAP_SLAPD_F (int) slap_sl_mem_stats LDAP_P((
+						SLAP_SL_STATS_FN *func, void *arg ));
+LDAP_SLAPD_V (unsigned) slap_sl_chain_max;
+LDAP_SLAPD_F (void) slap_retq_init LDAP_P((
+						slap_retq *rq, int max, size_t linkoff ));
+LDAP_SLAPD_F (void) slap_retq_destroy LDAP_P(( slap_retq *rq ));
+LDAP_SLAPD_F (int) slap_retq_put LDAP_P(( slap_retq *rq, void *item ));
+LDAP_SLAPD_F (void *) slap_retq_take LDAP_P(( slap_retq *rq ));
+LDAP_SLAPD_F (BerElement *) slap_iobuf_ber_alloc LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_iobuf_ber_detach LDAP_P(( BerElement *ber ));
+LDAP_SLAPD_F (void) slap_iobuf_ber_free LDAP_P(( BerElement *ber ));
+LDAP_SLAPD_F (void) slap_iobuf_destroy LDAP_P(( void ));
 
 /*
  * starttls.c
@@ -2099,6 +2156,8 @@ LDAP_SLAPD_V (time_t)		starttime;
 LDAP_SLAPD_V (ldap_pvt_thread_pool_t)	connection_pool;
 LDAP_SLAPD_V (int)			connection_pool_max;
 LDAP_SLAPD_V (int)			connection_pool_queues;
+LDAP_SLAPD_V (int)			connection_pool_steal;
+LDAP_SLAPD_V (int)			connection_pool_weights[LDAP_PVT_THREAD_POOL_NPRIO];
 LDAP_SLAPD_V (int)			slap_tool_thread_max;
 
 LDAP_SLAPD_V (ldap_pvt_thread_mutex_t)	entry2str_mutex;
@@ -2132,6 +2191,10 @@ LDAP_SLAPD_F (int) fe_op_abandon LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) fe_op_add LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) fe_op_bind LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) fe_op_bind_success LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_V (unsigned) slap_bind_threads;
+LDAP_SLAPD_F (void) slap_bind_limit_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_bind_limit_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_bind_limit_set LDAP_P(( unsigned threads ));
 LDAP_SLAPD_F (int) fe_op_compare LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) fe_op_delete LDAP_P((Operation *op, SlapReply *rs));
 LDAP_SLAPD_F (int) fe_op_modify LDAP_P((Operation *op, SlapReply *rs));
@@ -331,22 +331,408 @@ slap_writewait_play(
 	}
 }
 
-static long send_ldap_ber(
+/* Called by a backend just before it commits the write txn it started
+ * for op, so that callbacks can add their own records to it. These
+ * callbacks are expected to leave the callback list unmodified. If one
+ * fails, the backend must abort the txn.
+ */
+int
+slap_precommit_play(
+	Operation *op )
+{
+	slap_callback	*sc = op->o_callback;
+	int rc;
+
+	for ( ; sc; sc = sc->sc_next ) {
+		if ( sc->sc_precommit && ( rc = sc->sc_precommit( op, sc )))
+			return rc;
+	}
+	return LDAP_SUCCESS;
+}
+
+#ifdef HAVE_SYS_UIO_H
+#define SLAP_GATHER_WRITE
+#endif
+
+#ifdef SLAP_GATHER_WRITE
+#include <sys/uio.h>
+#include <limits.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX	16
+#endif
+
+/* Values at least this large are written with writev() straight from
+ * where the backend keeps them, usually its memory-mapped database,
+ * instead of being copied into the PDU buffer first.
+ */
+#define SLAP_GATHER_MIN	1024
+
+typedef struct slap_gather_item {
+	struct berval gi_bv;	/* attribute type or value */
+	ber_len_t gi_len;	/* attribute: length of the value SET */
+	int gi_attr;
+} slap_gather_item;
+
+typedef struct slap_gather {
+	slap_gather_item *sg_items;
+	int sg_nitems;
+	int sg_attr;		/* item of the current attribute */
+	struct iovec *sg_iov;
+	int sg_iovcnt;
+	int sg_next;		/* first iovec not completely written */
+	ber_len_t sg_len;	/* length of the whole PDU */
+	char *sg_buf;		/* tags, lengths and small values */
+	char *sg_pin;		/* private copy of the unwritten data */
+} slap_gather;
+
+#define GATHER_TLV(len)	( 1 + gather_lenlen( len ) + (len) )
+
+static ber_len_t
+gather_lenlen( ber_len_t len )
+{
+	ber_len_t n = 1;
+
+	if ( len >= 0x80 ) {
+		for ( ; len; len >>= 8 )
+			n++;
+	}
+	return n;
+}
+
+static char *
+gather_tl( char *p, ber_tag_t tag, ber_len_t len )
+{
+	int i;
+
+	*p++ = (unsigned char)tag;
+	if ( len < 0x80 ) {
+		*p++ = (unsigned char)len;
+		return p;
+	}
+	i = gather_lenlen( len ) - 1;
+	*p++ = 0x80 | i;
+	while ( i-- )
+		*p++ = (unsigned char)( len >> ( i * 8 ));
+	return p;
+}
+
+/*
+ * A gathered write goes to the socket with writev(), past the Sockbuf
+ * IO stack. It is only used while the Sockbuf holds nothing but the
+ * plain TCP (or fd) provider, so that no TLS, SASL or other layer is
+ * skipped, and only when the entry has a value large enough to be
+ * worth not copying.
+ */
+static int
+slap_gather_ok( Operation *op, SlapReply *rs )
+{
+	Connection *conn = op->o_conn;
+	Attribute *a;
+	int i;
+
+	if ( op->o_res_ber || conn == NULL )
+		return 0;
+	if ( ber_sockbuf_ctrl( conn->c_sb, LBER_SB_OPT_IS_PLAIN, NULL ) != 1 )
+		return 0;
+
+	for ( a = rs->sr_entry->e_attrs; a != NULL; a = a->a_next ) {
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ ) {
+			if ( a->a_vals[i].bv_len >= SLAP_GATHER_MIN )
+				return 1;
+		}
+	}
+	return 0;
+}
+
+static void
+slap_gather_init( Operation *op, SlapReply *rs, slap_gather *sg )
+{
+	Attribute *a;
+	int i, n = 0;
+
+	for ( a = rs->sr_entry->e_attrs; a != NULL; a = a->a_next ) {
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ );
+		n += i + 1;
+	}
+	for ( a = rs->sr_operational_attrs; a != NULL; a = a->a_next ) {
+		for ( i = 0; a->a_vals[i].bv_val != NULL; i++ );
+		n += i + 1;
+	}
+
+	memset( sg, 0, sizeof( *sg ));
+	sg->sg_items = op->o_tmpalloc( n * sizeof( slap_gather_item ),
+		op->o_tmpmemctx );
+}
+
+static void
+slap_gather_free( Operation *op, slap_gather *sg )
+{
+	op->o_tmpfree( sg->sg_items, op->o_tmpmemctx );
+	if ( sg->sg_iov )
+		op->o_tmpfree( sg->sg_iov, op->o_tmpmemctx );
+	if ( sg->sg_buf )
+		op->o_tmpfree( sg->sg_buf, op->o_tmpmemctx );
+	if ( sg->sg_pin )
+		op->o_tmpfree( sg->sg_pin, op->o_tmpmemctx );
+}
+
+static void
+slap_gather_attr( slap_gather *sg, struct berval *type )
+{
+	slap_gather_item *gi = &sg->sg_items[sg->sg_nitems];
+
+	gi->gi_bv = *type;
+	gi->gi_len = 0;
+	gi->gi_attr = 1;
+	sg->sg_attr = sg->sg_nitems++;
+}
+
+static void
+slap_gather_value( slap_gather *sg, struct berval *val )
+{
+	slap_gather_item *gi = &sg->sg_items[sg->sg_nitems++];
+
+	gi->gi_bv = *val;
+	gi->gi_attr = 0;
+	sg->sg_items[sg->sg_attr].gi_len += GATHER_TLV( val->bv_len );
+}
+
+/*
+ * Lay out the SearchResultEntry PDU. The DER lengths are known up
+ * front, so everything but the large values is written once into
+ * sg_buf and the large values are referenced by their own iovecs.
+ */
+static void
+slap_gather_build(
 	Operation *op,
-	BerElement *ber )
+	struct berval *dn,
+	struct berval *ctrls,
+	slap_gather *sg )
+{
+	slap_gather_item *gi, *end = sg->sg_items + sg->sg_nitems;
+	ber_len_t attrs = 0, res, msg, big = 0, len;
+	ber_int_t msgid = op->o_msgid;
+	char *p, *seg;
+	int i, nbig = 0, idlen;
+
+	for ( gi = sg->sg_items; gi < end; gi++ ) {
+		if ( gi->gi_attr ) {
+			len = GATHER_TLV( gi->gi_bv.bv_len ) + GATHER_TLV( gi->gi_len );
+			attrs += GATHER_TLV( len );
+		} else if ( gi->gi_bv.bv_len >= SLAP_GATHER_MIN ) {
+			big += gi->gi_bv.bv_len;
+			nbig++;
+		}
+	}
+
+	for ( idlen = 1; idlen < 4 && msgid >= 1L << ( idlen * 8 - 1 ); idlen++ );
+
+	res = GATHER_TLV( dn->bv_len ) + GATHER_TLV( attrs );
+	msg = 2 + idlen + GATHER_TLV( res ) + ctrls->bv_len;
+	sg->sg_len = GATHER_TLV( msg );
+
+	sg->sg_buf = op->o_tmpalloc( sg->sg_len - big, op->o_tmpmemctx );
+	sg->sg_iov = op->o_tmpalloc( ( 2 * nbig + 1 ) * sizeof( struct iovec ),
+		op->o_tmpmemctx );
+
+	p = seg = sg->sg_buf;
+	p = gather_tl( p, LBER_SEQUENCE, msg );
+	p = gather_tl( p, LBER_INTEGER, idlen );
+	for ( i = idlen; i--; )
+		*p++ = (unsigned char)( msgid >> ( i * 8 ));
+	p = gather_tl( p, LDAP_RES_SEARCH_ENTRY, res );
+	p = gather_tl( p, LBER_OCTETSTRING, dn->bv_len );
+	AC_MEMCPY( p, dn->bv_val, dn->bv_len );
+	p += dn->bv_len;
+	p = gather_tl( p, LBER_SEQUENCE, attrs );
+
+	for ( gi = sg->sg_items; gi < end; gi++ ) {
+		if ( gi->gi_attr ) {
+			len = GATHER_TLV( gi->gi_bv.bv_len ) + GATHER_TLV( gi->gi_len );
+			p = gather_tl( p, LBER_SEQUENCE, len );
+			p = gather_tl( p, LBER_OCTETSTRING, gi->gi_bv.bv_len );
+			AC_MEMCPY( p, gi->gi_bv.bv_val, gi->gi_bv.bv_len );
+			p += gi->gi_bv.bv_len;
+			p = gather_tl( p, LBER_SET, gi->gi_len );
+			continue;
+		}
+		p = gather_tl( p, LBER_OCTETSTRING, gi->gi_bv.bv_len );
+		if ( gi->gi_bv.bv_len < SLAP_GATHER_MIN ) {
+			AC_MEMCPY( p, gi->gi_bv.bv_val, gi->gi_bv.bv_len );
+			p += gi->gi_bv.bv_len;
+			continue;
+		}
+		sg->sg_iov[sg->sg_iovcnt].iov_base = seg;
+		sg->sg_iov[sg->sg_iovcnt++].iov_len = p - seg;
+		sg->sg_iov[sg->sg_iovcnt].iov_base = gi->gi_bv.bv_val;
+		sg->sg_iov[sg->sg_iovcnt++].iov_len = gi->gi_bv.bv_len;
+		seg = p;
+	}
+
+	AC_MEMCPY( p, ctrls->bv_val, ctrls->bv_len );
+	p += ctrls->bv_len;
+	if ( p > seg ) {
+		sg->sg_iov[sg->sg_iovcnt].iov_base = seg;
+		sg->sg_iov[sg->sg_iovcnt++].iov_len = p - seg;
+	}
+	assert( p - sg->sg_buf == sg->sg_len - big );
+}
+
+/*
+ * The values may live in a read transaction the backend releases
+ * while we wait for the socket, so copy whatever is left to write.
+ */
+static void
+slap_gather_pin( Operation *op, slap_gather *sg )
+{
+	ber_len_t len = 0;
+	char *p;
+	int i;
+
+	if ( sg->sg_pin )
+		return;
+
+	for ( i = sg->sg_next; i < sg->sg_iovcnt; i++ )
+		len += sg->sg_iov[i].iov_len;
+	p = sg->sg_pin = op->o_tmpalloc( len, op->o_tmpmemctx );
+	for ( i = sg->sg_next; i < sg->sg_iovcnt; i++ ) {
+		AC_MEMCPY( p, sg->sg_iov[i].iov_base, sg->sg_iov[i].iov_len );
+		p += sg->sg_iov[i].iov_len;
+	}
+	sg->sg_iov[sg->sg_next].iov_base = sg->sg_pin;
+	sg->sg_iov[sg->sg_next].iov_len = len;
+	sg->sg_iovcnt = sg->sg_next + 1;
+}
+
+/* returns 0 once everything is written, -1 with errno set otherwise */
+static int
+slap_gather_write( Connection *conn, slap_gather *sg )
+{
+	while ( sg->sg_next < sg->sg_iovcnt ) {
+		struct iovec *iov = &sg->sg_iov[sg->sg_next];
+		int cnt = sg->sg_iovcnt - sg->sg_next;
+		ssize_t n;
+
+		if ( cnt > IOV_MAX )
+			cnt = IOV_MAX;
+		n = writev( conn->c_sd, iov, cnt );
+		if ( n < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			return -1;
+		}
+		for ( ; n > 0 && (size_t)n >= iov->iov_len; iov++ ) {
+			n -= iov->iov_len;
+			sg->sg_next++;
+		}
+		if ( n > 0 ) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+#else
+typedef struct slap_gather slap_gather;
+
+#define slap_gather_ok( op, rs )	0
+#endif /* SLAP_GATHER_WRITE */
+
+/*
+ * While a search runs in the thread that received it, its entries
+ * and references are written with LBER_FLUSH_MORE and so coalesced in
+ * the connection's Sockbuf. The search result, or slap_stream_end()
+ * when the search ends without one, writes them out. Entries sent
+ * from other threads, e.g. by syncprov in the persist phase, are
+ * written immediately.
+ *
+ * Held back PDUs are written with the next one once they are older
+ * than SLAP_SB_COALESCE_USEC. Backends that may go a while without
+ * sending anything, e.g. while scanning candidates that don't match,
+ * call slap_stream_check() as they go, and those about to wait for
+ * something, e.g. a remote server, write them with slap_stream_flush().
+ */
+typedef struct slap_stream {
+	Operation *ss_op;
+	int ss_pending;		/* last PDU of ss_op was held back */
+	struct timeval ss_held;	/* when PDUs started being held back */
+} slap_stream;
+
+/* Have the PDUs held back for ss been waiting too long? */
+static int
+slap_stream_stale( slap_stream *ss )
+{
+	struct timeval now;
+
+	gettimeofday( &now, NULL );
+	return ( now.tv_sec - ss->ss_held.tv_sec ) * 1000000L +
+		now.tv_usec - ss->ss_held.tv_usec >= SLAP_SB_COALESCE_USEC;
+}
+
+void
+slap_stream_begin( Operation *op )
+{
+	slap_stream *ss;
+
+	if ( op->o_conn == NULL || op->o_threadctx == NULL )
+		return;
+
+	ss = op->o_tmpalloc( sizeof( slap_stream ), op->o_tmpmemctx );
+	ss->ss_op = op;
+	ss->ss_pending = 0;
+	if ( ldap_pvt_thread_pool_setkey( op->o_threadctx,
+		(void *)slap_stream_begin, ss, NULL, NULL, NULL ))
+		op->o_tmpfree( ss, op->o_tmpmemctx );
+}
+
+static slap_stream *
+slap_stream_get( Operation *op )
+{
+	void *ss = NULL;
+	void *ctx = ldap_pvt_thread_pool_context();
+
+	if ( ctx == NULL || ldap_pvt_thread_pool_getkey( ctx,
+		(void *)slap_stream_begin, &ss, NULL ) || ss == NULL ||
+		((slap_stream *)ss)->ss_op != op )
+		return NULL;
+	return ss;
+}
+
+/*
+ * Write one PDU, either the BerElement or, when sg is set, the
+ * gathered SearchResultEntry. With neither, only what is held back
+ * in the Sockbuf is written. If more is set and the op is streaming,
+ * the PDU may be held back.
+ */
+static long send_ldap_pdu(
+	Operation *op,
+	BerElement *ber,
+	slap_gather *sg,
+	int more )
 {
 	Connection *conn = op->o_conn;
-	ber_len_t bytes;
+	slap_stream *ss = slap_stream_get( op );
+	ber_len_t bytes = 0;
 	long ret = 0;
 	char *close_reason;
 	int do_resume = 0;
 
-	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+	if ( ss == NULL || ( more && ss->ss_pending && slap_stream_stale( ss )))
+		more = 0;
+
+#ifdef SLAP_GATHER_WRITE
+	if ( sg )
+		bytes = sg->sg_len;
+	else
+#endif
+	if ( ber )
+		ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
 
 	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
-	if (( op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
-		conn->c_writers < 0 ) {
+	if (( op->o_abandon && !op->o_cancel && ( ber || sg )) ||
+		!connection_valid( conn ) || conn->c_writers < 0 ) {
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		return 0;
 	}
@@ -377,7 +763,23 @@ static long send_ldap_ber(
 		int err;
 		char ebuf[128];
 
-		if ( ber_flush2( conn->c_sb, ber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+#ifdef SLAP_GATHER_WRITE
+		if ( sg ) {
+			/* whatever was held back goes first */
+			if ( ber_sockbuf_ctrl( conn->c_sb, LBER_SB_OPT_FLUSH, NULL ) > 0 &&
+				slap_gather_write( conn, sg ) == 0 )
+			{
+				ret = bytes;
+				break;
+			}
+		} else
+#endif
+		if ( ber == NULL ) {
+			if ( ber_sockbuf_ctrl( conn->c_sb, LBER_SB_OPT_FLUSH, NULL ) > 0 )
+				break;
+		} else if ( ber_flush2( conn->c_sb, ber,
+			more ? LBER_FLUSH_MORE : LBER_FLUSH_FREE_NEVER ) == 0 )
+		{
 			ret = bytes;
 			break;
 		}
@@ -410,6 +812,10 @@ fail:
 		conn->c_writewaiter = 1;
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		ldap_pvt_thread_pool_idle( &connection_pool );
+#ifdef SLAP_GATHER_WRITE
+		if ( sg )
+			slap_gather_pin( op, sg );
+#endif
 		slap_writewait_play( op );
 		err = slapd_wait_writer( conn->c_sd );
 		conn->c_writewaiter = 0;
@@ -433,6 +839,11 @@ fail:
 	}
 
 	conn->c_writing = 0;
+	if ( ss ) {
+		if ( more && !ss->ss_pending )
+			gettimeofday( &ss->ss_held, NULL );
+		ss->ss_pending = more;
+	}
 	if ( conn->c_writers < 0 ) {
 		/* shutting down, don't resume any ops */
 		do_resume = 0;
@@ -455,6 +866,48 @@ fail:
 	return ret;
 }
 
+static long send_ldap_ber(
+	Operation *op,
+	BerElement *ber )
+{
+	return send_ldap_pdu( op, ber, NULL, 0 );
+}
+
+/* Write what op has held back, before waiting for more to send */
+void
+slap_stream_flush( Operation *op )
+{
+	slap_stream *ss = slap_stream_get( op );
+
+	if ( ss != NULL && ss->ss_pending )
+		send_ldap_pdu( op, NULL, NULL, 0 );
+}
+
+/* Write what op has held back if it has been waiting too long */
+void
+slap_stream_check( Operation *op )
+{
+	slap_stream *ss = slap_stream_get( op );
+
+	if ( ss != NULL && ss->ss_pending && slap_stream_stale( ss ))
+		send_ldap_pdu( op, NULL, NULL, 0 );
+}
+
+void
+slap_stream_end( Operation *op )
+{
+	slap_stream *ss = slap_stream_get( op );
+
+	if ( ss == NULL )
+		return;
+
+	if ( ss->ss_pending )
+		send_ldap_pdu( op, NULL, NULL, 0 );
+	ldap_pvt_thread_pool_setkey( op->o_threadctx, (void *)slap_stream_begin,
+		NULL, NULL, NULL, NULL );
+	op->o_tmpfree( ss, op->o_tmpmemctx );
+}
+
 static int
 send_ldap_control( BerElement *ber, LDAPControl *c )
 {
@@ -868,6 +1321,8 @@ slap_send_ldap_result( Operation *op, SlapReply *rs )
 
 	rs->sr_type = REP_RESULT;
 
+	slap_group_cache_result( op, rs );
+
 	/* Propagate Abandons so that cleanup callbacks can be processed */
 	if ( rs->sr_err == SLAPD_ABANDON || op->o_abandon )
 		goto abandon;
@@ -1009,6 +1464,42 @@ slap_send_ldap_intermediate( Operation *op, SlapReply *rs )
 #define set_ldap_error( rs, err, text ) do { \
 		(rs)->sr_err = err; (rs)->sr_text = text; } while(0)
 
+/*
+ * Encode an attribute type, one of its values, or the end of the
+ * attribute, either into the BerElement or into the gather list.
+ */
+static int
+send_entry_type( BerElement *ber, slap_gather *sg, struct berval *type )
+{
+#ifdef SLAP_GATHER_WRITE
+	if ( sg ) {
+		slap_gather_attr( sg, type );
+		return 0;
+	}
+#endif
+	return ber_printf( ber, "{O[" /*]}*/ , type );
+}
+
+static int
+send_entry_value( BerElement *ber, slap_gather *sg, struct berval *val )
+{
+#ifdef SLAP_GATHER_WRITE
+	if ( sg ) {
+		slap_gather_value( sg, val );
+		return 0;
+	}
+#endif
+	return ber_printf( ber, "O", val );
+}
+
+static int
+send_entry_end( BerElement *ber, slap_gather *sg )
+{
+	if ( sg )
+		return 0;
+	return ber_printf( ber, /*{[*/ "]N}" );
+}
+
 /*
  * returns:
  *
@@ -1030,6 +1521,10 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	AccessControlState acl_state = ACL_STATE_INIT;
 	int			 attrsonly;
 	AttributeDescription *ad_entry = slap_schema.si_ad_entry;
+#ifdef SLAP_GATHER_WRITE
+	slap_gather	sgbuf;
+#endif
+	slap_gather	*sg = NULL;
 
 	/* a_flags: array of flags telling if the i-th element will be
 	 *          returned or filtered out
@@ -1093,6 +1588,15 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	if ( op->o_res_ber ) {
 		/* read back control or LDAP_CONNECTIONLESS */
 	    ber = op->o_res_ber;
+#ifdef SLAP_GATHER_WRITE
+	} else if ( slap_gather_ok( op, rs ) ) {
+		/* large values are sent without copying them, the
+		 * BerElement only takes the controls */
+		sg = &sgbuf;
+		slap_gather_init( op, rs, sg );
+		ber_init2( ber, NULL, LBER_USE_DER );
+		ber_set_option( ber, LBER_OPT_BER_MEMCTX, &op->o_tmpmemctx );
+#endif
 	} else {
 		struct berval	bv;
 
@@ -1115,7 +1619,9 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		}
 	} else
 #endif
-	if ( op->o_res_ber ) {
+	if ( sg ) {
+		rc = 0;
+	} else if ( op->o_res_ber ) {
 		/* read back control */
 	    rc = ber_printf( ber, "t{O{" /*}}*/,
 			LDAP_RES_SEARCH_ENTRY, &rs->sr_entry->e_name );
@@ -1225,7 +1731,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 				continue;
 			}
 
-			if (( rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname )) == -1 ) {
+			if (( rc = send_entry_type( ber, sg, &desc->ad_cname )) == -1 ) {
 				Debug( LDAP_DEBUG_ANY, 
 					"send_search_entry: conn %lu  ber_printf failed\n", 
 					op->o_connid );
@@ -1259,7 +1765,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 				if ( first ) {
 					first = 0;
 					finish = 1;
-					if (( rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname )) == -1 ) {
+					if (( rc = send_entry_type( ber, sg, &desc->ad_cname )) == -1 ) {
 						Debug( LDAP_DEBUG_ANY,
 							"send_search_entry: conn %lu  ber_printf failed\n", 
 							op->o_connid );
@@ -1271,7 +1777,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 						goto error_return;
 					}
 				}
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
+				if (( rc = send_entry_value( ber, sg, &a->a_vals[i] )) == -1 ) {
 					Debug( LDAP_DEBUG_ANY,
 						"send_search_entry: conn %lu  "
 						"ber_printf failed.\n", op->o_connid );
@@ -1285,7 +1791,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			}
 		}
 
-		if ( finish && ( rc = ber_printf( ber, /*{[*/ "]N}" )) == -1 ) {
+		if ( finish && ( rc = send_entry_end( ber, sg )) == -1 ) {
 			Debug( LDAP_DEBUG_ANY,
 				"send_search_entry: conn %lu ber_printf failed\n", 
 				op->o_connid );
@@ -1391,7 +1897,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			continue;
 		}
 
-		rc = ber_printf( ber, "{O[" /*]}*/ , &desc->ad_cname );
+		rc = send_entry_type( ber, sg, &desc->ad_cname );
 		if ( rc == -1 ) {
 			Debug( LDAP_DEBUG_ANY,
 				"send_search_entry: conn %lu  "
@@ -1421,7 +1927,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 					continue;
 				}
 
-				if (( rc = ber_printf( ber, "O", &a->a_vals[i] )) == -1 ) {
+				if (( rc = send_entry_value( ber, sg, &a->a_vals[i] )) == -1 ) {
 					Debug( LDAP_DEBUG_ANY,
 						"send_search_entry: conn %lu  ber_printf failed\n", 
 						op->o_connid );
@@ -1435,7 +1941,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 			}
 		}
 
-		if (( rc = ber_printf( ber, /*{[*/ "]N}" )) == -1 ) {
+		if (( rc = send_entry_end( ber, sg )) == -1 ) {
 			Debug( LDAP_DEBUG_ANY,
 				"send_search_entry: conn %lu  ber_printf failed\n",
 				op->o_connid );
@@ -1453,13 +1959,13 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 		e_flags = NULL;
 	}
 
-	rc = ber_printf( ber, /*{{*/ "}N}" );
+	rc = sg ? 0 : ber_printf( ber, /*{{*/ "}N}" );
 
 	if( rc != -1 ) {
 		rc = send_ldap_controls( op, ber, rs->sr_ctrls );
 	}
 
-	if( rc != -1 ) {
+	if( rc != -1 && sg == NULL ) {
 #ifdef LDAP_CONNECTIONLESS
 		if( op->o_conn && op->o_conn->c_is_udp ) {
 			if ( op->o_protocol != LDAP_VERSION2 ) {
@@ -1484,10 +1990,25 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	Debug( LDAP_DEBUG_STATS2, "%s ENTRY dn=\"%s\"\n",
 	    op->o_log_prefix, rs->sr_entry->e_nname.bv_val );
 
-	rs_flush_entry( op, rs, NULL );
+#ifdef SLAP_GATHER_WRITE
+	if ( sg ) {
+		struct berval ctrls;
+
+		/* the gather list points into the entry, it must stay
+		 * around until the PDU has been written */
+		ber_flatten2( ber, &ctrls, 0 );
+		slap_gather_build( op, &rs->sr_entry->e_name, &ctrls, sg );
+		bytes = send_ldap_pdu( op, NULL, sg, 0 );
+		rs_flush_entry( op, rs, NULL );
+	} else
+#endif
+	{
+		rs_flush_entry( op, rs, NULL );
+		if ( op->o_res_ber == NULL )
+			bytes = send_ldap_pdu( op, ber, NULL, 1 );
+	}
 
 	if ( op->o_res_ber == NULL ) {
-		bytes = send_ldap_ber( op, ber );
 		ber_free_buf( ber );
 
 		if ( bytes < 0 ) {
@@ -1513,6 +2034,12 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	rc = LDAP_SUCCESS;
 
 error_return:;
+#ifdef SLAP_GATHER_WRITE
+	if ( sg ) {
+		slap_gather_free( op, sg );
+	}
+#endif
+
 	if ( op->o_callback ) {
 		(void)slap_cleanup_play( op, rs );
 	}
@@ -1653,7 +2180,7 @@ slap_send_search_reference( Operation *op, SlapReply *rs )
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0) {
 #endif
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_pdu( op, ber, NULL, 1 );
 	ber_free_buf( ber );
 
 	if ( bytes < 0 ) {
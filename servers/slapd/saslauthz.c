@@ -1744,6 +1744,7 @@ slap_sasl_match( Operation *opx, struct berval *rule,
 	Operation op = {0};
 	SlapReply rs = {REP_RESULT};
 	struct berval base = BER_BVNULL;
+	struct berval gckey = BER_BVNULL;
 
 	sm.dn = assertDN;
 	sm.match = 0;
@@ -1839,6 +1840,16 @@ exact_match:
 	case LDAP_X_SCOPE_GROUP: {
 		char	*tmp;
 
+		if ( slap_groupcache_ttl ) {
+			slap_group_cache_key( opx, &gckey, SLAP_GC_AUTHZ,
+				&op.ors_filterstr, assertDN, authc );
+			if ( slap_group_cache_get( &op.o_req_ndn, &gckey, &rc,
+				NULL, NULL ) )
+			{
+				goto CONCLUDED;
+			}
+		}
+
 		/* Now filterstr looks like "(&(objectClass=<group_oc>)(<member_at>="
 		 * we need to append the <assertDN> so that the <group_dn> is searched
 		 * with scope "base", and the filter ensures that <assertDN> is
@@ -1926,7 +1937,15 @@ exact_match:
 		rc = LDAP_INAPPROPRIATE_AUTH;
 	}
 
+	if ( !BER_BVISNULL( &gckey ) && ( sm.match ||
+		rs.sr_err == LDAP_SUCCESS || rs.sr_err == LDAP_NO_SUCH_OBJECT ) )
+	{
+		slap_group_cache_put( &op.o_req_ndn, &gckey, rc, NULL,
+			opx->o_gcgen );
+	}
+
 CONCLUDED:
+	if( !BER_BVISNULL( &gckey ) ) slap_sl_free( gckey.bv_val, opx->o_tmpmemctx );
 	if( !BER_BVISNULL( &op.o_req_dn ) ) slap_sl_free( op.o_req_dn.bv_val, opx->o_tmpmemctx );
 	if( !BER_BVISNULL( &op.o_req_ndn ) ) slap_sl_free( op.o_req_ndn.bv_val, opx->o_tmpmemctx );
 	if( op.ors_filter ) filter_free_x( opx, op.ors_filter, 1 );
@@ -244,7 +244,9 @@ do_search(
 	}
 
 	op->o_bd = frontendDB;
+	slap_stream_begin( op );
 	rs->sr_err = frontendDB->be_search( op, rs );
+	slap_stream_end( op );
 	if ( rs->sr_err == SLAPD_ASYNCOP ) {
 		/* skip cleanup */
 		return rs->sr_err;
@@ -52,8 +52,10 @@
  * The allocator helps memory fragmentation, speed and memory leaks.
  * It is not (yet) reliable as a garbage collector:
  *
- * It falls back to context NULL - plain ber_memalloc() - when the
- * context's slab is full.  A reset does not reclaim such memory.
+ * When the context's slab is full, a stack context chains up to
+ * slap_sl_chain_max extra slabs (olcSlabChain), which a reset releases.
+ * Beyond that it falls back to context NULL - plain ber_memalloc().
+ * A reset does not reclaim such memory.
  * Conversely, free/realloc of data not from the given context assumes
  * context NULL.  The data must not belong to another memory context.
  *
@@ -67,9 +69,22 @@
 /*
  * The stack-based allocator stores (ber_len_t)sizeof(head+block) at
  * allocated blocks' head - and in freed blocks also at the tail, marked
- * by ORing *next* block's head with 1.  Freed blocks are only reclaimed
+ * by ORing *next* block's head with 1.  Freed blocks are reclaimed
  * from the last block forward.  This is fast, but when a block is never
- * freed, older blocks will not be reclaimed until the slab is reset...
+ * freed, older blocks would not be reclaimed until the slab is reset...
+ *
+ * So freed blocks below the top are also merged with free neighbours
+ * and, if big enough to hold a struct slab_free, put on a free list
+ * indexed by log2(size).  Allocations try those lists before bumping
+ * sh_last.  A listed block leaves its list when it is reused or when
+ * the top is reclaimed past it.
+ *
+ * slap_sl_release() drops everything allocated since slap_sl_mark() by
+ * resetting sh_last and the top of the slab chained last, and freeing
+ * the slabs chained since.  While a mark is set, allocations don't reuse
+ * free blocks, freed blocks aren't merged across the mark and the top
+ * isn't reclaimed below it, so that everything allocated since lies
+ * above the mark and no free block straddles it.  Marks don't nest.
  */
 
 #ifdef SLAP_NO_SL_MALLOC /* Useful with memory debuggers like Valgrind */
@@ -80,6 +95,23 @@ enum { No_sl_malloc = 0 };
 
 #define SLAP_SLAB_SOBLOCK 64
 
+unsigned slap_sl_chain_max = SLAP_SLAB_CHAIN;
+
+/* Head of a free stack block; its tail follows at the end of the block */
+struct slab_free {
+	ber_len_t sf_head;
+	LDAP_LIST_ENTRY(slab_free) sf_link;
+};
+
+/* Extra slab chained when the primary one is full, data follows */
+struct slab_chunk {
+	LDAP_SLIST_ENTRY(slab_chunk) sc_next;
+	void *sc_last;
+	void *sc_end;
+};
+
+#define SLAP_SL_NCLASS	(sizeof(ber_len_t) * 8)
+
 struct slab_object {
     void *so_ptr;
 	int so_blockhead;
@@ -90,22 +122,53 @@ struct slab_heap {
     void *sh_base;
     void *sh_last;
     void *sh_end;
+	void *sh_mark;	/* set by slap_sl_mark() */
+	struct slab_chunk *sh_markchunk;	/* head chunk at the mark */
+	void *sh_marklast;	/* its sc_last at the mark */
 	int sh_stack;
 	int sh_maxorder;
     unsigned char **sh_map;
     LDAP_LIST_HEAD(sh_freelist, slab_object) *sh_free;
 	LDAP_LIST_HEAD(sh_so, slab_object) sh_sopool;
+	LDAP_LIST_HEAD(sh_sfree, slab_free) sh_sfree[SLAP_SL_NCLASS];
+	LDAP_SLIST_HEAD(sh_chain, slab_chunk) sh_chain;
+	unsigned sh_nfree;	/* blocks on sh_sfree */
+	unsigned sh_nchunks;
+	ber_len_t sh_chainused;	/* size of chunks behind the head chunk */
+	slap_sl_stats_t sh_stats;
+	LDAP_LIST_ENTRY(slab_heap) sh_link;
 };
 
+static LDAP_LIST_HEAD(sl_heaps, slab_heap) slap_sl_heaps
+	= LDAP_LIST_HEAD_INITIALIZER(&slap_sl_heaps);
+static ldap_pvt_thread_mutex_t slap_sl_heaps_mutex;
+
 enum {
 	Align = sizeof(ber_len_t) > 2*sizeof(int)
 		? sizeof(ber_len_t) : 2*sizeof(int),
 	Align_log2 = 1 + (Align>2) + (Align>4) + (Align>8) + (Align>16),
 	order_start = Align_log2 - 1,
-	pad = Align - 1
+	pad = Align - 1,
+	/* Chunk data starts so that (data + head of first block) is aligned */
+	Chunk_head = ((sizeof(struct slab_chunk) + Align-1) & -Align) +
+		(unsigned) -sizeof(ber_len_t) % Align,
+	/* Smallest block which can go on a free list: head, links, tail */
+	Min_free = (sizeof(struct slab_free) + sizeof(ber_len_t) + Align-1)
+		& -Align
 };
 
 static struct slab_object * slap_replenish_sopool(struct slab_heap* sh);
+
+/* Memory contexts of PDU buffers: [class] to free into, [NCLASS] to
+ * alloc from, [NCLASS+1] marks a recyclable BerElement done reading */
+static char slap_iobuf_ctx[SLAP_IOBUF_NCLASS + 2];
+#define SLAP_IOBUF_READ		(slap_iobuf_ctx + SLAP_IOBUF_NCLASS)
+#define SLAP_IOBUF_DONE		(slap_iobuf_ctx + SLAP_IOBUF_NCLASS + 1)
+#define SLAP_IOBUF_CTX(ctx) \
+	((char *) (ctx) >= slap_iobuf_ctx && (char *) (ctx) <= SLAP_IOBUF_DONE)
+
+static void *slap_iobuf_malloc(ber_len_t size);
+static void slap_iobuf_put(int c, void *ptr);
 #ifdef SLAPD_UNUSED
 static void print_slheap(int level, void *ctx);
 #endif
@@ -128,11 +191,20 @@ slap_sl_mem_destroy(
 {
 	struct slab_heap *sh = data;
 	struct slab_object *so;
+	struct slab_chunk *sc;
 	int i;
 
 	if (!sh)
 		return;
 
+	while ((sc = LDAP_SLIST_FIRST(&sh->sh_chain)) != NULL) {
+		LDAP_SLIST_REMOVE_HEAD(&sh->sh_chain, sc_next);
+		ber_memfree_x(sc, NULL);
+	}
+	sh->sh_nchunks = 0;
+	sh->sh_chainused = 0;
+	sh->sh_markchunk = NULL;
+
 	if (!sh->sh_stack) {
 		for (i = 0; i <= sh->sh_maxorder - order_start; i++) {
 			so = LDAP_LIST_FIRST(&sh->sh_free[i]);
@@ -163,6 +235,9 @@ slap_sl_mem_destroy(
 	}
 
 	if (key != NULL) {
+		ldap_pvt_thread_mutex_lock(&slap_sl_heaps_mutex);
+		LDAP_LIST_REMOVE(sh, sh_link);
+		ldap_pvt_thread_mutex_unlock(&slap_sl_heaps_mutex);
 		ber_memfree_x(sh->sh_base, NULL);
 		ber_memfree_x(sh, NULL);
 	}
@@ -171,11 +246,21 @@ slap_sl_mem_destroy(
 BerMemoryFunctions slap_sl_mfuncs =
 	{ slap_sl_malloc, slap_sl_calloc, slap_sl_realloc, slap_sl_free };
 
+static slap_retq slap_iobuf_q[SLAP_IOBUF_NCLASS + 1];
+
 void
 slap_sl_mem_init()
 {
+	int i;
+
 	assert( Align == 1 << Align_log2 );
 
+	ldap_pvt_thread_mutex_init( &slap_sl_heaps_mutex );
+	for ( i = 0; i <= SLAP_IOBUF_NCLASS; i++ ) {
+		/* up to 1M bytes of buffers per class, and 256 BerElements */
+		slap_retq_init( &slap_iobuf_q[i],
+			i < SLAP_IOBUF_NCLASS ? (1024*1024) >> (6 + 2*i) : 256, 0 );
+	}
 	ber_set_option( NULL, LBER_OPT_MEMORY_FNS, &slap_sl_mfuncs );
 }
 
@@ -204,8 +289,12 @@ slap_sl_mem_create(
 	size = ((size + Align-1) & -Align) + Base_offset;
 
 	if (!sh) {
-		sh = ch_malloc(sizeof(struct slab_heap));
+		sh = ch_calloc(1, sizeof(struct slab_heap));
 		base = ch_malloc(size);
+		LDAP_SLIST_INIT(&sh->sh_chain);
+		ldap_pvt_thread_mutex_lock(&slap_sl_heaps_mutex);
+		LDAP_LIST_INSERT_HEAD(&slap_sl_heaps, sh, sh_link);
+		ldap_pvt_thread_mutex_unlock(&slap_sl_heaps_mutex);
 		SET_MEMCTX(thrctx, sh, slap_sl_mem_destroy);
 		VGMEMP_MARK(base, size);
 		VGMEMP_CREATE(sh, 0, 0);
@@ -222,6 +311,7 @@ slap_sl_mem_create(
 	}
 	sh->sh_base = base;
 	sh->sh_end = base + size;
+	sh->sh_stats.ss_size = size;
 
 	/* Align (base + head of first block) == first returned block */
 	base += Base_offset;
@@ -229,7 +319,15 @@ slap_sl_mem_create(
 
 	sh->sh_stack = stack;
 	if (stack) {
+		int i;
+
 		sh->sh_last = base;
+		sh->sh_mark = NULL;
+		sh->sh_markchunk = NULL;
+		sh->sh_nfree = 0;
+		for (i = 0; i < SLAP_SL_NCLASS; i++) {
+			LDAP_LIST_INIT(&sh->sh_sfree[i]);
+		}
 
 	} else {
 		int i, order = -1, order_end = -1;
@@ -288,6 +386,201 @@ slap_sl_mem_setctx(
 	SET_MEMCTX(thrctx, memctx, slap_sl_mem_destroy);
 }
 
+/* Free list index of a stack block: floor(log2(size)) */
+static int
+slap_sl_class( ber_len_t size )
+{
+	int i = 0;
+
+	while (size >>= 1)
+		i++;
+	return i;
+}
+
+/* Put free stack block p on a free list, if it is big enough */
+static void
+slap_sl_list( struct slab_heap *sh, ber_len_t *p, ber_len_t size )
+{
+	if (size >= Min_free) {
+		LDAP_LIST_INSERT_HEAD(&sh->sh_sfree[slap_sl_class(size)],
+			(struct slab_free *) p, sf_link);
+		sh->sh_nfree++;
+	}
+}
+
+/* Take free stack block p off its free list, if it is on one */
+static void
+slap_sl_unlist( struct slab_heap *sh, ber_len_t *p )
+{
+	if ((p[0] & -2) >= Min_free) {
+		LDAP_LIST_REMOVE((struct slab_free *) p, sf_link);
+		sh->sh_nfree--;
+	}
+}
+
+/*
+ * Find the slab holding stack block ptr, return a pointer to its
+ * last-block field and set *endp to its end.  NULL if not ours.
+ */
+static void **
+slap_sl_region( struct slab_heap *sh, void *ptr, void **endp )
+{
+	struct slab_chunk *sc;
+
+	if (ptr >= sh->sh_base && ptr < sh->sh_end) {
+		*endp = sh->sh_end;
+		return &sh->sh_last;
+	}
+	LDAP_SLIST_FOREACH(sc, &sh->sh_chain, sc_next) {
+		if (ptr >= (void *) sc && ptr < sc->sc_end) {
+			*endp = sc->sc_end;
+			return &sc->sc_last;
+		}
+	}
+	return NULL;
+}
+
+/* The mark in the slab whose last-block field is lastp, or NULL */
+static void *
+slap_sl_markof( struct slab_heap *sh, void **lastp )
+{
+	if (lastp == &sh->sh_last)
+		return sh->sh_mark;
+	if (sh->sh_markchunk && lastp == &sh->sh_markchunk->sc_last)
+		return sh->sh_marklast;
+	return NULL;
+}
+
+/* Free stack block p (pointing at its head) in the slab ending at *lastp */
+static void
+slap_sl_stack_free( struct slab_heap *sh, void **lastp, ber_len_t *p )
+{
+	ber_len_t size = p[0] & -2, *nextp, *tmpp;
+	void *mark = slap_sl_markof(sh, lastp);
+
+	nextp = (ber_len_t *) ((char *) p + size);
+	if (*lastp == nextp && (void *) nextp != mark) {
+		/* Reclaim freed block(s) off tail, down to the mark */
+		while ((*p & 1) && (void *) p != mark) {
+			p = (ber_len_t *) ((char *) p - p[-1]);
+			slap_sl_unlist(sh, p);
+		}
+		*lastp = p;
+		if (lastp == &sh->sh_last) {
+			VGMEMP_TRIM(sh, sh->sh_base,
+				(char *) sh->sh_last - (char *) sh->sh_base);
+		}
+		return;
+	}
+
+	/* Merge with the next block if it is free.  Unless the mark
+	 * stopped it, a free block right below *lastp has been reclaimed,
+	 * so tmpp is a real block. */
+	if ((void *) nextp != *lastp && (void *) nextp != mark) {
+		tmpp = (ber_len_t *) ((char *) nextp + (nextp[0] & -2));
+		if ((void *) tmpp < *lastp && (*tmpp & 1)) {
+			slap_sl_unlist(sh, nextp);
+			size += nextp[0] & -2;
+			nextp = tmpp;
+		}
+	}
+
+	/* Merge with the previous block if it is free */
+	if ((p[0] & 1) && (void *) p != mark) {
+		tmpp = (ber_len_t *) ((char *) p - p[-1]);
+		slap_sl_unlist(sh, tmpp);
+		size += p[-1];
+		p = tmpp;
+	}
+
+	/* Mark it free: tail = size, head of next block |= 1.
+	 * We can't tell Valgrind about it yet, because we
+	 * still need read/write access to this block for
+	 * when we eventually get to reclaim it.
+	 */
+	p[0] = (p[0] & 1) | size;
+	nextp[-1] = size;
+	if ((void *) nextp != *lastp)	/* kept below the mark */
+		nextp[0] |= 1;
+	slap_sl_list(sh, p, size);
+}
+
+/* Reuse a free stack block of at least size bytes, splitting it if
+ * the rest can go back on a free list.  Returns its head or NULL. */
+static ber_len_t *
+slap_sl_stack_reuse( struct slab_heap *sh, ber_len_t size )
+{
+	struct slab_free *sf;
+	ber_len_t bsize, *p, *nextp;
+	int i = slap_sl_class(size);
+
+	/* Blocks in class i may be too small, larger classes will fit */
+	sf = LDAP_LIST_FIRST(&sh->sh_sfree[i]);
+	if (!sf || (sf->sf_head & -2) < size) {
+		for (sf = NULL; ++i < SLAP_SL_NCLASS && !sf; )
+			sf = LDAP_LIST_FIRST(&sh->sh_sfree[i]);
+		if (!sf)
+			return NULL;
+	}
+	p = (ber_len_t *) sf;
+	slap_sl_unlist(sh, p);
+
+	bsize = p[0] & -2;
+	nextp = (ber_len_t *) ((char *) p + bsize);
+	if (bsize - size >= Min_free) {
+		ber_len_t *rest = (ber_len_t *) ((char *) p + size);
+
+		rest[0] = bsize - size;
+		nextp[-1] = bsize - size;
+		slap_sl_list(sh, rest, bsize - size);
+		p[0] = (p[0] & 1) | size;
+	} else {
+		nextp[0] &= -2;
+	}
+	sh->sh_stats.ss_reused++;
+	return p;
+}
+
+/* Bump-allocate a stack block from the slab chain, growing it if allowed */
+static ber_len_t *
+slap_sl_chain_alloc( struct slab_heap *sh, ber_len_t size )
+{
+	struct slab_chunk *sc = LDAP_SLIST_FIRST(&sh->sh_chain);
+	ber_len_t *newptr, used;
+
+	if (!sc || size >= (ber_len_t) ((char *) sc->sc_end - (char *) sc->sc_last)) {
+		ber_len_t csize = (char *) sh->sh_end - (char *) sh->sh_base;
+
+		if (sh->sh_nchunks >= slap_sl_chain_max)
+			return NULL;
+		if (csize < size + Align)
+			csize = size + Align;
+		csize += Chunk_head;
+		newptr = ber_memalloc_x(csize, NULL);
+		if (newptr == NULL)
+			return NULL;
+		if (sc)
+			sh->sh_chainused += (char *) sc->sc_end - (char *) sc;
+		sc = (struct slab_chunk *) newptr;
+		sc->sc_last = (char *) sc + Chunk_head;
+		sc->sc_end = (char *) sc + csize;
+		LDAP_SLIST_INSERT_HEAD(&sh->sh_chain, sc, sc_next);
+		sh->sh_nchunks++;
+		sh->sh_stats.ss_chained++;
+		Debug(LDAP_DEBUG_TRACE, "sl_malloc %lu: chained slab %u of %lu\n",
+			(unsigned long) size, sh->sh_nchunks, (unsigned long) csize );
+	}
+
+	newptr = sc->sc_last;
+	sc->sc_last = (char *) sc->sc_last + size;
+	used = ((char *) sh->sh_end - (char *) sh->sh_base) + sh->sh_chainused +
+		((char *) sc->sc_last - (char *) sc);
+	if (used > sh->sh_stats.ss_hiwat)
+		sh->sh_stats.ss_hiwat = used;
+	*newptr = size;
+	return newptr;
+}
+
 void *
 slap_sl_malloc(
     ber_len_t	size,
@@ -298,8 +591,9 @@ slap_sl_malloc(
 	ber_len_t *ptr, *newptr;
 
 	/* ber_set_option calls us like this */
-	if (No_sl_malloc || !ctx) {
-		newptr = ber_memalloc_x( size, NULL );
+	if (No_sl_malloc || !ctx || SLAP_IOBUF_CTX(ctx)) {
+		newptr = ctx == SLAP_IOBUF_READ
+			? slap_iobuf_malloc( size ) : ber_memalloc_x( size, NULL );
 		if ( newptr ) return newptr;
 		Debug(LDAP_DEBUG_ANY, "slap_sl_malloc of %lu bytes failed\n",
 			(unsigned long) size );
@@ -312,14 +606,30 @@ slap_sl_malloc(
 	size = (size + sizeof(ber_len_t) + Align-1 + !size) & -Align;
 
 	if (sh->sh_stack) {
+		if (sh->sh_nfree && !sh->sh_mark &&
+			(newptr = slap_sl_stack_reuse(sh, size)) != NULL)
+		{
+			return( (void *)(newptr + 1) );
+		}
+
 		if (size < (ber_len_t) ((char *) sh->sh_end - (char *) sh->sh_last)) {
 			newptr = sh->sh_last;
 			sh->sh_last = (char *) sh->sh_last + size;
+			if ((ber_len_t) ((char *) sh->sh_last - (char *) sh->sh_base) >
+				sh->sh_stats.ss_hiwat)
+			{
+				sh->sh_stats.ss_hiwat =
+					(char *) sh->sh_last - (char *) sh->sh_base;
+			}
 			VGMEMP_ALLOC(sh, newptr, size);
 			*newptr++ = size;
 			return( (void *)newptr );
 		}
 
+		if ((newptr = slap_sl_chain_alloc(sh, size)) != NULL) {
+			return( (void *)(newptr + 1) );
+		}
+
 		size -= sizeof(ber_len_t);
 
 	} else {
@@ -380,6 +690,7 @@ slap_sl_malloc(
 		/* FIXME: missing return; guessing we failed... */
 	}
 
+	sh->sh_stats.ss_fallback++;
 	Debug(LDAP_DEBUG_TRACE,
 		"sl_malloc %lu: ch_malloc\n",
 		(unsigned long) size );
@@ -414,13 +725,17 @@ slap_sl_realloc(void *ptr, ber_len_t size, void *ctx)
 {
 	struct slab_heap *sh = ctx;
 	ber_len_t oldsize, *p = (ber_len_t *) ptr, *nextp;
-	void *newptr;
+	void *newptr, **lastp = NULL, *end;
 
 	if (ptr == NULL)
 		return slap_sl_malloc(size, ctx);
 
+	if (!No_sl_malloc && sh && !SLAP_IOBUF_CTX(ctx) &&
+			((ptr >= sh->sh_base && ptr < sh->sh_end) || sh->sh_stack))
+		lastp = slap_sl_region(sh, ptr, &end);
+
 	/* Not our memory? */
-	if (No_sl_malloc || !sh || ptr < sh->sh_base || ptr >= sh->sh_end) {
+	if (lastp == NULL) {
 		/* Like ch_realloc(), except not trying a new context */
 		newptr = ber_memrealloc_x(ptr, size, NULL);
 		if (newptr) {
@@ -453,10 +768,11 @@ slap_sl_realloc(void *ptr, ber_len_t size, void *ctx)
 		oldsize &= -2;
 		nextp = (ber_len_t *) ((char *) p + oldsize);
 
-		/* If reallocing the last block, try to grow it */
-		if (nextp == sh->sh_last) {
-			if (size < (ber_len_t) ((char *) sh->sh_end - (char *) p)) {
-				sh->sh_last = (char *) p + size;
+		/* If reallocing the last block, try to grow it, but not
+		 * across the mark */
+		if (nextp == *lastp && (void *) nextp != slap_sl_markof(sh, lastp)) {
+			if (size < (ber_len_t) ((char *) end - (char *) p)) {
+				*lastp = (char *) p + size;
 				p[0] = (p[0] & 1) | size;
 				return ptr;
 			}
@@ -467,8 +783,7 @@ slap_sl_realloc(void *ptr, ber_len_t size, void *ctx)
 			newptr = slap_sl_malloc(size-sizeof(ber_len_t), ctx);
 			AC_MEMCPY(newptr, ptr, oldsize-sizeof(ber_len_t));
 			/* Not last block, can just mark old region as free */
-			nextp[-1] = oldsize;
-			nextp[0] |= 1;
+			slap_sl_stack_free(sh, lastp, p);
 			return newptr;
 		}
 
@@ -490,12 +805,21 @@ slap_sl_free(void *ptr, void *ctx)
 {
 	struct slab_heap *sh = ctx;
 	ber_len_t size;
-	ber_len_t *p = ptr, *nextp, *tmpp;
+	ber_len_t *p = ptr, *tmpp;
+	void **lastp = NULL, *end;
 
 	if (!ptr)
 		return;
 
-	if (No_sl_malloc || !sh || ptr < sh->sh_base || ptr >= sh->sh_end) {
+	if (!No_sl_malloc && sh && !SLAP_IOBUF_CTX(ctx) &&
+			((ptr >= sh->sh_base && ptr < sh->sh_end) || sh->sh_stack))
+		lastp = slap_sl_region(sh, ptr, &end);
+
+	if (lastp == NULL) {
+		if (SLAP_IOBUF_CTX(ctx) && (char *) ctx < SLAP_IOBUF_READ) {
+			slap_iobuf_put((char *) ctx - slap_iobuf_ctx, ptr);
+			return;
+		}
 		ber_memfree_x(ptr, NULL);
 		return;
 	}
@@ -503,25 +827,7 @@ slap_sl_free(void *ptr, void *ctx)
 	size = *(--p);
 
 	if (sh->sh_stack) {
-		size &= -2;
-		nextp = (ber_len_t *) ((char *) p + size);
-		if (sh->sh_last != nextp) {
-			/* Mark it free: tail = size, head of next block |= 1 */
-			nextp[-1] = size;
-			nextp[0] |= 1;
-			/* We can't tell Valgrind about it yet, because we
-			 * still need read/write access to this block for
-			 * when we eventually get to reclaim it.
-			 */
-		} else {
-			/* Reclaim freed block(s) off tail */
-			while (*p & 1) {
-				p = (ber_len_t *) ((char *) p - p[-1]);
-			}
-			sh->sh_last = p;
-			VGMEMP_TRIM(sh, sh->sh_base,
-				(char *) sh->sh_last - (char *) sh->sh_base);
-		}
+		slap_sl_stack_free(sh, lastp, p);
 
 	} else {
 		int size_shift, order_size;
@@ -643,18 +949,79 @@ slap_sl_free(void *ptr, void *ctx)
 	}
 }
 
+/* Whether free stack block sf goes away when releasing down to ptr */
+static int
+slap_sl_released( struct slab_heap *sh, void *sf, void *ptr )
+{
+	struct slab_chunk *sc;
+
+	if (sf >= sh->sh_base && sf < sh->sh_end)
+		return sf >= ptr;
+	if (!sh->sh_mark)
+		return 0;
+	LDAP_SLIST_FOREACH(sc, &sh->sh_chain, sc_next) {
+		if (sf >= (void *) sc && sf < sc->sc_end)
+			return sc != sh->sh_markchunk || sf >= sh->sh_marklast;
+		if (sc == sh->sh_markchunk)
+			break;
+	}
+	return 0;
+}
+
 void
 slap_sl_release( void *ptr, void *ctx )
 {
 	struct slab_heap *sh = ctx;
-	if ( sh && ptr >= sh->sh_base && ptr <= sh->sh_end )
+	if ( sh && ptr >= sh->sh_base && ptr <= sh->sh_end ) {
+		if ( sh->sh_stack && sh->sh_nfree ) {
+			struct slab_free *sf, *next;
+			int i;
+
+			/* Forget free blocks above the new tops */
+			for ( i = 0; i < SLAP_SL_NCLASS; i++ ) {
+				for ( sf = LDAP_LIST_FIRST( &sh->sh_sfree[i] ); sf; sf = next ) {
+					next = LDAP_LIST_NEXT( sf, sf_link );
+					if ( slap_sl_released( sh, sf, ptr )) {
+						LDAP_LIST_REMOVE( sf, sf_link );
+						sh->sh_nfree--;
+					}
+				}
+			}
+		}
+		if ( sh->sh_stack && sh->sh_mark ) {
+			struct slab_chunk *sc;
+
+			/* Free the slabs chained since the mark */
+			while (( sc = LDAP_SLIST_FIRST( &sh->sh_chain )) != NULL &&
+				sc != sh->sh_markchunk )
+			{
+				LDAP_SLIST_REMOVE_HEAD( &sh->sh_chain, sc_next );
+				ber_memfree_x( sc, NULL );
+				sh->sh_nchunks--;
+			}
+			sh->sh_chainused = 0;
+			if ( sc ) {
+				sc->sc_last = sh->sh_marklast;
+				while (( sc = LDAP_SLIST_NEXT( sc, sc_next )) != NULL )
+					sh->sh_chainused += (char *) sc->sc_end - (char *) sc;
+			}
+			sh->sh_markchunk = NULL;
+		}
 		sh->sh_last = ptr;
+		sh->sh_mark = NULL;
+	}
 }
 
 void *
 slap_sl_mark( void *ctx )
 {
 	struct slab_heap *sh = ctx;
+	if ( sh->sh_stack ) {
+		sh->sh_mark = sh->sh_last;
+		sh->sh_markchunk = LDAP_SLIST_FIRST( &sh->sh_chain );
+		if ( sh->sh_markchunk )
+			sh->sh_marklast = sh->sh_markchunk->sc_last;
+	}
 	return sh->sh_last;
 }
 
@@ -674,9 +1041,305 @@ slap_sl_context( void *ptr )
 	if (sh && ptr >= sh->sh_base && ptr <= sh->sh_end) {
 		return sh;
 	}
+	if (sh && sh->sh_stack && !LDAP_SLIST_EMPTY(&sh->sh_chain)) {
+		void *end;
+
+		if (slap_sl_region(sh, ptr, &end))
+			return sh;
+	}
 	return NULL;
 }
 
+/*
+ * Call func on the statistics of each memory context in turn,
+ * stopping if it returns nonzero.  Returns the number of contexts.
+ */
+int
+slap_sl_mem_stats( SLAP_SL_STATS_FN *func, void *arg )
+{
+	struct slab_heap *sh;
+	int n = 0;
+
+	ldap_pvt_thread_mutex_lock( &slap_sl_heaps_mutex );
+	LDAP_LIST_FOREACH( sh, &slap_sl_heaps, sh_link ) {
+		n++;
+		if ( func && func( &sh->sh_stats, arg ) )
+			break;
+	}
+	ldap_pvt_thread_mutex_unlock( &slap_sl_heaps_mutex );
+	return n;
+}
+
+/*
+ * Return queues recycle objects which are freed on another thread than
+ * the one which will want them next, like Operations allocated by the
+ * reader and freed by the worker.  With atomics slap_retq_put() pushes
+ * on a lock-free stack, and slap_retq_take() detaches the whole stack.
+ * Never popping single items avoids the ABA problem.  The count is
+ * approximate, it only bounds how much memory the queue hoards.
+ */
+#define RQ_NEXT(rq, item)	(*(void **) ((char *) (item) + (rq)->rq_linkoff))
+
+void
+slap_retq_init( slap_retq *rq, int max, size_t linkoff )
+{
+	rq->rq_head = NULL;
+	rq->rq_count = 0;
+	rq->rq_max = max;
+	rq->rq_linkoff = linkoff;
+#ifndef SLAP_RETQ_ATOMIC
+	ldap_pvt_thread_mutex_init( &rq->rq_mutex );
+#endif
+}
+
+void
+slap_retq_destroy( slap_retq *rq )
+{
+	rq->rq_head = NULL;
+	rq->rq_count = 0;
+#ifndef SLAP_RETQ_ATOMIC
+	ldap_pvt_thread_mutex_destroy( &rq->rq_mutex );
+#endif
+}
+
+/* Returns 0 if item was queued, -1 if the queue is full */
+int
+slap_retq_put( slap_retq *rq, void *item )
+{
+#ifdef SLAP_RETQ_ATOMIC
+	void *head;
+
+	if ( __atomic_load_n( &rq->rq_count, __ATOMIC_RELAXED ) >= rq->rq_max )
+		return -1;
+	__atomic_add_fetch( &rq->rq_count, 1, __ATOMIC_RELAXED );
+
+	head = __atomic_load_n( &rq->rq_head, __ATOMIC_RELAXED );
+	do {
+		RQ_NEXT( rq, item ) = head;
+	} while ( !__atomic_compare_exchange_n( &rq->rq_head, &head, item,
+		1, __ATOMIC_RELEASE, __ATOMIC_RELAXED ));
+#else
+	ldap_pvt_thread_mutex_lock( &rq->rq_mutex );
+	if ( rq->rq_count >= rq->rq_max ) {
+		ldap_pvt_thread_mutex_unlock( &rq->rq_mutex );
+		return -1;
+	}
+	RQ_NEXT( rq, item ) = rq->rq_head;
+	rq->rq_head = item;
+	rq->rq_count++;
+	ldap_pvt_thread_mutex_unlock( &rq->rq_mutex );
+#endif
+	return 0;
+}
+
+/* Returns the queued items as a list linked at rq_linkoff, or NULL */
+void *
+slap_retq_take( slap_retq *rq )
+{
+	void *head;
+#ifdef SLAP_RETQ_ATOMIC
+	void *item;
+	int n = 0;
+
+	if ( !__atomic_load_n( &rq->rq_head, __ATOMIC_RELAXED ))
+		return NULL;
+	head = __atomic_exchange_n( &rq->rq_head, NULL, __ATOMIC_ACQUIRE );
+	for ( item = head; item; item = RQ_NEXT( rq, item ))
+		n++;
+	__atomic_sub_fetch( &rq->rq_count, n, __ATOMIC_RELAXED );
+#else
+	ldap_pvt_thread_mutex_lock( &rq->rq_mutex );
+	head = rq->rq_head;
+	rq->rq_head = NULL;
+	rq->rq_count = 0;
+	ldap_pvt_thread_mutex_unlock( &rq->rq_mutex );
+#endif
+	return head;
+}
+
+/*
+ * Buffers of incoming PDUs.  A BerElement from slap_iobuf_ber_alloc()
+ * has memory context SLAP_IOBUF_READ, so liblber gets its buffer from
+ * slap_iobuf_malloc(), rounded up to a size class.  Once the PDU is
+ * read, slap_iobuf_ber_detach() switches it to SLAP_IOBUF_DONE, which
+ * allocates plainly but tells slap_iobuf_ber_free() the buffer is ours.
+ * The buffers are plain heap blocks and can be freed as such, but
+ * slap_iobuf_ber_free() recycles buffer and BerElement: into a small
+ * per-thread cache, else into slap_iobuf_q[] for any thread to take.
+ */
+#define SLAP_IOBUF_SIZE(c)	((ber_len_t) 64 << (2*(c)))
+#define SLAP_IOBUF_LOCAL	8	/* items per class in a thread's cache */
+
+typedef struct slap_iobuf_cache {
+	void	*ic_head[SLAP_IOBUF_NCLASS + 1];
+	int	ic_count[SLAP_IOBUF_NCLASS + 1];
+} slap_iobuf_cache;
+
+static int
+slap_iobuf_class( ber_len_t size )
+{
+	int c;
+
+	for ( c = 0; c < SLAP_IOBUF_NCLASS; c++ ) {
+		if ( size <= SLAP_IOBUF_SIZE( c ))
+			return c;
+	}
+	return -1;
+}
+
+static void
+slap_iobuf_cache_free( void *key, void *data )
+{
+	slap_iobuf_cache *ic = data;
+	void *ptr;
+	int c;
+
+	for ( c = 0; c <= SLAP_IOBUF_NCLASS; c++ ) {
+		while (( ptr = ic->ic_head[c] ) != NULL ) {
+			ic->ic_head[c] = *(void **) ptr;
+			ber_memfree_x( ptr, NULL );
+		}
+	}
+	ber_memfree_x( ic, NULL );
+}
+
+static slap_iobuf_cache *
+slap_iobuf_cache_get( void )
+{
+	void *ctx = ldap_pvt_thread_pool_context(), *data = NULL;
+
+	if ( !ctx )
+		return NULL;
+	ldap_pvt_thread_pool_getkey( ctx, (void *) slap_iobuf_cache_get,
+		&data, NULL );
+	if ( !data ) {
+		data = ber_memcalloc_x( 1, sizeof( slap_iobuf_cache ), NULL );
+		if ( data && ldap_pvt_thread_pool_setkey( ctx,
+			(void *) slap_iobuf_cache_get, data, slap_iobuf_cache_free,
+			NULL, NULL ))
+		{
+			ber_memfree_x( data, NULL );
+			data = NULL;
+		}
+	}
+	return data;
+}
+
+/* Get an item of class c (NCLASS: a BerElement) from the caches */
+static void *
+slap_iobuf_get( int c )
+{
+	slap_iobuf_cache *ic = slap_iobuf_cache_get();
+	void *ptr;
+
+	if ( !ic )
+		return NULL;
+	if ( !ic->ic_head[c] ) {
+		ic->ic_head[c] = slap_retq_take( &slap_iobuf_q[c] );
+		for ( ptr = ic->ic_head[c]; ptr; ptr = *(void **) ptr )
+			ic->ic_count[c]++;
+	}
+	ptr = ic->ic_head[c];
+	if ( ptr ) {
+		ic->ic_head[c] = *(void **) ptr;
+		ic->ic_count[c]--;
+	}
+	return ptr;
+}
+
+static void
+slap_iobuf_put( int c, void *ptr )
+{
+	slap_iobuf_cache *ic = slap_iobuf_cache_get();
+
+	if ( ic && ic->ic_count[c] < SLAP_IOBUF_LOCAL ) {
+		*(void **) ptr = ic->ic_head[c];
+		ic->ic_head[c] = ptr;
+		ic->ic_count[c]++;
+	} else if ( slap_retq_put( &slap_iobuf_q[c], ptr )) {
+		ber_memfree_x( ptr, NULL );
+	}
+}
+
+static void *
+slap_iobuf_malloc( ber_len_t size )
+{
+	int c = slap_iobuf_class( size );
+	void *ptr;
+
+	if ( c < 0 )
+		return ber_memalloc_x( size, NULL );
+	ptr = slap_iobuf_get( c );
+	if ( !ptr )
+		ptr = ber_memalloc_x( SLAP_IOBUF_SIZE( c ), NULL );
+	return ptr;
+}
+
+BerElement *
+slap_iobuf_ber_alloc( void )
+{
+	BerElement *ber;
+	void *memctx = SLAP_IOBUF_READ;
+
+	if ( No_sl_malloc )
+		return ber_alloc();
+
+	ber = slap_iobuf_get( SLAP_IOBUF_NCLASS );
+	if ( ber ) {
+		ber_init2( ber, NULL, 0 );
+	} else if (( ber = ber_alloc()) == NULL ) {
+		return NULL;
+	}
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &memctx );
+	return ber;
+}
+
+/* Done reading into ber, or done with the memory context set to parse it */
+void
+slap_iobuf_ber_detach( BerElement *ber )
+{
+	void *memctx = No_sl_malloc ? NULL : SLAP_IOBUF_DONE;
+
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &memctx );
+}
+
+void
+slap_iobuf_ber_free( BerElement *ber )
+{
+	void *memctx = NULL;
+	ber_len_t len = 0;
+	int c;
+
+	ber_get_option( ber, LBER_OPT_BER_MEMCTX, &memctx );
+	if ( memctx != SLAP_IOBUF_READ && memctx != SLAP_IOBUF_DONE ) {
+		ber_free( ber, 1 );
+		return;
+	}
+
+	/* The buffer was allocated for the whole PDU plus a NUL */
+	ber_get_option( ber, LBER_OPT_BER_TOTAL_BYTES, &len );
+	c = slap_iobuf_class( len + 1 );
+	memctx = c < 0 ? NULL : &slap_iobuf_ctx[c];
+	ber_set_option( ber, LBER_OPT_BER_MEMCTX, &memctx );
+	ber_free_buf( ber );
+	slap_iobuf_put( SLAP_IOBUF_NCLASS, ber );
+}
+
+void
+slap_iobuf_destroy( void )
+{
+	void *ptr, *next;
+	int c;
+
+	for ( c = 0; c <= SLAP_IOBUF_NCLASS; c++ ) {
+		for ( ptr = slap_retq_take( &slap_iobuf_q[c] ); ptr; ptr = next ) {
+			next = *(void **) ptr;
+			ber_memfree_x( ptr, NULL );
+		}
+		slap_retq_destroy( &slap_iobuf_q[c] );
+	}
+}
+
 static struct slab_object *
 slap_replenish_sopool(
     struct slab_heap* sh
@@ -139,6 +139,11 @@ LDAP_BEGIN_DECL
 #define SLAP_SB_MAX_INCOMING_DEFAULT ((1<<18) - 1)
 #define SLAP_SB_MAX_INCOMING_AUTH ((1<<24) - 1)
 
+/* search entries are coalesced into writes of up to this size,
+ * held back for up to about this many microseconds */
+#define SLAP_SB_COALESCE_SIZE	(1<<15)
+#define SLAP_SB_COALESCE_USEC	10000L
+
 #define SLAP_CONN_MAX_PENDING_DEFAULT	100
 #define SLAP_CONN_MAX_PENDING_AUTH	1000
 
@@ -1556,6 +1561,9 @@ typedef struct AccessControl {
 	/* "by" part: list of who has what access to the entries */
 	Access	*acl_access;
 
+	int		acl_flags;
+#define	ACL_F_SHARED	0x01	/* "by" part does not depend on the entry */
+
 	struct AccessControl	*acl_next;
 } AccessControl;
 
@@ -1700,8 +1708,20 @@ struct slap_limits_set {
 	int	lms_s_pr;
 	int	lms_s_pr_hide;
 	int	lms_s_pr_total;
+
+	/* thread pool priority class */
+	int	lms_prio;
 };
 
+/* Thread pool priority classes of operations; SLAP_PRIO_DEFAULT
+ * defers to the next less specific setting
+ */
+#define SLAP_PRIO_DEFAULT	0
+#define SLAP_PRIO_HIGH		1
+#define SLAP_PRIO_NORMAL	2
+#define SLAP_PRIO_LOW		3
+#define SLAP_PRIO2POOL(p)	((p) - SLAP_PRIO_HIGH)
+
 /* Note: this is different from LDAP_NO_LIMIT (0); slapd internal use only */
 #define SLAP_NO_LIMIT			-1
 #define SLAP_MAX_LIMIT			2147483647
@@ -1953,6 +1973,12 @@ struct BackendDB {
 
 #define SLAP_DISALLOW_AUX_WO_CR		0x4000U
 
+	slap_mask_t	be_opprio;	/* priority class per operation type */
+#define SLAP_OPPRIO_BITS	2
+#define SLAP_OPPRIO_MASK	0x3U
+#define SLAP_OPPRIO(be, opidx) \
+	(((be)->be_opprio >> ((opidx) * SLAP_OPPRIO_BITS)) & SLAP_OPPRIO_MASK)
+
 	slap_mask_t	be_requires;	/* pre-operation requirements */
 #define SLAP_REQUIRE_BIND		0x0001U	/* bind before op */
 #define SLAP_REQUIRE_LDAP_V3	0x0002U	/* LDAPv3 before op */
@@ -2210,6 +2236,27 @@ typedef int (BI_op_txn) LDAP_P(( Operation *op, int txnop, struct OpExtra **ptr
 #define SLAP_TXN_COMMIT	2
 #define SLAP_TXN_ABORT	3
 
+/* Private records kept by overlays in their database's own storage.
+ * bi_aux_open returns a handle for a named record set. bi_aux_put
+ * stores one record, or deletes it when data is NULL. bi_aux_walk hands
+ * the records from the first key >= from (or the first key if from is
+ * NULL) to func in key order; func returns 0 to continue or a mask of
+ * SLAP_AUX_* flags. Both run in the write txn op holds in the database,
+ * if any, so the records commit or abort with the op's own changes.
+ * Otherwise bi_aux_put uses a txn of its own, and bi_aux_walk reads the
+ * op's snapshot; without an op, both use a write txn of their own.
+ */
+typedef int (BI_aux_func) LDAP_P(( void *arg, struct berval *key,
+	struct berval *data ));
+#define SLAP_AUX_STOP	0x01	/* don't hand over any more records */
+#define SLAP_AUX_DELETE	0x02	/* delete this record, needs a write txn */
+typedef int (BI_aux_open) LDAP_P(( BackendDB *be, const char *name,
+	void **aux ));
+typedef int (BI_aux_put) LDAP_P(( BackendDB *be, Operation *op, void *aux,
+	struct berval *key, struct berval *data ));
+typedef int (BI_aux_walk) LDAP_P(( BackendDB *be, Operation *op, void *aux,
+	struct berval *from, BI_aux_func *func, void *arg ));
+
 typedef int (BI_conn_func) LDAP_P(( BackendDB *bd, Connection *c ));
 typedef BI_conn_func BI_connection_init;
 typedef BI_conn_func BI_connection_destroy;
@@ -2308,6 +2355,9 @@ struct BackendInfo {
 	BI_chk_referrals	*bi_chk_referrals;
 	BI_chk_controls		*bi_chk_controls;
 	BI_op_txn			*bi_op_txn;
+	BI_aux_open			*bi_aux_open;
+	BI_aux_put			*bi_aux_put;
+	BI_aux_walk			*bi_aux_walk;
 	BI_entry_get_rw		*bi_entry_get_rw;
 	BI_entry_release_rw	*bi_entry_release_rw;
 
@@ -2406,6 +2456,7 @@ typedef int (slap_response)( Operation *, SlapReply * );
 
 struct slap_callback;
 typedef void (slap_writewait)( Operation *, struct slap_callback * );
+typedef int (slap_precommit)( Operation *, struct slap_callback * );
 
 typedef struct slap_callback {
 	struct slap_callback *sc_next;
@@ -2413,6 +2464,7 @@ typedef struct slap_callback {
 	slap_response *sc_cleanup;
 	void *sc_private;
 	slap_writewait *sc_writewait;
+	slap_precommit *sc_precommit;
 } slap_callback;
 
 struct slap_overinfo;
@@ -2489,6 +2541,17 @@ typedef struct GroupAssertion {
 	char ga_ndn[1];
 } GroupAssertion;
 
+/* default size of the shared group cache, see groupcache.c */
+#define SLAP_GROUPCACHE_MAX	10000
+
+/* default number of slots of the verified password cache, see passwd.c */
+#define SLAP_PWCACHE_SIZE	1024
+
+/* types of questions kept in the shared group cache */
+#define SLAP_GC_GROUP	'G'	/* static group membership */
+#define SLAP_GC_ATTR	'A'	/* attribute values, without access control */
+#define SLAP_GC_AUTHZ	'S'	/* SASL authz group rule */
+
 struct slap_control_ids {
 	int sc_LDAPsync;
 	int sc_assert;
@@ -2574,6 +2637,8 @@ typedef struct Opheader {
 
 	slap_counters_t	*oh_counters;
 
+	unsigned long	oh_gcgen;	/* group cache generation at start */
+
 	char		oh_log_prefix[ /* sizeof("conn= op=") + 2*LDAP_PVT_INTTYPE_CHARS(unsigned long) */ SLAP_TEXT_BUFLEN ];
 
 #ifdef LDAP_SLAPI
@@ -2621,6 +2686,7 @@ struct Operation {
 #define o_tmpmemctx o_hdr->oh_tmpmemctx
 #define o_tmpmfuncs o_hdr->oh_tmpmfuncs
 #define o_counters o_hdr->oh_counters
+#define o_gcgen o_hdr->oh_gcgen
 
 #define	o_tmpalloc	o_tmpmfuncs->bmf_malloc
 #define o_tmpcalloc	o_tmpmfuncs->bmf_calloc
@@ -2711,6 +2777,10 @@ struct Operation {
 #define get_no_schema_check(op)			((op)->o_no_schema_check)
 	char o_no_subordinate_glue;
 #define get_no_subordinate_glue(op)		((op)->o_no_subordinate_glue)
+	char o_prio;	/* class the limits give the identity */
+	char o_dbprio;	/* class of the operation type in its database,
+			 * SLAP_PRIO_DEFAULT if it reached none;
+			 * see backend_op_prio() */
 
 #define SLAP_CONTROL_NONE	0
 #define SLAP_CONTROL_IGNORED	1
@@ -2936,6 +3006,11 @@ struct Connection {
 	char		c_writing;		/* someone is writing */
 
 	char		c_sasl_bind_in_progress;	/* multi-op bind in progress */
+	/* priority classes, protected by c_mutex; see connection_prio() */
+	char		c_prio;		/* class the limits give the identity */
+	char		c_dbprio;	/* class c_lastop had in its database */
+	char		c_lastop;	/* slap_op_t of the last request */
+	char		c_readprio;	/* pool class of the pending read */
 	char		c_writewaiter;	/* true if blocked on write */
 
 
@@ -3021,6 +3096,7 @@ struct Listener {
 #endif
 	int	sl_mute;	/* Listener is temporarily disabled due to emfile */
 	int	sl_busy;	/* Listener is busy (accept thread activated) */
+	int	sl_shard;	/* 1 + SO_REUSEPORT shard index, 0 if not sharded */
 	ber_socket_t sl_sd;
 	Sockaddr sl_sa;
 #define sl_addr	sl_sa.sa_in_addr
@@ -3076,6 +3152,36 @@ typedef int (*SLAP_ENTRY_INFO_FN) LDAP_P(( void *arg, Entry *e ));
 
 #define SLAP_SLAB_SIZE	(1024*1024)
 #define SLAP_SLAB_STACK 1
+#define SLAP_SLAB_CHAIN	4	/* default max extra slabs per context */
+
+/* Per memory context statistics, see slap_sl_mem_stats() */
+typedef struct slap_sl_stats {
+	ber_len_t	ss_size;	/* size of the primary slab */
+	ber_len_t	ss_hiwat;	/* peak slab usage, chained slabs included */
+	unsigned long	ss_reused;	/* blocks taken from the free lists */
+	unsigned long	ss_chained;	/* extra slabs allocated */
+	unsigned long	ss_fallback;	/* allocations passed to ch_malloc */
+} slap_sl_stats_t;
+
+typedef int (SLAP_SL_STATS_FN) LDAP_P(( slap_sl_stats_t *ss, void *arg ));
+
+#if defined(__GNUC__) && defined(__ATOMIC_ACQ_REL)
+#define SLAP_RETQ_ATOMIC	1
+#endif
+
+/* Return queue: any thread may put a free item on it, a thread
+ * wanting items takes the whole queue at once, see sl_malloc.c */
+typedef struct slap_retq {
+	void		*rq_head;
+	int		rq_count;
+	int		rq_max;
+	size_t		rq_linkoff;	/* offset of the item's next pointer */
+#ifndef SLAP_RETQ_ATOMIC
+	ldap_pvt_thread_mutex_t	rq_mutex;
+#endif
+} slap_retq;
+
+#define SLAP_IOBUF_NCLASS	5	/* buffer size classes, 64 to 16K bytes */
 
 #define SLAP_ZONE_ALLOC 1
 #undef SLAP_ZONE_ALLOC
@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 
+#include <ac/stdarg.h>
 #include <ac/stdlib.h>
 #include <ac/ctype.h>
 #include <ac/string.h>
@@ -1157,12 +1158,302 @@ slap_tool_update_ctxcsn_init(void)
 	return 0;
 }
 
+/* LDIF input pipeline.
+ *
+ * Records live in a ring of slots, indexed by their sequence number in
+ * the input. A parse thread takes the pipe lock, reads the next chunk
+ * of records into free slots, and parses them after dropping the lock.
+ * The caller consumes the slots strictly in sequence, so the backend
+ * still sees the records in input order no matter which thread parsed
+ * them. Without parse threads, each record is read and parsed by the
+ * caller on demand.
+ */
+#ifndef SLAP_TOOL_PIPE_CHUNK
+#define SLAP_TOOL_PIPE_CHUNK	32	/* records read at a time */
+#endif
+#ifndef SLAP_TOOL_PIPE_DEPTH
+#define SLAP_TOOL_PIPE_DEPTH	4	/* chunks queued per thread */
+#endif
+
+enum {
+	TR_FREE = 0,	/* slot is unused */
+	TR_READ,	/* read, being parsed */
+	TR_PARSED,	/* ready for the caller */
+	TR_TAKEN	/* owned by the caller */
+};
+
+static struct slap_tool_pipe {
+	slap_tool_rec *tp_recs;
+	unsigned long tp_nrecs;
+	unsigned long tp_next;		/* sequence number of the next read */
+	unsigned long tp_head;		/* sequence number of the next get */
+	unsigned long tp_lineno;	/* last line read so far */
+	int tp_eof;
+	int tp_readrc;			/* 0 on EOF, -1 on read failure */
+	int tp_stop;
+	int tp_nthreads;
+	ldap_pvt_thread_t *tp_threads;
+	ldap_pvt_thread_mutex_t tp_mutex;
+	ldap_pvt_thread_cond_t tp_room;	/* a chunk of slots was freed */
+	ldap_pvt_thread_cond_t tp_ready;	/* a record was parsed */
+	SLAP_TOOL_PARSE *tp_parse;
+	SLAP_TOOL_RELEASE *tp_release;
+	OperationBuffer tp_opbuf;	/* for unthreaded parsing */
+} slap_tool_pipe;
+
+/* Append a diagnostic to a record still owned by the pipe, so that
+ * messages come out in input order. Anything else goes to stderr.
+ */
+void
+slap_tool_printf( slap_tool_rec *tr, const char *fmt, ... )
+{
+	va_list ap;
+	size_t room;
+	int len;
+
+	if ( tr == NULL || tr->tr_state == TR_TAKEN ) {
+		va_start( ap, fmt );
+		vfprintf( stderr, fmt, ap );
+		va_end( ap );
+		return;
+	}
+
+	for (;;) {
+		room = tr->tr_msgsize - tr->tr_msglen;
+		va_start( ap, fmt );
+		len = vsnprintf( tr->tr_msg ? tr->tr_msg + tr->tr_msglen : NULL,
+			room, fmt, ap );
+		va_end( ap );
+		if ( len < 0 )
+			break;
+		if ( (size_t)len < room ) {
+			tr->tr_msglen += len;
+			break;
+		}
+		tr->tr_msgsize = tr->tr_msglen + len + 256;
+		tr->tr_msg = ch_realloc( tr->tr_msg, tr->tr_msgsize );
+	}
+}
+
+/* Read up to n records into the slots following tp_next.
+ * Must be called with the pipe locked.
+ */
+static int
+slap_tool_pipe_read( struct slap_tool_pipe *tp, int n )
+{
+	slap_tool_rec *tr;
+	int i = 0, rc;
+
+	while ( i < n && !tp->tp_eof ) {
+		tr = &tp->tp_recs[ ( tp->tp_next + i ) % tp->tp_nrecs ];
+		tr->tr_lineno = tp->tp_lineno + 1;
+		rc = ldif_read_record( ldiffp, &tp->tp_lineno,
+			&tr->tr_buf, &tr->tr_lmax );
+		if ( rc < 1 ) {
+			tp->tp_eof = 1;
+			tp->tp_readrc = rc < 0 ? -1 : 0;
+			break;
+		}
+		if ( tr->tr_lineno < jumpline )
+			continue;
+		tr->tr_nextline = tp->tp_lineno;
+		tr->tr_offset = ftello( ldiffp->fp );
+		tr->tr_rc = 0;
+		tr->tr_private = NULL;
+		tr->tr_msglen = 0;
+		tr->tr_state = TR_READ;
+		i++;
+	}
+	tp->tp_next += i;
+	return i;
+}
+
+static void *
+slap_tool_pipe_task( void *ctx )
+{
+	struct slap_tool_pipe *tp = ctx;
+	OperationBuffer opbuf;
+	Operation *op;
+	slap_tool_rec *tr;
+	unsigned long seq;
+	int i, n;
+
+	memset( &opbuf, 0, sizeof(opbuf) );
+	op = &opbuf.ob_op;
+	op->o_hdr = &opbuf.ob_hdr;
+	op->o_bd = be;
+
+	ldap_pvt_thread_mutex_lock( &tp->tp_mutex );
+	for (;;) {
+		while ( !tp->tp_stop && !tp->tp_eof &&
+			tp->tp_nrecs - ( tp->tp_next - tp->tp_head ) < SLAP_TOOL_PIPE_CHUNK )
+			ldap_pvt_thread_cond_wait( &tp->tp_room, &tp->tp_mutex );
+		if ( tp->tp_stop || tp->tp_eof )
+			break;
+
+		seq = tp->tp_next;
+		n = slap_tool_pipe_read( tp, SLAP_TOOL_PIPE_CHUNK );
+		ldap_pvt_thread_mutex_unlock( &tp->tp_mutex );
+
+		for ( i = 0; i < n; i++ ) {
+			tr = &tp->tp_recs[ ( seq + i ) % tp->tp_nrecs ];
+			tr->tr_rc = tp->tp_parse( op, tr );
+		}
+
+		ldap_pvt_thread_mutex_lock( &tp->tp_mutex );
+		for ( i = 0; i < n; i++ )
+			tp->tp_recs[ ( seq + i ) % tp->tp_nrecs ].tr_state = TR_PARSED;
+		ldap_pvt_thread_cond_signal( &tp->tp_ready );
+	}
+	/* let the others notice EOF, and the caller too if we read it */
+	ldap_pvt_thread_cond_broadcast( &tp->tp_room );
+	ldap_pvt_thread_cond_signal( &tp->tp_ready );
+	ldap_pvt_thread_mutex_unlock( &tp->tp_mutex );
+
+	return NULL;
+}
+
+int
+slap_tool_pipe_open(
+	SLAP_TOOL_PARSE *parse,
+	SLAP_TOOL_RELEASE *release,
+	int nthreads )
+{
+	struct slap_tool_pipe *tp = &slap_tool_pipe;
+	int i;
+
+	memset( tp, 0, sizeof(*tp) );
+	tp->tp_parse = parse;
+	tp->tp_release = release;
+	tp->tp_nrecs = nthreads > 0 ?
+		nthreads * SLAP_TOOL_PIPE_CHUNK * SLAP_TOOL_PIPE_DEPTH : 1;
+	tp->tp_recs = ch_calloc( tp->tp_nrecs, sizeof(slap_tool_rec) );
+
+	if ( nthreads < 1 ) {
+		tp->tp_opbuf.ob_op.o_hdr = &tp->tp_opbuf.ob_hdr;
+		tp->tp_opbuf.ob_op.o_bd = be;
+		return 0;
+	}
+
+	ldap_pvt_thread_mutex_init( &tp->tp_mutex );
+	ldap_pvt_thread_cond_init( &tp->tp_room );
+	ldap_pvt_thread_cond_init( &tp->tp_ready );
+	tp->tp_threads = ch_calloc( nthreads, sizeof(ldap_pvt_thread_t) );
+	for ( i = 0; i < nthreads; i++ ) {
+		if ( ldap_pvt_thread_create( &tp->tp_threads[i], 0,
+			slap_tool_pipe_task, tp ))
+			break;
+	}
+	tp->tp_nthreads = i;
+	if ( i == 0 ) {
+		slap_tool_pipe_close();
+		return -1;
+	}
+	return 0;
+}
+
+/* returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ * -2: parse failure
+ */
+int
+slap_tool_pipe_get( slap_tool_rec **trp )
+{
+	struct slap_tool_pipe *tp = &slap_tool_pipe;
+	slap_tool_rec *tr;
+
+	for (;;) {
+		tr = &tp->tp_recs[ tp->tp_head % tp->tp_nrecs ];
+		if ( tp->tp_nthreads ) {
+			ldap_pvt_thread_mutex_lock( &tp->tp_mutex );
+			while ( tr->tr_state != TR_PARSED &&
+				!( tp->tp_eof && tp->tp_head == tp->tp_next ))
+				ldap_pvt_thread_cond_wait( &tp->tp_ready, &tp->tp_mutex );
+			ldap_pvt_thread_mutex_unlock( &tp->tp_mutex );
+			if ( tr->tr_state != TR_PARSED )
+				return tp->tp_readrc;
+		} else {
+			if ( !slap_tool_pipe_read( tp, 1 ))
+				return tp->tp_readrc;
+			tr->tr_rc = tp->tp_parse( &tp->tp_opbuf.ob_op, tr );
+		}
+
+		tr->tr_state = TR_TAKEN;
+		if ( tr->tr_msglen ) {
+			fputs( tr->tr_msg, stderr );
+			tr->tr_msglen = 0;
+		}
+		if ( tr->tr_rc == 0 ) {
+			*trp = tr;
+			return 1;
+		}
+		slap_tool_pipe_done( tr );
+		if ( tr->tr_rc < 0 )
+			return -2;
+	}
+}
+
+/* Give a record's slot back; its parse output now belongs to the caller */
+void
+slap_tool_pipe_done( slap_tool_rec *tr )
+{
+	struct slap_tool_pipe *tp = &slap_tool_pipe;
+
+	tr->tr_private = NULL;
+	if ( !tp->tp_nthreads ) {
+		tr->tr_state = TR_FREE;
+		tp->tp_head++;
+		return;
+	}
+
+	ldap_pvt_thread_mutex_lock( &tp->tp_mutex );
+	tr->tr_state = TR_FREE;
+	tp->tp_head++;
+	if ( tp->tp_nrecs - ( tp->tp_next - tp->tp_head ) >= SLAP_TOOL_PIPE_CHUNK )
+		ldap_pvt_thread_cond_signal( &tp->tp_room );
+	ldap_pvt_thread_mutex_unlock( &tp->tp_mutex );
+}
+
+void
+slap_tool_pipe_close( void )
+{
+	struct slap_tool_pipe *tp = &slap_tool_pipe;
+	slap_tool_rec *tr;
+	unsigned long i;
+	int j;
+
+	if ( tp->tp_threads ) {
+		ldap_pvt_thread_mutex_lock( &tp->tp_mutex );
+		tp->tp_stop = 1;
+		ldap_pvt_thread_cond_broadcast( &tp->tp_room );
+		ldap_pvt_thread_mutex_unlock( &tp->tp_mutex );
+		for ( j = 0; j < tp->tp_nthreads; j++ )
+			ldap_pvt_thread_join( tp->tp_threads[j], NULL );
+		ch_free( tp->tp_threads );
+		ldap_pvt_thread_cond_destroy( &tp->tp_ready );
+		ldap_pvt_thread_cond_destroy( &tp->tp_room );
+		ldap_pvt_thread_mutex_destroy( &tp->tp_mutex );
+	}
+
+	for ( i = 0; i < tp->tp_nrecs; i++ ) {
+		tr = &tp->tp_recs[i];
+		if ( tr->tr_state == TR_PARSED && tr->tr_private && tp->tp_release )
+			tp->tp_release( tr );
+		ch_free( tr->tr_buf );
+		ch_free( tr->tr_msg );
+	}
+	ch_free( tp->tp_recs );
+	memset( tp, 0, sizeof(*tp) );
+}
+
 int
 slap_tool_entry_check(
 	const char *progname,
 	Operation *op,
 	Entry *e,
-	int lineno,
+	slap_tool_rec *tr,
 	const char **text,
 	char *textbuf,
 	size_t textlen )
@@ -1174,8 +1465,8 @@ slap_tool_entry_check(
 		slap_schema.si_ad_objectClass );
 
 	if( oc == NULL ) {
-		fprintf( stderr, "%s: dn=\"%s\" (line=%d): %s\n",
-			progname, e->e_dn, lineno,
+		slap_tool_printf( tr, "%s: dn=\"%s\" (line=%lu): %s\n",
+			progname, e->e_dn, tr->tr_lineno,
 			"no objectClass attribute");
 		return LDAP_NO_SUCH_ATTRIBUTE;
 	}
@@ -1188,8 +1479,8 @@ slap_tool_entry_check(
 			text, textbuf, textlen );
 
 		if( rc != LDAP_SUCCESS ) {
-			fprintf( stderr, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
-				progname, e->e_dn, lineno, rc, *text );
+			slap_tool_printf( tr, "%s: dn=\"%s\" (line=%lu): (%d) %s\n",
+				progname, e->e_dn, tr->tr_lineno, rc, *text );
 			return rc;
 		}
 		textbuf[ 0 ] = '\0';
@@ -1200,8 +1491,8 @@ slap_tool_entry_check(
 
 		int rc = slap_entry2mods( e, &ml, text, textbuf, textlen );
 		if ( rc != LDAP_SUCCESS ) {
-			fprintf( stderr, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
-				progname, e->e_dn, lineno, rc, *text );
+			slap_tool_printf( tr, "%s: dn=\"%s\" (line=%lu): (%d) %s\n",
+				progname, e->e_dn, tr->tr_lineno, rc, *text );
 			return rc;
 		}
 		textbuf[ 0 ] = '\0';
@@ -1209,8 +1500,8 @@ slap_tool_entry_check(
 		rc = slap_mods_check( op, ml, text, textbuf, textlen, NULL );
 		slap_mods_free( ml, 1 );
 		if ( rc != LDAP_SUCCESS ) {
-			fprintf( stderr, "%s: dn=\"%s\" (line=%d): (%d) %s\n",
-				progname, e->e_dn, lineno, rc, *text );
+			slap_tool_printf( tr, "%s: dn=\"%s\" (line=%lu): (%d) %s\n",
+				progname, e->e_dn, tr->tr_lineno, rc, *text );
 			return rc;
 		}
 		textbuf[ 0 ] = '\0';
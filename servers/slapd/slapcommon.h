@@ -20,6 +20,20 @@
 #define SLAPD_TOOLS 1
 #include "slap.h"
 
+#ifdef _WIN32
+# ifdef __WIN64__
+# define ftello(fp)	_ftelli64(fp)
+# else
+/* Ideally we would use _ftelli64 but that was only available
+ * starting in MSVCR80.DLL. The approach used here is inaccurate
+ * because returning the underlying file handle's file pointer
+ * doesn't take the stdio buffer offset into account. But, it
+ * works with all versions of MSVCRT.
+ */
+# define ftello(fp)	_telli64(fileno(fp))
+# endif
+#endif
+
 enum slaptool {
 	SLAPADD=1,	/* LDIF -> database tool */
 	SLAPCAT,	/* database -> LDIF tool */
@@ -127,11 +141,51 @@ unsigned long slap_tool_update_ctxcsn_check LDAP_P((
 
 int slap_tool_update_ctxcsn_init LDAP_P((void));
 
+/* LDIF input pipeline for slapadd and slapmodify: records are read
+ * in chunks, handed to a set of parse threads and delivered back to
+ * the caller in input order.
+ */
+typedef struct slap_tool_rec {
+	unsigned long tr_lineno;	/* first line of the record */
+	unsigned long tr_nextline;	/* last line of the record */
+	size_t tr_offset;		/* input offset after the record */
+	char *tr_buf;			/* LDIF text */
+	int tr_lmax;
+	int tr_state;
+	int tr_rc;			/* parse result */
+	void *tr_private;		/* parse output */
+	char *tr_msg;			/* deferred diagnostics */
+	size_t tr_msglen;
+	size_t tr_msgsize;
+} slap_tool_rec;
+
+/* parse a record; returns 0 if done, 1 to skip it, -2 on failure */
+typedef int (SLAP_TOOL_PARSE) LDAP_P(( Operation *op, slap_tool_rec *tr ));
+/* dispose of the parse output of a record that was never consumed */
+typedef void (SLAP_TOOL_RELEASE) LDAP_P(( slap_tool_rec *tr ));
+
+int slap_tool_pipe_open LDAP_P((
+	SLAP_TOOL_PARSE *parse,
+	SLAP_TOOL_RELEASE *release,
+	int nthreads ));
+
+int slap_tool_pipe_get LDAP_P((
+	slap_tool_rec **trp ));
+
+void slap_tool_pipe_done LDAP_P((
+	slap_tool_rec *tr ));
+
+void slap_tool_pipe_close LDAP_P((void));
+
+void slap_tool_printf LDAP_P((
+	slap_tool_rec *tr,
+	const char *fmt, ... )) LDAP_GCCATTR((format(printf, 2, 3)));
+
 int slap_tool_entry_check LDAP_P((
 	const char *progname,
 	Operation *op,
 	Entry *e,
-	int lineno,
+	slap_tool_rec *tr,
 	const char **text,
 	char *textbuf,
 	size_t textlen ));
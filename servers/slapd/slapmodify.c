@@ -41,15 +41,287 @@
 extern int slap_DN_strict;	/* dn.c */
 
 static char csnbuf[ LDAP_PVT_CSNSTR_BUFSIZE ];
+static const char *progname = "slapmodify";
+
+/* A change record, as prepared by the parse stage */
+typedef struct Mrec {
+	ber_tag_t mr_op;
+	char *mr_request;
+	struct berval mr_dn;
+	struct berval mr_ndn;
+	Modification *mr_mods;
+	int mr_nmods;
+} Mrec;
+
+static void
+mrec_free( Mrec *mr )
+{
+	int n;
+
+	for ( n = 0; n < mr->mr_nmods; n++ ) {
+		ber_bvarray_free( mr->mr_mods[ n ].sm_values );
+		ber_bvarray_free( mr->mr_mods[ n ].sm_nvalues );
+	}
+	ch_free( mr->mr_mods );
+	ch_free( mr->mr_dn.bv_val );
+	SLAP_FREE( mr->mr_ndn.bv_val );
+	ch_free( mr );
+}
+
+/* Parse stage, run by the pipe threads: decode the LDIF change record,
+ * normalize its DN and prepare the values of its modifications.
+ * Nothing here depends on the database contents.
+ */
+static int
+slapmodify_parse( Operation *op, slap_tool_rec *tr )
+{
+	const char *text;
+	BackendDB *bd;
+	struct berval rbuf;
+	LDIFRecord lr;
+	Mrec *mr;
+	int n;
+	int local_rc;
+	int rc = -2;
+
+	ber_str2bv( tr->tr_buf, 0, 0, &rbuf );
+
+	local_rc = ldap_parse_ldif_record( &rbuf, tr->tr_lineno, &lr,
+		"slapmodify", LDIF_NO_CONTROLS );
+
+	if ( local_rc != LDAP_SUCCESS ) {
+		slap_tool_printf( tr, "%s: could not parse entry (line=%lu)\n",
+			progname, tr->tr_lineno );
+		return -2;
+	}
+
+	mr = ch_calloc( 1, sizeof( Mrec ) );
+	mr->mr_op = lr.lr_op;
+
+	switch ( lr.lr_op ) {
+	case LDAP_REQ_ADD:
+		mr->mr_request = "add";
+		break;
+
+	case LDAP_REQ_MODIFY:
+		mr->mr_request = "modify";
+		break;
+
+	case LDAP_REQ_DELETE:
+		if ( be->be_entry_delete )
+		{
+			mr->mr_request = "delete";
+			break;
+		}
+		/* backend does not support delete, fallthru */
+
+	case LDAP_REQ_MODRDN:
+		slap_tool_printf( tr, "%s: request 0x%lx not supported (line=%lu)\n",
+			progname, (unsigned long)lr.lr_op, tr->tr_lineno );
+		goto cleanup;
+
+	default:
+		/* record skipped e.g. version: or comment or something we don't handle yet */
+		rc = 1;
+		goto cleanup;
+	}
+
+	local_rc = dnNormalize( 0, NULL, NULL, &lr.lr_dn, &mr->mr_ndn, NULL );
+	if ( local_rc != LDAP_SUCCESS ) {
+		slap_tool_printf( tr, "%s: DN=\"%s\" normalization failed (line=%lu)\n",
+			progname, lr.lr_dn.bv_val, tr->tr_lineno );
+		goto cleanup;
+	}
+
+	/* make sure the DN is not empty */
+	if( BER_BVISEMPTY( &mr->mr_ndn ) &&
+		!BER_BVISEMPTY( be->be_nsuffix ))
+	{
+		slap_tool_printf( tr, "%s: line %lu: "
+			"%s entry with empty dn=\"\"",
+			progname, tr->tr_lineno, mr->mr_request );
+		bd = select_backend( &mr->mr_ndn, nosubordinates );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
+			}
+
+			assert( bdtmp != NULL );
+			
+			slap_tool_printf( tr, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
+
+		}
+		slap_tool_printf( tr, "\n" );
+		goto cleanup;
+	}
+
+	/* check backend */
+	bd = select_backend( &mr->mr_ndn, nosubordinates );
+	if ( bd != be ) {
+		slap_tool_printf( tr, "%s: line %lu: "
+			"database #%d (%s) not configured to hold \"%s\"",
+			progname, tr->tr_lineno,
+			dbnum,
+			be->be_suffix[0].bv_val,
+			lr.lr_dn.bv_val );
+		if ( bd ) {
+			BackendDB *bdtmp;
+			int dbidx = 0;
+			LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
+				if ( bdtmp == bd ) break;
+				dbidx++;
+			}
+
+			assert( bdtmp != NULL );
+			
+			slap_tool_printf( tr, "; did you mean to use database #%d (%s)?",
+				dbidx,
+				bd->be_suffix[0].bv_val );
+
+		} else {
+			slap_tool_printf( tr, "; no database configured for that naming context" );
+		}
+		slap_tool_printf( tr, "\n" );
+		goto cleanup;
+	}
+
+	if ( lr.lrop_mods ) {
+		for ( n = 0; lr.lrop_mods[ n ] != NULL; n++ )
+			;
+		mr->mr_mods = ch_calloc( n + 1, sizeof( Modification ) );
+
+		for ( n = 0; lr.lrop_mods[ n ] != NULL; n++ ) {
+			LDAPMod *mod = lr.lrop_mods[ n ];
+			Modification *mods = &mr->mr_mods[ n ];
+			unsigned i = 0;
+			int bin = (mod->mod_op & LDAP_MOD_BVALUES);
+			int pretty = 0;
+			int normalize = 0;
+
+			mr->mr_nmods = n + 1;
+
+			local_rc = slap_str2ad( mod->mod_type, &mods->sm_desc, &text );
+			if ( local_rc != LDAP_SUCCESS ) {
+				slap_tool_printf( tr, "%s: slap_str2ad(\"%s\") failed for entry \"%s\" (%d: %s, lineno=%lu)\n",
+					progname, mod->mod_type, lr.lr_dn.bv_val, local_rc, text, tr->tr_lineno );
+				goto cleanup;
+			}
+
+			mods->sm_type = mods->sm_desc->ad_cname;
+
+			if ( mods->sm_desc->ad_type->sat_syntax->ssyn_pretty ) {
+				pretty = 1;
+
+			} else {
+				assert( mods->sm_desc->ad_type->sat_syntax->ssyn_validate != NULL );
+			}
+
+			if ( mods->sm_desc->ad_type->sat_equality &&
+				mods->sm_desc->ad_type->sat_equality->smr_normalize )
+			{
+				normalize = 1;
+			}
+
+			if ( bin && mod->mod_bvalues ) {
+				for ( i = 0; mod->mod_bvalues[ i ] != NULL; i++ )
+					;
+
+			} else if ( !bin && mod->mod_values ) {
+				for ( i = 0; mod->mod_values[ i ] != NULL; i++ )
+					;
+			}
+
+			if ( i != 0 )
+			{
+				mods->sm_values = ch_calloc( sizeof( struct berval ), i + 1 );
+				if ( normalize ) {
+					mods->sm_nvalues = ch_calloc( sizeof( struct berval ), i + 1 );
+				} else {
+					mods->sm_nvalues = NULL;
+				}
+			}
+			mods->sm_numvals = i;
+
+			for ( i = 0; i < mods->sm_numvals; i++ ) {
+				struct berval bv;
+
+				if ( bin ) {
+					bv = *mod->mod_bvalues[ i ];
+				} else {
+					ber_str2bv( mod->mod_values[ i ], 0, 0, &bv );
+				}
+
+				if ( pretty ) {
+					local_rc = ordered_value_pretty( mods->sm_desc,
+					&bv, &mods->sm_values[i], NULL );
+
+				} else {
+					local_rc = ordered_value_validate( mods->sm_desc,
+						&bv, 0 );
+				}
+
+				if ( local_rc != LDAP_SUCCESS ) {
+					slap_tool_printf( tr, "%s: DN=\"%s\": unable to %s attr=%s value #%d\n",
+						progname, lr.lr_dn.bv_val, pretty ? "prettify" : "validate",
+						mods->sm_desc->ad_cname.bv_val, i );
+					/* handle error */
+					goto cleanup;
+				}
+
+				if ( !pretty ) {
+					ber_dupbv( &mods->sm_values[i], &bv );
+				}
+
+				if ( normalize ) {
+					local_rc = ordered_value_normalize(
+						SLAP_MR_VALUE_OF_ATTRIBUTE_SYNTAX,
+						mods->sm_desc,
+						mods->sm_desc->ad_type->sat_equality,
+						&mods->sm_values[i], &mods->sm_nvalues[i],
+						NULL );
+					if ( local_rc != LDAP_SUCCESS ) {
+						slap_tool_printf( tr, "%s: DN=\"%s\": unable to normalize attr=%s value #%d\n",
+							progname, lr.lr_dn.bv_val, mods->sm_desc->ad_cname.bv_val, i );
+						/* handle error */
+						goto cleanup;
+					}
+				}
+			}
+
+			mods->sm_op = (mod->mod_op & ~LDAP_MOD_BVALUES);
+			mods->sm_flags = 0;
+		}
+	}
+
+	/* the record buffer will be reused, keep our own copy of the DN */
+	ber_dupbv( &mr->mr_dn, &lr.lr_dn );
+	tr->tr_private = mr;
+	rc = 0;
+
+cleanup:;
+	ldap_ldif_record_done( &lr );
+	if ( rc )
+		mrec_free( mr );
+	return rc;
+}
+
+static void
+slapmodify_release( slap_tool_rec *tr )
+{
+	mrec_free( tr->tr_private );
+}
 
 int
 slapmodify( int argc, char **argv )
 {
-	char *buf = NULL;
 	const char *text;
 	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
 	size_t textlen = sizeof textbuf;
-	const char *progname = "slapmodify";
 
 	struct berval csn;
 	unsigned long sid;
@@ -57,10 +329,10 @@ slapmodify( int argc, char **argv )
 	ID id;
 	OperationBuffer opbuf;
 	Operation *op;
+	slap_tool_rec *tr;
 
 	int checkvals, ldifrc;
-	unsigned long lineno, nextline;
-	int lmax;
+	unsigned long lineno;
 	int rc = EXIT_SUCCESS;
 
 	int enable_meter = 0;
@@ -97,9 +369,6 @@ slapmodify( int argc, char **argv )
 
 	checkvals = (slapMode & SLAP_TOOL_QUICK) ? 0 : 1;
 
-	lmax = 0;
-	nextline = 0;
-
 	/* enforce schema checking unless not disabled and allow unknown
 	 * attributes otherwise */
 	if ( (slapMode & SLAP_TOOL_NO_SCHEMA_CHECK) == 0) {
@@ -132,30 +401,32 @@ slapmodify( int argc, char **argv )
 		enable_meter = 0;
 	}
 
-	/* nextline is the line number of the end of the current entry */
-	for( lineno=1; ( ldifrc = ldif_read_record( ldiffp, &nextline, &buf, &lmax )) > 0;
-		lineno=nextline+1 )
+	if ( slap_tool_pipe_open( slapmodify_parse, slapmodify_release,
+		slap_tool_thread_max - 1 ))
 	{
-		BackendDB *bd;
+		fprintf( stderr, "%s: could not start LDIF parse threads.\n",
+			progname );
+		exit( EXIT_FAILURE );
+	}
+
+	for (;;) {
 		Entry *e_orig = NULL, *e = NULL;
-		struct berval rbuf;
-		LDIFRecord lr;
-		struct berval ndn = BER_BVNULL;
+		Mrec *mr;
 		int n;
-		int is_oc = 0;
-		int local_rc;
-		int mod_err = 0;
-		char *request = "(unknown)";
-
-		ber_str2bv( buf, 0, 0, &rbuf );
-
-		if ( lineno < jumpline )
-			continue;
+		int local_rc = LDAP_SUCCESS;
 
+		ldifrc = slap_tool_pipe_get( &tr );
+		if ( ldifrc < 1 ) {
+			if ( ldifrc == -2 ) {
+				rc = EXIT_FAILURE;
+				if ( continuemode ) continue;
+			}
+			break;
+		}
+		mr = tr->tr_private;
+		lineno = tr->tr_lineno;
 		if ( enable_meter )
-			lutil_meter_update( &meter,
-					 ftell( ldiffp->fp ),
-					 0);
+			lutil_meter_update( &meter, tr->tr_offset, 0 );
 
 		/*
 		 * Initialize text buffer
@@ -164,126 +435,20 @@ slapmodify( int argc, char **argv )
 		bvtext.bv_val = textbuf;
 		bvtext.bv_val[0] = '\0';
 
-		local_rc = ldap_parse_ldif_record( &rbuf, lineno, &lr,
-			"slapmodify", LDIF_NO_CONTROLS );
-
-		if ( local_rc != LDAP_SUCCESS ) {
-			fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
-				progname, lineno );
-			rc = EXIT_FAILURE;
-			if( continuemode ) continue;
-			break;
-		}
-
-		switch ( lr.lr_op ) {
-		case LDAP_REQ_ADD:
-			request = "add";
-			break;
-
-		case LDAP_REQ_MODIFY:
-			request = "modify";
-			break;
-
-		case LDAP_REQ_DELETE:
-			if ( be->be_entry_delete )
-			{
-				request = "delete";
-				break;
-			}
-			/* backend does not support delete, fallthru */
-
-		case LDAP_REQ_MODRDN:
-			fprintf( stderr, "%s: request 0x%lx not supported (line=%lu)\n",
-				progname, (unsigned long)lr.lr_op, lineno );
-			rc = EXIT_FAILURE;
-			goto cleanup;
-
-		default:
-			/* record skipped e.g. version: or comment or something we don't handle yet */
-			goto cleanup;
-		}
-
-		local_rc = dnNormalize( 0, NULL, NULL, &lr.lr_dn, &ndn, NULL );
-		if ( local_rc != LDAP_SUCCESS ) {
-			fprintf( stderr, "%s: DN=\"%s\" normalization failed (line=%lu)\n",
-				progname, lr.lr_dn.bv_val, lineno );
-			rc = EXIT_FAILURE;
-			goto cleanup;
-		}
-
-		/* make sure the DN is not empty */
-		if( BER_BVISEMPTY( &ndn ) &&
-			!BER_BVISEMPTY( be->be_nsuffix ))
-		{
-			fprintf( stderr, "%s: line %lu: "
-				"%s entry with empty dn=\"\"",
-				progname, lineno, request );
-			bd = select_backend( &ndn, nosubordinates );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
-
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
-
-			}
-			fprintf( stderr, "\n" );
-			rc = EXIT_FAILURE;
-			goto cleanup;
-		}
-
-		/* check backend */
-		bd = select_backend( &ndn, nosubordinates );
-		if ( bd != be ) {
-			fprintf( stderr, "%s: line %lu: "
-				"database #%d (%s) not configured to hold \"%s\"",
-				progname, lineno,
-				dbnum,
-				be->be_suffix[0].bv_val,
-				lr.lr_dn.bv_val );
-			if ( bd ) {
-				BackendDB *bdtmp;
-				int dbidx = 0;
-				LDAP_STAILQ_FOREACH( bdtmp, &backendDB, be_next ) {
-					if ( bdtmp == bd ) break;
-					dbidx++;
-				}
-
-				assert( bdtmp != NULL );
-				
-				fprintf( stderr, "; did you mean to use database #%d (%s)?",
-					dbidx,
-					bd->be_suffix[0].bv_val );
-
-			} else {
-				fprintf( stderr, "; no database configured for that naming context" );
-			}
-			fprintf( stderr, "\n" );
-			rc = EXIT_FAILURE;
-			goto cleanup;
-		}
-
 		/* get id and/or entry */
-		switch ( lr.lr_op ) {
+		switch ( mr->mr_op ) {
 			case LDAP_REQ_ADD:
 				e = entry_alloc();
-				ber_dupbv( &e->e_name, &lr.lr_dn );
-				ber_dupbv( &e->e_nname, &ndn );
+				ber_dupbv( &e->e_name, &mr->mr_dn );
+				ber_dupbv( &e->e_nname, &mr->mr_ndn );
 				break;
 
 			//case LDAP_REQ_MODRDN:
 			case LDAP_REQ_DELETE:
 			case LDAP_REQ_MODIFY:
-				id = be->be_dn2id_get( be, &ndn );
+				id = be->be_dn2id_get( be, &mr->mr_ndn );
 				rc = (id == NOID);
-				if ( rc == LDAP_SUCCESS && lr.lr_op != LDAP_REQ_DELETE ) {
+				if ( rc == LDAP_SUCCESS && mr->mr_op != LDAP_REQ_DELETE ) {
 					e_orig = be->be_entry_get( be, id );
 					if ( e_orig )
 						e = entry_dup( e_orig );
@@ -294,156 +459,50 @@ slapmodify( int argc, char **argv )
 
 		if ( rc != LDAP_SUCCESS ) {
 			fprintf( stderr, "%s: no such entry \"%s\" in database (lineno=%lu)\n",
-				progname, ndn.bv_val, lineno );
+				progname, mr->mr_ndn.bv_val, lineno );
 			rc = EXIT_FAILURE;
 			goto cleanup;
 		}
 
-		if ( lr.lrop_mods ) {
-			for ( n = 0; lr.lrop_mods && lr.lrop_mods[ n ] != NULL; n++ ) {
-				LDAPMod *mod = lr.lrop_mods[ n ];
-				Modification mods = { 0 };
-				unsigned i = 0;
-				int bin = (mod->mod_op & LDAP_MOD_BVALUES);
-				int pretty = 0;
-				int normalize = 0;
-
-				local_rc = slap_str2ad( mod->mod_type, &mods.sm_desc, &text );
-				if ( local_rc != LDAP_SUCCESS ) {
-					fprintf( stderr, "%s: slap_str2ad(\"%s\") failed for entry \"%s\" (%d: %s, lineno=%lu)\n",
-						progname, mod->mod_type, lr.lr_dn.bv_val, local_rc, text, lineno );
-					rc = EXIT_FAILURE;
-					goto cleanup;
-				}
-
-				mods.sm_type = mods.sm_desc->ad_cname;
+		if ( mr->mr_mods ) {
+			for ( n = 0; n < mr->mr_nmods; n++ ) {
+				Modification *mods = &mr->mr_mods[ n ];
 
-				if ( mods.sm_desc->ad_type->sat_syntax->ssyn_pretty ) {
-					pretty = 1;
-
-				} else {
-					assert( mods.sm_desc->ad_type->sat_syntax->ssyn_validate != NULL );
-				}
-
-				if ( mods.sm_desc->ad_type->sat_equality &&
-					mods.sm_desc->ad_type->sat_equality->smr_normalize )
-				{
-					normalize = 1;
-				}
-
-				if ( bin && mod->mod_bvalues ) {
-					for ( i = 0; mod->mod_bvalues[ i ] != NULL; i++ )
-						;
-
-				} else if ( !bin && mod->mod_values ) {
-					for ( i = 0; mod->mod_values[ i ] != NULL; i++ )
-						;
-				}
-
-				if ( i != 0 )
-				{
-					mods.sm_values = ch_calloc( sizeof( struct berval ), i + 1 );
-					if ( normalize ) {
-						mods.sm_nvalues = ch_calloc( sizeof( struct berval ), i + 1 );
-					} else {
-						mods.sm_nvalues = NULL;
-					}
-				}
-				mods.sm_numvals = i;
-
-				for ( i = 0; i < mods.sm_numvals; i++ ) {
-					struct berval bv;
-
-					if ( bin ) {
-						bv = *mod->mod_bvalues[ i ];
-					} else {
-						ber_str2bv( mod->mod_values[ i ], 0, 0, &bv );
-					}
-
-					if ( pretty ) {
-						local_rc = ordered_value_pretty( mods.sm_desc,
-						&bv, &mods.sm_values[i], NULL );
-
-					} else {
-						local_rc = ordered_value_validate( mods.sm_desc,
-							&bv, 0 );
-					}
-
-					if ( local_rc != LDAP_SUCCESS ) {
-						fprintf( stderr, "%s: DN=\"%s\": unable to %s attr=%s value #%d\n",
-							progname, e->e_dn, pretty ? "prettify" : "validate",
-							mods.sm_desc->ad_cname.bv_val, i );
-						/* handle error */
-						rc = EXIT_FAILURE;
-						ber_bvarray_free( mods.sm_values );
-						ber_bvarray_free( mods.sm_nvalues );
-						goto cleanup;
-					}
-
-					if ( !pretty ) {
-						ber_dupbv( &mods.sm_values[i], &bv );
-					}
-
-					if ( normalize ) {
-						local_rc = ordered_value_normalize(
-							SLAP_MR_VALUE_OF_ATTRIBUTE_SYNTAX,
-							mods.sm_desc,
-							mods.sm_desc->ad_type->sat_equality,
-							&mods.sm_values[i], &mods.sm_nvalues[i],
-							NULL );
-						if ( local_rc != LDAP_SUCCESS ) {
-							fprintf( stderr, "%s: DN=\"%s\": unable to normalize attr=%s value #%d\n",
-								progname, e->e_dn, mods.sm_desc->ad_cname.bv_val, i );
-							/* handle error */
-							rc = EXIT_FAILURE;
-							ber_bvarray_free( mods.sm_values );
-							ber_bvarray_free( mods.sm_nvalues );
-							goto cleanup;
-						}
-					}
-				}
-
-				mods.sm_op = (mod->mod_op & ~LDAP_MOD_BVALUES);
-				mods.sm_flags = 0;
-
-				if ( mods.sm_desc == slap_schema.si_ad_objectClass ) {
-					is_oc = 1;
-				}
-
-				switch ( mods.sm_op ) {
+				switch ( mods->sm_op ) {
 				case LDAP_MOD_ADD:
-					local_rc = modify_add_values( e, &mods,
+					local_rc = modify_add_values( e, mods,
 						0, &text, textbuf, textlen );
 					break;
 
 				case LDAP_MOD_DELETE:
-					local_rc = modify_delete_values( e, &mods,
+					local_rc = modify_delete_values( e, mods,
 						0, &text, textbuf, textlen );
 					break;
 
 				case LDAP_MOD_REPLACE:
-					local_rc = modify_replace_values( e, &mods,
+					local_rc = modify_replace_values( e, mods,
 						0, &text, textbuf, textlen );
 					break;
 
 				case LDAP_MOD_INCREMENT:
-					local_rc = modify_increment_values( e, &mods,
+					local_rc = modify_increment_values( e, mods,
 						0, &text, textbuf, textlen );
 					break;
-				}
 
-				ber_bvarray_free( mods.sm_values );
-				ber_bvarray_free( mods.sm_nvalues );
+				default:
+					local_rc = LDAP_OTHER;
+					break;
+				}
 
 				if ( local_rc != LDAP_SUCCESS ) {
 					fprintf( stderr, "%s: DN=\"%s\": unable to modify attr=%s\n",
-						progname, e->e_dn, mods.sm_desc->ad_cname.bv_val );
+						progname, e->e_dn, mods->sm_desc->ad_cname.bv_val );
 					rc = EXIT_FAILURE;
 					goto cleanup;
 				}
 			}
 
-			rc = slap_tool_entry_check( progname, op, e, lineno, &text, textbuf, textlen );
+			rc = slap_tool_entry_check( progname, op, e, tr, &text, textbuf, textlen );
 			if ( rc != LDAP_SUCCESS ) {
 				rc = EXIT_FAILURE;
 				goto cleanup;
@@ -554,7 +613,7 @@ slapmodify( int argc, char **argv )
 		/* check schema, objectClass etc */
 
 		if ( !dryrun ) {
-			switch ( lr.lr_op ) {
+			switch ( mr->mr_op ) {
 			case LDAP_REQ_ADD:
 				id = be->be_entry_put( be, e, &bvtext );
 				rc = (id == NOID);
@@ -566,14 +625,14 @@ slapmodify( int argc, char **argv )
 				break;
 
 			case LDAP_REQ_DELETE:
-				rc = be->be_entry_delete( be, &ndn, &bvtext );
+				rc = be->be_entry_delete( be, &mr->mr_ndn, &bvtext );
 				break;
 
 			}
 
 			if( rc != LDAP_SUCCESS ) {
 				fprintf( stderr, "%s: could not %s entry dn=\"%s\" "
-					"(line=%lu): %s\n", progname, request, ndn.bv_val,
+					"(line=%lu): %s\n", progname, mr->mr_request, mr->mr_ndn.bv_val,
 					lineno, bvtext.bv_val );
 				rc = EXIT_FAILURE;
 				goto cleanup;
@@ -583,21 +642,23 @@ slapmodify( int argc, char **argv )
 
 			if ( verbose )
 				fprintf( stderr, "%s: \"%s\" (%08lx)\n",
-					request, ndn.bv_val, (long) id );
+					mr->mr_request, mr->mr_ndn.bv_val, (long) id );
 		} else {
 			if ( verbose )
 				fprintf( stderr, "%s: \"%s\"\n",
-					request, ndn.bv_val );
+					mr->mr_request, mr->mr_ndn.bv_val );
 		}
 
 cleanup:;
-		ldap_ldif_record_done( &lr );
-		SLAP_FREE( ndn.bv_val );
+		slap_tool_pipe_done( tr );
+		mrec_free( mr );
 		if ( e ) entry_free( e );
 		if ( e_orig ) be_entry_release_w( op, e_orig );
 		if ( rc != LDAP_SUCCESS && !continuemode ) break;
 	}
 
+	slap_tool_pipe_close();
+
 	if ( ldifrc < 0 )
 		rc = EXIT_FAILURE;
 
@@ -614,8 +675,6 @@ cleanup:;
 		rc = slap_tool_update_ctxcsn( progname, sid, &bvtext );
 	}
 
-	ch_free( buf );
-
 	if ( !dryrun ) {
 		if ( enable_meter ) {
 			fprintf( stderr, "Closing DB..." );
@@ -146,6 +146,13 @@ typedef struct syncinfo_s {
 	int			si_strict_refresh;	/* stop listening during fallback refresh */
 	int			si_too_old;
 	int			si_is_configdb;
+	int			si_applythreads;
+	struct syncapply	*si_apply;
+	int			si_txnbatch;
+	int			si_txnbatchtime;
+	int			si_txncount;
+	time_t			si_txnstart;
+	OpExtra			*si_txn;
 	ber_int_t	si_msgid;
 	Avlnode			*si_presentlist;
 	LDAP			*si_ld;
@@ -1210,6 +1217,412 @@ get_pmutex(
 	return 0;
 }
 
+/* Parallel apply of refresh entries.
+ *
+ * During the refresh phase, entries without a cookie don't need to be
+ * committed in any particular order, except that a parent should be
+ * added before its children. With applythreads set, the consumer task
+ * keeps decoding messages and hands such entries to a set of queues,
+ * each drained by a pool task. Entries are assigned to queues by the
+ * RDN just below the search base, so each subtree is applied in the
+ * order it was received. Everything else (cookies, deletes, sync info
+ * messages, the base entry itself) first waits for the queues to empty
+ * and is then processed inline as before, which keeps the cookie from
+ * getting ahead of the changes it covers.
+ */
+#define SYNC_APPLY_BATCH	1024	/* drain at least this often */
+
+typedef struct syncapply_job {
+	struct syncapply_job	*sj_next;
+	Entry			*sj_entry;
+	Modifications		*sj_modlist;
+	int			sj_syncstate;
+	struct berval		sj_uuid;
+	char			sj_uuidbuf[UUIDLEN];
+} syncapply_job;
+
+#define SQ_IDLE		0
+#define SQ_SUBMITTED	1
+#define SQ_RUNNING	2
+
+typedef struct syncapply_queue {
+	struct syncapply	*sq_apply;
+	syncapply_job		*sq_head;
+	syncapply_job		**sq_tail;
+	int			sq_state;
+	void			*sq_cookie;
+} syncapply_queue;
+
+typedef struct syncapply {
+	syncinfo_t		*sa_si;
+	ldap_pvt_thread_mutex_t	sa_mutex;
+	ldap_pvt_thread_cond_t	sa_cond;
+	ldap_pvt_thread_mutex_t	sa_plmutex;	/* protects si_presentlist */
+	int			sa_busy;	/* queues not idle */
+	int			sa_count;	/* jobs since the last drain */
+	int			sa_pmutex;	/* holding cs_pmutex for the batch */
+	int			sa_err;
+	slap_ssf_t		sa_ssf;
+	int			sa_nqueues;
+	syncapply_queue		sa_queues[1];
+} syncapply;
+
+static syncapply *
+syncrepl_apply_init( syncinfo_t *si )
+{
+	syncapply *sa;
+	int i;
+
+	sa = ch_calloc( 1, sizeof( syncapply ) +
+		( si->si_applythreads - 1 ) * sizeof( syncapply_queue ));
+	sa->sa_si = si;
+	sa->sa_nqueues = si->si_applythreads;
+	for ( i = 0; i < sa->sa_nqueues; i++ ) {
+		sa->sa_queues[i].sq_apply = sa;
+		sa->sa_queues[i].sq_tail = &sa->sa_queues[i].sq_head;
+	}
+	ldap_pvt_thread_mutex_init( &sa->sa_mutex );
+	ldap_pvt_thread_cond_init( &sa->sa_cond );
+	ldap_pvt_thread_mutex_init( &sa->sa_plmutex );
+	return sa;
+}
+
+static void
+syncrepl_apply_free( syncapply *sa )
+{
+	assert( !sa->sa_busy );
+	ldap_pvt_thread_mutex_destroy( &sa->sa_plmutex );
+	ldap_pvt_thread_cond_destroy( &sa->sa_cond );
+	ldap_pvt_thread_mutex_destroy( &sa->sa_mutex );
+	ch_free( sa );
+}
+
+/* Pick the queue for an entry, or -1 if it must be applied inline */
+static int
+syncrepl_apply_slot(
+	syncinfo_t *si,
+	Entry *entry,
+	int syncstate,
+	struct berval *syncUUID )
+{
+	struct berval base, rdn;
+	unsigned hash = 2166136261U;
+	char *p;
+	ber_len_t i;
+
+	if ( !si->si_apply || si->si_refreshDone || si->si_is_configdb ||
+		si->si_syncdata == SYNCDATA_CHANGELOG )
+		return -1;
+
+	switch ( syncstate ) {
+	case LDAP_SYNC_PRESENT:
+		/* only recorded in the present list */
+		rdn = *syncUUID;
+		break;
+	case LDAP_SYNC_ADD:
+	case LDAP_SYNC_MODIFY:
+		if ( !entry )
+			return -1;
+		base = si->si_rewrite ? si->si_suffixm : si->si_base;
+		if ( entry->e_nname.bv_len <= base.bv_len ||
+			!dnIsSuffix( &entry->e_nname, &base ))
+			return -1;
+		/* the RDN right below the base; normalized DNs have
+		 * their separators escaped as hexpairs
+		 */
+		rdn = entry->e_nname;
+		if ( base.bv_len )
+			rdn.bv_len -= base.bv_len + 1;
+		p = ber_bvrchr( &rdn, ',' );
+		if ( p ) {
+			p++;
+			rdn.bv_len -= p - rdn.bv_val;
+			rdn.bv_val = p;
+		}
+		break;
+	default:
+		return -1;
+	}
+
+	for ( i = 0; i < rdn.bv_len; i++ ) {
+		hash ^= (unsigned char)rdn.bv_val[i];
+		hash *= 16777619U;
+	}
+	return hash % si->si_apply->sa_nqueues;
+}
+
+static int
+syncrepl_apply_job( syncinfo_t *si, Operation *op, syncapply_job *sj )
+{
+	struct berval syncUUID[2];
+	int rc;
+
+	/* syncrepl_entry frees the denormalized UUID from op's memctx */
+	syncUUID[0] = sj->sj_uuid;
+	BER_BVZERO( &syncUUID[1] );
+	if ( sj->sj_entry )
+		(void)slap_uuidstr_from_normalized( &syncUUID[1], &syncUUID[0], op->o_tmpmemctx );
+	rc = syncrepl_entry( si, op, sj->sj_entry, &sj->sj_modlist,
+		sj->sj_syncstate, syncUUID, NULL );
+	if ( sj->sj_modlist )
+		slap_mods_free( sj->sj_modlist, 1 );
+	ch_free( sj );
+	return rc;
+}
+
+/* Run the jobs of a queue, must be called with sa_mutex held */
+static void
+syncrepl_apply_run( syncapply_queue *sq, Operation *op )
+{
+	syncapply *sa = sq->sq_apply;
+	syncapply_job *sj;
+	int rc;
+
+	while (( sj = sq->sq_head )) {
+		sq->sq_head = sj->sj_next;
+		if ( !sq->sq_head )
+			sq->sq_tail = &sq->sq_head;
+		ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+		rc = syncrepl_apply_job( sa->sa_si, op, sj );
+		ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+		if ( rc && !sa->sa_err )
+			sa->sa_err = rc;
+	}
+	sq->sq_state = SQ_IDLE;
+	if ( !--sa->sa_busy )
+		ldap_pvt_thread_cond_signal( &sa->sa_cond );
+}
+
+static void *
+syncrepl_apply_task( void *ctx, void *arg )
+{
+	syncapply_queue *sq = arg;
+	syncapply *sa = sq->sq_apply;
+	syncinfo_t *si = sa->sa_si;
+	Connection conn = {0};
+	OperationBuffer opbuf;
+	Operation *op;
+
+	connection_fake_init( &conn, &opbuf, ctx );
+	op = &opbuf.ob_op;
+	/* same identity as the consumer task */
+	op->o_connid = SLAPD_SYNC_RID2SYNCCONN(si->si_rid);
+	op->o_managedsait = SLAP_CONTROL_NONCRITICAL;
+	if ( !si->si_schemachecking )
+		op->o_no_schema_check = 1;
+	op->o_bd = si->si_be;
+	op->o_dn = op->o_bd->be_rootdn;
+	op->o_ndn = op->o_bd->be_rootndn;
+	op->o_protocol = LDAP_VERSION3;
+	op->o_ssf = sa->sa_ssf;
+
+	ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+	sq->sq_state = SQ_RUNNING;
+	syncrepl_apply_run( sq, op );
+	ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+	return NULL;
+}
+
+/* Wait for all queued entries to be applied. Queues whose task didn't
+ * start yet are run here, so that a pending pool pause can't leave us
+ * waiting for a task that will never run. Returns the first error seen
+ * by the workers.
+ */
+static int
+syncrepl_apply_drain( syncinfo_t *si, Operation *op )
+{
+	syncapply *sa = si->si_apply;
+	int i, rc;
+
+	if ( !sa )
+		return LDAP_SUCCESS;
+
+	ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+	while ( sa->sa_busy ) {
+		for ( i = 0; i < sa->sa_nqueues; i++ ) {
+			syncapply_queue *sq = &sa->sa_queues[i];
+			if ( sq->sq_state == SQ_SUBMITTED && ( !sq->sq_cookie ||
+				ldap_pvt_thread_pool_retract( sq->sq_cookie ) > 0 )) {
+				sq->sq_state = SQ_RUNNING;
+				syncrepl_apply_run( sq, op );
+			}
+		}
+		if ( sa->sa_busy )
+			ldap_pvt_thread_cond_wait( &sa->sa_cond, &sa->sa_mutex );
+	}
+	rc = sa->sa_err;
+	sa->sa_err = 0;
+	sa->sa_count = 0;
+	ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+
+	if ( sa->sa_pmutex ) {
+		sa->sa_pmutex = 0;
+		ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
+	}
+	return rc;
+}
+
+/* Hand an entry to its queue. Takes ownership of entry and modlist. */
+static int
+syncrepl_apply_queue(
+	syncinfo_t *si,
+	Operation *op,
+	int slot,
+	Entry *entry,
+	Modifications *modlist,
+	int syncstate,
+	struct berval *syncUUID )
+{
+	syncapply *sa = si->si_apply;
+	syncapply_queue *sq = &sa->sa_queues[slot];
+	syncapply_job *sj;
+	int rc;
+
+	if ( sa->sa_count >= SYNC_APPLY_BATCH ) {
+		/* let other consumers of this DB get a turn */
+		rc = syncrepl_apply_drain( si, op );
+		if ( rc ) {
+			if ( entry )
+				entry_free( entry );
+			if ( modlist )
+				slap_mods_free( modlist, 1 );
+			return rc;
+		}
+	}
+	if ( !sa->sa_pmutex ) {
+		/* the whole batch is applied under the pending CSN mutex,
+		 * as a single entry would be */
+		if (( rc = get_pmutex( si ))) {
+			if ( entry )
+				entry_free( entry );
+			if ( modlist )
+				slap_mods_free( modlist, 1 );
+			return rc;
+		}
+		sa->sa_pmutex = 1;
+		sa->sa_ssf = op->o_ssf;
+	}
+
+	sj = ch_malloc( sizeof( syncapply_job ));
+	sj->sj_next = NULL;
+	sj->sj_entry = entry;
+	sj->sj_modlist = modlist;
+	sj->sj_syncstate = syncstate;
+	sj->sj_uuid.bv_val = sj->sj_uuidbuf;
+	sj->sj_uuid.bv_len = syncUUID[0].bv_len;
+	AC_MEMCPY( sj->sj_uuid.bv_val, syncUUID[0].bv_val, syncUUID[0].bv_len );
+
+	ldap_pvt_thread_mutex_lock( &sa->sa_mutex );
+	rc = sa->sa_err;
+	*sq->sq_tail = sj;
+	sq->sq_tail = &sj->sj_next;
+	sa->sa_count++;
+	if ( sq->sq_state == SQ_IDLE ) {
+		sq->sq_state = SQ_SUBMITTED;
+		sa->sa_busy++;
+		if ( ldap_pvt_thread_pool_submit2( &connection_pool,
+				syncrepl_apply_task, sq, &sq->sq_cookie ))
+			/* leave it to syncrepl_apply_drain */
+			sq->sq_cookie = NULL;
+	}
+	ldap_pvt_thread_mutex_unlock( &sa->sa_mutex );
+
+	return rc;
+}
+
+/* Batched refresh transactions.
+ *
+ * With txnbatch set, consecutive refresh entries that are applied by
+ * the consumer task itself share one backend transaction, using the
+ * same bi_op_txn hook as LDAP transactions. The batch holds the pending
+ * CSN mutex, like a single entry would, and is committed before any
+ * cookie is saved, so the stored contextCSN never covers uncommitted
+ * changes. A failed change aborts the whole batch; since the cookie
+ * wasn't advanced, the next refresh sends those entries again. The
+ * group cache drops what the batch wrote once more after the commit.
+ */
+static int
+syncrepl_txn_begin( syncinfo_t *si, Operation *op )
+{
+	BackendDB *be = op->o_bd;
+	int rc;
+
+	if ( si->si_txn )
+		return 0;
+
+	if (( rc = get_pmutex( si )))
+		return rc;
+
+	op->o_bd = si->si_wbe;
+	rc = op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_BEGIN, &si->si_txn );
+	if ( rc && si->si_txn ) {
+		LDAP_SLIST_REMOVE( &op->o_extra, si->si_txn, OpExtra, oe_next );
+		op->o_bd->bd_info->bi_op_txn( op, SLAP_TXN_ABORT, &si->si_txn );
+	}
+	op->o_bd = be;
+	if ( rc ) {
+		si->si_txn = NULL;
+		ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
+		Debug( LDAP_DEBUG_ANY, "syncrepl_txn_begin: %s "
+			"couldn't start DB transaction (%d)\n",
+			si->si_ridtxt, rc );
+		return LDAP_OTHER;
+	}
+	slap_group_cache_batch( op );
+	si->si_txncount = 0;
+	si->si_txnstart = slap_get_time();
+	return 0;
+}
+
+static int
+syncrepl_txn_end( syncinfo_t *si, Operation *op, int commit )
+{
+	BackendDB *be = op->o_bd;
+	int rc;
+
+	if ( !si->si_txn )
+		return 0;
+
+	LDAP_SLIST_REMOVE( &op->o_extra, si->si_txn, OpExtra, oe_next );
+	op->o_bd = si->si_wbe;
+	rc = op->o_bd->bd_info->bi_op_txn( op,
+		commit ? SLAP_TXN_COMMIT : SLAP_TXN_ABORT, &si->si_txn );
+	op->o_bd = be;
+	si->si_txn = NULL;
+	slap_group_cache_commit( op, commit && !rc );
+	ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
+
+	Debug( LDAP_DEBUG_SYNC, "syncrepl_txn_end: %s %s %d changes\n",
+		si->si_ridtxt, commit ? "committed" : "aborted", si->si_txncount );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "syncrepl_txn_end: %s "
+			"DB transaction commit failed (%d)\n",
+			si->si_ridtxt, rc );
+		rc = LDAP_OTHER;
+	}
+	return rc;
+}
+
+/* Can this entry be added to the current batch? */
+static int
+syncrepl_txn_batch( syncinfo_t *si )
+{
+	return si->si_txnbatch > 0 && !si->si_refreshDone &&
+		!si->si_apply && !si->si_is_configdb &&
+		si->si_wbe->bd_info->bi_op_txn != NULL;
+}
+
+/* Make sure everything received so far is committed */
+static int
+syncrepl_flush( syncinfo_t *si, Operation *op )
+{
+	int rc = syncrepl_txn_end( si, op, 1 );
+
+	if ( !rc )
+		rc = syncrepl_apply_drain( si, op );
+	return rc;
+}
+
 static int
 do_syncrep2(
 	Operation *op,
@@ -1231,6 +1644,8 @@ do_syncrep2(
 	int				m;
 
 	struct timeval tout = { 0, 0 };
+	/* keep reading while changes are pending */
+	struct timeval busy_tout = { 0, 100000 };
 
 	int		refreshDeletes = 0;
 	char empty[6] = "empty";
@@ -1247,8 +1662,13 @@ do_syncrep2(
 
 	slap_dup_sync_cookie( &syncCookie_req, &si->si_syncCookie );
 
+	if ( si->si_applythreads > 1 && !si->si_apply )
+		si->si_apply = syncrepl_apply_init( si );
+
 	while ( ( rc = ldap_result( si->si_ld, si->si_msgid, LDAP_MSG_ONE,
-		&tout, &msg ) ) > 0 )
+		( si->si_txn || ( si->si_apply && si->si_apply->sa_count )) ?
+			&busy_tout : &tout,
+		&msg ) ) > 0 )
 	{
 		int				match, punlock, syncstate;
 		struct berval	*retdata, syncUUID[2], cookie = BER_BVNULL;
@@ -1265,6 +1685,9 @@ do_syncrep2(
 			goto done;
 		}
 		si->si_lastcontact = slap_get_time();
+		if ( ldap_msgtype( msg ) != LDAP_RES_SEARCH_ENTRY &&
+			( rc = syncrepl_flush( si, op )))
+			goto done;
 		switch( ldap_msgtype( msg ) ) {
 		case LDAP_RES_SEARCH_ENTRY:
 #ifdef LDAP_CONTROL_X_DIRSYNC
@@ -1372,6 +1795,11 @@ do_syncrep2(
 			}
 			punlock = -1;
 			if ( ber_peek_tag( ber, &len ) == LDAP_TAG_SYNC_COOKIE ) {
+				/* everything before this cookie must be committed first */
+				if (( rc = syncrepl_flush( si, op ))) {
+					ldap_controls_free( rctrls );
+					goto done;
+				}
 				if ( ber_scanf( ber, /*"{"*/ "m}", &cookie ) != LBER_ERROR ) {
 
 				Debug( LDAP_DEBUG_SYNC, "do_syncrep2: %s cookie=%s\n",
@@ -1468,18 +1896,45 @@ logerr:
 			} else if ( ( rc = syncrepl_message_to_entry( si, op, msg,
 				&modlist, &entry, syncstate, syncUUID ) ) == LDAP_SUCCESS )
 			{
-				if ( punlock < 0 ) {
-					if (( rc = get_pmutex( si )))
-						goto done;
-				}
-				if ( ( rc = syncrepl_entry( si, op, entry, &modlist,
-					syncstate, syncUUID, syncCookie.ctxcsn ) ) == LDAP_SUCCESS &&
-					syncCookie.ctxcsn )
-				{
-					rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+				int slot = punlock < 0 ?
+					syncrepl_apply_slot( si, entry, syncstate, syncUUID ) : -1;
+
+				if ( slot >= 0 ) {
+					rc = syncrepl_apply_queue( si, op, slot, entry, modlist,
+						syncstate, syncUUID );
+					modlist = NULL;
+					slap_sl_free( syncUUID[1].bv_val, op->o_tmpmemctx );
+					BER_BVZERO( &syncUUID[1] );
+				} else {
+					int batch = punlock < 0 && syncrepl_txn_batch( si );
+
+					if ( batch ) {
+						if (( rc = syncrepl_txn_begin( si, op ))) {
+							ldap_controls_free( rctrls );
+							goto done;
+						}
+					} else if ( punlock < 0 ) {
+						if (( rc = syncrepl_flush( si, op )) ||
+							( rc = get_pmutex( si ))) {
+							ldap_controls_free( rctrls );
+							goto done;
+						}
+					}
+					if ( ( rc = syncrepl_entry( si, op, entry, &modlist,
+						syncstate, syncUUID, syncCookie.ctxcsn ) ) == LDAP_SUCCESS &&
+						syncCookie.ctxcsn )
+					{
+						rc = syncrepl_updateCookie( si, op, &syncCookie, 0 );
+					}
+					if ( batch ) {
+						if ( rc != LDAP_SUCCESS )
+							syncrepl_txn_end( si, op, 0 );
+						else if ( ++si->si_txncount >= si->si_txnbatch ||
+							slap_get_time() - si->si_txnstart >= si->si_txnbatchtime )
+							rc = syncrepl_txn_end( si, op, 1 );
+					} else if ( punlock < 0 )
+						ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 				}
-				if ( punlock < 0 )
-					ldap_pvt_thread_mutex_unlock( &si->si_cookieState->cs_pmutex );
 			}
 			if ( punlock >= 0 ) {
 				/* on failure, revert pending CSN */
@@ -1875,6 +2330,8 @@ logerr:
 		ldap_msgfree( msg );
 		msg = NULL;
 		if ( ldap_pvt_thread_pool_pausing( &connection_pool )) {
+			if (( rc = syncrepl_flush( si, op )))
+				goto done;
 			slap_sync_cookie_free( &syncCookie, 0 );
 			slap_sync_cookie_free( &syncCookie_req, 0 );
 			return SYNC_PAUSED;
@@ -1888,6 +2345,9 @@ logerr:
 	}
 
 done:
+	if (( m = syncrepl_flush( si, op )) && !rc )
+		rc = m;
+
 	if ( err != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
 			"do_syncrep2: %s (%d) %s\n",
@@ -3919,7 +4379,11 @@ syncrepl_entry(
 
 	if (( syncstate == LDAP_SYNC_PRESENT || syncstate == LDAP_SYNC_ADD ) ) {
 		if ( !si->si_refreshPresent && !si->si_refreshDone ) {
+			if ( si->si_apply )
+				ldap_pvt_thread_mutex_lock( &si->si_apply->sa_plmutex );
 			syncuuid_inserted = presentlist_insert( si, syncUUID );
+			if ( si->si_apply )
+				ldap_pvt_thread_mutex_unlock( &si->si_apply->sa_plmutex );
 		}
 	}
 
@@ -5779,6 +6243,9 @@ syncinfo_free( syncinfo_t *sie, int free_all )
 			ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 		}
 
+		if ( sie->si_apply ) {
+			syncrepl_apply_free( sie->si_apply );
+		}
 		ldap_pvt_thread_mutex_destroy( &sie->si_mutex );
 		ldap_pvt_thread_mutex_destroy( &sie->si_monitor_mutex );
 
@@ -5952,6 +6419,9 @@ config_suffixm( ConfigArgs *c, syncinfo_t *si )
 #define SUFFIXMSTR		"suffixmassage"
 #define	STRICT_REFRESH	"strictrefresh"
 #define LAZY_COMMIT		"lazycommit"
+#define APPLYTHREADSSTR	"applythreads"
+#define TXNBATCHSTR		"txnbatch"
+#define TXNBATCHTIMESTR	"txnbatchtime"
 
 /* FIXME: undocumented */
 #define EXATTRSSTR		"exattrs"
@@ -6479,6 +6949,42 @@ parse_syncrepl_line(
 					STRLENOF( LAZY_COMMIT ) ) )
 		{
 			si->si_lazyCommit = 1;
+		} else if ( !strncasecmp( c->argv[ i ], APPLYTHREADSSTR "=",
+					STRLENOF( APPLYTHREADSSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( APPLYTHREADSSTR "=" );
+			if ( lutil_atoi( &si->si_applythreads, val ) != 0 ||
+				si->si_applythreads < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid apply threads value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+		} else if ( !strncasecmp( c->argv[ i ], TXNBATCHTIMESTR "=",
+					STRLENOF( TXNBATCHTIMESTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( TXNBATCHTIMESTR "=" );
+			if ( lutil_atoi( &si->si_txnbatchtime, val ) != 0 ||
+				si->si_txnbatchtime < 1 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid txn batch time value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
+		} else if ( !strncasecmp( c->argv[ i ], TXNBATCHSTR "=",
+					STRLENOF( TXNBATCHSTR "=" ) ) )
+		{
+			val = c->argv[ i ] + STRLENOF( TXNBATCHSTR "=" );
+			if ( lutil_atoi( &si->si_txnbatch, val ) != 0 ||
+				si->si_txnbatch < 0 ) {
+				snprintf( c->cr_msg, sizeof( c->cr_msg ),
+					"invalid txn batch size value \"%s\".\n",
+					val );
+				Debug( LDAP_DEBUG_ANY, "%s: %s.\n", c->log, c->cr_msg );
+				return 1;
+			}
 		} else if ( !bindconf_parse( c->argv[i], &si->si_bindconf ) ) {
 			si->si_got |= GOT_BINDCONF;
 		} else {
@@ -6988,6 +7494,7 @@ add_syncrepl(
 	si->si_manageDSAit = 0;
 	si->si_tlimit = 0;
 	si->si_slimit = 0;
+	si->si_txnbatchtime = 1;
 
 	si->si_presentlist = NULL;
 	LDAP_LIST_INIT( &si->si_nonpresentlist );
@@ -7294,6 +7801,24 @@ syncrepl_unparse( syncinfo_t *si, struct berval *bv )
 		ptr = lutil_strcopy( ptr, " " LAZY_COMMIT );
 	}
 
+	if ( si->si_applythreads ) {
+		len = snprintf( ptr, WHATSLEFT, " " APPLYTHREADSSTR "=%d", si->si_applythreads );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
+	if ( si->si_txnbatch ) {
+		len = snprintf( ptr, WHATSLEFT, " " TXNBATCHSTR "=%d", si->si_txnbatch );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
+	if ( si->si_txnbatchtime != 1 ) {
+		len = snprintf( ptr, WHATSLEFT, " " TXNBATCHTIMESTR "=%d", si->si_txnbatchtime );
+		if ( WHATSLEFT <= len ) return;
+		ptr += len;
+	}
+
 	bc.bv_len = ptr - buf;
 	bc.bv_val = buf;
 	ber_dupbv( bv, &bc );
@@ -295,6 +295,10 @@ int txn_end_extop(
 		if ( rc ) {
 			rs->sr_text = "transaction commit failed";
 			rc = LDAP_OTHER;
+		} else {
+			/* answers cached before the commit may be stale */
+			LDAP_STAILQ_FOREACH( o, &c->c_txn_ops, o_next )
+				slap_group_cache_written( o );
 		}
 	} else {
 		rs->sr_text = "transaction aborted";
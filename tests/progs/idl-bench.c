@@ -0,0 +1,312 @@
+/* idl-bench -- micro-benchmark for the back-mdb IDL kernels */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#include "idlsimd.h"
+
+/* Sizes of the candidate lists typically combined by AND/OR filters:
+ * a selective key against a big one, two mid-sized keys, and two
+ * slots near the default IDL size.
+ */
+static const unsigned default_sizes[][2] = {
+	{ 10, 60000 },
+	{ 500, 60000 },
+	{ 5000, 5000 },
+	{ 20000, 60000 },
+	{ 65535, 65535 },
+	{ 0, 0 }
+};
+
+static const char *progname = "idl-bench";
+
+static void
+usage( void )
+{
+	fprintf( stderr,
+		"usage: %s [-k scalar|sse4.2|avx2] [-a <size>] [-b <size>]\n"
+		"\t[-r <idrange>] [-l <loops>] [-s <seed>]\n"
+		"Without -a and -b, a default set of IDL sizes is measured.\n"
+		"Without -k, every kernel this CPU supports is measured.\n"
+		"Results are checked against a plain C version of each kernel.\n",
+		progname );
+	exit( EXIT_FAILURE );
+}
+
+static double
+now( void )
+{
+	struct timeval tv;
+
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int
+idcmp( const void *v1, const void *v2 )
+{
+	const ID *i1 = v1, *i2 = v2;
+
+	return ( *i1 > *i2 ) - ( *i1 < *i2 );
+}
+
+/* Fill ids with n distinct sorted IDs from 1..range */
+static void
+genids( ID *ids, unsigned n, ID range )
+{
+	unsigned i, j;
+
+	for ( i = 0; i < n; i++ )
+		ids[i] = 1 + (ID)( (double)rand() / ( (double)RAND_MAX + 1 ) * range );
+	qsort( ids, n, sizeof(ID), idcmp );
+	for ( i = j = 0; i < n; i++ ) {
+		if ( j == 0 || ids[i] != ids[j-1] )
+			ids[j++] = ids[i];
+	}
+	/* top up duplicates with fresh IDs past the range */
+	for ( ; j < n; j++ )
+		ids[j] = ids[j-1] + 1;
+}
+
+/* Straightforward versions of the kernels, to check them against */
+static unsigned
+ref_isect( ID *out, const ID *a, unsigned na, const ID *b, unsigned nb )
+{
+	unsigned i = 0, j = 0, n = 0;
+
+	while ( i < na && j < nb ) {
+		if ( a[i] < b[j] ) {
+			i++;
+		} else if ( a[i] > b[j] ) {
+			j++;
+		} else {
+			out[n++] = a[i];
+			i++;
+			j++;
+		}
+	}
+	return n;
+}
+
+static unsigned
+ref_merge( ID *out, const ID *a, unsigned na, const ID *b, unsigned nb )
+{
+	unsigned i = 0, j = 0, n = 0;
+
+	while ( i < na || j < nb ) {
+		if ( j == nb || ( i < na && a[i] < b[j] ) ) {
+			out[n++] = a[i++];
+		} else if ( i == na || b[j] < a[i] ) {
+			out[n++] = b[j++];
+		} else {
+			out[n++] = a[i++];
+			j++;
+		}
+	}
+	return n;
+}
+
+static unsigned
+ref_lb( const ID *ids, unsigned n, ID id )
+{
+	unsigned i;
+
+	for ( i = 0; i < n && ids[i] < id; i++ )
+		;
+	return i;
+}
+
+/* Compare a kernel's result with the reference, return 1 if it differs */
+static int
+check_ids( int kern, const char *what, const ID *ids, unsigned n,
+	const ID *ref, unsigned nref )
+{
+	unsigned i;
+
+	if ( n != nref ) {
+		fprintf( stderr, "%s: %s %s returned %u IDs, expected %u\n",
+			progname, mdb_idl_kern_name( kern ), what, n, nref );
+		return 1;
+	}
+	for ( i = 0; i < n; i++ ) {
+		if ( ids[i] != ref[i] ) {
+			fprintf( stderr, "%s: %s %s returned ID %lu at %u, expected %lu\n",
+				progname, mdb_idl_kern_name( kern ), what,
+				(unsigned long)ids[i], i, (unsigned long)ref[i] );
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Time the kernels on one pair of lists, return the number of
+ * results that differ from the reference */
+static int
+bench( int kern, unsigned na, unsigned nb, ID range, int loops )
+{
+	ID *a, *b, *out, *ref, *keys;
+	unsigned i, n = 0, nref, nkeys = 1000;
+	double t0, t_isect, t_merge, t_copy, t_lb;
+	unsigned long sum = 0;
+	int l, errors = 0;
+
+	a = malloc( na * sizeof(ID) );
+	b = malloc( nb * sizeof(ID) );
+	out = malloc( ( na + nb ) * sizeof(ID) );
+	ref = malloc( ( na + nb ) * sizeof(ID) );
+	keys = malloc( nkeys * sizeof(ID) );
+	if ( !a || !b || !out || !ref || !keys ) {
+		fprintf( stderr, "%s: out of memory\n", progname );
+		exit( EXIT_FAILURE );
+	}
+
+	genids( a, na, range );
+	genids( b, nb, range );
+	for ( i = 0; i < nkeys; i++ )
+		keys[i] = 1 + (ID)( (double)rand() / ( (double)RAND_MAX + 1 ) * range );
+
+	t0 = now();
+	for ( l = 0; l < loops; l++ )
+		n = mdb_idl_isect( out, a, na, b, nb );
+	t_isect = now() - t0;
+	nref = ref_isect( ref, a, na, b, nb );
+	errors += check_ids( kern, "intersection", out, n, ref, nref );
+
+	/* the merge works in place, so time the copy separately */
+	t0 = now();
+	for ( l = 0; l < loops; l++ )
+		memcpy( out, a, na * sizeof(ID) );
+	t_copy = now() - t0;
+	t0 = now();
+	for ( l = 0; l < loops; l++ ) {
+		memcpy( out, a, na * sizeof(ID) );
+		n = mdb_idl_merge( out, na, b, nb );
+	}
+	t_merge = now() - t0 - t_copy;
+	nref = ref_merge( ref, a, na, b, nb );
+	errors += check_ids( kern, "union", out, n, ref, nref );
+
+	t0 = now();
+	for ( l = 0; l < loops; l++ ) {
+		for ( i = 0; i < nkeys; i++ )
+			sum += mdb_idl_lb( a, na, keys[i] );
+	}
+	t_lb = now() - t0;
+	for ( i = 0; i < nkeys; i++ ) {
+		n = mdb_idl_lb( a, na, keys[i] );
+		nref = ref_lb( a, na, keys[i] );
+		if ( n != nref ) {
+			fprintf( stderr, "%s: %s search for %lu returned %u, expected %u\n",
+				progname, mdb_idl_kern_name( kern ),
+				(unsigned long)keys[i], n, nref );
+			errors++;
+			break;
+		}
+	}
+
+	printf( "%-8s %8u %8u %10.2f %10.2f %10.3f   (%lu)\n",
+		mdb_idl_kern_name( kern ), na, nb,
+		t_isect * 1000000.0 / loops, t_merge * 1000000.0 / loops,
+		t_lb * 1000000000.0 / loops / nkeys, sum & 1 );
+
+	free( keys );
+	free( ref );
+	free( out );
+	free( b );
+	free( a );
+	return errors;
+}
+
+int
+main( int argc, char **argv )
+{
+	unsigned na = 0, nb = 0;
+	unsigned sizes[2][2] = { { 0, 0 }, { 0, 0 } };
+	const unsigned (*cases)[2] = default_sizes;
+	ID range = 1000000;
+	int loops = 200, kern = MDB_IDL_KERN_BEST, best, k, i, c, errors = 0;
+	unsigned seed = 1;
+
+	while ( ( c = getopt( argc, argv, "a:b:k:l:r:s:" ) ) != EOF ) {
+		switch ( c ) {
+		case 'a':
+			na = strtoul( optarg, NULL, 0 );
+			break;
+		case 'b':
+			nb = strtoul( optarg, NULL, 0 );
+			break;
+		case 'k':
+			for ( kern = MDB_IDL_KERN_SCALAR; kern <= MDB_IDL_KERN_AVX2; kern++ ) {
+				if ( !strcasecmp( optarg, mdb_idl_kern_name( kern ) ) )
+					break;
+			}
+			if ( kern > MDB_IDL_KERN_AVX2 )
+				usage();
+			break;
+		case 'l':
+			loops = atoi( optarg );
+			break;
+		case 'r':
+			range = strtoul( optarg, NULL, 0 );
+			break;
+		case 's':
+			seed = strtoul( optarg, NULL, 0 );
+			break;
+		default:
+			usage();
+		}
+	}
+	if ( loops < 1 || range < 1 || ( !na != !nb ) )
+		usage();
+
+	if ( na ) {
+		sizes[0][0] = na;
+		sizes[0][1] = nb;
+		cases = (const unsigned (*)[2])sizes;
+	}
+
+	best = mdb_idl_kern_init( MDB_IDL_KERN_BEST );
+	if ( kern > best ) {
+		fprintf( stderr, "%s: %s kernels not supported here\n",
+			progname, mdb_idl_kern_name( kern ) );
+		exit( EXIT_FAILURE );
+	}
+
+	printf( "%-8s %8s %8s %10s %10s %10s\n",
+		"kernel", "na", "nb", "isect us", "union us", "search ns" );
+	for ( i = 0; cases[i][0]; i++ ) {
+		for ( k = MDB_IDL_KERN_SCALAR; k <= best; k++ ) {
+			if ( kern != MDB_IDL_KERN_BEST && k != kern )
+				continue;
+			mdb_idl_kern_init( k );
+			srand( seed + i );
+			errors += bench( k, cases[i][0], cases[i][1], range, loops );
+		}
+	}
+
+	if ( errors ) {
+		fprintf( stderr, "%s: %d results differ from the reference\n",
+			progname, errors );
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
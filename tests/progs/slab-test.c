@@ -0,0 +1,180 @@
+/* slab-test -- check marks and chained slabs of the slapd stack allocator */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2020 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdlib.h>
+#include <ac/string.h>
+
+#include "slap.h"
+
+/* sl_malloc.c is linked in on its own, provide what it needs of slapd */
+int slapMode = SLAP_SERVER_MODE;
+int slap_debug;
+int ldap_syslog;
+int ldap_syslog_level;
+
+void *
+ch_malloc( ber_len_t size )
+{
+	void *p = malloc( size );
+
+	if ( !p ) {
+		perror( "malloc" );
+		exit( EXIT_FAILURE );
+	}
+	return p;
+}
+
+void *
+ch_calloc( ber_len_t nelem, ber_len_t size )
+{
+	void *p = calloc( nelem, size );
+
+	if ( !p ) {
+		perror( "calloc" );
+		exit( EXIT_FAILURE );
+	}
+	return p;
+}
+
+void *
+ch_realloc( void *block, ber_len_t size )
+{
+	void *p = realloc( block, size );
+
+	if ( !p ) {
+		perror( "realloc" );
+		exit( EXIT_FAILURE );
+	}
+	return p;
+}
+
+void
+ch_free( void *ptr )
+{
+	free( ptr );
+}
+
+#define SLAB_SIZE	(64*1024)
+#define ROUNDS	10
+
+static int
+get_stats( slap_sl_stats_t *ss, void *arg )
+{
+	*(slap_sl_stats_t *)arg = *ss;
+	return 1;
+}
+
+/* Allocate size bytes filled with c, and check they are ours */
+static char *
+fill( void *ctx, ber_len_t size, int c )
+{
+	char *p = slap_sl_malloc( size, ctx );
+
+	memset( p, c, size );
+	if ( slap_sl_context( p ) != ctx ) {
+		fprintf( stderr, "block of %lu bytes not taken from the slabs\n",
+			(unsigned long)size );
+		exit( EXIT_FAILURE );
+	}
+	return p;
+}
+
+static int
+check( const char *p, ber_len_t size, int c )
+{
+	ber_len_t i;
+
+	for ( i = 0; i < size; i++ ) {
+		if ( (unsigned char)p[i] != c )
+			return 1;
+	}
+	return 0;
+}
+
+int
+main( int argc, char **argv )
+{
+	slap_sl_stats_t ss, ss0;
+	void *ctx, *mark;
+	char *a, *b;
+	int i, rc = 0;
+
+	ldap_pvt_thread_initialize();
+	slap_sl_mem_init();
+	slap_sl_chain_max = 2;
+	ctx = slap_sl_mem_create( SLAB_SIZE, SLAP_SLAB_STACK,
+		ldap_pvt_thread_pool_context(), 1 );
+
+	/* Mark an empty context: each round fills the primary slab and
+	 * needs both chained slabs, which the release must free again.
+	 */
+	for ( i = 0; i < ROUNDS; i++ ) {
+		mark = slap_sl_mark( ctx );
+		fill( ctx, SLAB_SIZE / 2, 'c' );
+		fill( ctx, SLAB_SIZE / 2, 'd' );
+		fill( ctx, SLAB_SIZE / 2, 'e' );
+		slap_sl_release( mark, ctx );
+	}
+	slap_sl_mem_stats( get_stats, &ss );
+	printf( "empty mark: %lu slabs chained, %lu fallbacks\n",
+		ss.ss_chained, ss.ss_fallback );
+	if ( ss.ss_fallback || ss.ss_chained != 2 * ROUNDS ) {
+		fprintf( stderr, "chained slabs were not released\n" );
+		rc = 1;
+	}
+
+	/* Mark with a chained slab in use: each round fills the rest of it
+	 * and one more slab. The release must reset its top, free the new
+	 * slab and keep what was allocated before the mark. A reset keeps
+	 * the statistics, count from here.
+	 */
+	ss0 = ss;
+	ctx = slap_sl_mem_create( SLAB_SIZE, SLAP_SLAB_STACK,
+		ldap_pvt_thread_pool_context(), 1 );
+	a = fill( ctx, SLAB_SIZE * 3 / 4, 'a' );
+	b = fill( ctx, SLAB_SIZE / 4, 'b' );
+	for ( i = 0; i < ROUNDS; i++ ) {
+		char *c;
+
+		mark = slap_sl_mark( ctx );
+		c = fill( ctx, SLAB_SIZE / 2, 'c' );
+		fill( ctx, SLAB_SIZE / 2, 'd' );
+		/* freed above the mark, must not survive the release */
+		slap_sl_free( c, ctx );
+		slap_sl_release( mark, ctx );
+	}
+	slap_sl_mem_stats( get_stats, &ss );
+	ss.ss_chained -= ss0.ss_chained;
+	ss.ss_fallback -= ss0.ss_fallback;
+	printf( "chained mark: %lu slabs chained, %lu fallbacks\n",
+		ss.ss_chained, ss.ss_fallback );
+	if ( ss.ss_fallback || ss.ss_chained != 1 + ROUNDS ) {
+		fprintf( stderr, "chained slabs were not released\n" );
+		rc = 1;
+	}
+	if ( check( a, SLAB_SIZE * 3 / 4, 'a' ) || check( b, SLAB_SIZE / 4, 'b' )) {
+		fprintf( stderr, "blocks allocated before the mark were overwritten\n" );
+		rc = 1;
+	}
+	slap_sl_free( b, ctx );
+	slap_sl_free( a, ctx );
+
+	slap_sl_mem_destroy( (void *)1, ctx );
+	return rc;
+}
@@ -89,10 +89,12 @@ CONF2DB=$DATADIR/slapd-2db.conf
 MCONF=$DATADIR/slapd-provider.conf
 COMPCONF=$DATADIR/slapd-component.conf
 PWCONF=$DATADIR/slapd-pw.conf
+PWCACHECONF=$DATADIR/slapd-pwcache.conf
 WHOAMICONF=$DATADIR/slapd-whoami.conf
 ACLCONF=$DATADIR/slapd-acl.conf
 RCONF=$DATADIR/slapd-referrals.conf
 SRPROVIDERCONF=$DATADIR/slapd-syncrepl-provider.conf
+SLPSRPROVIDERCONF=$DATADIR/slapd-syncrepl-provider-slogpersist.conf
 DSRPROVIDERCONF=$DATADIR/slapd-deltasync-provider.conf
 DSRCONSUMERCONF=$DATADIR/slapd-deltasync-consumer.conf
 PPOLICYCONF=$DATADIR/slapd-ppolicy.conf
@@ -105,6 +107,8 @@ R2SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-refresh2.conf
 P1SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-persist1.conf
 P2SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-persist2.conf
 P3SRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-persist3.conf
+ATSRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-applythreads.conf
+TBSRCONSUMERCONF=$DATADIR/slapd-syncrepl-consumer-txnbatch.conf
 DIRSYNC1CONF=$DATADIR/slapd-dirsync1.conf
 DSEESYNC1CONF=$DATADIR/slapd-dsee-consumer1.conf
 DSEESYNC2CONF=$DATADIR/slapd-dsee-consumer2.conf
@@ -148,6 +152,12 @@ PASSWDCONF=$DATADIR/slapd-passwd.conf
 UNDOCONF=$DATADIR/slapd-config-undo.conf
 NAKEDCONF=$DATADIR/slapd-config-naked.conf
 VALREGEXCONF=$DATADIR/slapd-valregex.conf
+ACLCACHECONF=$DATADIR/slapd-aclcache.conf
+GROUPCACHECONF=$DATADIR/slapd-groupcache.conf
+SPARSECONF=$DATADIR/slapd-sparse.conf
+OPPRIOCONF=$DATADIR/slapd-opprio.conf
+BINDLIMITCONF=$DATADIR/slapd-bindlimit.conf
+IDLEXACTCONF=$DATADIR/slapd-idlexact.conf
 
 DYNAMICCONF=$DATADIR/slapd-dynamic.ldif
 